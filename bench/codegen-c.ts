@@ -0,0 +1,117 @@
+// Native speed of the C backend with and without type inference.
+// Run with `npm run bench:c`; needs a C compiler (`cc`, or set $CC).
+// "boxed" generates every variable as a tagged DroyValue, which is what
+// the backend produced before it inferred types; "typed" is the default.
+import { execFileSync, spawnSync } from 'node:child_process';
+import { mkdtempSync, readFileSync, rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { DroyCodeGenerator, DroyParser, DroyLexer } from '../src/lib/droy/compiler';
+
+const RUNS = 5;
+const CC = process.env.CC ?? 'cc';
+
+function exampleBlock(heading: string): string {
+  const examples = readFileSync(new URL('../droy-docs/EXAMPLES.md', import.meta.url), 'utf8');
+  const section = examples.slice(examples.indexOf(`### ${heading}`));
+  return /```droy\n([\s\S]*?)```/.exec(section)![1];
+}
+
+function exampleFunction(heading: string, name: string): string {
+  const match = new RegExp(`^func ${name}\\([\\s\\S]*?^\\}`, 'm').exec(exampleBlock(heading));
+  return match![0];
+}
+
+// EXAMPLES.md programs, scaled up with loops so their run time is measurable
+const programs: Array<[string, string]> = [
+  ['Control Flow', exampleBlock('Control Flow')],
+  ['calculate() x 2M', `${exampleFunction('Functions', 'calculate')}
+var total = 0
+var i = 0
+while i < 2000000 {
+  total = total + calculate(i, 3, "+") + calculate(i, 2, "*") - calculate(i, 4, "/")
+  i = i + 1
+}
+print total`],
+  ['while loop x 20M', `var count = 0
+var sum = 0
+while count < 20000000 {
+  sum = sum + count % 7
+  count = count + 1
+}
+print "Sum: " + sum`],
+  ['fib(30)', `func fib(n) {
+  if n < 2 {
+    return n
+  }
+  return fib(n - 1) + fib(n - 2)
+}
+print fib(30)`],
+  // Quarters sum exactly in any order, so SIMD and scalar totals agree
+  ['sum/min/max x 2k', `var readings = [${Array.from({ length: 100000 }, (_, i) => ((i * 7919) % 4000) / 4 - 500).join(', ')}]
+var total = 0
+var i = 0
+while i < 2000 {
+  total = total + sum(readings) + max(readings) - min(readings)
+  i = i + 1
+}
+print total`],
+  // Each iteration's strings are released when it ends
+  ['labels x 1M', `func label(kind, n) {
+  return kind + "-" + n
+}
+var matches = 0
+var i = 0
+while i < 1000000 {
+  var name = label("item", i % 1000) + "/" + i
+  if name == "item-999/999999" {
+    matches = matches + 1
+  }
+  i = i + 1
+}
+print matches`],
+];
+
+function build(dir: string, name: string, source: string, inferTypes: boolean): string {
+  const ast = new DroyParser(new DroyLexer(source).tokenize()).parse();
+  const c = new DroyCodeGenerator({ inferTypes }).generate(ast);
+  const file = join(dir, `${name}.c`);
+  writeFileSync(file, c);
+  execFileSync(CC, ['-O2', '-std=c11', '-fwrapv', '-o', join(dir, name), file, '-lm']);
+  return join(dir, name);
+}
+
+function time(binary: string): { ms: number; output: string } {
+  let best = Infinity;
+  let output = '';
+  for (let run = 0; run < RUNS; run++) {
+    const start = performance.now();
+    const result = spawnSync(binary, { encoding: 'utf8' });
+    best = Math.min(best, performance.now() - start);
+    output = result.stdout;
+  }
+  return { ms: best, output };
+}
+
+if (spawnSync(CC, ['--version']).error) {
+  console.log(`${CC} not found; set $CC to a C compiler to run this benchmark`);
+  process.exit(0);
+}
+
+const dir = mkdtempSync(join(tmpdir(), 'droy-bench-'));
+try {
+  console.log(`${'program'.padEnd(20)} ${'boxed'.padStart(10)} ${'typed'.padStart(10)}  speedup`);
+  programs.forEach(([name, source], index) => {
+    const boxed = time(build(dir, `boxed${index}`, source, false));
+    const typed = time(build(dir, `typed${index}`, source, true));
+    if (boxed.output !== typed.output) {
+      throw new Error(`${name}: typed and boxed output differ`);
+    }
+    console.log(
+      `${name.padEnd(20)} ${boxed.ms.toFixed(1).padStart(7)} ms ${typed.ms.toFixed(1).padStart(7)} ms  ` +
+      `${(boxed.ms / typed.ms).toFixed(1).padStart(6)}x`,
+    );
+  });
+} finally {
+  rmSync(dir, { recursive: true, force: true });
+}
@@ -0,0 +1,45 @@
+// Lexer throughput benchmark for the three Droy front ends.
+// Run with `npm run bench:lexer`.
+import { readFileSync } from 'node:fs';
+import { DroyLexer } from '../src/lib/droy/compiler';
+import { DroyLexerV2 } from '../src/lib/droy/compiler-v2';
+import { DroyLexerV3 } from '../src/lib/droy/compiler-v3';
+
+const TARGET_LINES = 20000;
+const RUNS = 30;
+
+function loadCorpus(): string {
+  const examples = readFileSync(new URL('../droy-docs/EXAMPLES.md', import.meta.url), 'utf8');
+  const blocks = [...examples.matchAll(/```droy\n([\s\S]*?)```/g)].map((match) => match[1]);
+  const unit = blocks.join('\n');
+  const unitLines = unit.split('\n').length;
+  return unit.repeat(Math.ceil(TARGET_LINES / unitLines));
+}
+
+const lexers: Array<[string, (source: string) => { length: number }]> = [
+  ['DroyLexer (v1)', (source) => new DroyLexer(source).tokenize()],
+  ['DroyLexerV2', (source) => new DroyLexerV2(source).tokenize()],
+  ['DroyLexerV3', (source) => new DroyLexerV3(source).tokenize()],
+  ['DroyLexerV3 compact', (source) => new DroyLexerV3(source).tokenizeCompact()],
+];
+
+const source = loadCorpus();
+console.log(`corpus: ${source.split('\n').length} lines, ${(source.length / 1024).toFixed(0)} KiB\n`);
+
+for (const [name, tokenize] of lexers) {
+  tokenize(source); // warm up
+
+  let tokens = 0;
+  let best = Infinity;
+  for (let run = 0; run < RUNS; run++) {
+    const start = performance.now();
+    tokens = tokenize(source).length;
+    best = Math.min(best, performance.now() - start);
+  }
+
+  const tokensPerSecond = tokens / (best / 1000);
+  console.log(
+    `${name.padEnd(20)} ${best.toFixed(1).padStart(8)} ms  ` +
+    `${(tokensPerSecond / 1e6).toFixed(2).padStart(6)} M tokens/s  (${tokens} tokens)`,
+  );
+}
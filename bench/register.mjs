@@ -0,0 +1,5 @@
+// Lets Node's type stripping load the compiler sources, which use
+// extensionless relative imports the way Vite resolves them.
+import { register } from 'node:module';
+
+register('./resolve-ts.mjs', import.meta.url);
@@ -0,0 +1,14 @@
+// Resolve hook: maps extensionless relative imports to their .ts file.
+import { existsSync } from 'node:fs';
+import { fileURLToPath } from 'node:url';
+
+export async function resolve(specifier, context, nextResolve) {
+  const isRelative = specifier.startsWith('./') || specifier.startsWith('../');
+  if (isRelative && context.parentURL && !/\.[cm]?[jt]sx?$/.test(specifier)) {
+    const candidate = new URL(`${specifier}.ts`, context.parentURL);
+    if (existsSync(fileURLToPath(candidate))) {
+      return nextResolve(candidate.href, context);
+    }
+  }
+  return nextResolve(specifier, context);
+}
@@ -0,0 +1,415 @@
+// Benchmark suite and regression gate for the three Droy front ends.
+// Run with `npm run bench`. Every phase (lexing, parsing and each generator)
+// is measured on every corpus, in child processes of their own so JIT and heap
+// state don't carry over, and compared with bench/baseline.json: a phase
+// whose throughput drops, or whose peak heap grows, by more than the
+// threshold fails the run.
+//
+// Throughput is compared relative to a fixed reference workload that each
+// child times alongside the phase, so the gate measures the compiler rather
+// than the machine: a baseline recorded on a faster machine doesn't make
+// every phase look slower.
+//
+//   npm run bench                      measure and compare
+//   npm run bench -- --update          measure and record the baseline
+//   npm run bench -- --threshold=20    allowed regression in percent (15)
+//   npm run bench -- --filter=lex      only measurements whose name matches
+//
+// Heap sizes still depend on the Node version that recorded the baseline.
+import { spawnSync } from 'node:child_process';
+import { existsSync, readFileSync, writeFileSync } from 'node:fs';
+import { cpus } from 'node:os';
+import { fileURLToPath } from 'node:url';
+import { GCProfiler, getHeapStatistics } from 'node:v8';
+import { DroyCodeGenerator, DroyLLVMGenerator, DroyLexer, DroyParser } from '../src/lib/droy/compiler';
+import { DroyLexerV2, DroyParserV2, DroyUIGenerator } from '../src/lib/droy/compiler-v2';
+import { DroyLexerV3, DroyParserV3, DroyUIGeneratorV3 } from '../src/lib/droy/compiler-v3';
+
+const BASELINE = new URL('./baseline.json', import.meta.url);
+const DEFAULT_THRESHOLD = 15;
+// Heap changes below this are page-granularity noise
+const HEAP_SLACK = 1024 * 1024;
+// A measurement repeats until both are reached; throughput is the fastest run
+const MIN_RUNS = 5;
+const MIN_MS = 1000;
+// Processes per measurement; the JIT settles differently in each, and the
+// median one is kept
+const PROCESSES = 3;
+
+type Unit = 'tokens' | 'nodes' | 'bytes';
+
+interface Phase {
+  name: string;
+  unit: Unit;
+  // The LLVM backend only compiles statically typed logic, not UI
+  logicOnly?: boolean;
+  // Builds the input from a program, untimed; throws when the front end
+  // doesn't support the program
+  prepare(source: string): unknown;
+  run(input: unknown): unknown;
+  // How many units run() produced, counted outside the timed run
+  count(output: unknown): number;
+}
+
+interface Measurement {
+  units: number;
+  ms: number;
+  perSecond: number;
+  // Throughput over the reference workload's, the figure baselines compare
+  relative: number;
+  // Most heap in use during one run, above the level after a full GC
+  heap: number;
+}
+
+interface Baseline {
+  node: string;
+  cpu: string;
+  results: Record<string, Measurement>;
+}
+
+// AST nodes are the objects of the tree with a string `type`
+function countNodes(value: unknown): number {
+  if (Array.isArray(value)) return value.reduce((sum: number, item) => sum + countNodes(item), 0);
+  if (value === null || typeof value !== 'object') return 0;
+  let count = typeof (value as { type?: unknown }).type === 'string' ? 1 : 0;
+  for (const child of Object.values(value)) count += countNodes(child);
+  return count;
+}
+
+function countBytes(output: unknown): number {
+  const parts = typeof output === 'string' ? [output] : Object.values(output as Record<string, string>);
+  return parts.reduce((sum, part) => sum + Buffer.byteLength(part), 0);
+}
+
+function lexPhase(name: string, tokenize: (source: string) => unknown[]): Phase {
+  return {
+    name,
+    unit: 'tokens',
+    prepare: (source) => source,
+    run: (source) => tokenize(source as string),
+    count: (tokens) => (tokens as unknown[]).length,
+  };
+}
+
+function parsePhase<T>(name: string, tokenize: (source: string) => T, parse: (tokens: T) => unknown): Phase {
+  return {
+    name,
+    unit: 'nodes',
+    prepare: (source) => {
+      const tokens = tokenize(source);
+      parse(tokens);
+      return tokens;
+    },
+    run: (tokens) => parse(tokens as T),
+    count: countNodes,
+  };
+}
+
+function generatePhase<T>(name: string, parse: (source: string) => T, generate: (ast: T) => unknown, logicOnly = false): Phase {
+  return {
+    name,
+    unit: 'bytes',
+    logicOnly,
+    prepare: (source) => {
+      const ast = parse(source);
+      generate(ast);
+      return ast;
+    },
+    run: (ast) => generate(ast as T),
+    count: countBytes,
+  };
+}
+
+const v1Tokens = (source: string) => new DroyLexer(source).tokenize();
+const v2Tokens = (source: string) => new DroyLexerV2(source).tokenize();
+const v3Tokens = (source: string) => new DroyLexerV3(source).tokenize();
+
+const phases: Phase[] = [
+  lexPhase('lex v1', v1Tokens),
+  lexPhase('lex v2', v2Tokens),
+  lexPhase('lex v3', v3Tokens),
+  parsePhase('parse v1', v1Tokens, (tokens) => new DroyParser(tokens).parse()),
+  parsePhase('parse v2', v2Tokens, (tokens) => new DroyParserV2(tokens).parse()),
+  parsePhase('parse v3', v3Tokens, (tokens) => new DroyParserV3(tokens).parse()),
+  generatePhase('generate C', (source) => new DroyParser(v1Tokens(source)).parse(), (ast) => new DroyCodeGenerator().generate(ast)),
+  generatePhase('generate LLVM', (source) => new DroyParser(v1Tokens(source)).parse(), (ast) => new DroyLLVMGenerator().generate(ast), true),
+  generatePhase('generate UI v2', (source) => new DroyParserV2(v2Tokens(source)).parse(), (ast) => new DroyUIGenerator().generate(ast)),
+  generatePhase('generate UI v3', (source) => new DroyParserV3(v3Tokens(source)).parse(), (ast) => new DroyUIGeneratorV3().generate(ast)),
+];
+
+// A block of logic every front end compiles, and UI for those that render it
+function syntheticBlock(k: number, ui: boolean): string {
+  const logic = `# Block ${k}
+func score${k}(n, bias) {
+  var total = 0
+  var i = 0
+  while i < n {
+    if i % 3 == 0 {
+      total = total + i * bias
+    } else {
+      total = total - 1
+    }
+    i = i + 1
+  }
+  return total
+}
+var result${k} = score${k}(${k % 50}, 2)
+if result${k} > 10 {
+  print result${k}
+} else {
+  print result${k} + 1
+}
+`;
+  return ui ? `${logic}~card padding: ${k % 40}px {
+  ~title "Card ${k}"
+  ~text "Total for block ${k}"
+  ~btn "Open" color: #6366f1
+}
+` : logic;
+}
+
+function syntheticProgram(lines: number, ui: boolean): string {
+  const blocks: string[] = [];
+  for (let k = 0, total = 0; total < lines; k++) {
+    const block = syntheticBlock(k, ui);
+    blocks.push(block);
+    total += block.split('\n').length - 1;
+  }
+  return blocks.join('');
+}
+
+// The programs of a corpus by name; each example is named by its heading
+const corpora: Array<[string, (phase: Phase) => Array<[string, string]>]> = [
+  ['examples', () => {
+    const examples = readFileSync(new URL('../droy-docs/EXAMPLES.md', import.meta.url), 'utf8');
+    return [...examples.matchAll(/^### (.+)\n[\s\S]*?```droy\n([\s\S]*?)```/gm)].map((match): [string, string] => [match[1], match[2]]);
+  }],
+  ['1k lines', (phase) => [['1k lines', syntheticProgram(1000, !phase.logicOnly)]]],
+  ['10k lines', (phase) => [['10k lines', syntheticProgram(10000, !phase.logicOnly)]]],
+  ['100k lines', (phase) => [['100k lines', syntheticProgram(100000, !phase.logicOnly)]]],
+];
+
+// The examples each phase is known not to support. Any other program that
+// fails to prepare fails the run, and so does a listed one that prepares, so
+// the measured set only changes along with this list.
+const V1_UNSUPPORTED = [
+  'Functions', 'Navigation', 'Dashboard Layout', 'Authentication', 'Todo App', 'Chat Application',
+  'E-commerce Product Page',
+];
+const V2_UNSUPPORTED = [
+  'Variables and Types', 'Functions', 'State Management', 'REST API', 'Authentication', 'WebSocket', 'Todo App',
+  'Chat Application', 'E-commerce Product Page', 'Fade In',
+];
+const V3_UNSUPPORTED = ['Functions', 'Authentication', 'Chat Application', 'E-commerce Product Page'];
+const unsupported: Record<string, string[]> = {
+  'parse v1': V1_UNSUPPORTED,
+  'parse v2': V2_UNSUPPORTED,
+  'parse v3': V3_UNSUPPORTED,
+  'generate C': V1_UNSUPPORTED,
+  // Everything but plain logic
+  'generate LLVM': [
+    'Hello World', 'Variables and Types', 'Functions', 'Button Variants', 'Card Component', 'Form Layout',
+    'Navigation', 'Dashboard Layout', 'Image Gallery', 'Color Palette', 'User Data', 'Product Data',
+    'State Management', 'REST API', 'Authentication', 'WebSocket', 'Todo App', 'Chat Application',
+    'E-commerce Product Page', 'Fade In', 'Slide In', 'Hover Effects', 'Solid Colors', 'Gradients',
+    'Color Blending',
+  ],
+  'generate UI v2': V2_UNSUPPORTED,
+  'generate UI v3': V3_UNSUPPORTED,
+};
+
+// The reference workload stands in for the machine: it scans a fixed text
+// into word and symbol records and counts the words, the kind of work a
+// lexer does, with code that never changes. Editing it, or its text,
+// invalidates every baseline.
+const REFERENCE_TEXT = 'var total = score(i, 2) * bias + 1 # sum\n~btn "Open" color: #6366f1 {\n}\n'.repeat(500);
+
+// Runs before the first timed one, and timed runs per round
+const REFERENCE_WARMUP = 50;
+const REFERENCE_RUNS = 5;
+
+function isWordCode(code: number): boolean {
+  return (code >= 48 && code <= 57) || (code >= 65 && code <= 90) || (code >= 97 && code <= 122) || code === 95;
+}
+
+function referenceRun(): number {
+  const text = REFERENCE_TEXT;
+  const words = new Map<string, number>();
+  const records: Array<{ code: number; value: string }> = [];
+  for (let start = 0; start < text.length;) {
+    let end = start + 1;
+    if (isWordCode(text.charCodeAt(start))) {
+      while (end < text.length && isWordCode(text.charCodeAt(end))) end++;
+    }
+    const value = text.slice(start, end);
+    words.set(value, (words.get(value) ?? 0) + 1);
+    records.push({ code: text.charCodeAt(start), value });
+    start = end;
+  }
+  return records.length + words.size;
+}
+
+// Time of `reps` runs, in ms
+function timed(run: () => unknown, reps: number): number {
+  const start = performance.now();
+  for (let rep = 0; rep < reps; rep++) run();
+  return performance.now() - start;
+}
+
+function measure(phase: Phase, programs: Array<[string, string]>): Measurement {
+  const expected = unsupported[phase.name] ?? [];
+  const inputs: unknown[] = [];
+  for (const [name, program] of programs) {
+    let input: unknown;
+    try {
+      input = phase.prepare(program);
+    } catch (err) {
+      if (expected.includes(name)) continue;
+      throw new Error(`${phase.name} cannot prepare ${name}: ${err instanceof Error ? err.message : String(err)}`);
+    }
+    if (expected.includes(name)) {
+      throw new Error(`${phase.name} now supports ${name}; remove it from the unsupported list`);
+    }
+    inputs.push(input);
+  }
+  const runAll = () => inputs.map((input) => phase.run(input));
+
+  // Started with --expose-gc by the parent
+  const gc = (globalThis as { gc?: () => void }).gc!;
+  gc();
+  const before = getHeapStatistics().used_heap_size;
+  // The heap is at a high point whenever a GC starts, and at the end
+  const profiler = new GCProfiler();
+  profiler.start();
+  const outputs = runAll();
+  const peaks = profiler.stop().statistics.map((entry) => entry.beforeGC.heapStatistics.usedHeapSize);
+  const heap = Math.max(0, ...peaks, getHeapStatistics().used_heap_size) - before;
+  const units = outputs.reduce((sum: number, output) => sum + phase.count(output), 0);
+
+  // Each round times the reference workload a few times, as the phase's
+  // garbage can land in any one of them, and then the phase, repeated to
+  // about as long as one reference run, so both see the same machine; each
+  // keeps its fastest run. A forced GC between them would leave some phases
+  // running in a shrunken young generation.
+  for (let run = 0; run < REFERENCE_WARMUP; run++) referenceRun();
+  const referenceUnits = referenceRun();
+  const reps = Math.max(1, Math.round(timed(referenceRun, 1) / Math.max(timed(runAll, 1), 0.001)));
+  let best = Infinity;
+  let bestReference = Infinity;
+  let total = 0;
+  for (let round = 0; round < MIN_RUNS || total < MIN_MS; round++) {
+    for (let run = 0; run < REFERENCE_RUNS; run++) {
+      const reference = timed(referenceRun, 1);
+      bestReference = Math.min(bestReference, reference);
+      total += reference;
+    }
+    const ms = timed(runAll, reps);
+    best = Math.min(best, ms / reps);
+    total += ms;
+  }
+  const perSecond = units / (best / 1000);
+  return { units, ms: best, perSecond, relative: perSecond / (referenceUnits / (bestReference / 1000)), heap };
+}
+
+function format(value: number, unit: string): string {
+  const [scale, prefix] = value >= 1e6 ? [1e6, 'M'] : value >= 1e3 ? [1e3, 'K'] : [1, ''];
+  return `${(value / scale).toFixed(2)} ${prefix}${prefix ? ' ' : ''}${unit}`;
+}
+
+function change(current: number, baseline: number): number {
+  return baseline ? ((current - baseline) / baseline) * 100 : 0;
+}
+
+// The median of PROCESSES children measuring one phase on one corpus
+function measureCell(phase: Phase, corpus: string): Measurement {
+  const runs: Measurement[] = [];
+  for (let run = 0; run < PROCESSES; run++) {
+    const child = spawnSync(
+      process.execPath,
+      [...process.execArgv, '--expose-gc', fileURLToPath(import.meta.url), `--cell=${phase.name}|${corpus}`],
+      { encoding: 'utf8', maxBuffer: 1 << 20 },
+    );
+    if (child.status !== 0) {
+      throw new Error(`${phase.name} | ${corpus} failed:\n${child.stderr}`);
+    }
+    runs.push(JSON.parse(child.stdout));
+  }
+  return runs.sort((x, y) => x.relative - y.relative)[PROCESSES >> 1];
+}
+
+function main(): void {
+  const args = process.argv.slice(2);
+  const option = (name: string) => args.find((arg) => arg.startsWith(`--${name}=`))?.slice(name.length + 3);
+
+  // A child measures one phase on one corpus and prints the result
+  const cell = option('cell');
+  if (cell) {
+    const [phaseName, corpusName] = cell.split('|');
+    const phase = phases.find((entry) => entry.name === phaseName)!;
+    const programs = corpora.find(([name]) => name === corpusName)![1](phase);
+    process.stdout.write(JSON.stringify(measure(phase, programs)));
+    return;
+  }
+
+  const update = args.includes('--update');
+  const threshold = Number(option('threshold') ?? DEFAULT_THRESHOLD);
+  const filter = option('filter');
+  const baseline: Baseline | null = existsSync(BASELINE) ? JSON.parse(readFileSync(BASELINE, 'utf8')) : null;
+  const cpu = cpus()[0]?.model ?? 'unknown';
+  if (baseline && !update && baseline.node !== process.version) {
+    console.log(`baseline was recorded with Node ${baseline.node}; heap sizes may not compare\n`);
+  }
+
+  const results: Record<string, Measurement> = { ...(update ? baseline?.results : {}) };
+  const regressions: string[] = [];
+  console.log(
+    `${'phase'.padEnd(16)} ${'corpus'.padEnd(11)} ${'throughput'.padStart(16)} ${'peak heap'.padStart(10)}  vs baseline`,
+  );
+  for (const phase of phases) {
+    for (const [corpus] of corpora) {
+      const key = `${phase.name} | ${corpus}`;
+      if (filter && !key.includes(filter)) continue;
+
+      let result = measureCell(phase, corpus);
+      // Baselines from before the reference workload don't compare
+      const previous = baseline?.results[key];
+      // A slow result is measured again before it counts; a busy machine
+      // seldom stays busy for both
+      if (!update && previous?.relative && change(result.relative, previous.relative) < -threshold) {
+        const again = measureCell(phase, corpus);
+        if (again.relative > result.relative) result = again;
+      }
+      results[key] = result;
+
+      let comparison = 'no baseline';
+      if (previous?.relative) {
+        const speed = change(result.relative, previous.relative);
+        const heap = change(result.heap, previous.heap);
+        comparison = `${speed >= 0 ? '+' : ''}${speed.toFixed(1)}% speed, ${heap >= 0 ? '+' : ''}${heap.toFixed(1)}% heap`;
+        if (!update && speed < -threshold) {
+          regressions.push(`${key}: ${(-speed).toFixed(1)}% slower`);
+        }
+        if (!update && heap > threshold && result.heap - previous.heap > HEAP_SLACK) {
+          regressions.push(`${key}: ${heap.toFixed(1)}% more heap`);
+        }
+      }
+      console.log(
+        `${phase.name.padEnd(16)} ${corpus.padEnd(11)} ${format(result.perSecond, `${phase.unit}/s`).padStart(16)} ` +
+        `${`${(result.heap / (1024 * 1024)).toFixed(1)} MB`.padStart(10)}  ${comparison}`,
+      );
+    }
+  }
+
+  if (update) {
+    writeFileSync(BASELINE, `${JSON.stringify({ node: process.version, cpu, results }, null, 2)}\n`);
+    console.log(`\nbaseline written to ${fileURLToPath(BASELINE)}`);
+    return;
+  }
+  if (regressions.length > 0) {
+    console.log(`\n${regressions.length} regression(s) beyond ${threshold}%:\n${regressions.map((line) => `  ${line}`).join('\n')}`);
+    process.exit(1);
+  }
+  console.log(`\nno regressions beyond ${threshold}%`);
+}
+
+main();
@@ -0,0 +1,56 @@
+// Run time of Droy programs on the bytecode VM.
+// Run with `npm run bench:vm`.
+import { DroyBytecodeCompiler, DroyVM } from '../src/lib/droy/vm';
+import { DroyLexerV3, DroyParserV3 } from '../src/lib/droy/compiler-v3';
+
+const RUNS = 5;
+
+const programs: Array<[string, string]> = [
+  ['while loop x 1M', `var count = 0
+var sum = 0
+while count < 1000000 {
+  sum = sum + count % 7
+  count = count + 1
+}
+print "Sum: " + sum`],
+  ['fib(25)', `func fib(n) {
+  if n < 2 {
+    return n
+  }
+  return fib(n - 1) + fib(n - 2)
+}
+print fib(25)`],
+  ['closures x 200K', `func counter() {
+  var n = 0
+  func next() {
+    n = n + 1
+    return n
+  }
+  return next
+}
+var tick = counter()
+var total = 0
+while total < 200000 {
+  total = tick()
+}
+print total`],
+];
+
+console.log(`${'program'.padEnd(20)} ${'compile'.padStart(10)} ${'run'.padStart(10)}  output`);
+for (const [name, source] of programs) {
+  const ast = new DroyParserV3(new DroyLexerV3(source).tokenize()).parse();
+  let compileMs = Infinity;
+  let runMs = Infinity;
+  let output = '';
+  for (let run = 0; run < RUNS; run++) {
+    let start = performance.now();
+    const proto = new DroyBytecodeCompiler().compile(ast);
+    compileMs = Math.min(compileMs, performance.now() - start);
+    start = performance.now();
+    output = new DroyVM().run(proto).output;
+    runMs = Math.min(runMs, performance.now() - start);
+  }
+  console.log(
+    `${name.padEnd(20)} ${compileMs.toFixed(2).padStart(7)} ms ${runMs.toFixed(1).padStart(7)} ms  ${output.trim()}`,
+  );
+}
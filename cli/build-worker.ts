@@ -0,0 +1,11 @@
+// Droy CLI - build worker thread
+// Compiles the jobs build.ts sends it one at a time and answers each with
+// its outcome, so a thread that finishes early simply gets the next file.
+import { parentPort, workerData } from 'node:worker_threads';
+import { compileFile, type CompileContext, type CompileJob } from './compile-file';
+
+const context: CompileContext = workerData;
+
+parentPort!.on('message', (job: CompileJob) => {
+  parentPort!.postMessage(compileFile(job, context));
+});
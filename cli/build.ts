@@ -0,0 +1,239 @@
+// Droy CLI - `droy build`
+// Compiles every .droy file under a directory to an HTML page. The manifest
+// in the cache directory records, for each file of the last build, the hash
+// of its source and the files it imports. A file is rebuilt when its source
+// changed, its page is missing, or a file it imports (at any depth) was
+// rebuilt; everything else is left as it is. Rebuilds are spread over
+// worker threads.
+import { createHash } from 'node:crypto';
+import { existsSync, mkdirSync, readFileSync, readdirSync, rmSync, writeFileSync } from 'node:fs';
+import { availableParallelism } from 'node:os';
+import { join, relative, resolve, sep } from 'node:path';
+import { Worker } from 'node:worker_threads';
+import { resolveImport } from '../src/lib/droy/modules';
+import { chunksDir, compileFile, sourceHash, type CompileContext, type CompileJob, type CompileOutcome } from './compile-file';
+
+export interface BuildOptions {
+  root: string;
+  outDir: string;
+  // Null builds everything and keeps no cache
+  cacheDir: string | null;
+  workers: number;
+  // Rebuild every file even if it is up to date
+  force: boolean;
+  // URL template of resized images for img srcsets; see media.ts
+  imageCdn: string | null;
+}
+
+export interface BuildResult {
+  files: number;
+  outcomes: CompileOutcome[];
+  upToDate: number;
+  removed: number;
+  ms: number;
+}
+
+interface ManifestFile {
+  hash: string;
+  // Files this one imports, relative to the build root
+  imports: string[];
+}
+
+interface Manifest {
+  version: string;
+  // The image CDN the pages were written with; changing it rebuilds them all
+  imageCdn?: string | null;
+  files: Record<string, ManifestFile>;
+}
+
+// The compiler, and the CLI that writes the pages
+const COMPILER_DIRS = [new URL('../src/lib/droy/', import.meta.url), new URL('./', import.meta.url)];
+
+export const defaultWorkers = (): number => Math.max(1, availableParallelism() - 1);
+
+// Any change to the compiler or CLI sources changes this, which invalidates
+// every cached tokens/AST entry and the manifest
+function compilerVersion(): string {
+  const hash = createHash('sha256');
+  for (const [i, dir] of COMPILER_DIRS.entries()) {
+    for (const name of readdirSync(dir).filter((name) => name.endsWith('.ts')).sort()) {
+      hash.update(`${i}/${name}`).update('\0').update(readFileSync(new URL(name, dir))).update('\0');
+    }
+  }
+  return hash.digest('hex');
+}
+
+// .droy files under `root` with paths relative to it; hidden directories,
+// node_modules and the build's own directories are skipped
+function findSources(root: string, skip: string[]): string[] {
+  const files: string[] = [];
+  const walk = (dir: string): void => {
+    for (const entry of readdirSync(dir, { withFileTypes: true })) {
+      const path = join(dir, entry.name);
+      if (entry.isDirectory()) {
+        if (!entry.name.startsWith('.') && entry.name !== 'node_modules' && !skip.includes(path)) walk(path);
+      } else if (entry.isFile() && entry.name.endsWith('.droy')) {
+        files.push(relative(root, path).split(sep).join('/'));
+      }
+    }
+  };
+  walk(root);
+  return files.sort();
+}
+
+function readManifest(cacheDir: string | null, version: string): Manifest {
+  if (cacheDir) {
+    try {
+      const manifest = JSON.parse(readFileSync(join(cacheDir, 'manifest.json'), 'utf8')) as Manifest;
+      if (manifest.version === version) return manifest;
+    } catch {
+      // No usable manifest: everything is rebuilt
+    }
+  }
+  return { version, files: {} };
+}
+
+function runJobs(jobs: CompileJob[], workers: number, context: CompileContext): Promise<CompileOutcome[]> {
+  // Starting a thread costs more than compiling a few files
+  if (workers <= 1 || jobs.length <= 1) {
+    return Promise.resolve(jobs.map((job) => compileFile(job, context)));
+  }
+
+  return new Promise((resolvePromise, reject) => {
+    const outcomes: CompileOutcome[] = [];
+    const threads = Array.from(
+      { length: Math.min(workers, jobs.length) },
+      () => new Worker(new URL('./build-worker.ts', import.meta.url), { workerData: context }),
+    );
+    let next = 0;
+    const fail = (error: Error): void => {
+      for (const thread of threads) thread.terminate();
+      reject(error);
+    };
+    for (const thread of threads) {
+      thread.on('message', (outcome: CompileOutcome) => {
+        outcomes.push(outcome);
+        if (next < jobs.length) {
+          thread.postMessage(jobs[next++]);
+        } else {
+          thread.terminate();
+        }
+        if (outcomes.length === jobs.length) resolvePromise(outcomes);
+      });
+      thread.on('error', fail);
+      thread.postMessage(jobs[next++]);
+    }
+  });
+}
+
+export async function build(options: BuildOptions): Promise<BuildResult> {
+  const start = performance.now();
+  const root = resolve(options.root);
+  const outDir = resolve(options.outDir);
+  const cacheDir = options.cacheDir && resolve(options.cacheDir);
+  const version = compilerVersion();
+  const previous = readManifest(cacheDir, version);
+
+  const files = findSources(root, [outDir, ...(cacheDir ? [cacheDir] : [])]);
+  const output = (file: string): string => join(outDir, file.replace(/\.droy$/, '.html'));
+  const sources = new Map<string, { source: string; hash: string }>();
+  for (const file of files) {
+    const source = readFileSync(join(root, file), 'utf8');
+    sources.set(file, { source, hash: sourceHash(version, source) });
+  }
+
+  // A file is dirty when it changed itself, or imports (at any depth) a file
+  // that is dirty or not a source under the root (deleted, or outside it), so
+  // that the build reports the missing import. A file whose own source is unchanged
+  // still has its last build's imports. Files that import each other are
+  // dirty together, so dirtiness is decided per strongly connected component
+  // of the import graph (Tarjan's algorithm).
+  const rebuildAll = options.force || (previous.imageCdn ?? null) !== options.imageCdn;
+  const changed = (file: string): boolean => {
+    const last = previous.files[file];
+    const current = sources.get(file)!;
+    return (
+      rebuildAll ||
+      !last ||
+      last.hash !== current.hash ||
+      !existsSync(output(file)) ||
+      last.imports.some((path) => !sources.has(path))
+    );
+  };
+  const dirty = new Map<string, boolean>();
+  // Whether a file changed or imports a dirty file outside its component
+  const own = new Map<string, boolean>();
+  const index = new Map<string, number>();
+  const lowLink = new Map<string, number>();
+  const stack: string[] = [];
+  const onStack = new Set<string>();
+  const visit = (file: string): void => {
+    index.set(file, index.size);
+    lowLink.set(file, index.get(file)!);
+    stack.push(file);
+    onStack.add(file);
+    let result = changed(file);
+    for (const path of previous.files[file]?.imports ?? []) {
+      if (!sources.has(path)) continue;
+      if (!index.has(path)) {
+        visit(path);
+        lowLink.set(file, Math.min(lowLink.get(file)!, lowLink.get(path)!));
+      } else if (onStack.has(path)) {
+        lowLink.set(file, Math.min(lowLink.get(file)!, index.get(path)!));
+      }
+      if (!onStack.has(path)) result ||= dirty.get(path)!;
+    }
+    own.set(file, result);
+    if (lowLink.get(file) !== index.get(file)) return;
+    const component = stack.splice(stack.lastIndexOf(file));
+    const componentDirty = component.some((member) => own.get(member));
+    for (const member of component) {
+      onStack.delete(member);
+      dirty.set(member, componentDirty);
+    }
+  };
+  for (const file of files) {
+    if (!index.has(file)) visit(file);
+  }
+
+  const jobs: CompileJob[] = files.filter((file) => dirty.get(file)).map((file) => ({
+    file,
+    source: sources.get(file)!.source,
+    hash: sources.get(file)!.hash,
+    previous: previous.files[file]?.hash ?? null,
+    output: output(file),
+  }));
+  const outcomes = await runJobs(jobs, options.workers, { root, cacheDir, version, imageCdn: options.imageCdn });
+
+  const manifest: Manifest = { version, imageCdn: options.imageCdn, files: {} };
+  for (const file of files) {
+    if (!dirty.get(file) && previous.files[file]) manifest.files[file] = previous.files[file];
+  }
+  for (const outcome of outcomes) {
+    // Failed files are left out, so the next build tries them again
+    if (!outcome.error) {
+      manifest.files[outcome.file] = {
+        hash: outcome.hash,
+        imports: outcome.imports.map((path) => resolveImport(outcome.file, path)),
+      };
+    }
+  }
+
+  // Pages of sources that no longer exist
+  let removed = 0;
+  for (const file of Object.keys(previous.files)) {
+    if (!sources.has(file) && existsSync(output(file))) {
+      rmSync(output(file));
+      rmSync(chunksDir(output(file)), { recursive: true, force: true });
+      removed++;
+    }
+  }
+
+  if (cacheDir) {
+    mkdirSync(cacheDir, { recursive: true });
+    writeFileSync(join(cacheDir, 'manifest.json'), JSON.stringify(manifest));
+  }
+
+  outcomes.sort((a, b) => (a.file < b.file ? -1 : a.file > b.file ? 1 : 0));
+  return { files: files.length, outcomes, upToDate: files.length - jobs.length, removed, ms: performance.now() - start };
+}
@@ -0,0 +1,221 @@
+// Droy CLI - compiles one .droy file to an HTML page through the build cache.
+// The cache keeps the compact tokens, statement spans and AST of every
+// source it has seen, v8-serialized under a hash of the compiler version and
+// the source text. A source seen before is neither lexed nor parsed again;
+// an edited one is reparsed against its previous version, so only the
+// statements that changed are parsed. Imported modules are linked in
+// through a module graph kept for every file the thread compiles, so each
+// one is parsed once per thread at most, and through the cache not at all.
+// A program with `route`s is split: see writeRoutes().
+import { createHash } from 'node:crypto';
+import { mkdirSync, readFileSync, renameSync, rmSync, writeFileSync } from 'node:fs';
+import { dirname, join, relative, sep } from 'node:path';
+import { deserialize, serialize } from 'node:v8';
+import { threadId } from 'node:worker_threads';
+import {
+  DroyLexerV3,
+  DroyParserV3,
+  DroyUIGeneratorV3,
+  type ASTNode,
+  type StatementSpan,
+  type TokenType,
+  type UISplitOutput,
+} from '../src/lib/droy/compiler-v3';
+import { DroyModuleGraph } from '../src/lib/droy/modules';
+import { DroyOptimizer } from '../src/lib/droy/optimizer';
+import { defaultRoute, routeChunk, routeDirectory, routePage, splitManifest } from '../src/lib/droy/router';
+import { TokenBuffer, type TokenBufferData } from '../src/lib/droy/token-buffer';
+
+export interface CompileContext {
+  root: string;
+  cacheDir: string | null;
+  // Hash of the compiler sources
+  version: string;
+  imageCdn: string | null;
+}
+
+export interface CompileJob {
+  // Path relative to the build root, with `/` separators
+  file: string;
+  source: string;
+  hash: string;
+  // Hash of the source this file had in the last build, if it was cached
+  previous: string | null;
+  output: string;
+}
+
+export interface CompileOutcome {
+  file: string;
+  hash: string;
+  // `import` paths as written in the source
+  imports: string[];
+  parse: 'cached' | 'reparsed' | 'parsed';
+  error: string | null;
+}
+
+interface CacheEntry {
+  source: string;
+  tokens: TokenBufferData<TokenType>;
+  spans: StatementSpan[];
+  ast: ASTNode;
+  imports: string[];
+}
+
+export function sourceHash(version: string, source: string): string {
+  return createHash('sha256').update(version).update('\0').update(source).digest('hex');
+}
+
+// Kept for every file a thread compiles, and remade for a build with
+// another root or image CDN
+const optimizer = new DroyOptimizer();
+let generator: DroyUIGeneratorV3 | null = null;
+let modules: DroyModuleGraph | null = null;
+let built: CompileContext | null = null;
+
+export function compileFile(job: CompileJob, context: CompileContext): CompileOutcome {
+  const { cacheDir } = context;
+  let entry: CacheEntry | null = null;
+  let parse: CompileOutcome['parse'] = 'parsed';
+  try {
+    entry = cacheDir ? readEntry(cacheDir, job.hash) : null;
+    if (entry) {
+      parse = 'cached';
+    } else {
+      const previous = cacheDir && job.previous ? readEntry(cacheDir, job.previous) : null;
+      if (previous) parse = 'reparsed';
+      entry = parseSource(job.source, previous);
+      if (cacheDir) writeEntry(cacheDir, job.hash, entry);
+    }
+
+    if (built?.root !== context.root || built.imageCdn !== context.imageCdn) {
+      generator = modules = null;
+      built = context;
+    }
+    generator ??= new DroyUIGeneratorV3({ media: context.imageCdn ? { imageCdn: context.imageCdn } : {} });
+    modules ??= new DroyModuleGraph(
+      { read: (path) => readFileSync(join(context.root, path), 'utf8') },
+      (source) => cachedParse(source, context),
+    );
+    const ast = optimizer.optimize(modules.link(job.file, entry.ast));
+    mkdirSync(dirname(job.output), { recursive: true });
+    if (ast.body.some((stmt: ASTNode) => stmt.type === 'Route')) {
+      writeRoutes(job, generator.split(ast));
+    } else {
+      const { html, css, js } = generator.generate(ast);
+      writeFileSync(job.output, page(job.file, html, css, js));
+    }
+    return { file: job.file, hash: job.hash, imports: entry.imports, parse, error: null };
+  } catch (err) {
+    const error = err instanceof Error ? err.message : String(err);
+    return { file: job.file, hash: job.hash, imports: entry?.imports ?? [], parse, error };
+  }
+}
+
+function parseSource(source: string, previous: CacheEntry | null): CacheEntry {
+  const tokens = new DroyLexerV3(source).tokenizeCompact();
+  const parser = new DroyParserV3(tokens);
+  let ast: ASTNode;
+  if (previous) {
+    parser.restore(TokenBuffer.fromData(previous.source, previous.tokens), previous.spans, previous.ast);
+    ast = parser.reparse(tokens);
+  } else {
+    ast = parser.parse();
+  }
+  const imports = ast.body
+    .filter((stmt: ASTNode) => stmt.type === 'ImportStatement')
+    .map((stmt: ASTNode) => stmt.path as string);
+  return { source, tokens: tokens.toData(), spans: [...parser.getStatementSpans()], ast, imports };
+}
+
+function cachedParse(source: string, context: CompileContext): ASTNode {
+  if (!context.cacheDir) return parseSource(source, null).ast;
+  const hash = sourceHash(context.version, source);
+  let entry = readEntry(context.cacheDir, hash);
+  if (!entry) {
+    entry = parseSource(source, null);
+    writeEntry(context.cacheDir, hash, entry);
+  }
+  return entry.ast;
+}
+
+function entryPath(cacheDir: string, hash: string): string {
+  return join(cacheDir, 'ast', hash.slice(0, 2), hash);
+}
+
+// A missing or unreadable entry is a miss
+function readEntry(cacheDir: string, hash: string): CacheEntry | null {
+  try {
+    return deserialize(readFileSync(entryPath(cacheDir, hash))) as CacheEntry;
+  } catch {
+    return null;
+  }
+}
+
+// Written beside its final name and renamed, so a thread never reads a
+// half-written entry
+function writeEntry(cacheDir: string, hash: string, entry: CacheEntry): void {
+  const path = entryPath(cacheDir, hash);
+  const temp = `${path}.${process.pid}.${threadId}.tmp`;
+  mkdirSync(dirname(path), { recursive: true });
+  writeFileSync(temp, serialize(entry));
+  renameSync(temp, path);
+}
+
+// Chunks of the page at `output`
+export function chunksDir(output: string): string {
+  return output.replace(/\.html$/, '.chunks');
+}
+
+// The page at `output` shows the route at "/" (or the first route), and in
+// history mode every other route gets a page at `<output>/<path>/index.html`.
+// The route chunks, the shell's deferred stylesheet and a manifest of them
+// are written to chunksDir(output), replacing the previous build's.
+function writeRoutes(job: CompileJob, split: UISplitOutput): void {
+  // Every page's file, first, so a route that can't have one writes nothing
+  const entry = defaultRoute(split)!;
+  const pages = (split.router.mode === 'history' ? split.routes : [entry]).map((route) => ({
+    route,
+    file: route === entry ? job.output : join(job.output.replace(/\.html$/, ''), routeDirectory(route.path), 'index.html'),
+  }));
+
+  const chunks = chunksDir(job.output);
+  rmSync(chunks, { recursive: true, force: true });
+  mkdirSync(chunks, { recursive: true });
+  const manifest = splitManifest(split);
+  if (manifest.shell.css) writeFileSync(join(chunks, manifest.shell.css), split.shell.css);
+  split.routes.forEach((route, index) => {
+    const files = manifest.routes[index];
+    writeFileSync(join(chunks, files.js), routeChunk(route));
+    if (files.css) writeFileSync(join(chunks, files.css), route.css);
+  });
+  writeFileSync(join(chunks, 'manifest.json'), JSON.stringify(manifest, null, 2));
+
+  for (const { route, file } of pages) {
+    const url = relative(dirname(file), chunks).split(sep).join('/');
+    const { html, css, js } = routePage(split, route, `${url}/`);
+    mkdirSync(dirname(file), { recursive: true });
+    writeFileSync(file, page(job.file, html, css, js));
+  }
+}
+
+function page(file: string, html: string, css: string, js: string): string {
+  const title = file.replace(/^.*\//, '').replace(/\.droy$/, '');
+  return `<!DOCTYPE html>
+<html lang="en">
+<head>
+<meta charset="utf-8">
+<meta name="viewport" content="width=device-width, initial-scale=1">
+<title>${title.replace(/[&<>]/g, (ch) => `&#${ch.charCodeAt(0)};`)}</title>
+<style>
+${css.replace(/<\/style/gi, '<\\/style')}
+</style>
+</head>
+<body>
+${html}
+<script>
+${js.replace(/<\/script/gi, '<\\/script')}
+</script>
+</body>
+</html>
+`;
+}
@@ -0,0 +1,78 @@
+// Droy command line.
+// Run with `npm run droy -- build <dir>`.
+import * as nodeModule from 'node:module';
+import { join } from 'node:path';
+import { parseArgs } from 'node:util';
+
+// Keeps V8's compiled code for the compiler modules between runs, so a short
+// build isn't mostly spent compiling the compiler. The modules are imported
+// once it is on.
+nodeModule.enableCompileCache?.();
+const { build, defaultWorkers } = await import('./build');
+
+const USAGE = `Usage: droy build [dir] [options]
+
+Compiles every .droy file under dir (default: .) to an HTML page, rebuilding
+only the files that changed since the last build or import one that did.
+
+Options:
+  --out <dir>      where pages are written (default: <dir>/droy-dist)
+  --cache <dir>    build cache directory (default: <dir>/.droy-cache)
+  --no-cache       rebuild everything and keep no cache
+  --workers <n>    threads to compile on (default: ${defaultWorkers()})
+  --force          rebuild every file
+  --image-cdn <url>
+                   serve images through a CDN with srcsets of resized copies;
+                   the URL has {src}, {width} and optionally {format}
+  -h, --help       show this help`;
+
+async function main(argv: string[]): Promise<number> {
+  const { values, positionals } = parseArgs({
+    args: argv,
+    allowPositionals: true,
+    options: {
+      out: { type: 'string' },
+      cache: { type: 'string' },
+      'no-cache': { type: 'boolean', default: false },
+      workers: { type: 'string' },
+      force: { type: 'boolean', default: false },
+      'image-cdn': { type: 'string' },
+      help: { type: 'boolean', short: 'h', default: false },
+    },
+  });
+
+  const [command, dir = '.', ...rest] = positionals;
+  if (values.help || command !== 'build' || rest.length > 0) {
+    console.log(USAGE);
+    return values.help ? 0 : 1;
+  }
+  const workers = values.workers === undefined ? defaultWorkers() : Number(values.workers);
+  if (!Number.isInteger(workers) || workers < 1) {
+    console.error(`--workers must be a positive integer, got ${values.workers}`);
+    return 1;
+  }
+
+  const result = await build({
+    root: dir,
+    outDir: values.out ?? join(dir, 'droy-dist'),
+    cacheDir: values['no-cache'] ? null : (values.cache ?? join(dir, '.droy-cache')),
+    workers,
+    force: values.force,
+    imageCdn: values['image-cdn'] ?? null,
+  });
+
+  const failed = result.outcomes.filter((outcome) => outcome.error);
+  for (const outcome of failed) {
+    console.error(`${outcome.file}: ${outcome.error}`);
+  }
+  const count = (parse: string): number => result.outcomes.filter((outcome) => outcome.parse === parse).length;
+  console.log(
+    `Built ${result.outcomes.length - failed.length} of ${result.files} files in ${(result.ms / 1000).toFixed(2)}s ` +
+    `(${count('parsed')} parsed, ${count('reparsed')} reparsed, ${count('cached')} from cache; ` +
+    `${result.upToDate} up to date${result.removed ? `, ${result.removed} removed` : ''})` +
+    (failed.length ? `, ${failed.length} failed` : ''),
+  );
+  return failed.length ? 1 : 0;
+}
+
+process.exitCode = await main(process.argv.slice(2));
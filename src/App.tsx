@@ -24,8 +24,12 @@ import {
 } from 'lucide-react';
 import { Button } from '@/components/ui/button';
 import { Tabs, TabsContent, TabsList, TabsTrigger } from '@/components/ui/tabs';
-import { DroyCompilerV3 } from '@/lib/droy/compiler-v3';
+import { useCompileService } from '@/hooks/use-compile-service';
+import type { CompileResult } from '@/lib/droy/compile-service';
+import type { CompileStats } from '@/lib/droy/trace';
 import { CodeEditorV3 } from '@/components/CodeEditorV3';
+import { PreviewFrame } from '@/components/PreviewFrame';
+import { CompileFlame } from '@/components/CompileFlame';
 import { ParticleBackground } from '@/components/ParticleBackground';
 import './App.css';
 
@@ -436,13 +440,20 @@ gradient #ff6b6b, #feca57</code></pre>
 function App() {
   const [code, setCode] = useState(defaultCode);
   const [output, setOutput] = useState('');
+  // Timings and sizes of the last Run's compile
+  const [stats, setStats] = useState<CompileStats | null>(null);
   const [html, setHtml] = useState('');
   const [css, setCss] = useState('');
+  // Output of the last Run; the preview then follows every edit that compiles
+  const [preview, setPreview] = useState<CompileResult | null>(null);
   const [activeTab, setActiveTab] = useState('preview');
   const [isCompiling, setIsCompiling] = useState(false);
   const [copied, setCopied] = useState(false);
   const [mobileMenuOpen, setMobileMenuOpen] = useState(false);
   const [selectedCategory, setSelectedCategory] = useState(0);
+  // Compiles off the main thread on every edit; feeds the editor and preview
+  const { result: compiled, compile } = useCompileService(code);
+  const livePreview = preview && compiled && !compiled.error ? compiled : preview;
   
   const containerRef = useRef<HTMLDivElement>(null);
   const { scrollYProgress } = useScroll({ target: containerRef });
@@ -469,36 +480,28 @@ function App() {
     return () => window.removeEventListener('mousemove', handleMouseMove);
   }, [mouseX, mouseY]);
 
-  const compileCode = () => {
+  const compileCode = async () => {
     setIsCompiling(true);
     try {
-      const compiler = new DroyCompilerV3();
-      const result = compiler.compile(code);
+      // The background compiles don't run the program, so this one always
+      // goes out; if an edit supersedes it, the edit's compile runs instead
+      const result = await compile(code, { run: true, stats: true });
+      // The service was disposed
+      if (!result) return;
+      setStats(result.stats);
+      if (result.error) {
+        setOutput(`Error: ${result.error}\n`);
+        return;
+      }
       setHtml(result.html);
       setCss(result.css);
-      
-      // Simulate execution output
-      const lines = code.split('\n');
-      let simulatedOutput = '';
-      lines.forEach((line) => {
-        const trimmed = line.trim();
-        if (trimmed.startsWith('print ')) {
-          const match = trimmed.match(/print\s+(.+)/);
-          if (match) {
-            const value = match[1].trim();
-            if (value.startsWith('"') && value.endsWith('"')) {
-              simulatedOutput += value.slice(1, -1) + '\n';
-            } else {
-              simulatedOutput += `[${value}]\n`;
-            }
-          }
-        }
-      });
-      setOutput(simulatedOutput || 'Compiled successfully!\n');
+      setPreview(result);
+      setOutput(result.output || 'Compiled successfully!\n');
     } catch (error) {
       setOutput(`Error: ${error}\n`);
+    } finally {
+      setIsCompiling(false);
     }
-    setIsCompiling(false);
   };
 
   const copyCode = (text: string) => {
@@ -818,7 +821,7 @@ function App() {
 
             <div className="grid lg:grid-cols-2">
               <div className="bg-[#0d0d12] min-h-[500px]">
-                <CodeEditorV3 code={code} onChange={setCode} />
+                <CodeEditorV3 code={code} onChange={setCode} tokens={compiled?.source === code ? compiled.tokens : undefined} />
               </div>
 
               <div className="bg-[#1a1a2e] border-t lg:border-t-0 lg:border-r border-white/10">
@@ -843,11 +846,8 @@ function App() {
                   </TabsList>
 
                   <TabsContent value="preview" className="m-0 p-4 min-h-[450px]">
-                    {html ? (
-                      <div>
-                        <style>{css}</style>
-                        <div dangerouslySetInnerHTML={{ __html: html }} />
-                      </div>
+                    {livePreview?.html ? (
+                      <PreviewFrame content={livePreview} />
                     ) : (
                       <div className="text-slate-500 text-center py-20">
                         <Monitor className="w-12 h-12 mx-auto mb-4 opacity-50" />
@@ -859,7 +859,10 @@ function App() {
                   <TabsContent value="output" className="m-0">
                     <div className="p-4 font-mono text-sm min-h-[450px]">
                       {output ? (
-                        <pre className="text-green-400 whitespace-pre-wrap">{output}</pre>
+                        <>
+                          <pre className="text-green-400 whitespace-pre-wrap">{output}</pre>
+                          {stats && <CompileFlame stats={stats} />}
+                        </>
                       ) : (
                         <div className="text-slate-500 text-center py-20">
                           <Terminal className="w-12 h-12 mx-auto mb-4 opacity-50" />
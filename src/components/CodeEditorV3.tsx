@@ -1,133 +1,81 @@
-import { useEffect, useRef, useState } from 'react';
-import { DroyCompilerV3 } from '@/lib/droy/compiler-v3';
+import { useEffect, useMemo, useRef, useState } from 'react';
+import { DroyCompilerV3, type TokenType } from '@/lib/droy/compiler-v3';
+import { highlightDroy } from '@/lib/droy/highlight';
+import { TokenArray, type TokenStream } from '@/lib/droy/token-buffer';
 
 interface CodeEditorV3Props {
   code: string;
   onChange: (code: string) => void;
+  // Tokens from the compile worker; without them the editor lexes locally
+  tokens?: TokenStream<TokenType>;
 }
 
-export function CodeEditorV3({ code, onChange }: CodeEditorV3Props) {
-  const textareaRef = useRef<HTMLTextAreaElement>(null);
-  const highlightRef = useRef<HTMLPreElement>(null);
-  const [tokens, setTokens] = useState<any[]>([]);
+// Lines don't wrap, so each is one leading-6 row below the p-4 padding
+const LINE_HEIGHT = 24;
+const PADDING = 16;
+// Lines rendered beyond each edge of the viewport
+const OVERSCAN = 20;
 
-  useEffect(() => {
-    const compiler = new DroyCompilerV3();
-    const result = compiler.tokenize(code);
-    setTokens(result);
-  }, [code]);
+const FONT_FAMILY = 'ui-monospace, SFMono-Regular, "SF Mono", Consolas, monospace';
 
-  useEffect(() => {
-    if (textareaRef.current && highlightRef.current) {
-      highlightRef.current.scrollTop = textareaRef.current.scrollTop;
-      highlightRef.current.scrollLeft = textareaRef.current.scrollLeft;
-    }
-  }, [code]);
+export function CodeEditorV3({ code, onChange, tokens: workerTokens }: CodeEditorV3Props) {
+  const textareaRef = useRef<HTMLTextAreaElement>(null);
+  // Kept across renders so each keystroke only re-lexes the edited lines
+  const [compiler] = useState(() => new DroyCompilerV3());
+  const [viewport, setViewport] = useState({ top: 0, left: 0, height: 0 });
 
-  const handleScroll = () => {
-    if (textareaRef.current && highlightRef.current) {
-      highlightRef.current.scrollTop = textareaRef.current.scrollTop;
-      highlightRef.current.scrollLeft = textareaRef.current.scrollLeft;
-    }
+  const lines = useMemo(
+    () => highlightDroy(code, workerTokens ?? new TokenArray(compiler.tokenize(code))),
+    [compiler, code, workerTokens],
+  );
+
+  const updateViewport = () => {
+    const textarea = textareaRef.current;
+    if (!textarea) return;
+    const next = { top: textarea.scrollTop, left: textarea.scrollLeft, height: textarea.clientHeight };
+    setViewport((current) =>
+      current.top === next.top && current.left === next.left && current.height === next.height ? current : next,
+    );
   };
 
-  const getHighlightedCode = () => {
-    if (!tokens.length) return code;
+  // Edits can scroll the textarea without a scroll event
+  useEffect(updateViewport, [code]);
 
-    const sourceLines = code.split('\n');
-    
-    return sourceLines.map((line) => {
-      // SET / SETUP
-      line = line.replace(/\b(set|setup)\b(=)([a-zA-Z_][a-zA-Z0-9_-]*)/g, 
-        '<span class="text-purple-400">$1</span><span class="text-slate-300">$2</span><span class="text-blue-300">$3</span>');
-      
-      // TOOL
-      line = line.replace(/\b(tool)(=?)([a-zA-Z_][a-zA-Z0-9_-]*)?/g, 
-        '<span class="text-purple-400">$1</span><span class="text-slate-300">$2</span><span class="text-blue-300">$3</span>');
-      
-      // GET_SET, VALUE_SET, TOOL_SET
-      line = line.replace(/\b(GET_SET|VALUE_SET|TOOL_SET)\b/g, 
-        '<span class="text-purple-400">$1</span>');
-      
-      // value-set with operations
-      line = line.replace(/(value-set)(=)(\()/g, 
-        '<span class="text-purple-400">$1</span><span class="text-slate-300">$2</span><span class="text-yellow-400">$3</span>');
-      
-      // DATA
-      line = line.replace(/\b(data)\b/g, 
-        '<span class="text-green-400">$1</span>');
-      
-      // SERVER
-      line = line.replace(/\b(server)\b(=?)/g, 
-        '<span class="text-orange-400">$1</span><span class="text-slate-300">$2</span>');
-      
-      // Group / ID / Name
-      line = line.replace(/\b(group|id|name)\b(=)([a-zA-Z_][a-zA-Z0-9_-]*)/g, 
-        '<span class="text-cyan-400">$1</span><span class="text-slate-300">$2</span><span class="text-blue-300">$3</span>');
-      
-      // UI Components: ~topbar, ~sidebar, etc.
-      line = line.replace(/(~)(topbar|sidebar|header|footer|nav|menu|btn|img|image|video|audio|icon|text|title|subtitle|container|grid|flex|row|col|column|card|modal|toast|tooltip|color|bg|background)\b/g, 
-        '<span class="text-cyan-400">$1$2</span>');
-      
-      // Events: @click, @hover, etc.
-      line = line.replace(/(@)(click|hover|focus|blur|keydown|keyup|submit|change|on|off)\b/g, 
-        '<span class="text-orange-400">$1$2</span>');
-      
-      // Keywords
-      line = line.replace(/\b(set|get|var|func|return|if|else|for|while|print|input|link|array|class|import|export|bind|ref|watch|emit|fetch|post|put|delete|patch|ws|blend|gradient|theme|mode|math|calc|random|round|floor|ceil|abs|min|max|sum|avg|count)\b/g, 
-        '<span class="text-pink-400">$1</span>');
-      
-      // Layout properties
-      line = line.replace(/\b(width|height|padding|margin|border|radius|shadow|opacity|size|position|top|left|right|bottom|z_index|display|visible|hidden|cols|gap|align|justify|autoplay|loop|muted|controls)\b/g, 
-        '<span class="text-yellow-400">$1</span>');
-      
-      // Hex colors
-      line = line.replace(/(#[0-9a-fA-F]{3,6})/g, 
-        '<span class="text-yellow-400">$1</span>');
-      
-      // Strings
-      line = line.replace(/("[^"]*"|'[^']*')/g, 
-        '<span class="text-green-400">$1</span>');
-      
-      // Numbers
-      line = line.replace(/\b(\d+\.?\d*)\b/g, 
-        '<span class="text-orange-400">$1</span>');
-      
-      // Comments
-      line = line.replace(/(#.*)$/g, 
-        '<span class="text-slate-500">$1</span>');
-      
-      // Operators
-      line = line.replace(/(\+|-|\*|\/|%|\*\*|==|!=|<=|>=|<|>|&&|\|\||!|=|:|=>|\|>|\{|\}|\[|\])/g, 
-        '<span class="text-slate-300">$1</span>');
-      
-      // Parentheses in value-set
-      line = line.replace(/(\(|\))/g, 
-        '<span class="text-yellow-400">$1</span>');
-      
-      return line;
-    }).join('\n');
-  };
+  useEffect(() => {
+    const textarea = textareaRef.current;
+    if (!textarea) return;
+    const observer = new ResizeObserver(updateViewport);
+    observer.observe(textarea);
+    return () => observer.disconnect();
+  }, []);
+
+  // Only the lines in view are in the overlay; it is shifted to where the
+  // textarea has scrolled them
+  const first = Math.max(0, Math.floor((viewport.top - PADDING) / LINE_HEIGHT) - OVERSCAN);
+  const last = Math.min(lines.length, Math.ceil((viewport.top + viewport.height) / LINE_HEIGHT) + OVERSCAN);
 
   return (
     <div className="relative w-full h-full min-h-[500px]">
-      <pre
-        ref={highlightRef}
-        className="absolute inset-0 m-0 p-4 font-mono text-sm leading-6 text-slate-300 whitespace-pre-wrap break-words overflow-auto pointer-events-none"
-        style={{
-          fontFamily: 'ui-monospace, SFMono-Regular, "SF Mono", Consolas, monospace',
-        }}
-        dangerouslySetInnerHTML={{ __html: getHighlightedCode() }}
-      />
+      <div className="absolute inset-0 overflow-hidden pointer-events-none">
+        <pre
+          className="m-0 p-4 font-mono text-sm leading-6 text-slate-300 whitespace-pre"
+          style={{
+            fontFamily: FONT_FAMILY,
+            transform: `translate(${-viewport.left}px, ${first * LINE_HEIGHT - viewport.top}px)`,
+          }}
+          dangerouslySetInnerHTML={{ __html: lines.slice(first, last).join('\n') }}
+        />
+      </div>
       
       <textarea
         ref={textareaRef}
         value={code}
         onChange={(e) => onChange(e.target.value)}
-        onScroll={handleScroll}
-        className="absolute inset-0 w-full h-full p-4 font-mono text-sm leading-6 text-transparent bg-transparent caret-white resize-none focus:outline-none"
+        onScroll={updateViewport}
+        wrap="off"
+        className="absolute inset-0 w-full h-full p-4 font-mono text-sm leading-6 text-transparent bg-transparent caret-white resize-none whitespace-pre focus:outline-none"
         style={{
-          fontFamily: 'ui-monospace, SFMono-Regular, "SF Mono", Consolas, monospace',
+          fontFamily: FONT_FAMILY,
         }}
         spellCheck={false}
         autoComplete="off"
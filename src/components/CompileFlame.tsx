@@ -0,0 +1,92 @@
+import { useMemo } from 'react';
+import { Download } from 'lucide-react';
+import { Button } from '@/components/ui/button';
+import { hitRate, toTraceEvents, type CacheCounter, type CompileStats } from '@/lib/droy/trace';
+
+interface CompileFlameProps {
+  stats: CompileStats;
+}
+
+const ROW_HEIGHT = 20;
+// Spans narrower than this share of the compile are too small to see
+const MIN_WIDTH = 0.002;
+const COLORS: Record<string, string> = {
+  phase: 'bg-indigo-500/70',
+  statement: 'bg-slate-500/70',
+  component: 'bg-emerald-500/70',
+};
+
+function formatMs(ms: number): string {
+  return ms >= 1 ? `${ms.toFixed(1)} ms` : `${(ms * 1000).toFixed(0)} µs`;
+}
+
+function formatRate(counter: CacheCounter): string {
+  const rate = hitRate(counter);
+  return rate === null ? '–' : `${Math.round(rate * 100)}%`;
+}
+
+function downloadTrace(stats: CompileStats): void {
+  const blob = new Blob([JSON.stringify(toTraceEvents(stats))], { type: 'application/json' });
+  const link = document.createElement('a');
+  link.href = URL.createObjectURL(blob);
+  link.download = 'droy-compile-trace.json';
+  link.click();
+  URL.revokeObjectURL(link.href);
+}
+
+// Flame view of one compile: the phases on the top row and, under each, the
+// statements and components it rendered
+export function CompileFlame({ stats }: CompileFlameProps) {
+  const { spans, end, depth } = useMemo(() => {
+    const end = stats.spans.reduce((last, span) => Math.max(last, span.start + span.duration), 0) || 1;
+    const spans = stats.spans.filter((span) => span.depth === 0 || span.duration / end >= MIN_WIDTH);
+    return { spans, end, depth: spans.reduce((deepest, span) => Math.max(deepest, span.depth), 0) + 1 };
+  }, [stats]);
+
+  const components = Object.entries(stats.components).sort((a, b) => b[1].ms - a[1].ms).slice(0, 5);
+
+  return (
+    <div className="mt-4 border-t border-white/10 pt-4 font-mono text-xs text-slate-400">
+      <div className="flex items-center justify-between mb-2">
+        <span>
+          Compiled in {formatMs(stats.total)}: {stats.tokens} tokens, {stats.nodes} nodes,{' '}
+          {stats.output.html + stats.output.css + stats.output.js} bytes
+        </span>
+        <Button size="sm" variant="ghost" className="h-6 px-2" onClick={() => downloadTrace(stats)} title="Chrome trace">
+          <Download className="w-3 h-3 mr-1" />
+          Trace
+        </Button>
+      </div>
+      <div className="relative w-full overflow-hidden" style={{ height: depth * ROW_HEIGHT }}>
+        {spans.map((span, index) => (
+          <div
+            key={index}
+            title={`${span.name}: ${formatMs(span.duration)}`}
+            className={`absolute truncate px-1 text-white border-r border-[#1a1a2e] ${COLORS[span.category] ?? COLORS.statement}`}
+            style={{
+              left: `${(span.start / end) * 100}%`,
+              width: `${(span.duration / end) * 100}%`,
+              top: span.depth * ROW_HEIGHT,
+              height: ROW_HEIGHT - 2,
+              lineHeight: `${ROW_HEIGHT - 2}px`,
+            }}
+          >
+            {span.name}
+          </div>
+        ))}
+      </div>
+      <div className="mt-2 space-y-1">
+        <div>
+          {Object.entries(stats.phases).map(([phase, ms]) => `${phase} ${formatMs(ms)}`).join(' · ')}
+        </div>
+        <div>
+          reused: lexer {formatRate(stats.cache.lexer)} · parser {formatRate(stats.cache.parser)} · generator{' '}
+          {formatRate(stats.cache.generator)}
+        </div>
+        {components.length > 0 && (
+          <div>{components.map(([name, entry]) => `${name} ×${entry.count} ${formatMs(entry.ms)}`).join(' · ')}</div>
+        )}
+      </div>
+    </div>
+  );
+}
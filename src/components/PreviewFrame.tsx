@@ -0,0 +1,46 @@
+import { useEffect, useRef, useState } from 'react';
+import { PREVIEW_DOCUMENT, PreviewHost, type PreviewContent, type PreviewSize } from '@/lib/droy/preview';
+
+interface PreviewFrameProps {
+  content: PreviewContent;
+}
+
+// Renders compiled pages in a sandboxed iframe that is patched in place on
+// every compile rather than rebuilt
+export function PreviewFrame({ content }: PreviewFrameProps) {
+  const frameRef = useRef<HTMLIFrameElement>(null);
+  const [host] = useState(() => new PreviewHost());
+  const [loaded, setLoaded] = useState(false);
+  const [height, setHeight] = useState(0);
+
+  useEffect(() => {
+    if (!loaded) return;
+    frameRef.current?.contentWindow?.postMessage(host.update(content), '*');
+  }, [host, loaded, content]);
+
+  useEffect(() => {
+    const handleMessage = (event: MessageEvent<PreviewSize>) => {
+      if (event.source !== frameRef.current?.contentWindow || event.data?.type !== 'droy-preview-size') return;
+      setHeight(event.data.height);
+    };
+    window.addEventListener('message', handleMessage);
+    return () => window.removeEventListener('message', handleMessage);
+  }, []);
+
+  return (
+    <iframe
+      ref={frameRef}
+      title="Preview"
+      sandbox="allow-scripts"
+      srcDoc={PREVIEW_DOCUMENT}
+      onLoad={() => {
+        host.reset();
+        // A reload with `loaded` already set still has to resend everything
+        frameRef.current?.contentWindow?.postMessage(host.update(content), '*');
+        setLoaded(true);
+      }}
+      className="w-full min-h-[450px] border-0 bg-transparent"
+      style={{ height }}
+    />
+  );
+}
@@ -0,0 +1,43 @@
+import * as React from "react"
+import { CompileService, type CompileOptions, type CompileResult } from "@/lib/droy/compile-service"
+
+// Compiles `source` in the compile worker whenever it changes. `result` is the
+// newest finished compile (possibly for older text while one is in flight).
+export function useCompileService(source: string) {
+  const serviceRef = React.useRef<CompileService | null>(null)
+  const [result, setResult] = React.useState<CompileResult | null>(null)
+  const [isCompiling, setIsCompiling] = React.useState(false)
+
+  React.useEffect(() => {
+    const service = new CompileService()
+    serviceRef.current = service
+    return () => {
+      service.dispose()
+      serviceRef.current = null
+    }
+  }, [])
+
+  const compile = React.useCallback(async (text: string, options?: CompileOptions) => {
+    const service = serviceRef.current
+    if (!service) return null
+
+    setIsCompiling(true)
+    try {
+      const next = await service.compile(text, options)
+      if (next) {
+        setResult(next)
+        setIsCompiling(false)
+      }
+      return next
+    } catch (error) {
+      setIsCompiling(false)
+      throw error
+    }
+  }, [])
+
+  React.useEffect(() => {
+    compile(source).catch(() => {})
+  }, [compile, source])
+
+  return { result, isCompiling, compile }
+}
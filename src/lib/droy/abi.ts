@@ -0,0 +1,139 @@
+// Droy Language - Byte-level compile ABI
+// A compile boundary that only passes bytes: the source goes in as UTF-8
+// and the HTML, CSS, JS and any error come back in one buffer with a fixed
+// layout. Hosts that don't share the compiler's object model (edge workers,
+// other runtimes, a future WebAssembly build of the core) depend on this
+// layout rather than on the TypeScript API, so it only changes with
+// DROY_ABI_VERSION.
+//
+// For now the core behind the ABI is the TypeScript DroyCompilerV3 itself:
+// this module wraps it, rather than the TypeScript API wrapping a
+// WebAssembly core. A WebAssembly build can take its place without hosts
+// noticing.
+//
+// Output layout, little-endian:
+//   u32 DROY_ABI_MAGIC
+//   u32 DROY_ABI_VERSION
+//   u32 status       (DroyABIStatus)
+//   4 × (u32 byteLength, UTF-8 bytes) for html, css, js and error, in that order
+
+import { DroyCompilerV3, type CssMode } from './compiler-v3';
+
+// "DROY" read as a little-endian u32
+export const DROY_ABI_MAGIC = 0x594f5244;
+export const DROY_ABI_VERSION = 1;
+
+export const DroyABIStatus = {
+  OK: 0,
+  COMPILE_ERROR: 1,
+  INVALID_INPUT: 2,
+} as const;
+
+export type DroyABIStatus = (typeof DroyABIStatus)[keyof typeof DroyABIStatus];
+
+// Options are passed as bit flags so they cross the boundary as one u32
+export const DroyABIFlags = {
+  CSS_DEDUPLICATED: 1 << 0,
+  CSS_ATOMIC: 1 << 1,
+  NO_OPTIMIZE: 1 << 2,
+} as const;
+
+export interface DroyABIOutput {
+  status: DroyABIStatus;
+  html: string;
+  css: string;
+  js: string;
+  error: string;
+}
+
+const HEADER_BYTES = 12;
+const SECTIONS = 4;
+
+const encoder = new TextEncoder();
+// Invalid UTF-8 in the source is an input error, not something to patch over
+const strictDecoder = new TextDecoder('utf-8', { fatal: true });
+const decoder = new TextDecoder();
+
+function cssMode(flags: number): CssMode {
+  if (flags & DroyABIFlags.CSS_ATOMIC) return 'atomic';
+  if (flags & DroyABIFlags.CSS_DEDUPLICATED) return 'deduplicated';
+  return 'rules';
+}
+
+export function encodeOutput(status: DroyABIStatus, sections: [string, string, string, string]): Uint8Array {
+  const bytes = sections.map((section) => encoder.encode(section));
+  const buffer = new Uint8Array(HEADER_BYTES + bytes.reduce((sum, part) => sum + 4 + part.length, 0));
+  const view = new DataView(buffer.buffer);
+  view.setUint32(0, DROY_ABI_MAGIC, true);
+  view.setUint32(4, DROY_ABI_VERSION, true);
+  view.setUint32(8, status, true);
+  let offset = HEADER_BYTES;
+  for (const part of bytes) {
+    view.setUint32(offset, part.length, true);
+    buffer.set(part, offset + 4);
+    offset += 4 + part.length;
+  }
+  return buffer;
+}
+
+export function decodeOutput(buffer: Uint8Array): DroyABIOutput {
+  const view = new DataView(buffer.buffer, buffer.byteOffset, buffer.byteLength);
+  if (buffer.byteLength < HEADER_BYTES || view.getUint32(0, true) !== DROY_ABI_MAGIC) {
+    throw new Error('Not a Droy compile output');
+  }
+  const version = view.getUint32(4, true);
+  if (version !== DROY_ABI_VERSION) {
+    throw new Error(`Droy compile output has ABI version ${version}, expected ${DROY_ABI_VERSION}`);
+  }
+
+  const sections: string[] = [];
+  let offset = HEADER_BYTES;
+  for (let i = 0; i < SECTIONS; i++) {
+    // Lengths come from the buffer, so check them before reading past one
+    if (offset + 4 > buffer.byteLength) {
+      throw new Error('Droy compile output is truncated');
+    }
+    const length = view.getUint32(offset, true);
+    if (length > buffer.byteLength - offset - 4) {
+      throw new Error('Droy compile output is truncated');
+    }
+    sections.push(decoder.decode(buffer.subarray(offset + 4, offset + 4 + length)));
+    offset += 4 + length;
+  }
+  const [html, css, js, error] = sections;
+  return { status: view.getUint32(8, true) as DroyABIStatus, html, css, js, error };
+}
+
+// One compiler behind the ABI. Like DroyCompilerV3 it keeps the previous
+// compile, so a host sending successive versions of a file gets incremental
+// recompiles without holding any compiler objects itself.
+export class DroyABICompiler {
+  private compilers = new Map<number, DroyCompilerV3>();
+
+  public compile(source: Uint8Array, flags: number = 0): Uint8Array {
+    let text: string;
+    try {
+      text = strictDecoder.decode(source);
+    } catch {
+      return encodeOutput(DroyABIStatus.INVALID_INPUT, ['', '', '', 'Source is not valid UTF-8']);
+    }
+
+    let compiler = this.compilers.get(flags);
+    if (!compiler) {
+      compiler = new DroyCompilerV3({
+        css: cssMode(flags),
+        optimize: flags & DroyABIFlags.NO_OPTIMIZE ? false : undefined,
+      });
+      this.compilers.set(flags, compiler);
+    }
+
+    try {
+      const { html, css, js } = compiler.compile(text);
+      return encodeOutput(DroyABIStatus.OK, [html, css, js, '']);
+    } catch (err) {
+      // A failed compile may leave the incremental state half updated
+      this.compilers.delete(flags);
+      return encodeOutput(DroyABIStatus.COMPILE_ERROR, ['', '', '', err instanceof Error ? err.message : String(err)]);
+    }
+  }
+}
@@ -0,0 +1,159 @@
+// Droy Language - Shared front-end definitions
+// The token and AST node types every front end, AST pass and backend uses,
+// and the token-kind sets the parsers test lookahead against.
+
+import type { ScannedToken } from './scanner';
+
+export type Token<T extends string> = ScannedToken<T>;
+
+// Nodes are plain objects discriminated by their `type`, one shape per kind.
+// Fields only some grammars fill are optional; children are ASTNode, so a
+// pass narrows the one node it looks at and not the whole tree.
+
+// Literals
+export type NumberLiteral = { type: 'NumberLiteral'; value: number };
+export type StringLiteral = { type: 'StringLiteral'; value: string };
+export type BooleanLiteral = { type: 'BooleanLiteral'; value: boolean };
+export type NullLiteral = { type: 'NullLiteral'; value: null };
+export type ColorLiteral = { type: 'ColorLiteral'; value: string };
+export type ArrayLiteral = { type: 'ArrayLiteral'; elements: ASTNode[] };
+export type ObjectLiteral = { type: 'ObjectLiteral'; properties: { key: string; value: ASTNode }[] };
+export type LiteralNode = NumberLiteral | StringLiteral | BooleanLiteral | NullLiteral;
+
+// Expressions
+export type Identifier = { type: 'Identifier'; name: string };
+export type GetExpression = { type: 'GetExpression'; name: string };
+export type BinaryExpression = { type: 'BinaryExpression'; operator: string; left: ASTNode; right: ASTNode };
+export type LogicalExpression = { type: 'LogicalExpression'; operator: string; left: ASTNode; right: ASTNode };
+export type UnaryExpression = { type: 'UnaryExpression'; operator: string; operand: ASTNode };
+export type AssignmentExpression = { type: 'AssignmentExpression'; operator: '='; left: ASTNode; right: ASTNode };
+export type CallExpression = { type: 'CallExpression'; callee: ASTNode; arguments: ASTNode[] };
+export type PipeExpression = { type: 'PipeExpression'; left: ASTNode; right: ASTNode };
+export type MathOperation = { type: 'MathOperation'; operation: string; values: ASTNode[] };
+
+// Statements
+export type Program = { type: 'Program'; body: ASTNode[] };
+export type Empty = { type: 'Empty' };
+export type ExpressionStatement = { type: 'ExpressionStatement'; expression: ASTNode };
+export type PrintStatement = { type: 'PrintStatement'; value: ASTNode };
+export type ReturnStatement = { type: 'ReturnStatement'; value: ASTNode };
+export type VariableDeclaration = { type: 'VariableDeclaration'; name: string; value: ASTNode };
+// `~s=p*hello` in the V1 grammar declares the pointer string `_ptr`
+export type SetDeclaration = { type: 'SetDeclaration'; name: string; value: ASTNode; pointer?: boolean };
+export type FunctionDeclaration = { type: 'FunctionDeclaration'; name: string; params: string[]; body: ASTNode[] };
+export type ClassDeclaration = { type: 'ClassDeclaration'; name: string; methods: ASTNode[] };
+export type IfStatement = {
+  type: 'IfStatement';
+  condition: ASTNode;
+  consequent: ASTNode[];
+  alternate: ASTNode[] | null;
+};
+export type ForLoop = { type: 'ForLoop'; iterator: string; iterable: ASTNode; body: ASTNode[] };
+export type WhileLoop = { type: 'WhileLoop'; condition: ASTNode; body: ASTNode[] };
+// A handler body; `params` are the names a V3 handler binds, like `e =>`
+export type BlockStatement = { type: 'BlockStatement'; params?: string[]; body: ASTNode[] };
+export type ImportStatement = { type: 'ImportStatement'; path: string };
+export type ExportStatement = { type: 'ExportStatement'; declaration: ASTNode };
+
+// Shorthand statements
+export type ShorthandAction = { type: 'ShorthandAction'; target: string; action: string; value: ASTNode };
+export type SetNaming = { type: 'SetNaming'; name: string; expression: ASTNode | null };
+export type Setup = { type: 'Setup'; action: string | null; target: ASTNode | null };
+export type Tool = { type: 'Tool'; action: string | null; config: ASTNode | null };
+export type GetSet = { type: 'GetSet'; properties: Record<string, ASTNode> };
+export type ValueSet = {
+  type: 'ValueSet';
+  assignments: { name: string; value: ASTNode; operation?: string }[];
+};
+export type GroupIdName = { type: 'GroupIdName'; kind: string; name: ASTNode | null; value: ASTNode | null };
+export type ColorBlend = { type: 'ColorBlend'; blendType: string; colors: string[]; mode: string };
+
+// UI, data and network
+export type UIComponent = {
+  type: 'UIComponent';
+  component: string;
+  props: Record<string, any>;
+  children: ASTNode[];
+};
+export type EventHandler = { type: 'EventHandler'; event: string; handler: ASTNode | null };
+export type LayoutProperty = { type: 'LayoutProperty'; property: string; value: ASTNode | null };
+export type KeyBinding = { type: 'KeyBinding'; key: string | null };
+export type Binding = { type: 'Binding'; target: string | null; source: ASTNode | null };
+export type Ref = { type: 'Ref'; name: string | null };
+export type Watch = { type: 'Watch'; target: ASTNode; handler: ASTNode | null };
+export type Emit = { type: 'Emit'; event: ASTNode; data: ASTNode | null };
+export type Data = {
+  type: 'Data';
+  name: string | null;
+  source: ASTNode | null;
+  url: ASTNode | null;
+  format: string;
+};
+export type Server = { type: 'Server'; config: Record<string, any> };
+export type ServerRequest = {
+  type: 'ServerRequest';
+  method: string;
+  url: ASTNode | null;
+  options: Record<string, any>;
+  handler: ASTNode | null;
+};
+export type Socket = { type: 'Socket'; url: ASTNode };
+export type SocketHandler = { type: 'SocketHandler'; event: string; handler: ASTNode | null };
+export type Route = { type: 'Route'; path: string; children: ASTNode[] };
+export type Router = { type: 'Router'; config: Record<string, any> };
+
+// One step of an animation: `from`, `to` or a percentage, and the style
+// object the element has there
+export interface KeyframeStep {
+  at: string;
+  style: ASTNode;
+}
+
+// Motion. The V2 grammar names an animation by its kind (`animationType`)
+// and has no steps; V3 names it and lists its keyframes.
+export type Animation = {
+  type: 'Animation';
+  animationType?: string;
+  name?: string | null;
+  props: Record<string, ASTNode>;
+  frames?: KeyframeStep[];
+};
+export type Keyframes = { type: 'Keyframes'; name: string; frames: KeyframeStep[] };
+export type Transition = {
+  type: 'Transition';
+  property: string | null;
+  value: ASTNode | null;
+  props: Record<string, ASTNode>;
+};
+
+export type DroyNode =
+  | NumberLiteral | StringLiteral | BooleanLiteral | NullLiteral | ColorLiteral | ArrayLiteral | ObjectLiteral
+  | Identifier | GetExpression | BinaryExpression | LogicalExpression | UnaryExpression | AssignmentExpression
+  | CallExpression | PipeExpression | MathOperation
+  | Program | Empty | ExpressionStatement | PrintStatement | ReturnStatement | VariableDeclaration | SetDeclaration
+  | FunctionDeclaration | ClassDeclaration | IfStatement | ForLoop | WhileLoop | BlockStatement
+  | ImportStatement | ExportStatement
+  | ShorthandAction | SetNaming | Setup | Tool | GetSet | ValueSet | GroupIdName | ColorBlend
+  | UIComponent | EventHandler | LayoutProperty | KeyBinding | Binding | Ref | Watch | Emit | Data
+  | Server | ServerRequest | Socket | SocketHandler | Route | Router
+  | Animation | Keyframes | Transition;
+
+export type NodeType = DroyNode['type'];
+
+// The node of one kind: NodeOf<'ForLoop'> is ForLoop
+export type NodeOf<K extends NodeType> = Extract<DroyNode, { type: K }>;
+
+// Any node, for code that walks the tree without narrowing; its `type` is
+// still one of the kinds above
+export interface ASTNode {
+  type: NodeType;
+  [key: string]: any;
+}
+
+// A fixed set of token kinds. Parsers keep these as module constants and
+// test with has() instead of building an array of kinds at every call.
+export type TokenSet<T extends string> = ReadonlySet<T>;
+
+export function tokenSet<T extends string>(...types: T[]): TokenSet<T> {
+  return new Set(types);
+}
@@ -0,0 +1,691 @@
+// Droy Language - C runtime support
+// Sections of C source that DroyCodeGenerator prepends on demand. Typed code
+// needs none of them; they back the arena everything is allocated from,
+// string building, typed arrays, the tagged DroyValue used where no static
+// type could be inferred, and the math builtins.
+
+// printf conversion for doubles in every place a number becomes text
+export const DOUBLE_FORMAT = '%.15g';
+
+export type CRuntimeSection = 'arena' | 'format' | 'array' | 'value' | 'math';
+
+// Headers each section needs beyond stdio/stdlib/string/stdbool
+export const SECTION_INCLUDES: Record<CRuntimeSection, string[]> = {
+  arena: ['#include <stddef.h>'],
+  format: ['#include <stdarg.h>'],
+  array: [],
+  value: ['#include <stdarg.h>', '#include <math.h>'],
+  math: ['#include <math.h>'],
+};
+
+export const SECTION_DEPENDENCIES: Record<CRuntimeSection, CRuntimeSection[]> = {
+  arena: [],
+  format: ['arena'],
+  array: ['arena'],
+  value: ['arena', 'format'],
+  math: [],
+};
+
+// Emission order; a section only uses the ones before it
+export const SECTION_ORDER: CRuntimeSection[] = ['arena', 'format', 'array', 'value', 'math'];
+
+export const C_RUNTIME: Record<CRuntimeSection, string> = {
+  arena: `/* Region allocation. Strings, arrays and boxed values are bumped off the
+   top of one arena, a chain of blocks. A function call, loop iteration or
+   statement whose values cannot outlive it takes a mark of the top on entry
+   and releases back to it on exit, which reclaims everything in between at
+   once; a function returning a string keeps just that string. */
+typedef struct DroyArenaBlock {
+  struct DroyArenaBlock* prev;
+  char* end;
+} DroyArenaBlock;
+
+static struct {
+  DroyArenaBlock* block;
+  char* base;
+  char* top;
+  char* end;
+  /* The largest block released, kept for the next one needed */
+  DroyArenaBlock* spare;
+} droy_arena;
+
+#define DROY_ARENA_ALIGN 8
+#define DROY_ARENA_MIN_BLOCK ((size_t)64 << 10)
+#define DROY_ARENA_MAX_BLOCK ((size_t)16 << 20)
+
+static inline void droy_arena_grow(size_t size) {
+  size_t need = sizeof(DroyArenaBlock) + size;
+  DroyArenaBlock* block = droy_arena.spare;
+  if (block && (size_t)(block->end - (char*)block) >= need) {
+    droy_arena.spare = NULL;
+  } else {
+    /* Blocks double up to a limit, so a long chain stays rare */
+    size_t capacity = droy_arena.block ? (size_t)(droy_arena.block->end - (char*)droy_arena.block) * 2 : DROY_ARENA_MIN_BLOCK;
+    if (capacity > DROY_ARENA_MAX_BLOCK) capacity = DROY_ARENA_MAX_BLOCK;
+    while (capacity < need) capacity *= 2;
+    block = malloc(capacity);
+    if (!block) {
+      fputs("droy: out of memory\\n", stderr);
+      exit(1);
+    }
+    block->end = (char*)block + capacity;
+  }
+  block->prev = droy_arena.block;
+  droy_arena.block = block;
+  droy_arena.base = droy_arena.top = (char*)(block + 1);
+  droy_arena.end = block->end;
+}
+
+static inline void* droy_alloc(size_t size) {
+  size = (size + DROY_ARENA_ALIGN - 1) & ~(size_t)(DROY_ARENA_ALIGN - 1);
+  if ((size_t)(droy_arena.end - droy_arena.top) < size) droy_arena_grow(size);
+  void* memory = droy_arena.top;
+  droy_arena.top += size;
+  return memory;
+}
+
+static inline char* droy_arena_mark(void) {
+  return droy_arena.top;
+}
+
+/* Drops the blocks allocated since the one the mark is in */
+static inline void droy_arena_pop(char* mark) {
+  while (droy_arena.block && !(mark >= (char*)(droy_arena.block + 1) && mark <= droy_arena.block->end)) {
+    DroyArenaBlock* block = droy_arena.block;
+    droy_arena.block = block->prev;
+    if (!droy_arena.spare || droy_arena.spare->end - (char*)droy_arena.spare < block->end - (char*)block) {
+      free(droy_arena.spare);
+      droy_arena.spare = block;
+    } else {
+      free(block);
+    }
+  }
+  droy_arena.base = droy_arena.block ? (char*)(droy_arena.block + 1) : NULL;
+  droy_arena.end = droy_arena.block ? droy_arena.block->end : NULL;
+  droy_arena.top = mark;
+}
+
+static inline void droy_arena_release(char* mark) {
+  if (mark >= droy_arena.base && mark <= droy_arena.top) {
+    droy_arena.top = mark;
+  } else {
+    droy_arena_pop(mark);
+  }
+}
+
+/* Strings are NUL-terminated for C, with their length in front, so nothing
+   needs strlen. A Droy string value points at chars. */
+typedef struct {
+  int length;
+  char chars[];
+} DroyString;
+
+#define DROY_STRING_LENGTH(s) (((const DroyString*)((const char*)(s) - offsetof(DroyString, chars)))->length)
+
+/* A string constant with the same layout */
+#define DROY_STATIC_STRING(name, text) \\
+  static const struct { int length; char chars[sizeof(text)]; } name = { sizeof(text) - 1, text }
+
+static inline bool droy_string_equals(const char* a, const char* b) {
+  return a == b || (DROY_STRING_LENGTH(a) == DROY_STRING_LENGTH(b) && memcmp(a, b, DROY_STRING_LENGTH(a)) == 0);
+}
+
+/* Whether p was allocated since the mark was taken */
+static inline bool droy_arena_since(char* mark, const char* p) {
+  for (DroyArenaBlock* block = droy_arena.block; block; block = block->prev) {
+    char* base = (char*)(block + 1);
+    bool marked = mark >= base && mark <= block->end;
+    if (p >= base && p < block->end) return !marked || p >= mark;
+    if (marked) return false;
+  }
+  return false;
+}
+
+/* Releases back to the mark but keeps s, moving it down to where the mark was */
+static inline const char* droy_arena_keep(char* mark, const char* s) {
+  if (!droy_arena_since(mark, s)) {
+    droy_arena_release(mark);
+    return s;
+  }
+  DroyString* from = (DroyString*)(s - offsetof(DroyString, chars));
+  size_t size = offsetof(DroyString, chars) + from->length + 1;
+  DroyString* to;
+  if (mark >= droy_arena.base && mark <= droy_arena.top) {
+    droy_arena.top = mark;
+    to = droy_alloc(size);
+    memmove(to, from, size);
+  } else {
+    /* Built in a block the release frees */
+    DroyString* copy = malloc(size);
+    memcpy(copy, from, size);
+    droy_arena_release(mark);
+    to = droy_alloc(size);
+    memcpy(to, copy, size);
+    free(copy);
+  }
+  return to->chars;
+}
+`,
+
+  format: `/* Strings are built in place past the top of the arena. Room for more
+   bytes after the used ones already written; a string that outgrows its
+   block moves to a new one. */
+static inline char* droy_reserve(size_t used, size_t more) {
+  size_t header = offsetof(DroyString, chars);
+  if ((size_t)(droy_arena.end - droy_arena.top) < header + used + more + 1) {
+    char* from = droy_arena.top;
+    droy_arena_grow(2 * (header + used + more + 1));
+    if (used) memcpy(droy_arena.top + header, from + header, used);
+  }
+  return droy_arena.top + header;
+}
+
+static inline int droy_write_int(char* out, int value) {
+  char digits[10];
+  int count = 0, length = 0;
+  unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+  do {
+    digits[count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0) out[length++] = '-';
+  while (count) out[length++] = digits[--count];
+  return length;
+}
+
+/* Concatenates one argument per letter of kinds: s a string, d an int,
+   g a double, b a bool */
+static inline const char* droy_concat(const char* kinds, ...) {
+  va_list args;
+  va_start(args, kinds);
+  size_t used = 0;
+  for (const char* kind = kinds; *kind; kind++) {
+    switch (*kind) {
+      case 's': {
+        const char* s = va_arg(args, const char*);
+        size_t length = DROY_STRING_LENGTH(s);
+        memcpy(droy_reserve(used, length) + used, s, length);
+        used += length;
+        break;
+      }
+      case 'd': {
+        char* out = droy_reserve(used, 11);
+        used += droy_write_int(out + used, va_arg(args, int));
+        break;
+      }
+      case 'g': {
+        char* out = droy_reserve(used, 32);
+        used += snprintf(out + used, 33, "${DOUBLE_FORMAT}", va_arg(args, double));
+        break;
+      }
+      case 'b': {
+        bool value = va_arg(args, int);
+        memcpy(droy_reserve(used, 5) + used, value ? "true" : "false", value ? 4 : 5);
+        used += value ? 4 : 5;
+        break;
+      }
+    }
+  }
+  va_end(args);
+  DroyString* string = droy_alloc(offsetof(DroyString, chars) + used + 1);
+  string->length = (int)used;
+  string->chars[used] = '\\0';
+  return string->chars;
+}
+`,
+
+  array: `/* Arrays with an element type known at compile time */
+#define DROY_ARRAY_TYPE(T, Name) \\
+  typedef struct { int length; T* items; } Name; \\
+  static inline Name Name##_of(int length, const T* items) { \\
+    Name array = { length, droy_alloc(sizeof(T) * (length > 0 ? length : 1)) }; \\
+    if (length > 0) memcpy(array.items, items, sizeof(T) * length); \\
+    return array; \\
+  }
+`,
+
+  value: `/* Tagged values, for whatever has no static type */
+typedef enum { DROY_NULL, DROY_INT, DROY_DOUBLE, DROY_BOOL, DROY_STRING, DROY_ARRAY, DROY_OBJECT } DroyTag;
+
+typedef struct DroyValue {
+  DroyTag tag;
+  union {
+    int i;
+    double d;
+    bool b;
+    const char* s;
+    struct DroyArray_value* a;
+    void* p;
+  } as;
+} DroyValue;
+
+typedef struct DroyArray_value { int length; DroyValue* items; } DroyArray_value;
+
+static inline DroyValue droy_null(void) { DroyValue v = { DROY_NULL, { 0 } }; return v; }
+static inline DroyValue droy_int(int i) { DroyValue v = { DROY_INT, { 0 } }; v.as.i = i; return v; }
+static inline DroyValue droy_double(double d) { DroyValue v = { DROY_DOUBLE, { 0 } }; v.as.d = d; return v; }
+static inline DroyValue droy_bool(bool b) { DroyValue v = { DROY_BOOL, { 0 } }; v.as.b = b; return v; }
+static inline DroyValue droy_string(const char* s) { DroyValue v = { DROY_STRING, { 0 } }; v.as.s = s; return v; }
+
+static inline DroyValue droy_object(const void* data, size_t size) {
+  DroyValue v = { DROY_OBJECT, { 0 } };
+  v.as.p = droy_alloc(size);
+  memcpy(v.as.p, data, size);
+  return v;
+}
+
+static inline DroyArray_value DroyArray_value_of(int length, const DroyValue* items) {
+  DroyArray_value array = { length, droy_alloc(sizeof(DroyValue) * (length > 0 ? length : 1)) };
+  if (length > 0) memcpy(array.items, items, sizeof(DroyValue) * length);
+  return array;
+}
+
+static inline DroyValue droy_array(DroyArray_value array) {
+  DroyValue v = { DROY_ARRAY, { 0 } };
+  v.as.a = droy_alloc(sizeof(DroyArray_value));
+  *v.as.a = array;
+  return v;
+}
+
+static inline double droy_number(DroyValue v) {
+  switch (v.tag) {
+    case DROY_INT: return v.as.i;
+    case DROY_DOUBLE: return v.as.d;
+    case DROY_BOOL: return v.as.b;
+    case DROY_STRING: return strtod(v.as.s, NULL);
+    default: return 0;
+  }
+}
+
+static inline bool droy_truthy(DroyValue v) {
+  switch (v.tag) {
+    case DROY_NULL: return false;
+    case DROY_INT: return v.as.i != 0;
+    case DROY_DOUBLE: return v.as.d == v.as.d && v.as.d != 0;
+    case DROY_BOOL: return v.as.b;
+    case DROY_STRING: return v.as.s[0] != '\\0';
+    default: return true;
+  }
+}
+
+DROY_STATIC_STRING(droy_empty_string, "");
+DROY_STATIC_STRING(droy_null_string, "null");
+DROY_STATIC_STRING(droy_true_string, "true");
+DROY_STATIC_STRING(droy_false_string, "false");
+DROY_STATIC_STRING(droy_comma_string, ",");
+DROY_STATIC_STRING(droy_object_string, "[object Object]");
+
+static inline const char* droy_to_string(DroyValue v) {
+  switch (v.tag) {
+    case DROY_NULL: return droy_null_string.chars;
+    case DROY_INT: return droy_concat("d", v.as.i);
+    case DROY_DOUBLE: return droy_concat("g", v.as.d);
+    case DROY_BOOL: return v.as.b ? droy_true_string.chars : droy_false_string.chars;
+    case DROY_STRING: return v.as.s;
+    case DROY_ARRAY: {
+      const char* out = droy_empty_string.chars;
+      for (int i = 0; i < v.as.a->length; i++) {
+        const char* item = droy_to_string(v.as.a->items[i]);
+        out = i ? droy_concat("sss", out, droy_comma_string.chars, item) : item;
+      }
+      return out;
+    }
+    default: return droy_object_string.chars;
+  }
+}
+
+static inline DroyValue droy_add(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_STRING || b.tag == DROY_STRING) {
+    return droy_string(droy_concat("ss", droy_to_string(a), droy_to_string(b)));
+  }
+  if (a.tag == DROY_INT && b.tag == DROY_INT) return droy_int(a.as.i + b.as.i);
+  return droy_double(droy_number(a) + droy_number(b));
+}
+
+static inline DroyValue droy_sub(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_INT && b.tag == DROY_INT) return droy_int(a.as.i - b.as.i);
+  return droy_double(droy_number(a) - droy_number(b));
+}
+
+static inline DroyValue droy_mul(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_INT && b.tag == DROY_INT) return droy_int(a.as.i * b.as.i);
+  return droy_double(droy_number(a) * droy_number(b));
+}
+
+static inline DroyValue droy_div(DroyValue a, DroyValue b) {
+  return droy_double(droy_number(a) / droy_number(b));
+}
+
+static inline DroyValue droy_mod(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_INT && b.tag == DROY_INT && b.as.i != 0) return droy_int(a.as.i % b.as.i);
+  return droy_double(fmod(droy_number(a), droy_number(b)));
+}
+
+static inline DroyValue droy_neg(DroyValue v) {
+  if (v.tag == DROY_INT) return droy_int(-v.as.i);
+  return droy_double(-droy_number(v));
+}
+
+static inline int droy_compare(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_STRING && b.tag == DROY_STRING) return strcmp(a.as.s, b.as.s);
+  double x = droy_number(a);
+  double y = droy_number(b);
+  return (x > y) - (x < y);
+}
+
+static inline bool droy_equals(DroyValue a, DroyValue b) {
+  if (a.tag == DROY_STRING && b.tag == DROY_STRING) return droy_string_equals(a.as.s, b.as.s);
+  if (a.tag == DROY_NULL || b.tag == DROY_NULL) return a.tag == b.tag;
+  if (a.tag == DROY_ARRAY || a.tag == DROY_OBJECT || b.tag == DROY_ARRAY || b.tag == DROY_OBJECT) {
+    return a.tag == b.tag && a.as.p == b.as.p;
+  }
+  return droy_number(a) == droy_number(b);
+}
+
+static inline int droy_length(DroyValue v) {
+  return v.tag == DROY_ARRAY ? v.as.a->length : 0;
+}
+
+static inline DroyValue droy_at(DroyValue v, int index) {
+  return v.as.a->items[index];
+}
+
+static inline void droy_print(DroyValue v) {
+  printf("%s\\n", droy_to_string(v));
+}
+
+/* sum/avg/min/max/count over one array or several values, as in the VM */
+static inline DroyArray_value droy_operands(int count, DroyValue* args) {
+  if (count == 1 && args[0].tag == DROY_ARRAY) return *args[0].as.a;
+  return (DroyArray_value){ count, args };
+}
+
+static inline DroyValue droy_sum_values(int count, DroyValue* args) {
+  DroyArray_value values = droy_operands(count, args);
+  double total = 0;
+  for (int i = 0; i < values.length; i++) total += droy_number(values.items[i]);
+  return droy_double(total);
+}
+
+static inline DroyValue droy_avg_values(int count, DroyValue* args) {
+  DroyArray_value values = droy_operands(count, args);
+  if (values.length == 0) return droy_double(0);
+  return droy_double(droy_number(droy_sum_values(count, args)) / values.length);
+}
+
+/* The smallest value for sign 1, the largest for -1; NaN wins, as in Math.min */
+static inline DroyValue droy_extreme_values(int count, DroyValue* args, int sign) {
+  DroyArray_value values = droy_operands(count, args);
+  if (values.length == 0) {
+    fputs(sign > 0 ? "droy: min of an empty array\\n" : "droy: max of an empty array\\n", stderr);
+    exit(1);
+  }
+  double result = droy_number(values.items[0]);
+  for (int i = 1; i < values.length && result == result; i++) {
+    double x = droy_number(values.items[i]);
+    if (x != x || (sign > 0 ? x < result : x > result)) result = x;
+  }
+  return droy_double(result);
+}
+
+static inline DroyValue droy_count_values(int count, DroyValue* args) {
+  return droy_int(droy_operands(count, args).length);
+}
+`,
+
+  math: `/* Math builtins. Reductions over typed arrays run on SIMD kernels: AVX2 or
+   SSE2 on x86-64, picked by what the CPU running the program supports, and
+   NEON on AArch64; other targets use the scalar loops. Vector sums add in a
+   different order than a loop would, so double sums can differ from the
+   VM's in the last bits. Ints are summed in 64 bits. NaN wins in min/max. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DROY_MATH_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DROY_MATH_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Math.round: halves round up */
+static inline double droy_round(double x) {
+  double r = floor(x);
+  return x - r >= 0.5 ? r + 1 : r;
+}
+
+static inline double droy_sum_f64_scalar(const double* items, int length) {
+  double total = 0;
+  for (int i = 0; i < length; i++) total += items[i];
+  return total;
+}
+
+static inline long long droy_sum_i32_scalar(const int* items, int length) {
+  long long total = 0;
+  for (int i = 0; i < length; i++) total += items[i];
+  return total;
+}
+
+/* Folds items into result, the smallest so far for sign 1 or the largest for -1 */
+static inline double droy_extreme_f64_from(double result, const double* items, int length, int sign) {
+  for (int i = 0; i < length && result == result; i++) {
+    double x = items[i];
+    if (x != x || (sign > 0 ? x < result : x > result)) result = x;
+  }
+  return result;
+}
+
+static inline int droy_extreme_i32_from(int result, const int* items, int length, int sign) {
+  for (int i = 0; i < length; i++) {
+    if (sign > 0 ? items[i] < result : items[i] > result) result = items[i];
+  }
+  return result;
+}
+
+static inline double droy_min_f64_scalar(const double* items, int length) {
+  return droy_extreme_f64_from(items[0], items + 1, length - 1, 1);
+}
+static inline double droy_max_f64_scalar(const double* items, int length) {
+  return droy_extreme_f64_from(items[0], items + 1, length - 1, -1);
+}
+static inline int droy_min_i32_scalar(const int* items, int length) {
+  return droy_extreme_i32_from(items[0], items + 1, length - 1, 1);
+}
+static inline int droy_max_i32_scalar(const int* items, int length) {
+  return droy_extreme_i32_from(items[0], items + 1, length - 1, -1);
+}
+
+#if DROY_MATH_X86
+#define DROY_AVX2 __attribute__((target("avx2")))
+
+DROY_AVX2 static inline double droy_sum_f64_avx2(const double* items, int length) {
+  __m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= length; i += 8) {
+    a = _mm256_add_pd(a, _mm256_loadu_pd(items + i));
+    b = _mm256_add_pd(b, _mm256_loadu_pd(items + i + 4));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(a, b));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + droy_sum_f64_scalar(items + i, length - i);
+}
+
+static inline double droy_sum_f64_sse2(const double* items, int length) {
+  __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= length; i += 4) {
+    a = _mm_add_pd(a, _mm_loadu_pd(items + i));
+    b = _mm_add_pd(b, _mm_loadu_pd(items + i + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(a, b));
+  return lanes[0] + lanes[1] + droy_sum_f64_scalar(items + i, length - i);
+}
+
+DROY_AVX2 static inline long long droy_sum_i32_avx2(const int* items, int length) {
+  __m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= length; i += 8) {
+    a = _mm256_add_epi64(a, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(items + i))));
+    b = _mm256_add_epi64(b, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(items + i + 4))));
+  }
+  long long lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(a, b));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + droy_sum_i32_scalar(items + i, length - i);
+}
+
+static inline long long droy_sum_i32_sse2(const int* items, int length) {
+  __m128i total = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(items + i));
+    __m128i sign = _mm_srai_epi32(x, 31);
+    total = _mm_add_epi64(total, _mm_unpacklo_epi32(x, sign));
+    total = _mm_add_epi64(total, _mm_unpackhi_epi32(x, sign));
+  }
+  long long lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, total);
+  return lanes[0] + lanes[1] + droy_sum_i32_scalar(items + i, length - i);
+}
+
+/* Lanes keep their own extreme; NaNs are tracked apart, since the min/max
+   instructions do not propagate them */
+#define DROY_EXTREME_F64_AVX2(name, op, sign) \\
+  DROY_AVX2 static inline double name(const double* items, int length) { \\
+    __m256d result = _mm256_set1_pd(items[0]), nan = _mm256_setzero_pd(); \\
+    int i = 0; \\
+    for (; i + 4 <= length; i += 4) { \\
+      __m256d x = _mm256_loadu_pd(items + i); \\
+      nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q)); \\
+      result = op(result, x); \\
+    } \\
+    if (_mm256_movemask_pd(nan)) return NAN; \\
+    double lanes[4]; \\
+    _mm256_storeu_pd(lanes, result); \\
+    return droy_extreme_f64_from(droy_extreme_f64_from(lanes[0], lanes + 1, 3, sign), items + i, length - i, sign); \\
+  }
+
+#define DROY_EXTREME_F64_SSE2(name, op, sign) \\
+  static inline double name(const double* items, int length) { \\
+    __m128d result = _mm_set1_pd(items[0]), nan = _mm_setzero_pd(); \\
+    int i = 0; \\
+    for (; i + 2 <= length; i += 2) { \\
+      __m128d x = _mm_loadu_pd(items + i); \\
+      nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x)); \\
+      result = op(result, x); \\
+    } \\
+    if (_mm_movemask_pd(nan)) return NAN; \\
+    double lanes[2]; \\
+    _mm_storeu_pd(lanes, result); \\
+    return droy_extreme_f64_from(droy_extreme_f64_from(lanes[0], lanes + 1, 1, sign), items + i, length - i, sign); \\
+  }
+
+#define DROY_EXTREME_I32_AVX2(name, op, sign) \\
+  DROY_AVX2 static inline int name(const int* items, int length) { \\
+    __m256i result = _mm256_set1_epi32(items[0]); \\
+    int i = 0; \\
+    for (; i + 8 <= length; i += 8) result = op(result, _mm256_loadu_si256((const __m256i*)(items + i))); \\
+    int lanes[8]; \\
+    _mm256_storeu_si256((__m256i*)lanes, result); \\
+    return droy_extreme_i32_from(droy_extreme_i32_from(lanes[0], lanes + 1, 7, sign), items + i, length - i, sign); \\
+  }
+
+/* SSE2 has no 32-bit min/max; a compare picks each lane */
+#define DROY_EXTREME_I32_SSE2(name, sign) \\
+  static inline int name(const int* items, int length) { \\
+    __m128i result = _mm_set1_epi32(items[0]); \\
+    int i = 0; \\
+    for (; i + 4 <= length; i += 4) { \\
+      __m128i x = _mm_loadu_si128((const __m128i*)(items + i)); \\
+      __m128i take = sign > 0 ? _mm_cmplt_epi32(x, result) : _mm_cmpgt_epi32(x, result); \\
+      result = _mm_or_si128(_mm_and_si128(take, x), _mm_andnot_si128(take, result)); \\
+    } \\
+    int lanes[4]; \\
+    _mm_storeu_si128((__m128i*)lanes, result); \\
+    return droy_extreme_i32_from(droy_extreme_i32_from(lanes[0], lanes + 1, 3, sign), items + i, length - i, sign); \\
+  }
+
+DROY_EXTREME_F64_AVX2(droy_min_f64_avx2, _mm256_min_pd, 1)
+DROY_EXTREME_F64_AVX2(droy_max_f64_avx2, _mm256_max_pd, -1)
+DROY_EXTREME_F64_SSE2(droy_min_f64_sse2, _mm_min_pd, 1)
+DROY_EXTREME_F64_SSE2(droy_max_f64_sse2, _mm_max_pd, -1)
+DROY_EXTREME_I32_AVX2(droy_min_i32_avx2, _mm256_min_epi32, 1)
+DROY_EXTREME_I32_AVX2(droy_max_i32_avx2, _mm256_max_epi32, -1)
+DROY_EXTREME_I32_SSE2(droy_min_i32_sse2, 1)
+DROY_EXTREME_I32_SSE2(droy_max_i32_sse2, -1)
+
+#define DROY_MATH_KERNEL(name, ...) \\
+  (__builtin_cpu_supports("avx2") ? name##_avx2(__VA_ARGS__) : name##_sse2(__VA_ARGS__))
+
+#elif DROY_MATH_NEON
+static inline double droy_sum_f64_neon(const double* items, int length) {
+  float64x2_t a = vdupq_n_f64(0), b = vdupq_n_f64(0);
+  int i = 0;
+  for (; i + 4 <= length; i += 4) {
+    a = vaddq_f64(a, vld1q_f64(items + i));
+    b = vaddq_f64(b, vld1q_f64(items + i + 2));
+  }
+  return vaddvq_f64(vaddq_f64(a, b)) + droy_sum_f64_scalar(items + i, length - i);
+}
+
+static inline long long droy_sum_i32_neon(const int* items, int length) {
+  int64x2_t total = vdupq_n_s64(0);
+  int i = 0;
+  for (; i + 4 <= length; i += 4) total = vpadalq_s32(total, vld1q_s32(items + i));
+  return vaddvq_s64(total) + droy_sum_i32_scalar(items + i, length - i);
+}
+
+/* FMIN/FMAX give NaN when either operand is NaN, so no tracking is needed */
+#define DROY_EXTREME_NEON(name, T, vector, load, op, fold, from, lanes, sign) \\
+  static inline T name(const T* items, int length) { \\
+    vector result = vdupq_n_##lanes(items[0]); \\
+    int i = 0; \\
+    for (; i + (int)(16 / sizeof(T)) <= length; i += 16 / sizeof(T)) result = op(result, load(items + i)); \\
+    return from(fold(result), items + i, length - i, sign); \\
+  }
+
+DROY_EXTREME_NEON(droy_min_f64_neon, double, float64x2_t, vld1q_f64, vminq_f64, vminvq_f64, droy_extreme_f64_from, f64, 1)
+DROY_EXTREME_NEON(droy_max_f64_neon, double, float64x2_t, vld1q_f64, vmaxq_f64, vmaxvq_f64, droy_extreme_f64_from, f64, -1)
+DROY_EXTREME_NEON(droy_min_i32_neon, int, int32x4_t, vld1q_s32, vminq_s32, vminvq_s32, droy_extreme_i32_from, s32, 1)
+DROY_EXTREME_NEON(droy_max_i32_neon, int, int32x4_t, vld1q_s32, vmaxq_s32, vmaxvq_s32, droy_extreme_i32_from, s32, -1)
+
+#define DROY_MATH_KERNEL(name, ...) name##_neon(__VA_ARGS__)
+#else
+#define DROY_MATH_KERNEL(name, ...) name##_scalar(__VA_ARGS__)
+#endif
+
+/* Empty arrays sum to 0; their min or max ends the program, as it fails in
+   the VM */
+static inline void droy_empty_extreme(const char* name) {
+  fprintf(stderr, "droy: %s of an empty array\\n", name);
+  exit(1);
+}
+
+static inline double droy_sum_f64(const double* items, int length) {
+  return DROY_MATH_KERNEL(droy_sum_f64, items, length);
+}
+static inline long long droy_sum_i32(const int* items, int length) {
+  return DROY_MATH_KERNEL(droy_sum_i32, items, length);
+}
+static inline double droy_min_f64(const double* items, int length) {
+  if (length < 1) droy_empty_extreme("min");
+  return DROY_MATH_KERNEL(droy_min_f64, items, length);
+}
+static inline double droy_max_f64(const double* items, int length) {
+  if (length < 1) droy_empty_extreme("max");
+  return DROY_MATH_KERNEL(droy_max_f64, items, length);
+}
+static inline int droy_min_i32(const int* items, int length) {
+  if (length < 1) droy_empty_extreme("min");
+  return DROY_MATH_KERNEL(droy_min_i32, items, length);
+}
+static inline int droy_max_i32(const int* items, int length) {
+  if (length < 1) droy_empty_extreme("max");
+  return DROY_MATH_KERNEL(droy_max_i32, items, length);
+}
+
+/* min/max of several numbers; NaN wins */
+static inline double droy_min2_f64(double a, double b) { return a != a || a < b ? a : b; }
+static inline double droy_max2_f64(double a, double b) { return a != a || a > b ? a : b; }
+static inline int droy_min2_i32(int a, int b) { return a < b ? a : b; }
+static inline int droy_max2_i32(int a, int b) { return a > b ? a : b; }
+`,
+};
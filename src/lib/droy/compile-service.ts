@@ -0,0 +1,134 @@
+// Droy Language - Off-main-thread compile service
+// Runs DroyCompilerV3 in a Web Worker. Every request carries a version; when
+// a newer request arrives the older ones are dropped, either in the worker's
+// queue or when their result comes back. A dropped request that asked to run
+// the program is carried over to the newer one. The worker only sends the UI
+// fragments that changed; the service keeps the rest. A compile can also run
+// the program on the bytecode VM and return what it printed, and record
+// per-phase timings and sizes.
+
+import { applyUIPatch, type TokenType, type UIFragment, type UIPatch } from './compiler-v3';
+import { TokenBuffer, type TokenBufferData } from './token-buffer';
+import { outputBytes, type CompileStats } from './trace';
+
+export interface CompileOptions {
+  // Also run the program and collect its printed output
+  run?: boolean;
+  // Also time the phases and count what they produced
+  stats?: boolean;
+}
+
+export interface CompileRequest extends CompileOptions {
+  version: number;
+  source: string;
+}
+
+export interface CompileResponse {
+  version: number;
+  tokens: TokenBufferData<TokenType>;
+  // Null when parsing or generation failed
+  patch: UIPatch | null;
+  // Set when parsing or generation failed; the tokens are still valid
+  error: string | null;
+  // What the program printed, ending with its runtime error if it had one;
+  // null unless the request asked to run it
+  output: string | null;
+  // Null unless the request asked for stats
+  stats: CompileStats | null;
+}
+
+export interface CompileResult {
+  version: number;
+  source: string;
+  tokens: TokenBuffer<TokenType>;
+  html: string;
+  css: string;
+  js: string;
+  // What html and css are joined from, in document order
+  fragments: UIFragment[];
+  rules: string[];
+  error: string | null;
+  output: string | null;
+  stats: CompileStats | null;
+}
+
+interface PendingRequest extends CompileOptions {
+  source: string;
+  // The caller of this request, and of superseded ones that carried over
+  waiters: Array<{ resolve: (result: CompileResult | null) => void; reject: (error: Error) => void }>;
+}
+
+export class CompileService {
+  private worker: Worker;
+  private version: number = 0;
+  private pending = new Map<number, PendingRequest>();
+  private fragments = new Map<string, UIFragment>();
+
+  constructor() {
+    this.worker = new Worker(new URL('./compile.worker.ts', import.meta.url), { type: 'module' });
+    this.worker.onmessage = (event: MessageEvent<CompileResponse>) => this.receive(event.data);
+    this.worker.onerror = (event) => this.fail(new Error(event.message || 'Compile worker crashed'));
+  }
+
+  // Resolves with the result, or with null when a newer compile superseded
+  // it. A request that runs the program or records stats is not dropped:
+  // the newer compile does that too, and both resolve with its result.
+  public compile(source: string, options: CompileOptions = {}): Promise<CompileResult | null> {
+    const version = ++this.version;
+    const next: PendingRequest = { source, run: options.run, stats: options.stats, waiters: [] };
+    for (const request of this.pending.values()) {
+      if (request.run || request.stats) {
+        next.run ||= request.run;
+        next.stats ||= request.stats;
+        next.waiters.push(...request.waiters);
+      } else {
+        for (const waiter of request.waiters) waiter.resolve(null);
+      }
+    }
+    this.pending.clear();
+
+    return new Promise((resolve, reject) => {
+      next.waiters.push({ resolve, reject });
+      this.pending.set(version, next);
+      const request: CompileRequest = { version, source, run: next.run, stats: next.stats };
+      this.worker.postMessage(request);
+    });
+  }
+
+  public dispose(): void {
+    this.worker.terminate();
+    for (const request of this.pending.values()) {
+      for (const waiter of request.waiters) waiter.resolve(null);
+    }
+    this.pending.clear();
+  }
+
+  private receive(response: CompileResponse): void {
+    // Patches build on each other, so stale ones are applied too
+    const output = response.patch
+      ? applyUIPatch(this.fragments, response.patch)
+      : { html: '', css: '', js: '', fragments: [], rules: [] };
+
+    const request = this.pending.get(response.version);
+    if (!request) return;
+
+    this.pending.delete(response.version);
+    const result: CompileResult = {
+      version: response.version,
+      source: request.source,
+      tokens: TokenBuffer.fromData(request.source, response.tokens),
+      ...output,
+      error: response.error,
+      output: response.output,
+      stats: response.stats && { ...response.stats, output: outputBytes(output) },
+    };
+    for (const waiter of request.waiters) waiter.resolve(result);
+  }
+
+  private fail(error: Error): void {
+    for (const request of this.pending.values()) {
+      for (const waiter of request.waiters) waiter.reject(error);
+    }
+    this.pending.clear();
+  }
+}
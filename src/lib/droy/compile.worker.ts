@@ -0,0 +1,114 @@
+// Droy Language - Compile worker
+// Lexes into a compact TokenBuffer and transfers its arrays back, so the
+// token stream is never structured-cloned, and sends the generated UI as a
+// patch of changed fragments. A worker serves one document: its lexer keeps
+// the last source, so an edit is re-lexed from the lines it touches, and the
+// parser is told which tokens around it stayed the same. Requests that arrive while a compile is
+// running replace each other; only the newest is compiled next. Requests
+// that ask to run the program execute it on the bytecode VM, and requests
+// that ask for stats are traced phase by phase.
+
+import {
+  DroyLexerV3,
+  DroyParserV3,
+  DroyUIGeneratorV3,
+  computeEdit,
+  type ASTNode,
+  type TokenType,
+  type UIPatch,
+} from './compiler-v3';
+import type { CompileRequest, CompileResponse } from './compile-service';
+import { DroyOptimizer } from './optimizer';
+import { TokenBuffer } from './token-buffer';
+import { CompileTrace, compileStats, type CompileStats } from './trace';
+import { runDroy } from './vm';
+
+// Calls and loop iterations a run may take, so a runaway loop fails instead
+// of stalling every later compile
+const RUN_STEP_LIMIT = 10_000_000;
+
+let next: CompileRequest | null = null;
+let scheduled = false;
+// Kept between requests so unchanged lines are not lexed, and unchanged
+// statements not parsed, optimized or generated, again
+let lexer: DroyLexerV3 | null = null;
+let lexed: TokenBuffer<TokenType> | null = null;
+let parser: DroyParserV3 | null = null;
+const optimizer = new DroyOptimizer();
+const generator = new DroyUIGeneratorV3();
+
+function compile(request: CompileRequest): void {
+  const trace = request.stats ? new CompileTrace() : null;
+  const time = <T>(phase: string, step: () => T): T => (trace ? trace.time(phase, 'phase', step) : step());
+  const previous = lexed;
+  const tokens = time('lex', () => lex(request.source));
+  let patch: UIPatch | null = null;
+  let error: string | null = null;
+  let output: string | null = null;
+  let stats: CompileStats | null = null;
+
+  generator.setTrace(trace);
+  try {
+    const window = tokens === previous ? { prefix: tokens.length, suffix: 0 } : lexer!.getReusedWindow();
+    const edit = previous ? { previous, window } : undefined;
+    const parsed = time('parse', () => (parser ? parser.reparse(tokens, edit) : (parser = new DroyParserV3(tokens)).parse()));
+    const ast = time('optimize', () => optimizer.optimize(parsed));
+    patch = time('generate', () => generator.generatePatch(ast));
+    if (trace) {
+      trace.cache.lexer.total = tokens.length;
+      trace.cache.lexer.reused = tokens === previous ? tokens.length : tokens.length - lexer!.getScannedTokenCount();
+      trace.cache.parser.total = parsed.body.length;
+      trace.cache.parser.reused = parser.getReusedStatementCount();
+      // The output is sized by the service, which has all of it once the patch is applied
+      stats = compileStats(trace, { tokens: tokens.length, ast: parsed, html: '', css: '', js: '' });
+    }
+    if (request.run) {
+      output = run(ast);
+    }
+  } catch (err) {
+    error = String(err);
+  } finally {
+    generator.setTrace(null);
+  }
+
+  const data = tokens.toData();
+  const response: CompileResponse = { version: request.version, tokens: data, patch, error, output, stats };
+  self.postMessage(response, { transfer: TokenBuffer.transferList(data) });
+}
+
+function lex(source: string): TokenBuffer<TokenType> {
+  if (!lexer || !lexed) {
+    lexer = new DroyLexerV3(source);
+    return (lexed = lexer.tokenizeCompact());
+  }
+  const edit = computeEdit(lexer.getSource(), source);
+  if (edit) lexed = lexer.retokenizeCompact(lexed, edit);
+  return lexed;
+}
+
+function run(ast: ASTNode): string {
+  const lines: string[] = [];
+  try {
+    runDroy(ast, { print: (line) => lines.push(`${line}\n`), maxSteps: RUN_STEP_LIMIT });
+  } catch (err) {
+    lines.push(`Runtime error: ${err instanceof Error ? err.message : String(err)}\n`);
+  }
+  return lines.join('');
+}
+
+function drain(): void {
+  scheduled = false;
+  const request = next;
+  next = null;
+  if (request) {
+    compile(request);
+  }
+}
+
+self.onmessage = (event: MessageEvent<CompileRequest>) => {
+  next = event.data;
+  if (!scheduled) {
+    scheduled = true;
+    setTimeout(drain, 0);
+  }
+};
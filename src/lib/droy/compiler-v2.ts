@@ -2,6 +2,18 @@
 // Supports ultra-short syntax and UI/Media concepts
 // New syntax: set = print: hello, ~ui btn: "Click", ~img: "url", ~color: #ff0000
 
+import {
+  CharCode,
+  DroyScanner,
+  KeywordTable,
+  isAlpha,
+  isDigit,
+  isIdentStart,
+  isWhitespace,
+} from './scanner';
+import { tokenSet, type ASTNode, type TokenSet, type Token as SharedToken } from './ast';
+import { DroyParserCore } from './parser';
+
 export type TokenType = 
   // Core
   | 'SET' | 'GET' | 'VAR' | 'FUNC' | 'RETURN' | 'IF' | 'ELSE' | 'FOR' | 'WHILE'
@@ -29,30 +41,16 @@ export type TokenType =
   | 'COMMA' | 'COLON' | 'SEMICOLON' | 'PIPE' | 'ARROW' | 'FAT_ARROW'
   | 'COMMENT' | 'NEWLINE' | 'EOF' | 'TILDE' | 'AT' | 'HASH' | 'DOLLAR';
 
-export interface Token {
-  type: TokenType;
-  value: string;
-  line: number;
-  column: number;
-}
+export type Token = SharedToken<TokenType>;
 
-export interface ASTNode {
-  type: string;
-  [key: string]: any;
-}
+export type { ASTNode };
 
 // ============================================
 // LEXER - Tokenizer
 // ============================================
-export class DroyLexerV2 {
-  private source: string;
-  private position: number = 0;
-  private line: number = 1;
-  private column: number = 1;
-  private tokens: Token[] = [];
-
+export class DroyLexerV2 extends DroyScanner<TokenType> {
   // Keywords mapping
-  private keywords: Map<string, TokenType> = new Map([
+  private keywords = new KeywordTable<TokenType>([
     // Core
     ['set', 'SET'], ['get', 'GET'], ['var', 'VAR'], ['func', 'FUNC'],
     ['return', 'RETURN'], ['if', 'IF'], ['else', 'ELSE'],
@@ -85,330 +83,180 @@ export class DroyLexerV2 {
     ['true', 'BOOLEAN'], ['false', 'BOOLEAN'], ['null', 'NULL'],
   ]);
 
-  constructor(source: string) {
-    this.source = source;
-  }
-
-  private peek(offset: number = 0): string {
-    const pos = this.position + offset;
-    return pos < this.source.length ? this.source[pos] : '\0';
-  }
-
-  private advance(): string {
-    const char = this.peek();
-    this.position++;
-    if (char === '\n') {
-      this.line++;
-      this.column = 1;
-    } else {
-      this.column++;
-    }
-    return char;
-  }
-
-  private skipWhitespace(): void {
-    while (/\s/.test(this.peek()) && this.peek() !== '\n') {
-      this.advance();
-    }
-  }
-
-  private readString(quote: string): string {
-    let value = '';
-    this.advance();
-    while (this.peek() !== quote && this.peek() !== '\0') {
-      if (this.peek() === '\\') {
-        this.advance();
-        const escaped = this.advance();
-        switch (escaped) {
-          case 'n': value += '\n'; break;
-          case 't': value += '\t'; break;
-          case 'r': value += '\r'; break;
-          case '\\': value += '\\'; break;
-          case '"': value += '"'; break;
-          case "'": value += "'"; break;
-          default: value += escaped;
-        }
-      } else {
-        value += this.advance();
-      }
-    }
-    this.advance();
-    return value;
-  }
-
-  private readNumber(): string {
-    let value = '';
-    let hasDot = false;
-    while (/[0-9.]/.test(this.peek())) {
-      if (this.peek() === '.') {
-        if (hasDot) break;
-        hasDot = true;
-      }
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private readIdentifier(): string {
-    let value = '';
-    while (/[a-zA-Z0-9_]/.test(this.peek())) {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private readHexColor(): string {
-    let value = '#';
-    this.advance(); // skip #
-    while (/[0-9a-fA-F]/.test(this.peek()) && value.length < 7) {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private readComment(): string {
-    let value = '';
-    while (this.peek() !== '\n' && this.peek() !== '\0') {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private addToken(type: TokenType, value: string): void {
-    this.tokens.push({
-      type,
-      value,
-      line: this.line,
-      column: this.column - value.length,
-    });
-  }
-
   public tokenize(): Token[] {
     while (this.position < this.source.length) {
-      const char = this.peek();
+      const code = this.peekCode();
 
-      // Skip whitespace
-      if (/\s/.test(char) && char !== '\n') {
-        this.skipWhitespace();
+      // Words, blanks and numbers make up most of a source
+      if (isIdentStart(code)) {
+        this.readWord(this.keywords, 'IDENTIFIER');
         continue;
       }
 
-      // Newlines
-      if (char === '\n') {
-        this.addToken('NEWLINE', '\n');
-        this.advance();
+      if (isWhitespace(code)) {
+        this.skipWhitespace();
         continue;
       }
 
-      // Comments
-      if (char === '#') {
-        this.readComment();
+      if (isDigit(code)) {
+        const value = this.readNumber();
+        this.addToken('NUMBER', value);
         continue;
       }
 
-      // Hex colors: #ff0000
-      if (char === '#') {
-        const color = this.readHexColor();
-        this.addToken('HEX_COLOR', color);
-        continue;
-      }
+      // Prefixes, comments and strings are decided by the first char
+      switch (code) {
+        case CharCode.Newline:
+          this.addToken('NEWLINE', '\n');
+          this.advance();
+          continue;
 
-      // Tilde prefix: ~ui, ~btn, ~img, etc.
-      if (char === '~') {
-        this.advance();
-        const next = this.peek();
-        
-        // Check for ~ui, ~btn, etc.
-        if (/[a-zA-Z]/.test(next)) {
-          const word = this.readIdentifier();
-          const keywordType = this.keywords.get(word);
-          if (keywordType) {
-            this.addToken(keywordType, `~${word}`);
+        // Comments
+        case CharCode.Hash:
+          this.skipComment();
+          continue;
+
+        // Tilde prefix: ~ui, ~btn, ~img, etc.
+        case CharCode.Tilde:
+          this.advance();
+          if (isAlpha(this.peekCode())) {
+            this.readWord(this.keywords, 'IDENTIFIER', this.position - 1);
           } else {
-            this.addToken('IDENTIFIER', `~${word}`);
+            this.addToken('TILDE', '~');
           }
           continue;
-        }
-        
-        // ~s, ~g shorthand
-        if (next === 's') {
+
+        // At prefix: @click, @hover, etc.
+        case CharCode.At:
           this.advance();
-          this.addToken('SET', '~s');
+          this.readWord(this.keywords, 'AT', this.position - 1);
           continue;
-        }
-        if (next === 'g') {
+
+        // Dollar prefix: $var
+        case CharCode.Dollar: {
           this.advance();
-          this.addToken('GET', '~g');
+          const word = this.readIdentifier();
+          this.addToken('IDENTIFIER', `$${word}`);
           continue;
         }
-        
-        this.addToken('TILDE', '~');
-        continue;
-      }
 
-      // At prefix: @click, @hover, etc.
-      if (char === '@') {
-        this.advance();
-        const word = this.readIdentifier();
-        const keywordType = this.keywords.get(word);
-        if (keywordType) {
-          this.addToken(keywordType, `@${word}`);
-        } else {
-          this.addToken('AT', `@${word}`);
+        case CharCode.DoubleQuote:
+        case CharCode.SingleQuote: {
+          const value = this.readString(code);
+          this.addToken('STRING', value);
+          continue;
         }
-        continue;
-      }
-
-      // Dollar prefix: $var
-      if (char === '$') {
-        this.advance();
-        const word = this.readIdentifier();
-        this.addToken('IDENTIFIER', `$${word}`);
-        continue;
-      }
-
-      // Strings
-      if (char === '"' || char === "'") {
-        const value = this.readString(char);
-        this.addToken('STRING', value);
-        continue;
-      }
-
-      // Numbers
-      if (/[0-9]/.test(char)) {
-        const value = this.readNumber();
-        this.addToken('NUMBER', value);
-        continue;
-      }
-
-      // Identifiers and keywords
-      if (/[a-zA-Z_]/.test(char)) {
-        const value = this.readIdentifier();
-        const type = this.keywords.get(value) || 'IDENTIFIER';
-        this.addToken(type, value);
-        continue;
       }
 
       // Operators and punctuation
-      switch (char) {
-        case '+':
-          this.advance();
-          if (this.peek() === '=') {
+      this.advance();
+      const next = this.peekCode();
+      switch (code) {
+        case CharCode.Plus:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '+=');
           } else {
             this.addToken('PLUS', '+');
           }
           break;
-        case '-':
-          this.advance();
-          if (this.peek() === '>') {
+        case CharCode.Minus:
+          if (next === CharCode.GreaterThan) {
             this.advance();
             this.addToken('ARROW', '->');
-          } else if (this.peek() === '=') {
+          } else if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '-=');
           } else {
             this.addToken('MINUS', '-');
           }
           break;
-        case '*':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Asterisk:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '*=');
           } else {
             this.addToken('MULTIPLY', '*');
           }
           break;
-        case '/':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Slash:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '/=');
-          } else if (this.peek() === '/') {
-            this.readComment();
+          } else if (next === CharCode.Slash) {
+            this.skipComment();
           } else {
             this.addToken('DIVIDE', '/');
           }
           break;
-        case '%':
-          this.advance();
+        case CharCode.Percent:
           this.addToken('MODULO', '%');
           break;
-        case '=':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Equals:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('EQ', '==');
-          } else if (this.peek() === '>') {
+          } else if (next === CharCode.GreaterThan) {
             this.advance();
             this.addToken('FAT_ARROW', '=>');
           } else {
             this.addToken('ASSIGN', '=');
           }
           break;
-        case ':':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Colon:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('COLON_ASSIGN', ':=');
           } else {
             this.addToken('COLON', ':');
           }
           break;
-        case '!':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Exclamation:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('NEQ', '!=');
           } else {
             this.addToken('NOT', '!');
           }
           break;
-        case '<':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.LessThan:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('LTE', '<=');
-          } else if (this.peek() === '-') {
+          } else if (next === CharCode.Minus) {
             this.advance();
             this.addToken('ARROW_ASSIGN', '<-');
           } else {
             this.addToken('LT', '<');
           }
           break;
-        case '>':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.GreaterThan:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('GTE', '>=');
           } else {
             this.addToken('GT', '>');
           }
           break;
-        case '&':
-          this.advance();
-          if (this.peek() === '&') {
+        case CharCode.Ampersand:
+          if (next === CharCode.Ampersand) {
             this.advance();
             this.addToken('AND', '&&');
           }
           break;
-        case '|':
-          this.advance();
-          if (this.peek() === '|') {
+        case CharCode.Pipe:
+          if (next === CharCode.Pipe) {
             this.advance();
             this.addToken('OR', '||');
-          } else if (this.peek() === '>') {
+          } else if (next === CharCode.GreaterThan) {
             this.advance();
             this.addToken('PIPE', '|>');
           } else {
             this.addToken('PIPE', '|');
           }
           break;
-        case '.':
-          this.advance();
-          if (this.peek() === '.' && this.peek(1) === '.') {
+        case CharCode.Dot:
+          if (next === CharCode.Dot && this.peekCode(1) === CharCode.Dot) {
             this.advance();
             this.advance();
             this.addToken('SPREAD', '...');
@@ -416,40 +264,30 @@ export class DroyLexerV2 {
             this.addToken('DOT', '.');
           }
           break;
-        case '(':
-          this.advance();
+        case CharCode.OpenParen:
           this.addToken('LPAREN', '(');
           break;
-        case ')':
-          this.advance();
+        case CharCode.CloseParen:
           this.addToken('RPAREN', ')');
           break;
-        case '{':
-          this.advance();
+        case CharCode.OpenBrace:
           this.addToken('LBRACE', '{');
           break;
-        case '}':
-          this.advance();
+        case CharCode.CloseBrace:
           this.addToken('RBRACE', '}');
           break;
-        case '[':
-          this.advance();
+        case CharCode.OpenBracket:
           this.addToken('LBRACKET', '[');
           break;
-        case ']':
-          this.advance();
+        case CharCode.CloseBracket:
           this.addToken('RBRACKET', ']');
           break;
-        case ',':
-          this.advance();
+        case CharCode.Comma:
           this.addToken('COMMA', ',');
           break;
-        case ';':
-          this.advance();
+        case CharCode.Semicolon:
           this.addToken('SEMICOLON', ';');
           break;
-        default:
-          this.advance();
       }
     }
 
@@ -458,42 +296,37 @@ export class DroyLexerV2 {
   }
 }
 
+const UI_COMPONENTS = tokenSet<TokenType>(
+  'BTN', 'IMG', 'IMAGE', 'VIDEO', 'AUDIO', 'ICON', 'COLOR', 'BG', 'BACKGROUND', 'TEXT',
+  'TITLE', 'SUBTITLE', 'CONTAINER', 'GRID', 'FLEX', 'ROW', 'COL', 'COLUMN', 'CARD',
+  'MODAL', 'TOAST', 'TOOLTIP'
+);
+const EVENT_TOKENS = tokenSet<TokenType>(
+  'CLICK', 'HOVER', 'FOCUS', 'BLUR', 'KEYDOWN', 'KEYUP', 'SUBMIT', 'CHANGE', 'ON', 'OFF'
+);
+const ANIMATION_TOKENS = tokenSet<TokenType>('ANIMATE', 'TRANSITION');
+const LAYOUT_PROPERTIES = tokenSet<TokenType>(
+  'WIDTH', 'HEIGHT', 'PADDING', 'MARGIN', 'BORDER', 'RADIUS', 'SHADOW', 'OPACITY', 'SIZE',
+  'POSITION', 'TOP', 'LEFT', 'RIGHT', 'BOTTOM'
+);
+// Actions of the short form `set = print: hello`
+const SET_ACTIONS = tokenSet<TokenType>('PRINT', 'INPUT', 'VAR', 'FUNC');
+// Props spelled like keywords: `~card width: 200`
+const INLINE_STYLE_PROPS = tokenSet<TokenType>('WIDTH', 'HEIGHT', 'COLOR', 'BG', 'BACKGROUND');
+const EQUALITY_OPERATORS = tokenSet<TokenType>('EQ', 'NEQ');
+const COMPARISON_OPERATORS = tokenSet<TokenType>('LT', 'GT', 'LTE', 'GTE');
+const ADDITIVE_OPERATORS = tokenSet<TokenType>('PLUS', 'MINUS');
+const MULTIPLICATIVE_OPERATORS = tokenSet<TokenType>('MULTIPLY', 'DIVIDE', 'MODULO');
+const UNARY_OPERATORS = tokenSet<TokenType>('NOT', 'MINUS');
+// Words read as a variable in expressions
+const IDENTIFIER_TOKENS = tokenSet<TokenType>('GET', 'IDENTIFIER');
+
 // ============================================
 // PARSER - AST Builder
 // ============================================
-export class DroyParserV2 {
-  private tokens: Token[];
-  private position: number = 0;
-
+export class DroyParserV2 extends DroyParserCore<TokenType> {
   constructor(tokens: Token[]) {
-    this.tokens = tokens;
-  }
-
-  private peek(offset: number = 0): Token {
-    const pos = this.position + offset;
-    return pos < this.tokens.length ? this.tokens[pos] : this.tokens[this.tokens.length - 1];
-  }
-
-  private advance(): Token {
-    return this.tokens[this.position++];
-  }
-
-  private expect(type: TokenType): Token {
-    const token = this.advance();
-    if (token.type !== type) {
-      throw new Error(`Expected ${type} but got ${token.type} at line ${token.line}`);
-    }
-    return token;
-  }
-
-  private match(...types: TokenType[]): boolean {
-    return types.includes(this.peek().type);
-  }
-
-  private skipNewlines(): void {
-    while (this.match('NEWLINE')) {
-      this.advance();
-    }
+    super(tokens);
   }
 
   public parse(): ASTNode {
@@ -523,21 +356,17 @@ export class DroyParserV2 {
     }
 
     // UI components: ~btn, ~img, ~color, etc.
-    if (this.match('BTN', 'IMG', 'IMAGE', 'VIDEO', 'AUDIO', 'ICON', 
-                   'COLOR', 'BG', 'BACKGROUND', 'TEXT', 'TITLE', 'SUBTITLE',
-                   'CONTAINER', 'GRID', 'FLEX', 'ROW', 'COL', 'COLUMN',
-                   'CARD', 'MODAL', 'TOAST', 'TOOLTIP')) {
+    if (this.matchAny(UI_COMPONENTS)) {
       return this.parseUIComponent();
     }
 
     // Events: @click, @hover, etc.
-    if (this.match('CLICK', 'HOVER', 'FOCUS', 'BLUR', 'KEYDOWN', 'KEYUP', 
-                   'SUBMIT', 'CHANGE', 'ON', 'OFF')) {
+    if (this.matchAny(EVENT_TOKENS)) {
       return this.parseEventHandler();
     }
 
     // Animation
-    if (this.match('ANIMATE', 'TRANSITION')) {
+    if (this.matchAny(ANIMATION_TOKENS)) {
       return this.parseAnimation();
     }
 
@@ -558,9 +387,7 @@ export class DroyParserV2 {
     if (this.match('REF')) return this.parseRef();
 
     // Layout properties
-    if (this.match('WIDTH', 'HEIGHT', 'PADDING', 'MARGIN', 'BORDER', 
-                   'RADIUS', 'SHADOW', 'OPACITY', 'SIZE', 'POSITION',
-                   'TOP', 'LEFT', 'RIGHT', 'BOTTOM')) {
+    if (this.matchAny(LAYOUT_PROPERTIES)) {
       return this.parseLayoutProperty();
     }
 
@@ -581,7 +408,7 @@ export class DroyParserV2 {
       this.advance();
       
       // Check for: = print: value
-      if (this.match('PRINT', 'INPUT', 'VAR', 'FUNC')) {
+      if (this.matchAny(SET_ACTIONS)) {
         const action = this.advance().value;
         
         if (this.match('COLON')) {
@@ -647,7 +474,7 @@ export class DroyParserV2 {
         props.text = this.advance().value;
       } else if (this.match('HEX_COLOR')) {
         props.color = this.advance().value;
-      } else if (this.match('WIDTH', 'HEIGHT', 'COLOR', 'BG', 'BACKGROUND')) {
+      } else if (this.matchAny(INLINE_STYLE_PROPS)) {
         const key = this.advance().value.toLowerCase();
         if (this.match('COLON')) {
           this.advance();
@@ -1031,7 +858,7 @@ export class DroyParserV2 {
   private parseEquality(): ASTNode {
     let left = this.parseComparison();
     
-    while (this.match('EQ', 'NEQ')) {
+    while (this.matchAny(EQUALITY_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseComparison();
       left = {
@@ -1048,7 +875,7 @@ export class DroyParserV2 {
   private parseComparison(): ASTNode {
     let left = this.parseAdditive();
     
-    while (this.match('LT', 'GT', 'LTE', 'GTE')) {
+    while (this.matchAny(COMPARISON_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseAdditive();
       left = {
@@ -1065,7 +892,7 @@ export class DroyParserV2 {
   private parseAdditive(): ASTNode {
     let left = this.parseMultiplicative();
     
-    while (this.match('PLUS', 'MINUS')) {
+    while (this.matchAny(ADDITIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseMultiplicative();
       left = {
@@ -1082,7 +909,7 @@ export class DroyParserV2 {
   private parseMultiplicative(): ASTNode {
     let left = this.parseUnary();
     
-    while (this.match('MULTIPLY', 'DIVIDE', 'MODULO')) {
+    while (this.matchAny(MULTIPLICATIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseUnary();
       left = {
@@ -1097,7 +924,7 @@ export class DroyParserV2 {
   }
 
   private parseUnary(): ASTNode {
-    if (this.match('NOT', 'MINUS')) {
+    if (this.matchAny(UNARY_OPERATORS)) {
       const op = this.advance().value;
       const operand = this.parseUnary();
       return {
@@ -1175,7 +1002,7 @@ export class DroyParserV2 {
       };
     }
     
-    if (this.match('GET', 'IDENTIFIER')) {
+    if (this.matchAny(IDENTIFIER_TOKENS)) {
       const name = this.advance().value;
       return {
         type: 'Identifier',
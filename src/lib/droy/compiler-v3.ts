@@ -2,6 +2,28 @@
 // Advanced concepts: SET/SETUP naming, TOOL, GET_SET, Color Blending, DATA, SERVER
 // Syntax: set=topbar=s+d, setup=get: sty, tool=get:, value-set=(a=1,s=2,c+s=3)
 
+import {
+  CharCode,
+  DroyScanner,
+  KeywordTable,
+  isAlpha,
+  isDigit,
+  isHexDigit,
+  isIdentStart,
+  isWhitespace,
+} from './scanner';
+import { TokenArray, TokenBuffer, TokenKinds, type TokenStream } from './token-buffer';
+import { tokenSet, type ASTNode, type KeyframeStep, type TokenSet, type Token as SharedToken } from './ast';
+import { DroyParserCore } from './parser';
+import { writeUIChunks, type UIChunk, type UIPart, type UISink } from './ui-sink';
+import { DroyOptimizer, type DroyOptimizerOptions } from './optimizer';
+import { runDroy, type DroyRunResult, type DroyVMOptions } from './vm';
+import { REACTIVE_RUNTIME, jsExpression, jsHandler, jsName, jsObject, jsRequest } from './reactive';
+import { ROUTER_RUNTIME, attributeValue, routeSection } from './router';
+import { MEDIA_RUNTIME, pixels, responsiveImage, sizeAttributes, type DroyMediaOptions } from './media';
+import { DroyModuleGraph, type DroyModuleHost } from './modules';
+import { CompileTrace, compileStats, type CompileStats } from './trace';
+
 export type TokenType = 
   // Core
   | 'SET' | 'GET' | 'VAR' | 'FUNC' | 'RETURN' | 'IF' | 'ELSE' | 'FOR' | 'WHILE'
@@ -56,29 +78,91 @@ export type TokenType =
   | 'COMMENT' | 'NEWLINE' | 'EOF' | 'TILDE' | 'AT' | 'HASH' | 'DOLLAR'
   | 'QUESTION' | 'EXCLAMATION' | 'PERCENT' | 'AMPERSAND';
 
-export interface Token {
-  type: TokenType;
-  value: string;
-  line: number;
-  column: number;
+export type Token = SharedToken<TokenType>;
+
+// Kind ids shared by every compact token buffer of this version
+const TOKEN_KINDS = new TokenKinds<TokenType>();
+
+export type { ASTNode, KeyframeStep };
+
+// Token counts at the start and end of a re-lexed stream that are the same
+// tokens as in the stream before the edit
+export interface LexWindow {
+  prefix: number;
+  suffix: number;
+}
+
+// A single text change: `removedLength` characters at `offset` were replaced
+// by `insertedText`.
+export interface LexEdit {
+  offset: number;
+  removedLength: number;
+  insertedText: string;
+}
+
+// Smallest single edit turning `previous` into `next`, or null if they match.
+export function computeEdit(previous: string, next: string): LexEdit | null {
+  const limit = Math.min(previous.length, next.length);
+  let prefix = 0;
+  while (prefix < limit && previous.charCodeAt(prefix) === next.charCodeAt(prefix)) {
+    prefix++;
+  }
+  if (prefix === previous.length && prefix === next.length) return null;
+
+  let suffix = 0;
+  while (suffix < limit - prefix &&
+         previous.charCodeAt(previous.length - 1 - suffix) === next.charCodeAt(next.length - 1 - suffix)) {
+    suffix++;
+  }
+
+  return {
+    offset: prefix,
+    removedLength: previous.length - prefix - suffix,
+    insertedText: next.slice(prefix, next.length - suffix),
+  };
+}
+
+function countNewlines(text: string, from: number, to: number): number {
+  let count = 0;
+  let index = text.indexOf('\n', from);
+  while (index !== -1 && index < to) {
+    count++;
+    index = text.indexOf('\n', index + 1);
+  }
+  return count;
+}
+
+function lineStartBefore(text: string, position: number): number {
+  return position <= 0 ? 0 : text.lastIndexOf('\n', position - 1) + 1;
+}
+
+// What re-lexing reads of a previous token stream, plain or compact
+type LineTokens = Pick<TokenBuffer<TokenType>, 'length' | 'type' | 'line'>;
+
+// Index of the first token on or after `line` (tokens are ordered by line).
+function firstTokenOnLine(tokens: LineTokens, line: number): number {
+  let low = 0;
+  let high = tokens.length;
+  while (low < high) {
+    const mid = (low + high) >>> 1;
+    if (tokens.line(mid) < line) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
 }
 
-export interface ASTNode {
-  type: string;
-  [key: string]: any;
+function isLineEnd(tokens: LineTokens, index: number, line: number): boolean {
+  return tokens.type(index) === 'NEWLINE' && tokens.line(index) === line;
 }
 
 // ============================================
 // LEXER - Tokenizer
 // ============================================
-export class DroyLexerV3 {
-  private source: string;
-  private position: number = 0;
-  private line: number = 1;
-  private column: number = 1;
-  private tokens: Token[] = [];
-
-  private keywords: Map<string, TokenType> = new Map([
+export class DroyLexerV3 extends DroyScanner<TokenType> {
+  private keywords = new KeywordTable<TokenType>([
     // Core
     ['set', 'SET'], ['get', 'GET'], ['var', 'VAR'], ['func', 'FUNC'],
     ['return', 'RETURN'], ['if', 'IF'], ['else', 'ELSE'],
@@ -145,446 +229,668 @@ export class DroyLexerV3 {
     ['watch', 'WATCH'], ['emit', 'EMIT'],
     // Types
     ['str', 'STR'], ['string', 'STRING'], ['bool', 'BOOL'], ['boolean', 'BOOLEAN'],
+    ['true', 'BOOLEAN'], ['false', 'BOOLEAN'],
     ['null', 'NULL'], ['undefined', 'UNDEFINED'],
     ['in', 'IN'], ['of', 'OF'], ['is', 'IS'], ['as', 'AS'],
     // RGB/HSL
     ['rgb', 'RGB'], ['rgba', 'RGBA'], ['hsl', 'HSL'],
   ]);
 
-  constructor(source: string) {
-    this.source = source;
-  }
+  // See getScannedTokenCount() and getReusedWindow()
+  private scanned = 0;
+  private window: LexWindow = { prefix: 0, suffix: 0 };
 
-  private peek(offset: number = 0): string {
-    const pos = this.position + offset;
-    return pos < this.source.length ? this.source[pos] : '\0';
-  }
-
-  private advance(): string {
-    const char = this.peek();
-    this.position++;
-    if (char === '\n') {
-      this.line++;
-      this.column = 1;
-    } else {
-      this.column++;
+  public tokenize(): Token[] {
+    while (this.position < this.source.length) {
+      this.scanToken();
     }
-    return char;
-  }
 
-  private skipWhitespace(): void {
-    while (/\s/.test(this.peek()) && this.peek() !== '\n') {
-      this.advance();
-    }
+    this.addToken('EOF', '');
+    this.scanned = this.buffer ? this.buffer.length : this.tokens.length;
+    this.window = { prefix: 0, suffix: 0 };
+    return this.tokens;
   }
 
-  private readString(quote: string): string {
-    let value = '';
-    this.advance();
-    while (this.peek() !== quote && this.peek() !== '\0') {
-      if (this.peek() === '\\') {
-        this.advance();
-        const escaped = this.advance();
-        switch (escaped) {
-          case 'n': value += '\n'; break;
-          case 't': value += '\t'; break;
-          case 'r': value += '\r'; break;
-          case '\\': value += '\\'; break;
-          case '"': value += '"'; break;
-          case "'": value += "'"; break;
-          default: value += escaped;
-        }
-      } else {
-        value += this.advance();
+  // Same token stream as tokenize(), stored as typed arrays over the source
+  // (roughly one token per four characters, hence the initial capacity).
+  public tokenizeCompact(): TokenBuffer<TokenType> {
+    const buffer = new TokenBuffer<TokenType>(this.source, TOKEN_KINDS, (this.source.length >> 2) + 16);
+    this.buffer = buffer;
+    this.tokenize();
+    this.buffer = null;
+    return buffer;
+  }
+
+  public getSource(): string {
+    return this.source;
+  }
+
+  // Tokens the last tokenize() or retokenize() call scanned; retokenize()
+  // reused the rest of the stream it returned
+  public getScannedTokenCount(): number {
+    return this.scanned;
+  }
+
+  // Tokens at the start and at the end of the stream the last retokenize()
+  // (or retokenizeCompact()) call returned that it copied from the previous
+  // stream unchanged
+  public getReusedWindow(): LexWindow {
+    return this.window;
+  }
+
+  // Incremental re-lexing. `previous` must be the token stream of the source
+  // this lexer currently holds; after the call the lexer holds the edited
+  // source. Scanning restarts at the first line touched by the edit and stops
+  // at the first line boundary past it where the old stream can be resumed.
+  // Tokens before that window are reused as-is, tokens after it are reused
+  // with their line numbers shifted.
+  public retokenize(previous: Token[], edit: LexEdit): Token[] {
+    const { first, lineDelta } = this.restart(new TokenArray(previous), edit);
+    this.tokens = [];
+    const resume = this.scanWindow(new TokenArray(previous), edit, lineDelta);
+    this.scanned = this.tokens.length;
+    if (resume < 0) {
+      this.window = { prefix: first, suffix: 0 };
+      return previous.slice(0, first).concat(this.tokens);
+    }
+
+    this.window = { prefix: first, suffix: previous.length - resume };
+    const tail = previous.slice(resume);
+    const shifted = lineDelta === 0
+      ? tail
+      : tail.map((token) => ({ ...token, line: token.line + lineDelta }));
+    return previous.slice(0, first).concat(this.tokens, shifted);
+  }
+
+  // retokenize() for a compact stream. The tokens around the rescanned
+  // window are block-copied from `previous`, the ones after it with their
+  // offsets and lines shifted, so an edit costs its window plus a copy.
+  public retokenizeCompact(previous: TokenBuffer<TokenType>, edit: LexEdit): TokenBuffer<TokenType> {
+    const { first, lineDelta } = this.restart(previous, edit);
+    const buffer = new TokenBuffer<TokenType>(this.source, TOKEN_KINDS, previous.length + 16);
+    buffer.append(previous, 0, first, 0, 0);
+    this.buffer = buffer;
+    let resume: number;
+    try {
+      resume = this.scanWindow(previous, edit, lineDelta);
+    } finally {
+      this.buffer = null;
+    }
+    this.scanned = buffer.length - first;
+    if (resume < 0) {
+      this.window = { prefix: first, suffix: 0 };
+      return buffer;
+    }
+
+    this.window = { prefix: first, suffix: previous.length - resume };
+    const offsetDelta = edit.insertedText.length - edit.removedLength;
+    buffer.append(previous, resume, previous.length, offsetDelta, lineDelta);
+    return buffer;
+  }
+
+  // Applies `edit` to the source and moves the cursor to the start of the
+  // first line it touches. Returns the index in `previous` of the first
+  // token to rescan, and how many lines the edit adds.
+  private restart(previous: LineTokens, edit: LexEdit): { first: number; lineDelta: number } {
+    const { offset, removedLength, insertedText } = edit;
+    const oldSource = this.source;
+    const lineDelta = countNewlines(insertedText, 0, insertedText.length) -
+      countNewlines(oldSource, offset, offset + removedLength);
+    this.source = oldSource.slice(0, offset) + insertedText + oldSource.slice(offset + removedLength);
+
+    // Restart right after the last NEWLINE token before the edited line. A
+    // string token carries the line it ends on, so a multi-line string that
+    // runs into the edited line is rescanned from its opening quote.
+    const editLine = 1 + countNewlines(oldSource, 0, offset);
+    let first = firstTokenOnLine(previous, editLine);
+    while (first > 0 && previous.type(first - 1) !== 'NEWLINE') {
+      first--;
+    }
+    const startLine = first > 0 ? previous.line(first - 1) + 1 : 1;
+    let lineStart = lineStartBefore(oldSource, offset);
+    for (let line = editLine; line > startLine; line--) {
+      lineStart = lineStartBefore(oldSource, lineStart - 1);
+    }
+
+    this.position = lineStart;
+    this.line = startLine;
+    this.column = 1;
+    return { first, lineDelta };
+  }
+
+  // Scans from the cursor until the old stream can be resumed, and returns
+  // the index in `previous` to resume at, or -1 after scanning to the end
+  private scanWindow(previous: LineTokens, edit: LexEdit, lineDelta: number): number {
+    const editEnd = edit.offset + edit.insertedText.length;
+    const scannedFrom = this.buffer ? this.buffer.length : 0;
+    while (this.position < this.source.length) {
+      this.scanToken();
+      // The newline just consumed must lie past the edit for the old and new
+      // streams to agree from here on.
+      if (this.position <= editEnd || this.column !== 1) continue;
+      const count = this.buffer ? this.buffer.length : this.tokens.length;
+      if (count === scannedFrom) continue;
+      const last = this.buffer ? this.buffer.type(count - 1) : this.tokens[count - 1].type;
+      if (last !== 'NEWLINE') continue;
+
+      const oldLine = this.line - lineDelta;
+      const next = firstTokenOnLine(previous, oldLine);
+      if (next > 0 && next < previous.length && isLineEnd(previous, next - 1, oldLine - 1)) {
+        return next;
       }
     }
-    this.advance();
-    return value;
-  }
 
-  private readNumber(): string {
-    let value = '';
-    let hasDot = false;
-    while (/[0-9.]/.test(this.peek())) {
-      if (this.peek() === '.') {
-        if (hasDot) break;
-        hasDot = true;
-      }
-      value += this.advance();
-    }
-    return value;
+    this.addToken('EOF', '');
+    return -1;
   }
 
-  private readIdentifier(): string {
-    let value = '';
-    while (/[a-zA-Z0-9_]/.test(this.peek())) {
-      value += this.advance();
-    }
-    return value;
-  }
+  private scanToken(): void {
+    const code = this.peekCode();
 
-  private readHexColor(): string {
-    let value = '#';
-    this.advance();
-    while (/[0-9a-fA-F]/.test(this.peek()) && value.length < 7) {
-      value += this.advance();
+    // Words, blanks and numbers make up most of a source
+    if (isIdentStart(code)) {
+      this.readWord(this.keywords, 'IDENTIFIER');
+      return;
     }
-    return value;
-  }
 
-  private readComment(): string {
-    let value = '';
-    while (this.peek() !== '\n' && this.peek() !== '\0') {
-      value += this.advance();
+    if (isWhitespace(code)) {
+      this.skipWhitespace();
+      return;
     }
-    return value;
-  }
 
-  private addToken(type: TokenType, value: string): void {
-    this.tokens.push({
-      type,
-      value,
-      line: this.line,
-      column: this.column - value.length,
-    });
-  }
-
-  public tokenize(): Token[] {
-    while (this.position < this.source.length) {
-      const char = this.peek();
-
-      if (/\s/.test(char) && char !== '\n') {
-        this.skipWhitespace();
-        continue;
-      }
+    if (isDigit(code)) {
+      const value = this.readNumber();
+      this.addToken('NUMBER', value);
+      return;
+    }
 
-      if (char === '\n') {
-        this.addToken('NEWLINE', '\n');
+    // The rest is decided by the first char
+    switch (code) {
+      case CharCode.Newline:
+        this.addToken('NEWLINE', '\n', this.position + 1);
         this.advance();
-        continue;
-      }
+        return;
 
-      if (char === '#') {
-        if (/[0-9a-fA-F]/.test(this.peek(1))) {
+      case CharCode.Hash:
+        if (isHexDigit(this.peekCode(1))) {
           const color = this.readHexColor();
           this.addToken('HEX_COLOR', color);
         } else {
-          this.readComment();
+          this.skipComment();
         }
-        continue;
-      }
+        return;
 
-      // Tilde prefix
-      if (char === '~') {
+      // Tilde prefix: `~btn` keeps the `~` in the word's value
+      case CharCode.Tilde:
         this.advance();
-        const next = this.peek();
-        
-        if (/[a-zA-Z]/.test(next)) {
-          const word = this.readIdentifier();
-          const keywordType = this.keywords.get(word);
-          if (keywordType) {
-            this.addToken(keywordType, `~${word}`);
-          } else {
-            this.addToken('IDENTIFIER', `~${word}`);
-          }
-          continue;
-        }
-        
-        if (next === 's') {
-          this.advance();
-          this.addToken('SET', '~s');
-          continue;
-        }
-        if (next === 'g') {
-          this.advance();
-          this.addToken('GET', '~g');
-          continue;
+        if (isAlpha(this.peekCode())) {
+          this.readWord(this.keywords, 'IDENTIFIER', this.position - 1);
+        } else {
+          this.addToken('TILDE', '~');
         }
-        
-        this.addToken('TILDE', '~');
-        continue;
-      }
+        return;
 
       // At prefix for events
-      if (char === '@') {
+      case CharCode.At:
         this.advance();
-        const word = this.readIdentifier();
-        const keywordType = this.keywords.get(word);
-        if (keywordType) {
-          this.addToken(keywordType, `@${word}`);
-        } else {
-          this.addToken('AT', `@${word}`);
-        }
-        continue;
-      }
+        this.readWord(this.keywords, 'AT', this.position - 1);
+        return;
 
       // Dollar prefix
-      if (char === '$') {
+      case CharCode.Dollar: {
         this.advance();
         const word = this.readIdentifier();
         this.addToken('IDENTIFIER', `$${word}`);
-        continue;
+        return;
       }
 
       // Strings
-      if (char === '"' || char === "'") {
-        const value = this.readString(char);
-        this.addToken('STRING', value);
-        continue;
-      }
-
-      // Numbers
-      if (/[0-9]/.test(char)) {
-        const value = this.readNumber();
-        this.addToken('NUMBER', value);
-        continue;
-      }
-
-      // Identifiers
-      if (/[a-zA-Z_]/.test(char)) {
-        const value = this.readIdentifier();
-        const type = this.keywords.get(value) || 'IDENTIFIER';
-        this.addToken(type, value);
-        continue;
+      case CharCode.DoubleQuote:
+      case CharCode.SingleQuote: {
+        const value = this.readString(code);
+        this.addToken('STRING', value, this.position - 1);
+        return;
       }
+    }
 
-      // Operators
-      switch (char) {
-        case '+':
-          this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('ASSIGN', '+=');
-          } else {
-            this.addToken('PLUS', '+');
-          }
-          break;
-        case '-':
-          this.advance();
-          if (this.peek() === '>') {
-            this.advance();
-            this.addToken('ARROW', '->');
-          } else if (this.peek() === '=') {
-            this.advance();
-            this.addToken('ASSIGN', '-=');
-          } else {
-            this.addToken('MINUS', '-');
-          }
-          break;
-        case '*':
-          this.advance();
-          if (this.peek() === '*') {
-            this.advance();
-            this.addToken('POWER', '**');
-          } else if (this.peek() === '=') {
-            this.advance();
-            this.addToken('ASSIGN', '*=');
-          } else {
-            this.addToken('MULTIPLY', '*');
-          }
-          break;
-        case '/':
+    // Operators
+    this.advance();
+    const next = this.peekCode();
+    switch (code) {
+      case CharCode.Plus:
+        if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('ASSIGN', '/=');
-          } else if (this.peek() === '/') {
-            this.readComment();
-          } else {
-            this.addToken('DIVIDE', '/');
-          }
-          break;
-        case '%':
+          this.addToken('ASSIGN', '+=');
+        } else {
+          this.addToken('PLUS', '+');
+        }
+        break;
+      case CharCode.Minus:
+        if (next === CharCode.GreaterThan) {
           this.advance();
-          this.addToken('MODULO', '%');
-          break;
-        case '=':
+          this.addToken('ARROW', '->');
+        } else if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('EQ', '==');
-          } else if (this.peek() === '>') {
-            this.advance();
-            this.addToken('FAT_ARROW', '=>');
-          } else {
-            this.addToken('ASSIGN', '=');
-          }
-          break;
-        case ':':
+          this.addToken('ASSIGN', '-=');
+        } else {
+          this.addToken('MINUS', '-');
+        }
+        break;
+      case CharCode.Asterisk:
+        if (next === CharCode.Asterisk) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('COLON_ASSIGN', ':=');
-          } else {
-            this.addToken('COLON', ':');
-          }
-          break;
-        case '!':
+          this.addToken('POWER', '**');
+        } else if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('NEQ', '!=');
-          } else {
-            this.addToken('EXCLAMATION', '!');
-          }
-          break;
-        case '?':
+          this.addToken('ASSIGN', '*=');
+        } else {
+          this.addToken('MULTIPLY', '*');
+        }
+        break;
+      case CharCode.Slash:
+        if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '?') {
-            this.advance();
-            this.addToken('NULLISH', '??');
-          } else if (this.peek() === '.') {
-            this.advance();
-            this.addToken('OPTIONAL', '?.');
-          } else {
-            this.addToken('QUESTION', '?');
-          }
-          break;
-        case '<':
+          this.addToken('ASSIGN', '/=');
+        } else if (next === CharCode.Slash) {
+          this.skipComment();
+        } else {
+          this.addToken('DIVIDE', '/');
+        }
+        break;
+      case CharCode.Percent:
+        this.addToken('MODULO', '%');
+        break;
+      case CharCode.Equals:
+        if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('LTE', '<=');
-          } else if (this.peek() === '-') {
-            this.advance();
-            this.addToken('ARROW_ASSIGN', '<-');
-          } else {
-            this.addToken('LT', '<');
-          }
-          break;
-        case '>':
+          this.addToken('EQ', '==');
+        } else if (next === CharCode.GreaterThan) {
           this.advance();
-          if (this.peek() === '=') {
-            this.advance();
-            this.addToken('GTE', '>=');
-          } else {
-            this.addToken('GT', '>');
-          }
-          break;
-        case '&':
+          this.addToken('FAT_ARROW', '=>');
+        } else {
+          this.addToken('ASSIGN', '=');
+        }
+        break;
+      case CharCode.Colon:
+        if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '&') {
-            this.advance();
-            this.addToken('AND', '&&');
-          } else {
-            this.addToken('AMPERSAND', '&');
-          }
-          break;
-        case '|':
+          this.addToken('COLON_ASSIGN', ':=');
+        } else {
+          this.addToken('COLON', ':');
+        }
+        break;
+      case CharCode.Exclamation:
+        if (next === CharCode.Equals) {
           this.advance();
-          if (this.peek() === '|') {
-            this.advance();
-            this.addToken('OR', '||');
-          } else if (this.peek() === '>') {
-            this.advance();
-            this.addToken('PIPE', '|>');
-          } else {
-            this.addToken('PIPE', '|');
-          }
-          break;
-        case '.':
+          this.addToken('NEQ', '!=');
+        } else {
+          this.addToken('EXCLAMATION', '!');
+        }
+        break;
+      case CharCode.Question:
+        if (next === CharCode.Question) {
           this.advance();
-          if (this.peek() === '.' && this.peek(1) === '.') {
-            this.advance();
-            this.advance();
-            this.addToken('SPREAD', '...');
-          } else {
-            this.addToken('DOT', '.');
-          }
-          break;
-        case '(':
+          this.addToken('NULLISH', '??');
+        } else if (next === CharCode.Dot) {
           this.advance();
-          this.addToken('LPAREN', '(');
-          break;
-        case ')':
+          this.addToken('OPTIONAL', '?.');
+        } else {
+          this.addToken('QUESTION', '?');
+        }
+        break;
+      case CharCode.LessThan:
+        if (next === CharCode.Equals) {
           this.advance();
-          this.addToken('RPAREN', ')');
-          break;
-        case '{':
+          this.addToken('LTE', '<=');
+        } else if (next === CharCode.Minus) {
           this.advance();
-          this.addToken('LBRACE', '{');
-          break;
-        case '}':
+          this.addToken('ARROW_ASSIGN', '<-');
+        } else {
+          this.addToken('LT', '<');
+        }
+        break;
+      case CharCode.GreaterThan:
+        if (next === CharCode.Equals) {
           this.advance();
-          this.addToken('RBRACE', '}');
-          break;
-        case '[':
+          this.addToken('GTE', '>=');
+        } else {
+          this.addToken('GT', '>');
+        }
+        break;
+      case CharCode.Ampersand:
+        if (next === CharCode.Ampersand) {
           this.advance();
-          this.addToken('LBRACKET', '[');
-          break;
-        case ']':
+          this.addToken('AND', '&&');
+        } else {
+          this.addToken('AMPERSAND', '&');
+        }
+        break;
+      case CharCode.Pipe:
+        if (next === CharCode.Pipe) {
           this.advance();
-          this.addToken('RBRACKET', ']');
-          break;
-        case ',':
+          this.addToken('OR', '||');
+        } else if (next === CharCode.GreaterThan) {
           this.advance();
-          this.addToken('COMMA', ',');
-          break;
-        case ';':
+          this.addToken('PIPE', '|>');
+        } else {
+          this.addToken('PIPE', '|');
+        }
+        break;
+      case CharCode.Dot:
+        if (next === CharCode.Dot && this.peekCode(1) === CharCode.Dot) {
           this.advance();
-          this.addToken('SEMICOLON', ';');
-          break;
-        default:
           this.advance();
-      }
+          this.addToken('SPREAD', '...');
+        } else {
+          this.addToken('DOT', '.');
+        }
+        break;
+      case CharCode.OpenParen:
+        this.addToken('LPAREN', '(');
+        break;
+      case CharCode.CloseParen:
+        this.addToken('RPAREN', ')');
+        break;
+      case CharCode.OpenBrace:
+        this.addToken('LBRACE', '{');
+        break;
+      case CharCode.CloseBrace:
+        this.addToken('RBRACE', '}');
+        break;
+      case CharCode.OpenBracket:
+        this.addToken('LBRACKET', '[');
+        break;
+      case CharCode.CloseBracket:
+        this.addToken('RBRACKET', ']');
+        break;
+      case CharCode.Comma:
+        this.addToken('COMMA', ',');
+        break;
+      case CharCode.Semicolon:
+        this.addToken('SEMICOLON', ';');
+        break;
     }
-
-    this.addToken('EOF', '');
-    return this.tokens;
   }
 }
 
 // ============================================
 // PARSER - AST Builder
 // ============================================
-export class DroyParserV3 {
-  private tokens: Token[];
-  private position: number = 0;
 
-  constructor(tokens: Token[]) {
-    this.tokens = tokens;
+// A top-level statement of the last parse. `lookahead` is one past the
+// furthest token the parser examined while building it, so the node depends
+// only on the tokens in [start, lookahead).
+export interface StatementSpan {
+  start: number;
+  end: number;
+  lookahead: number;
+  hash: number;
+  node: ASTNode;
+}
+
+function sameToken(a: TokenStream<TokenType>, i: number, b: TokenStream<TokenType>, j: number): boolean {
+  return a.type(i) === b.type(j) && a.value(i) === b.value(j);
+}
+
+const FNV_OFFSET = 0x811c9dc5;
+
+function fnv1a(hash: number, text: string): number {
+  for (let i = 0; i < text.length; i++) {
+    hash = Math.imul(hash ^ text.charCodeAt(i), 0x01000193);
   }
+  return hash;
+}
 
-  private peek(offset: number = 0): Token {
-    const pos = this.position + offset;
-    return pos < this.tokens.length ? this.tokens[pos] : this.tokens[this.tokens.length - 1];
+// FNV-1a over the types and values of tokens [start, end)
+function hashTokens(tokens: TokenStream<TokenType>, start: number, end: number): number {
+  let hash = FNV_OFFSET;
+  for (let i = start; i < end; i++) {
+    hash = fnv1a(hash, tokens.type(i) + '\0' + tokens.value(i));
+    hash = Math.imul(hash ^ 0xff, 0x01000193);
   }
+  return hash >>> 0;
+}
 
-  private advance(): Token {
-    return this.tokens[this.position++];
+// 48-bit content id (two FNV-1a passes) in base 36
+function contentId(text: string): string {
+  const high = fnv1a(FNV_OFFSET, text) >>> 0;
+  const low = fnv1a(0x01000193, text) & 0xffff;
+  return high.toString(36) + low.toString(36).padStart(4, '0');
+}
+
+// Maps the statements of a previous parse onto a new token stream. A
+// statement is reused when every token it looked at lies in the common
+// prefix or the common suffix of the two streams. The lexer knows these
+// after an incremental re-lex; otherwise the streams are compared.
+class StatementReuse {
+  private spans = new Map<number, StatementSpan>();
+  private prefix: number;
+  private suffixStart: number;
+  private delta: number;
+
+  constructor(
+    previous: TokenStream<TokenType>,
+    next: TokenStream<TokenType>,
+    spans: StatementSpan[],
+    window: LexWindow | null,
+  ) {
+    const limit = Math.min(previous.length, next.length);
+    let prefix = window ? window.prefix : 0;
+    let suffix = window ? window.suffix : 0;
+    if (!window) {
+      while (prefix < limit && sameToken(previous, prefix, next, prefix)) {
+        prefix++;
+      }
+      while (
+        suffix < limit - prefix &&
+        sameToken(previous, previous.length - 1 - suffix, next, next.length - 1 - suffix)
+      ) {
+        suffix++;
+      }
+    }
+
+    this.prefix = prefix;
+    this.suffixStart = previous.length - suffix;
+    this.delta = next.length - previous.length;
+    for (const span of spans) {
+      this.spans.set(span.start, span);
+    }
   }
 
-  private expect(type: TokenType): Token {
-    const token = this.advance();
-    if (token.type !== type) {
-      throw new Error(`Expected ${type} but got ${token.type} at line ${token.line}`);
+  // The span to reuse for a statement starting at `start` in the new stream
+  find(start: number): StatementSpan | undefined {
+    const same = this.spans.get(start);
+    if (same && same.lookahead <= this.prefix) {
+      return same;
     }
-    return token;
+
+    const old = start - this.delta;
+    if (old < this.suffixStart) return undefined;
+    const moved = this.spans.get(old);
+    return moved && {
+      ...moved,
+      start,
+      end: moved.end + this.delta,
+      lookahead: moved.lookahead + this.delta,
+    };
   }
+}
 
-  private match(...types: TokenType[]): boolean {
-    return types.includes(this.peek().type);
+const NAMING_TOKENS = tokenSet<TokenType>('GROUP', 'ID', 'NAME');
+const COLOR_OPERATIONS = tokenSet<TokenType>('BLEND', 'BLEND_MODE', 'GRADIENT');
+const UI_COMPONENTS = tokenSet<TokenType>(
+  'BTN', 'IMG', 'IMAGE', 'VIDEO', 'AUDIO', 'ICON', 'COLOR', 'BG', 'BACKGROUND', 'TEXT',
+  'TITLE', 'SUBTITLE', 'CONTAINER', 'GRID', 'FLEX', 'ROW', 'COL', 'COLUMN', 'CARD',
+  'MODAL', 'TOAST', 'TOOLTIP', 'TOPBAR', 'SIDEBAR', 'FOOTER', 'HEADER', 'NAV', 'MENU'
+);
+const EVENT_TOKENS = tokenSet<TokenType>(
+  'CLICK', 'HOVER', 'FOCUS', 'BLUR', 'KEYDOWN', 'KEYUP', 'SUBMIT', 'CHANGE', 'ON', 'OFF'
+);
+const REQUEST_TOKENS = tokenSet<TokenType>('FETCH', 'POST', 'PUT', 'DELETE', 'PATCH');
+const SOCKET_TOKENS = tokenSet<TokenType>('WS', 'WEBSOCKET');
+const LAYOUT_PROPERTIES = tokenSet<TokenType>(
+  'WIDTH', 'HEIGHT', 'PADDING', 'MARGIN', 'BORDER', 'RADIUS', 'SHADOW', 'OPACITY', 'SIZE',
+  'POSITION', 'TOP', 'LEFT', 'RIGHT', 'BOTTOM', 'Z_INDEX'
+);
+// Operators joining names in `value-set=(c+s=3)`
+const VALUE_SET_OPERATORS = tokenSet<TokenType>('PLUS', 'MINUS', 'MULTIPLY', 'DIVIDE');
+// What may separate a name from its value: `data x: 1`, `data x = 1`
+const VALUE_SEPARATORS = tokenSet<TokenType>('COLON', 'ASSIGN');
+const DATA_FORMATS = tokenSet<TokenType>('JSON', 'CSV', 'XML', 'YAML');
+const LINE_ENDS = tokenSet<TokenType>('NEWLINE', 'EOF');
+const BLEND_COLORS = tokenSet<TokenType>('HEX_COLOR', 'IDENTIFIER');
+const BLEND_MODE_TOKENS = tokenSet<TokenType>('BLEND_MODE', 'MODE');
+// Arguments a math statement takes without parentheses
+const MATH_ARGUMENTS = tokenSet<TokenType>('NUMBER', 'STRING', 'IDENTIFIER', 'LBRACKET');
+// Props spelled like keywords: `~card width: 200`
+const INLINE_STYLE_PROPS = tokenSet<TokenType>('WIDTH', 'HEIGHT', 'COLOR', 'BG', 'BACKGROUND');
+// Statements a handler body may be without braces
+const HANDLER_STATEMENTS = tokenSet<TokenType>('PRINT', 'EMIT');
+const EQUALITY_OPERATORS = tokenSet<TokenType>('EQ', 'NEQ');
+const COMPARISON_OPERATORS = tokenSet<TokenType>('LT', 'GT', 'LTE', 'GTE');
+const ADDITIVE_OPERATORS = tokenSet<TokenType>('PLUS', 'MINUS');
+const MULTIPLICATIVE_OPERATORS = tokenSet<TokenType>('MULTIPLY', 'DIVIDE', 'MODULO');
+const UNARY_OPERATORS = tokenSet<TokenType>('NOT', 'EXCLAMATION', 'MINUS');
+// Words read as a variable in expressions
+const IDENTIFIER_TOKENS = tokenSet<TokenType>('GET', 'IDENTIFIER');
+
+// Builtins that parse as MathOperation, in statements and in expressions
+const MATH_OPERATIONS = tokenSet<TokenType>(
+  'MATH', 'CALC', 'SUM', 'AVG', 'MIN', 'MAX', 'COUNT', 'RANDOM', 'ROUND', 'FLOOR', 'CEIL', 'ABS',
+);
+
+// Tokens that can follow a math builtin as its operand: `sum [1, 2]`
+const MATH_OPERANDS = tokenSet<TokenType>('LPAREN', 'COLON', 'NUMBER', 'STRING', 'IDENTIFIER', 'LBRACKET');
+
+// Literal tokens; every other token spelled like a word can also be a name
+const LITERAL_TOKENS = tokenSet<TokenType>('STRING', 'NUMBER', 'HEX_COLOR', 'BOOLEAN', 'NULL');
+
+export class DroyParserV3 extends DroyParserCore<TokenType> {
+  // `tokens` as it was passed in
+  private input: Token[] | TokenStream<TokenType>;
+  // Furthest token examined, which bounds the tokens a statement depends on
+  private furthest: number = 0;
+  // Result of the last successful parse, reused by reparse()
+  private parsed: {
+    input: Token[] | TokenStream<TokenType>;
+    tokens: TokenStream<TokenType>;
+    spans: StatementSpan[];
+    program: ASTNode;
+  } | null = null;
+  private reusedStatements: number = 0;
+
+  // Accepts the lexer's token array or a compact TokenBuffer
+  constructor(tokens: Token[] | TokenStream<TokenType>) {
+    super(tokens);
+    this.input = tokens;
+  }
+
+  // DroyParserCore's token access, also recording how far the parser looks
+  // ahead; peek, advance and currentType are all that read the stream
+  protected peek(offset: number = 0): Token {
+    const pos = this.position + offset;
+    const index = pos < this.tokens.length ? pos : this.tokens.length - 1;
+    if (index > this.furthest) this.furthest = index;
+    return this.tokens.get(index);
   }
 
-  private skipNewlines(): void {
-    while (this.match('NEWLINE')) {
-      this.advance();
-    }
+  protected advance(): Token {
+    if (this.position > this.furthest) this.furthest = this.position;
+    return this.tokens.get(this.position++);
+  }
+
+  protected currentType(): TokenType {
+    const pos = this.position < this.tokens.length ? this.position : this.tokens.length - 1;
+    if (pos > this.furthest) this.furthest = pos;
+    return this.tokens.type(pos);
+  }
+
+  // Names may be words the lexer reserves, like `count` or `name`
+  private isName(token: Token): boolean {
+    return token.type === 'IDENTIFIER' || (!LITERAL_TOKENS.has(token.type) && /^[A-Za-z_]\w*$/.test(token.value));
+  }
+
+  private expectName(): string {
+    return this.isName(this.peek()) ? this.advance().value : this.expect('IDENTIFIER').value;
   }
 
   public parse(): ASTNode {
+    this.position = 0;
+    return this.parseProgram(null);
+  }
+
+  // Parses an edited version of the last successfully parsed token stream.
+  // Unchanged top-level statements come back as the same node objects, and
+  // the Program node itself is kept when nothing changed. `edit` is what
+  // the lexer's retokenize() left unchanged of `edit.previous`; when that is
+  // the stream of the last parse, the two are not compared token by token.
+  public reparse(
+    tokens: Token[] | TokenStream<TokenType>,
+    edit?: { previous: Token[] | TokenStream<TokenType>; window: LexWindow },
+  ): ASTNode {
+    this.input = tokens;
+    this.tokens = Array.isArray(tokens) ? new TokenArray(tokens) : tokens;
+    this.position = 0;
+    const parsed = this.parsed;
+    const window = edit && parsed && edit.previous === parsed.input ? edit.window : null;
+    return this.parseProgram(parsed && new StatementReuse(parsed.tokens, this.tokens, parsed.spans, window));
+  }
+
+  // Takes up a parse saved elsewhere (the CLI's build cache) as the last
+  // one, so the next reparse() only parses the statements that changed
+  public restore(tokens: TokenStream<TokenType>, spans: StatementSpan[], program: ASTNode): void {
+    this.tokens = tokens;
+    this.input = tokens;
+    this.parsed = { input: tokens, tokens, spans, program };
+  }
+
+  // Top-level statements of the last parse, in source order
+  public getStatementSpans(): readonly StatementSpan[] {
+    return this.parsed ? this.parsed.spans : [];
+  }
+
+  public getReusedStatementCount(): number {
+    return this.reusedStatements;
+  }
+
+  private parseProgram(reuse: StatementReuse | null): ASTNode {
     const statements: ASTNode[] = [];
+    const spans: StatementSpan[] = [];
+    let reused = 0;
     this.skipNewlines();
     
     while (!this.match('EOF')) {
-      const stmt = this.parseStatement();
-      if (stmt.type !== 'Empty') {
-        statements.push(stmt);
+      const start = this.position;
+      let span = reuse?.find(start);
+      if (span) {
+        this.position = span.end;
+        reused++;
+      } else {
+        this.furthest = start;
+        const node = this.parseStatement();
+        span = {
+          start,
+          end: this.position,
+          lookahead: this.furthest + 1,
+          hash: hashTokens(this.tokens, start, this.position),
+          node,
+        };
+      }
+
+      spans.push(span);
+      if (span.node.type !== 'Empty') {
+        statements.push(span.node);
       }
       this.skipNewlines();
     }
 
-    return { type: 'Program', body: statements };
+    const previous = this.parsed;
+    const unchanged =
+      previous !== null && reused === spans.length && spans.length === previous.spans.length;
+    const program = unchanged ? previous.program : { type: 'Program', body: statements };
+    this.parsed = { input: this.input, tokens: this.tokens, spans, program };
+    this.reusedStatements = reused;
+    return program;
   }
 
   private parseStatement(): ASTNode {
@@ -629,38 +935,42 @@ export class DroyParserV3 {
       return this.parseServer();
     }
 
+    // Views: `route "/about" { ... }`, and `router mode: "history"`
+    if (this.match('ROUTE') && this.peek(1).type === 'STRING') {
+      return this.parseRoute();
+    }
+    if (this.match('ROUTER')) {
+      return this.parseRouter();
+    }
+
     // GROUP/ID/NAME
-    if (this.match('GROUP', 'ID', 'NAME')) {
+    if (this.matchAny(NAMING_TOKENS)) {
       return this.parseGroupIdName();
     }
 
     // Color blending
-    if (this.match('BLEND', 'BLEND_MODE', 'GRADIENT')) {
+    if (this.matchAny(COLOR_OPERATIONS)) {
       return this.parseColorBlend();
     }
 
-    // Math operations
-    if (this.match('MATH', 'CALC', 'SUM', 'AVG', 'MIN', 'MAX', 'RANDOM')) {
-      return this.parseMathOperation();
+    // Math operations, unless the word is assigned to: `count = count + 1`
+    if (this.matchAny(MATH_OPERATIONS)) {
+      return this.peek(1).type === 'ASSIGN' ? this.parseExpressionStatement() : this.parseMathOperation();
     }
 
     // UI Components
-    if (this.match('BTN', 'IMG', 'IMAGE', 'VIDEO', 'AUDIO', 'ICON', 
-                   'COLOR', 'BG', 'BACKGROUND', 'TEXT', 'TITLE', 'SUBTITLE',
-                   'CONTAINER', 'GRID', 'FLEX', 'ROW', 'COL', 'COLUMN',
-                   'CARD', 'MODAL', 'TOAST', 'TOOLTIP',
-                   'TOPBAR', 'SIDEBAR', 'FOOTER', 'HEADER', 'NAV', 'MENU')) {
+    if (this.matchAny(UI_COMPONENTS)) {
       return this.parseUIComponent();
     }
 
     // Events
-    if (this.match('CLICK', 'HOVER', 'FOCUS', 'BLUR', 'KEYDOWN', 'KEYUP', 
-                   'SUBMIT', 'CHANGE', 'ON', 'OFF')) {
+    if (this.matchAny(EVENT_TOKENS)) {
       return this.parseEventHandler();
     }
 
     // Core statements
-    if (this.match('GET')) return this.parseGet();
+    // `get name` reads a value; `get: "/url"` is a request
+    if (this.match('GET')) return this.peek(1).type === 'COLON' ? this.parseServerRequest() : this.parseGet();
     if (this.match('VAR')) return this.parseVar();
     if (this.match('FUNC')) return this.parseFunc();
     if (this.match('IF')) return this.parseIf();
@@ -671,20 +981,31 @@ export class DroyParserV3 {
     if (this.match('CLASS')) return this.parseClass();
     if (this.match('IMPORT')) return this.parseImport();
     if (this.match('EXPORT')) return this.parseExport();
-    if (this.match('BIND')) return this.parseBind();
+    // `state name: value` declares like `bind`; `state.user = ...` is not a declaration
+    if (this.match('BIND') || (this.match('STATE') && this.isName(this.peek(1)))) return this.parseBind();
     if (this.match('REF')) return this.parseRef();
     if (this.match('WATCH')) return this.parseWatch();
     if (this.match('EMIT')) return this.parseEmit();
 
     // Server requests
-    if (this.match('FETCH', 'POST', 'PUT', 'DELETE', 'PATCH')) {
+    if (this.matchAny(REQUEST_TOKENS)) {
       return this.parseServerRequest();
     }
 
+    // `ws: "url"` opens a socket and `@ws:message => ...` handles its events
+    if (this.matchAny(SOCKET_TOKENS) && this.peek(1).type === 'COLON') {
+      return this.peek().value.startsWith('@') ? this.parseSocketHandler() : this.parseSocket();
+    }
+
+    // Animations: `animate fade duration: 500`, `keyframe fade { ... }`, `transition: "..."`
+    if (this.match('ANIMATE')) return this.parseAnimation();
+    if (this.match('TRANSITION')) return this.parseTransition();
+    if (this.match('KEYFRAME') || (this.match('AT') && this.peek().value === '@keyframes')) {
+      return this.parseKeyframes();
+    }
+
     // Layout properties
-    if (this.match('WIDTH', 'HEIGHT', 'PADDING', 'MARGIN', 'BORDER', 
-                   'RADIUS', 'SHADOW', 'OPACITY', 'SIZE', 'POSITION',
-                   'TOP', 'LEFT', 'RIGHT', 'BOTTOM', 'Z_INDEX')) {
+    if (this.matchAny(LAYOUT_PROPERTIES)) {
       return this.parseLayoutProperty();
     }
 
@@ -700,7 +1021,7 @@ export class DroyParserV3 {
   private parseSetNaming(): ASTNode {
     this.advance(); // SET
     this.expect('ASSIGN');
-    const name = this.expect('IDENTIFIER').value;
+    const name = this.expectName();
     
     let expression = null;
     if (this.match('ASSIGN')) {
@@ -792,10 +1113,10 @@ export class DroyParserV3 {
       this.expect('LPAREN');
       
       while (!this.match('RPAREN') && !this.match('EOF')) {
-        const name = this.expect('IDENTIFIER').value;
+        const name = this.expectName();
         
         let operation: string | undefined = undefined;
-        if (this.match('PLUS', 'MINUS', 'MULTIPLY', 'DIVIDE')) {
+        if (this.matchAny(VALUE_SET_OPERATORS)) {
           operation = this.advance().value;
           this.expect('IDENTIFIER'); // consume second identifier
         }
@@ -819,26 +1140,37 @@ export class DroyParserV3 {
     };
   }
 
-  // DATA
+  // DATA: `data name: value [format: csv]`, `data name = value [: csv]`, or
+  // `data name: fetch "url" [format: csv]` for a source loaded at run time
   private parseData(): ASTNode {
     this.advance(); // DATA
     
     let name = null;
     let source = null;
+    let url = null;
     let format = 'json';
     
-    if (this.match('IDENTIFIER')) {
+    if (this.isName(this.peek()) && !this.matchAny(VALUE_SEPARATORS)) {
       name = this.advance().value;
     }
     
-    if (this.match('ASSIGN')) {
+    if (this.matchAny(VALUE_SEPARATORS)) {
       this.advance();
-      source = this.parseExpression();
+      if (this.match('FETCH')) {
+        this.advance();
+        url = this.parseExpression();
+      } else if (this.matchAny(DATA_FORMATS) && LINE_ENDS.has(this.peek(1).type)) {
+        // `data name: csv` only names the format
+        format = this.advance().value.toLowerCase();
+      } else {
+        source = this.parseExpression();
+      }
     }
     
-    if (this.match('COLON')) {
+    if (this.match('COLON') || (this.peek().value === 'format' && this.peek(1).type === 'COLON')) {
+      if (!this.match('COLON')) this.advance();
       this.advance();
-      if (this.match('JSON', 'CSV', 'XML', 'YAML')) {
+      if (this.isName(this.peek())) {
         format = this.advance().value.toLowerCase();
       }
     }
@@ -847,11 +1179,14 @@ export class DroyParserV3 {
       type: 'Data',
       name,
       source,
+      url,
       format,
     };
   }
 
-  // SERVER
+  // SERVER: `server = "url"` sets the endpoint; settings are written
+  // `server=api: "url"`, `server batch: "/batch" ttl: 30` or as a block,
+  // `server { api: "url", batch: "/batch" }`
   private parseServer(): ASTNode {
     this.advance(); // SERVER
     
@@ -859,24 +1194,57 @@ export class DroyParserV3 {
     
     if (this.match('ASSIGN')) {
       this.advance();
-      config.endpoint = this.parseExpression();
-    }
-    
-    // Parse additional config
-    while (this.match('IDENTIFIER')) {
-      const key = this.advance().value;
-      if (this.match('COLON') || this.match('ASSIGN')) {
-        this.advance();
-        config[key] = this.parseExpression();
-      }
+      if (!this.isPropKey()) config.endpoint = this.parseExpression();
     }
 
+    Object.assign(config, this.parseSettings());
+
     return {
       type: 'Server',
       config,
     };
   }
 
+  // `key: value` settings on the line or in a `{ ... }` block
+  private parseSettings(): Record<string, ASTNode> {
+    const settings: Record<string, ASTNode> = {};
+    const block = this.match('LBRACE');
+    if (block) this.advance();
+    for (;;) {
+      if (block) this.skipNewlines();
+      if (!this.isPropKey()) break;
+      const key = this.advance().value.toLowerCase();
+      this.advance(); // COLON or ASSIGN
+      settings[key] = this.parseExpression();
+      if (this.match('COMMA')) this.advance();
+    }
+    if (block) this.expect('RBRACE');
+    return settings;
+  }
+
+  // route "/about" { ... }: a view shown when the URL is at its path
+  private parseRoute(): ASTNode {
+    this.advance(); // ROUTE
+    const path = this.advance().value;
+    const children: ASTNode[] = [];
+    if (this.match('LBRACE')) {
+      this.advance();
+      this.skipNewlines();
+      while (!this.match('RBRACE') && !this.match('EOF')) {
+        children.push(this.parseStatement());
+        this.skipNewlines();
+      }
+      this.expect('RBRACE');
+    }
+    return { type: 'Route', path, children };
+  }
+
+  // router mode: "history" base: "/app"
+  private parseRouter(): ASTNode {
+    this.advance(); // ROUTER
+    return { type: 'Router', config: this.parseSettings() };
+  }
+
   // GROUP/ID/NAME
   private parseGroupIdName(): ASTNode {
     const type = this.advance().type;
@@ -909,18 +1277,19 @@ export class DroyParserV3 {
     let colors: string[] = [];
     let mode = 'normal';
     
+    // `blend: #f00, #00f` or `blend #f00, #00f`
     if (this.match('COLON')) {
       this.advance();
-      
-      while (this.match('HEX_COLOR', 'IDENTIFIER') || this.match('STRING')) {
-        colors.push(this.advance().value);
-        if (this.match('COMMA')) {
-          this.advance();
-        }
+    }
+    while (this.matchAny(BLEND_COLORS) || this.match('STRING')) {
+      colors.push(this.advance().value);
+      if (this.match('COMMA')) {
+        this.advance();
       }
     }
     
-    if (this.match('BLEND_MODE')) {
+    // `blend_mode: multiply` or `mode: multiply`
+    if (this.matchAny(BLEND_MODE_TOKENS)) {
       this.advance();
       if (this.match('COLON')) {
         this.advance();
@@ -954,6 +1323,11 @@ export class DroyParserV3 {
     } else if (this.match('COLON')) {
       this.advance();
       values.push(this.parseExpression());
+    } else {
+      // Juxtaposed operands: `round 3.14`, `random 1 100`, `sum [1, 2, 3]`
+      while (this.matchAny(MATH_ARGUMENTS)) {
+        values.push(this.parseUnary());
+      }
     }
 
     return {
@@ -963,25 +1337,29 @@ export class DroyParserV3 {
     };
   }
 
-  // Server requests
+  // Server requests: `post: "/users" data: { ... } => (response) => { ... }`
   private parseServerRequest(): ASTNode {
     const method = this.advance().type;
     
     let url = null;
     let options: Record<string, any> = {};
+    let handler: ASTNode | null = null;
     
     if (this.match('COLON')) {
       this.advance();
       url = this.parseExpression();
     }
     
-    // Parse options
-    while (this.match('IDENTIFIER')) {
-      const key = this.advance().value;
-      if (this.match('COLON') || this.match('ASSIGN')) {
-        this.advance();
-        options[key] = this.parseExpression();
-      }
+    // Options: `data`, `headers`, `ttl`, `batch`
+    while (this.isPropKey()) {
+      const key = this.advance().value.toLowerCase();
+      this.advance(); // COLON or ASSIGN
+      options[key] = this.parseExpression();
+    }
+
+    if (this.match('FAT_ARROW')) {
+      this.advance();
+      handler = this.parseHandler();
     }
 
     return {
@@ -989,6 +1367,35 @@ export class DroyParserV3 {
       method: method.toLowerCase(),
       url,
       options,
+      handler,
+    };
+  }
+
+  private parseSocket(): ASTNode {
+    this.advance(); // WS
+    this.expect('COLON');
+    return {
+      type: 'Socket',
+      url: this.parseExpression(),
+    };
+  }
+
+  // `@ws:open`, `@ws:message`, `@ws:close` or `@ws:error`
+  private parseSocketHandler(): ASTNode {
+    this.advance(); // @ws
+    this.expect('COLON');
+    const event = this.expectName().toLowerCase();
+    let handler: ASTNode | null = null;
+
+    if (this.match('FAT_ARROW')) {
+      this.advance();
+      handler = this.parseHandler();
+    }
+
+    return {
+      type: 'SocketHandler',
+      event,
+      handler,
     };
   }
 
@@ -1001,7 +1408,8 @@ export class DroyParserV3 {
            this.match('STRING') || this.match('HEX_COLOR') ||
            this.match('NUMBER') ||
            this.match('WIDTH') || this.match('HEIGHT') ||
-           this.match('COLOR') || this.match('BG') || this.match('BACKGROUND')) {
+           this.match('COLOR') || this.match('BG') || this.match('BACKGROUND') ||
+           this.isPropKey()) {
       
       if (this.match('COLON')) {
         this.advance();
@@ -1019,12 +1427,17 @@ export class DroyParserV3 {
         props.color = this.advance().value;
       } else if (this.match('NUMBER')) {
         props.value = parseFloat(this.advance().value);
-      } else if (this.match('WIDTH', 'HEIGHT', 'COLOR', 'BG', 'BACKGROUND')) {
+      } else if (this.matchAny(INLINE_STYLE_PROPS)) {
         const key = this.advance().value.toLowerCase();
         if (this.match('COLON') || this.match('ASSIGN')) {
           this.advance();
           props[key] = this.parseExpression();
         }
+      } else if (this.isPropKey()) {
+        // Any other word used as a key: `text: label`, `value = total`
+        const key = this.advance().value.toLowerCase();
+        this.advance();
+        props[key] = this.parseExpression();
       } else {
         break;
       }
@@ -1047,36 +1460,80 @@ export class DroyParserV3 {
     };
   }
 
+  private isPropKey(): boolean {
+    const next = this.peek(1).type;
+    return this.isName(this.peek()) && (next === 'COLON' || next === 'ASSIGN');
+  }
+
   private parseEventHandler(): ASTNode {
     const event = this.advance().value;
     let handler: ASTNode | null = null;
 
     if (this.match('FAT_ARROW')) {
       this.advance();
-      if (this.match('LBRACE')) {
-        this.advance();
-        const body: ASTNode[] = [];
-        while (!this.match('RBRACE') && !this.match('EOF')) {
-          body.push(this.parseStatement());
-          this.skipNewlines();
+      handler = this.parseHandler();
+    }
+
+    return {
+      type: 'EventHandler',
+      event,
+      handler,
+    };
+  }
+
+  // What follows `=>` in an event handler or watch: a block or an
+  // expression, optionally after a parameter list: `(value, old) => { ... }`
+  private parseHandler(): ASTNode {
+    const params: string[] = [];
+    if (this.match('LPAREN') && this.isParameterList()) {
+      this.advance();
+      while (!this.match('RPAREN')) {
+        params.push(this.expectName());
+        if (this.match('COMMA')) {
+          this.advance();
         }
-        this.expect('RBRACE');
-        handler = { type: 'BlockStatement', body };
-      } else {
-        handler = this.parseExpression();
       }
+      this.advance(); // )
+      this.expect('FAT_ARROW');
+    }
+
+    if (this.match('LBRACE')) {
+      this.advance();
+      const body: ASTNode[] = [];
+      while (!this.match('RBRACE') && !this.match('EOF')) {
+        body.push(this.parseStatement());
+        this.skipNewlines();
+      }
+      this.expect('RBRACE');
+      return { type: 'BlockStatement', params, body };
     }
 
-    return {
-      type: 'EventHandler',
-      event,
-      handler,
-    };
+    if (this.matchAny(HANDLER_STATEMENTS)) {
+      return { type: 'BlockStatement', params, body: [this.parseStatement()] };
+    }
+
+    // An assignment only makes sense run as a statement: `click => n = n + 1`
+    const statement = this.parseExpressionStatement();
+    if (statement.expression.type === 'AssignmentExpression') {
+      return { type: 'BlockStatement', params, body: [statement] };
+    }
+    return params.length > 0
+      ? { type: 'BlockStatement', params, body: [{ type: 'ReturnStatement', value: statement.expression }] }
+      : statement.expression;
+  }
+
+  // Whether the tokens from here read `(name, ...) =>`
+  private isParameterList(): boolean {
+    let offset = 1;
+    while (this.isName(this.peek(offset)) || this.peek(offset).type === 'COMMA') {
+      offset++;
+    }
+    return this.peek(offset).type === 'RPAREN' && this.peek(offset + 1).type === 'FAT_ARROW';
   }
 
   private parseSet(): ASTNode {
     this.advance();
-    const name = this.expect('IDENTIFIER').value;
+    const name = this.expectName();
     this.expect('ASSIGN');
     const value = this.parseExpression();
     
@@ -1089,7 +1546,7 @@ export class DroyParserV3 {
 
   private parseGet(): ASTNode {
     this.advance();
-    const name = this.expect('IDENTIFIER').value;
+    const name = this.expectName();
     
     return {
       type: 'GetExpression',
@@ -1099,7 +1556,7 @@ export class DroyParserV3 {
 
   private parseVar(): ASTNode {
     this.advance();
-    const name = this.expect('IDENTIFIER').value;
+    const name = this.expectName();
     this.expect('ASSIGN');
     const value = this.parseExpression();
     
@@ -1112,12 +1569,12 @@ export class DroyParserV3 {
 
   private parseFunc(): ASTNode {
     this.advance();
-    const name = this.expect('IDENTIFIER').value;
+    const name = this.expectName();
     this.expect('LPAREN');
     
     const params: string[] = [];
     while (!this.match('RPAREN') && !this.match('EOF')) {
-      params.push(this.expect('IDENTIFIER').value);
+      params.push(this.expectName());
       if (this.match('COMMA')) {
         this.advance();
       }
@@ -1178,8 +1635,8 @@ export class DroyParserV3 {
 
   private parseFor(): ASTNode {
     this.advance();
-    const iterator = this.expect('IDENTIFIER').value;
-    this.expect('IDENTIFIER'); // 'in'
+    const iterator = this.expectName();
+    this.expect('IN');
     const iterable = this.parseExpression();
     this.expect('LBRACE');
     
@@ -1274,10 +1731,10 @@ export class DroyParserV3 {
 
   private parseBind(): ASTNode {
     this.advance();
-    const target = this.match('IDENTIFIER') ? this.advance().value : null;
+    const target = this.isName(this.peek()) ? this.advance().value : null;
     let source = null;
     
-    if (this.match('COLON')) {
+    if (this.matchAny(VALUE_SEPARATORS)) {
       this.advance();
       source = this.parseExpression();
     }
@@ -1291,7 +1748,7 @@ export class DroyParserV3 {
 
   private parseRef(): ASTNode {
     this.advance();
-    const name = this.match('IDENTIFIER') ? this.advance().value : null;
+    const name = this.isName(this.peek()) ? this.advance().value : null;
 
     return {
       type: 'Ref',
@@ -1306,7 +1763,7 @@ export class DroyParserV3 {
     
     if (this.match('FAT_ARROW')) {
       this.advance();
-      handler = this.parseExpression();
+      handler = this.parseHandler();
     }
 
     return {
@@ -1349,8 +1806,103 @@ export class DroyParserV3 {
     };
   }
 
+  // animate [keyframes] duration: 500 delay: 100 easing: "ease-out", followed
+  // on the next lines by its own frames if it names none:
+  //   from: { opacity: 0 }
+  //   to: { opacity: 1 }
+  private parseAnimation(): ASTNode {
+    this.advance(); // ANIMATE
+    const name = this.isName(this.peek()) && !this.isPropKey() ? this.advance().value : null;
+    const props = this.parseTimingProps();
+    const frames: KeyframeStep[] = [];
+    for (;;) {
+      const start = this.position;
+      this.skipNewlines();
+      if (!this.isFrameStart()) {
+        this.position = start;
+        break;
+      }
+      frames.push(this.parseFrame());
+    }
+    return { type: 'Animation', name, props, frames };
+  }
+
+  // keyframe fade { from: { opacity: 0 } to: { opacity: 1 } }, also written
+  // @keyframes fade { from { opacity: 0 } 50% { opacity: 0.5 } ... }
+  private parseKeyframes(): ASTNode {
+    this.advance(); // KEYFRAME or @keyframes
+    const name = this.expectName();
+    this.expect('LBRACE');
+    const frames: KeyframeStep[] = [];
+    this.skipNewlines();
+    while (this.isFrameStart()) {
+      frames.push(this.parseFrame());
+      if (this.match('COMMA')) this.advance();
+      this.skipNewlines();
+    }
+    this.expect('RBRACE');
+    return { type: 'Keyframes', name, frames };
+  }
+
+  // transition: "transform 0.3s ease", or transition transform duration: 300
+  private parseTransition(): ASTNode {
+    this.advance(); // TRANSITION
+    if (this.match('COLON') || this.match('ASSIGN')) {
+      this.advance();
+      return { type: 'Transition', property: null, value: this.parseExpression(), props: {} };
+    }
+    const property = this.isName(this.peek()) && !this.isPropKey() ? this.advance().value : null;
+    return { type: 'Transition', property, value: null, props: this.parseTimingProps() };
+  }
+
+  // `duration: 500 easing: "ease-out"` and any other `key: value` on the line
+  private parseTimingProps(): Record<string, ASTNode> {
+    const props: Record<string, ASTNode> = {};
+    while (this.isPropKey()) {
+      const key = this.advance().value.toLowerCase();
+      this.advance();
+      props[key] = this.parseExpression();
+    }
+    return props;
+  }
+
+  // `from`, `to` or a percentage, then the frame's style object, with or
+  // without a colon between them
+  private isFrameStart(): boolean {
+    const token = this.peek();
+    let offset = 1;
+    if (token.type === 'NUMBER') {
+      if (this.peek(offset).type === 'MODULO') offset++;
+    } else if (token.type !== 'IDENTIFIER' || (token.value !== 'from' && token.value !== 'to')) {
+      return false;
+    }
+    if (this.peek(offset).type === 'COLON') offset++;
+    return this.peek(offset).type === 'LBRACE';
+  }
+
+  private parseFrame(): KeyframeStep {
+    const token = this.advance();
+    let at = token.value;
+    if (token.type === 'NUMBER') {
+      if (this.match('MODULO')) this.advance();
+      at = `${parseFloat(token.value)}%`;
+    }
+    if (this.match('COLON')) this.advance();
+    return { at, style: this.parseObject() };
+  }
+
   private parseExpressionStatement(): ASTNode {
     const expr = this.parseExpression();
+    if (expr.type === 'Identifier' && this.match('ASSIGN')) {
+      // `n += 1` is read as `n = n + 1`
+      const operator = this.advance().value;
+      const value = this.parseExpression();
+      const right = operator === '=' ? value : { type: 'BinaryExpression', operator: operator[0], left: expr, right: value };
+      return {
+        type: 'ExpressionStatement',
+        expression: { type: 'AssignmentExpression', operator: '=', left: expr, right },
+      };
+    }
     return {
       type: 'ExpressionStatement',
       expression: expr,
@@ -1414,7 +1966,7 @@ export class DroyParserV3 {
   private parseEquality(): ASTNode {
     let left = this.parseComparison();
     
-    while (this.match('EQ', 'NEQ')) {
+    while (this.matchAny(EQUALITY_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseComparison();
       left = {
@@ -1431,7 +1983,7 @@ export class DroyParserV3 {
   private parseComparison(): ASTNode {
     let left = this.parseAdditive();
     
-    while (this.match('LT', 'GT', 'LTE', 'GTE')) {
+    while (this.matchAny(COMPARISON_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseAdditive();
       left = {
@@ -1448,7 +2000,7 @@ export class DroyParserV3 {
   private parseAdditive(): ASTNode {
     let left = this.parseMultiplicative();
     
-    while (this.match('PLUS', 'MINUS')) {
+    while (this.matchAny(ADDITIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseMultiplicative();
       left = {
@@ -1465,7 +2017,7 @@ export class DroyParserV3 {
   private parseMultiplicative(): ASTNode {
     let left = this.parsePower();
     
-    while (this.match('MULTIPLY', 'DIVIDE', 'MODULO')) {
+    while (this.matchAny(MULTIPLICATIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parsePower();
       left = {
@@ -1497,8 +2049,8 @@ export class DroyParserV3 {
   }
 
   private parseUnary(): ASTNode {
-    if (this.match('NOT', 'MINUS')) {
-      const op = this.advance().value;
+    if (this.matchAny(UNARY_OPERATORS)) {
+      const op = this.advance().type === 'MINUS' ? '-' : '!';
       const operand = this.parseUnary();
       return {
         type: 'UnaryExpression',
@@ -1513,7 +2065,8 @@ export class DroyParserV3 {
   private parseCall(): ASTNode {
     let callee = this.parsePrimary();
     
-    if (this.match('LPAREN')) {
+    // Calls chain, so a returned func can be called: `adder(1)(2)`
+    while (this.match('LPAREN')) {
       this.advance();
       const args: ASTNode[] = [];
       while (!this.match('RPAREN') && !this.match('EOF')) {
@@ -1524,7 +2077,7 @@ export class DroyParserV3 {
       }
       this.expect('RPAREN');
       
-      return {
+      callee = {
         type: 'CallExpression',
         callee,
         arguments: args,
@@ -1575,7 +2128,11 @@ export class DroyParserV3 {
       };
     }
     
-    if (this.match('GET', 'IDENTIFIER')) {
+    if (this.matchAny(MATH_OPERATIONS) && MATH_OPERANDS.has(this.peek(1).type)) {
+      return this.parseMathOperation();
+    }
+
+    if (this.matchAny(IDENTIFIER_TOKENS)) {
       const name = this.advance().value;
       return {
         type: 'Identifier',
@@ -1597,6 +2154,13 @@ export class DroyParserV3 {
     if (this.match('LBRACE')) {
       return this.parseObject();
     }
+
+    if (this.isName(this.peek())) {
+      return {
+        type: 'Identifier',
+        name: this.advance().value,
+      };
+    }
     
     this.advance();
     return { type: 'Empty' };
@@ -1606,11 +2170,14 @@ export class DroyParserV3 {
     this.advance();
     const elements: ASTNode[] = [];
     
+    // Literals may span lines
+    this.skipNewlines();
     while (!this.match('RBRACKET') && !this.match('EOF')) {
       elements.push(this.parseExpression());
       if (this.match('COMMA')) {
         this.advance();
       }
+      this.skipNewlines();
     }
     
     this.expect('RBRACKET');
@@ -1624,8 +2191,9 @@ export class DroyParserV3 {
     this.advance();
     const properties: { key: string; value: ASTNode }[] = [];
     
+    this.skipNewlines();
     while (!this.match('RBRACE') && !this.match('EOF')) {
-      const key = this.expect('IDENTIFIER').value;
+      const key = this.expectName();
       this.expect('COLON');
       const value = this.parseExpression();
       properties.push({ key, value });
@@ -1633,6 +2201,7 @@ export class DroyParserV3 {
       if (this.match('COMMA')) {
         this.advance();
       }
+      this.skipNewlines();
     }
     
     this.expect('RBRACE');
@@ -1646,38 +2215,805 @@ export class DroyParserV3 {
 // ============================================
 // UI GENERATOR
 // ============================================
+// How component styles are written:
+// - 'rules': one rule per component instance (the default)
+// - 'deduplicated': one shared class per distinct declaration block
+// - 'atomic': one class per distinct declaration
+// Both compact modes drop overridden and no-op declarations and emit every
+// rule once, so the stylesheet grows with the number of distinct styles.
+export type CssMode = 'rules' | 'deduplicated' | 'atomic';
+
+export interface DroyUIGeneratorV3Options {
+  css?: CssMode;
+  // Image CDN and srcset widths; see media.ts
+  media?: DroyMediaOptions;
+}
+
+// Output of one statement: its HTML plus the CSS rules and JS it contributed.
+// `id` is derived from the content, so equal fragments share an id.
+export interface UIFragment {
+  id: string;
+  html: string;
+  rules: string[];
+  js: string;
+  // Runtimes `js` calls, which the output then starts with
+  runtimes: UIRuntime[];
+}
+
+export interface UISplitOptions {
+  // Most CSS a route's page inlines, counted in characters (bytes, for
+  // ASCII CSS): the shell's critical rules, then the route's own in
+  // document order. 14 KiB by default.
+  criticalBytes?: number;
+}
+
+// One route's view, loaded on its own
+export interface UIRouteChunk {
+  path: string;
+  // Derived from the content; names the chunk's files
+  id: string;
+  html: string;
+  // Every rule of the route not in the shell, and the leading ones its own
+  // page inlines
+  css: string;
+  critical: string;
+  js: string;
+}
+
+export interface UISplitOutput {
+  // The statements outside the routes, with an empty section for each route.
+  // `critical` is inlined in every page and `css` loaded after first paint;
+  // `js` starts with the runtimes the program uses.
+  shell: { id: string; html: string; critical: string; css: string; js: string };
+  routes: UIRouteChunk[];
+  router: { mode: 'hash' | 'history'; base: string };
+}
+
+// Changes since the previous generatePatch() call on the same generator
+export interface UIPatch {
+  // Fragment ids of the top-level statements, in document order
+  order: string[];
+  // Fragments the receiver has not been sent yet
+  added: UIFragment[];
+  // Ids that no longer occur in the document
+  removed: string[];
+  // Whether rules repeated across fragments are written once
+  uniqueRules: boolean;
+}
+
+interface CachedFragment {
+  id?: string;
+  html: string;
+  rules: string[];
+  js: string;
+  runtimes: UIRuntime[];
+  // Names whose being declared in the program decided the output, each
+  // prefixed with '1' if it was declared and '0' if not
+  names: string[];
+}
+
+function fragmentId(fragment: CachedFragment): string {
+  return (fragment.id ??= contentId(`${fragment.html}\0${fragment.rules.join('')}\0${fragment.js}`));
+}
+
+// Declarations that only restate the user-agent default of a plain div or
+// span. Other elements (button, input, a, p...) have defaults of their own,
+// so there they do take effect.
+const NO_OP_BOX_DECLARATIONS = new Set([
+  'color: inherit;', 'background: transparent;', 'border-radius: 0;', 'margin: 0;', 'padding: 0;',
+]);
+
+// Splits a "\n  prop: value;" block into the declarations that take effect:
+// a later declaration of the same property replaces an earlier one.
+function effectiveDeclarations(block: string, tag: string): string[] {
+  const byProperty = new Map<string, string>();
+  for (const line of block.split('\n')) {
+    const declaration = line.trim();
+    if (!declaration) continue;
+    const property = declaration.slice(0, declaration.indexOf(':'));
+    byProperty.delete(property);
+    byProperty.set(property, declaration);
+  }
+
+  const plainBox = tag === 'div' || tag === 'span';
+  const values = [...byProperty.values()];
+  return plainBox ? values.filter((declaration) => !NO_OP_BOX_DECLARATIONS.has(declaration)) : values;
+}
+
+const LITERAL_NODES = new Set(['NumberLiteral', 'StringLiteral', 'ColorLiteral', 'BooleanLiteral', 'NullLiteral']);
+
+// Expressions outside a handler have no JS locals; every name is in the store
+const NO_LOCALS: ReadonlySet<string> = new Set();
+
+// DOM event for each event keyword, written `click` or `@click`
+function domEvent(event: string): string {
+  const name = event.replace(/^@/, '').toLowerCase();
+  return name === 'hover' ? 'mouseenter' : name;
+}
+
+// A prop written as bare words, `bg: white` or `justify: space-between`,
+// lexes as identifiers; these are the words it spells, in order
+function bareWords(node: ASTNode): string[] | null {
+  if (node.type === 'Identifier') return [node.name];
+  if (node.type !== 'BinaryExpression' || node.operator !== '-') return null;
+  const left = bareWords(node.left);
+  const right = node.right.type === 'NumberLiteral' ? [String(node.right.value)] : bareWords(node.right);
+  return left && right ? [...left, ...right] : null;
+}
+
+const declaredCache = new WeakMap<ASTNode, string[]>();
+
+// Every name a statement declares or assigns, at any depth
+function declaredNames(node: ASTNode): string[] {
+  let names = declaredCache.get(node);
+  if (!names) {
+    names = [];
+    collectDeclared(node, names);
+    declaredCache.set(node, names);
+  }
+  return names;
+}
+
+function collectDeclared(value: unknown, names: string[]): void {
+  if (Array.isArray(value)) {
+    for (const item of value) collectDeclared(item, names);
+    return;
+  }
+  if (!value || typeof value !== 'object') return;
+  const node = value as ASTNode;
+  switch (node.type) {
+    case 'VariableDeclaration':
+    case 'SetDeclaration':
+    case 'Data':
+    case 'FunctionDeclaration':
+    case 'Ref':
+      if (node.name) names.push(node.name);
+      break;
+    case 'Binding':
+      if (node.target) names.push(node.target);
+      break;
+    case 'ForLoop':
+      names.push(node.iterator);
+      break;
+    case 'AssignmentExpression':
+      if (node.left.type === 'Identifier') names.push(node.left.name);
+      break;
+  }
+  // Func and handler parameters, and the names a value-set assigns
+  if (Array.isArray(node.params)) names.push(...node.params);
+  if (typeof node.name === 'string' && node.value !== undefined && node.type === undefined) names.push(node.name);
+  for (const key in node) {
+    if (node[key] && typeof node[key] === 'object') collectDeclared(node[key], names);
+  }
+}
+
+// Components whose text or value prop is their content
+const CONTENT_COMPONENTS = new Set(['btn', 'button', 'icon', 'text', 'title', 'subtitle']);
+const MEDIA_COMPONENTS = new Set(['img', 'image', 'video', 'audio']);
+// ...and whose value or color prop is their background
+const SWATCH_COMPONENTS = new Set(['color', 'bg', 'background']);
+
+// CSS property set by each prop, when the prop is bound at run time
+const STYLE_PROPS: Record<string, string> = {
+  width: 'width',
+  height: 'height',
+  margin: 'margin',
+  padding: 'padding',
+  radius: 'border-radius',
+  borderradius: 'border-radius',
+  shadow: 'box-shadow',
+  opacity: 'opacity',
+  z_index: 'z-index',
+  bg: 'background',
+  background: 'background',
+  color: 'color',
+  gap: 'gap',
+  size: 'font-size',
+};
+
+// What a prop bound at run time sets on its element: the text, an attribute
+// or a style property
+function propTarget(component: string, key: string): { kind: 'text' | 'attr' | 'style'; name: string } {
+  if (MEDIA_COMPONENTS.has(component) && (key === 'value' || key === 'src')) {
+    return { kind: 'attr', name: 'src' };
+  }
+  if (SWATCH_COMPONENTS.has(component) && (key === 'value' || key === 'color')) {
+    return { kind: 'style', name: 'background' };
+  }
+  if ((component === 'btn' || component === 'button') && key === 'color') {
+    return { kind: 'style', name: 'background' };
+  }
+  if (key === 'text' || (key === 'value' && CONTENT_COMPONENTS.has(component))) {
+    return { kind: 'text', name: '' };
+  }
+  return key in STYLE_PROPS ? { kind: 'style', name: STYLE_PROPS[key] } : { kind: 'attr', name: key };
+}
+
+// Literals, and arrays and objects of them
+function literalTree(node: ASTNode): boolean {
+  switch (node.type) {
+    case 'ArrayLiteral':
+      return node.elements.every(literalTree);
+    case 'ObjectLiteral':
+      return node.properties.every((property: { value: ASTNode }) => literalTree(property.value));
+    default:
+      return LITERAL_NODES.has(node.type);
+  }
+}
+
+// Runtimes the generated JS can call, in the order the output includes them
+const RUNTIMES = {
+  reactive: REACTIVE_RUNTIME,
+  router: ROUTER_RUNTIME,
+  media: MEDIA_RUNTIME,
+};
+
+export type UIRuntime = keyof typeof RUNTIMES;
+
+function runtimeCode(used: ReadonlySet<UIRuntime>): string {
+  let code = '';
+  for (const [name, runtime] of Object.entries(RUNTIMES)) {
+    if (used.has(name as UIRuntime)) code += runtime;
+  }
+  return code;
+}
+
+// Top-level components that render above the fold on every route
+const FOLD_COMPONENTS = new Set(['TOPBAR', 'SIDEBAR', 'HEADER', 'NAV']);
+// One TCP initial congestion window, so a page's first round trip carries
+// its critical CSS
+const DEFAULT_CRITICAL_BYTES = 14 * 1024;
+
+// Height of a windowed list's viewport when the component sets none
+const DEFAULT_VIRTUAL_HEIGHT = '400px';
+
+// Children that attach to their component's element rather than render
+const ATTACHED_NODES = new Set(['EventHandler', 'Ref', 'Animation', 'Transition']);
+
+// Properties the compositor animates without layout or paint
+const COMPOSITOR_PROPERTIES = new Set(['transform', 'opacity', 'filter', 'translate', 'scale', 'rotate']);
+// Properties that lay the page out again on every frame they change
+const LAYOUT_CSS_PROPERTIES = new Set([
+  'width', 'height', 'min-width', 'min-height', 'max-width', 'max-height', 'margin', 'margin-top',
+  'margin-right', 'margin-bottom', 'margin-left', 'padding', 'padding-top', 'padding-right',
+  'padding-bottom', 'padding-left', 'top', 'right', 'bottom', 'left', 'inset', 'font-size',
+  'line-height', 'letter-spacing', 'border', 'border-width', 'flex-basis', 'gap',
+]);
+const UNITLESS_PROPERTIES = new Set(['opacity', 'z-index', 'scale', 'font-weight', 'line-height', 'flex-grow', 'flex-shrink', 'order']);
+// Offsets animated as translations: `left: 40` moves the element 40px from
+// where it sits with a transform instead of by layout
+const OFFSET_TRANSLATIONS: Record<string, ['X' | 'Y', number]> = {
+  x: ['X', 1], left: ['X', 1], right: ['X', -1], y: ['Y', 1], top: ['Y', 1], bottom: ['Y', -1],
+};
+const LENGTH = /^(-?(?:\d+\.?\d*|\.\d+))(px|em|rem)?$/;
+const LAYOUT_NOTE = ' /* lays out every frame; animate transform or opacity instead */';
+
+// Inline handlers that set `will-change` for `layers` when the element's own
+// animation or transition starts and clear it when it ends
+function layerHandlers(layers: Set<string>, start: string, end: string, cancel: string): string {
+  if (layers.size === 0) return '';
+  const set = `if(event.target===this)this.style.willChange='${[...layers].join(', ')}'`;
+  const clear = "if(event.target===this)this.style.willChange=''";
+  return ` on${start}="${set}" on${end}="${clear}" on${cancel}="${clear}"`;
+}
+
+// @keyframes are shared by every element running the animation, so they are
+// written once whatever the CssMode
+function isSharedRule(rule: string): boolean {
+  return rule.startsWith('@keyframes ');
+}
+
+// The rules not in `seen`, each once, adding them to it
+function unseenRules(rules: string[], seen: Set<string>): string[] {
+  const unseen: string[] = [];
+  for (const rule of rules) {
+    if (seen.has(rule)) continue;
+    seen.add(rule);
+    unseen.push(rule);
+  }
+  return unseen;
+}
+
+function literalNumber(node: ASTNode): number | null {
+  if (node.type === 'NumberLiteral') return node.value;
+  if (node.type === 'UnaryExpression' && node.operator === '-' && node.operand.type === 'NumberLiteral') {
+    return -node.operand.value;
+  }
+  return null;
+}
+
+// The CSS a style object value spells: numbers get the property's unit,
+// bare words are joined, and anything computed is left out
+function styleValue(property: string, node: ASTNode): string | null {
+  const number = literalNumber(node);
+  if (number !== null) {
+    if (UNITLESS_PROPERTIES.has(property)) return String(number);
+    return `${number}${property === 'rotate' ? 'deg' : 'px'}`;
+  }
+  if (LITERAL_NODES.has(node.type)) return node.value === null ? null : String(node.value);
+  return bareWords(node)?.join('-') ?? null;
+}
+
+// `duration: 500` is in milliseconds; strings such as "0.5s" are kept
+function timeValue(node: ASTNode | undefined, fallback: string): string {
+  const number = node ? literalNumber(node) : null;
+  if (number !== null) return `${number}ms`;
+  return (node && styleValue('', node)) || fallback;
+}
+
+function cssProperty(key: string): string {
+  const name = key.toLowerCase();
+  return STYLE_PROPS[name] ?? name.replace(/_/g, '-');
+}
+
+// A keyframe's declarations. Offsets given as lengths become translations
+// and join any transform of the frame, in the order they were written.
+function frameDeclarations(style: ASTNode): string[] {
+  const transforms: string[] = [];
+  const declarations: string[] = [];
+  for (const { key, value } of style.properties as Array<{ key: string; value: ASTNode }>) {
+    const property = cssProperty(key);
+    const text = styleValue(property, value);
+    if (text === null) continue;
+    const offset = OFFSET_TRANSLATIONS[key.toLowerCase()];
+    const length = offset && LENGTH.exec(text);
+    if (length) {
+      const amount = parseFloat(length[1]) * offset[1];
+      transforms.push(`translate${offset[0]}(${amount}${length[2] ?? 'px'})`);
+    } else if (property === 'transform') {
+      transforms.push(text);
+    } else {
+      declarations.push(`${property}: ${text}${LAYOUT_CSS_PROPERTIES.has(property) ? LAYOUT_NOTE : ''};`);
+    }
+  }
+  if (transforms.length > 0) declarations.unshift(`transform: ${transforms.join(' ')};`);
+  return declarations;
+}
+
+function animationValue(name: string, props: Record<string, ASTNode>): string {
+  const duration = timeValue(props.duration, '300ms');
+  const easing = props.easing ? styleValue('', props.easing) ?? 'ease' : 'ease';
+  const delay = timeValue(props.delay, '0ms');
+  const repeat = props.iterations ?? props.repeat;
+  let iterations = '1';
+  if (repeat?.type === 'BooleanLiteral') {
+    iterations = repeat.value ? 'infinite' : '1';
+  } else if (repeat) {
+    iterations = String(literalNumber(repeat) ?? styleValue('', repeat) ?? 1);
+  }
+  const direction = props.direction ? styleValue('', props.direction) ?? 'normal' : 'normal';
+  // `both` holds the first frame through the delay and the last one after
+  const fill = props.fill ? styleValue('', props.fill) ?? 'both' : 'both';
+  return `${name} ${duration} ${easing} ${delay} ${iterations} ${direction} ${fill}`;
+}
+
+// The transition value and the properties it animates
+function transitionValue(node: ASTNode): { value: string; properties: string[] } | null {
+  if (node.value) {
+    const value = styleValue('', node.value);
+    if (!value) return null;
+    return { value, properties: value.split(',').map((part) => part.trim().split(/\s+/)[0]) };
+  }
+  const property = node.property ? cssProperty(node.property) : 'all';
+  const easing = node.props.easing ? styleValue('', node.props.easing) ?? 'ease' : 'ease';
+  return {
+    value: `${property} ${timeValue(node.props.duration, '300ms')} ${easing} ${timeValue(node.props.delay, '0ms')}`,
+    properties: [property],
+  };
+}
+
+// A generator instance caches the output of every node it has generated, keyed
+// by node identity. Combined with DroyParserV3.reparse(), which keeps unchanged
+// statements as the same objects, regenerating after a small edit only renders
+// the statements that changed. Nodes must not be mutated once generated.
 export class DroyUIGeneratorV3 {
-  private output: string = '';
-  private styles: string = '';
-  private styleCounter: number = 0;
+  private styles: string[] = [];
   private scripts: string = '';
-
-  private generateClassName(): string {
-    return `droy-${this.styleCounter++}`;
+  private cssMode: CssMode;
+  private media: DroyMediaOptions;
+  private fragments = new WeakMap<ASTNode, CachedFragment>();
+  // False while streaming, so rendered fragments are not kept
+  private retain: boolean = true;
+  private topLevel: CachedFragment[] = [];
+  private sent = new Set<string>();
+  // Runtimes used by what has been generated so far, in this pass or, while
+  // a statement renders, by that statement
+  private runtimes = new Set<UIRuntime>();
+  // While rendering a list row template: the slot fills bound props become
+  private row: { locals: Set<string>; fills: string[] } | null = null;
+  // Names the program being generated declares, and the ones looked up so far
+  private declared = new Set<string>();
+  private consulted: string[] = [];
+  // Top-level `keyframe` declarations by name, with the key that marks
+  // their current frames in `declared`
+  private keyframes = new Map<string, { key: string; frames: KeyframeStep[] }>();
+  private trace: CompileTrace | null = null;
+
+  constructor(options: DroyUIGeneratorV3Options = {}) {
+    this.cssMode = options.css ?? 'rules';
+    this.media = options.media ?? {};
+  }
+
+  // Records the statements and components rendered from here on, and how
+  // many came from the cache, in `trace`; null stops recording
+  public setTrace(trace: CompileTrace | null): void {
+    this.trace = trace;
+  }
+
+  // Class names are derived from the rule body, so they only change when the
+  // styles they carry change.
+  private generateClassName(declarations: string): string {
+    return `droy-${contentId(declarations)}`;
+  }
+
+  // Adds the rules for a "\n  prop: value;" block and returns the class
+  // attribute value that applies it (empty when nothing takes effect).
+  private styleClasses(declarations: string, tag: string): string {
+    if (this.cssMode === 'rules') {
+      const className = this.generateClassName(declarations);
+      this.styles.push(`.${className} {${declarations}\n}\n`);
+      return className;
+    }
+
+    const effective = effectiveDeclarations(declarations, tag);
+    if (this.cssMode === 'atomic') {
+      return effective.map((declaration) => {
+        const className = this.generateClassName(declaration);
+        this.styles.push(`.${className} { ${declaration} }\n`);
+        return className;
+      }).join(' ');
+    }
+
+    if (effective.length === 0) return '';
+    const block = effective.map((declaration) => `\n  ${declaration}`).join('');
+    const className = this.generateClassName(block);
+    this.styles.push(`.${className} {${block}\n}\n`);
+    return className;
   }
 
   public generate(ast: ASTNode): { html: string; css: string; js: string } {
+    const parts: Record<UIPart, string[]> = { html: [], css: [], js: [] };
+    for (const chunk of this.emit(ast, true)) {
+      parts[chunk.part].push(chunk.text);
+    }
+    return { html: parts.html.join(''), css: parts.css.join(''), js: parts.js.join('') };
+  }
+
+  // Yields the output as it is generated: the HTML one top-level statement at
+  // a time, then the CSS rules, then the JS. Nothing is cached, so only the
+  // statement being rendered and the pending rules and scripts are held. Use
+  // a compact CssMode to bound the rules by the number of distinct styles.
+  public *chunks(ast: ASTNode): Generator<UIChunk, void, undefined> {
+    yield* this.emit(ast, false);
+  }
+
+  // Writes chunks() to `sink`, waiting whenever the sink applies backpressure
+  public stream(ast: ASTNode, sink: UISink): Promise<void> {
+    return writeUIChunks(this.chunks(ast), sink);
+  }
+
+  private *emit(ast: ASTNode, retain: boolean): Generator<UIChunk, void, undefined> {
+    this.styles = [];
+    this.scripts = '';
+    this.topLevel = [];
+    this.runtimes = new Set();
+    this.consulted = [];
+    this.declared = new Set();
+    this.keyframes = new Map();
     if (ast.type === 'Program') {
-      const htmlParts: string[] = [];
-      
       for (const stmt of ast.body) {
-        const result = this.generateStatement(stmt);
-        if (result) {
-          htmlParts.push(result);
+        for (const name of declaredNames(stmt)) this.declared.add(name);
+        if (stmt.type === 'Keyframes') {
+          const key = `@keyframes ${stmt.name} ${contentId(JSON.stringify(stmt.frames))}`;
+          this.keyframes.set(stmt.name, { key, frames: stmt.frames });
+          this.declared.add(`@keyframes ${stmt.name}`).add(key);
+        }
+      }
+    }
+    this.retain = retain;
+
+    const unique = this.cssMode !== 'rules';
+    const rules: string[] = [];
+    const seen = new Set<string>();
+    try {
+      if (ast.type === 'Program') {
+        let first = true;
+        for (const stmt of ast.body) {
+          const result = this.generateStatement(stmt);
+          if (retain) {
+            this.topLevel.push(this.fragments.get(stmt)!);
+          }
+          for (const rule of this.styles) {
+            if (!unique && !isSharedRule(rule)) {
+              rules.push(rule);
+            } else if (!seen.has(rule)) {
+              seen.add(rule);
+              rules.push(rule);
+            }
+          }
+          this.styles = [];
+
+          if (result) {
+            if (!first) yield { part: 'html', text: '\n' };
+            yield { part: 'html', text: result };
+            first = false;
+          }
+        }
+      }
+
+      for (const rule of rules) {
+        yield { part: 'css', text: rule };
+      }
+      const runtime = runtimeCode(this.runtimes);
+      if (runtime) {
+        yield { part: 'js', text: runtime };
+      }
+      if (this.scripts) {
+        yield { part: 'js', text: this.scripts };
+      }
+    } finally {
+      this.retain = true;
+    }
+  }
+
+  // Generates `ast` and returns only what changed since the previous patch.
+  // Apply the patches in order with applyUIPatch() to rebuild the output.
+  public generatePatch(ast: ASTNode): UIPatch {
+    this.generate(ast);
+
+    const order: string[] = [];
+    const added: UIFragment[] = [];
+    const current = new Set<string>();
+    for (const fragment of this.topLevel) {
+      const id = fragmentId(fragment);
+      order.push(id);
+      if (!current.has(id)) {
+        current.add(id);
+        if (!this.sent.has(id)) {
+          const { html, rules, js, runtimes } = fragment;
+          added.push({ id, html, rules, js, runtimes });
         }
       }
-      
-      this.output = htmlParts.join('\n');
     }
 
+    const removed = [...this.sent].filter((id) => !current.has(id));
+    this.sent = current;
+    return { order, added, removed, uniqueRules: this.cssMode !== 'rules' };
+  }
+
+  // Splits the output by route, for sites that load one view at a time.
+  // The shell is every statement outside the routes, with an empty section
+  // where each route goes, and each route becomes a chunk of its own HTML,
+  // rules and JS; chunks leave out the rules the shell inlines. The
+  // rules of what the first paint shows (the shell before the first route,
+  // its top bar, sidebar and header, and each route's first components up to
+  // `criticalBytes` per page) are marked critical, to be inlined.
+  public split(ast: ASTNode, options: UISplitOptions = {}): UISplitOutput {
+    this.generate(ast);
+    const body: ASTNode[] = ast.type === 'Program' ? ast.body : [];
+    const router: UISplitOutput['router'] = { mode: 'hash', base: '' };
+    const firstRoute = body.findIndex((stmt) => stmt.type === 'Route');
+    const aboveFold: string[] = [];
+    const belowFold: string[] = [];
+    const views: Array<{ path: string; html: string; rules: string[]; js: string }> = [];
+    // Shell HTML, and the index of the view at each route's place
+    const parts: Array<string | number> = [];
+    let js = '';
+    body.forEach((stmt, index) => {
+      const fragment = this.topLevel[index];
+      if (stmt.type === 'Route') {
+        parts.push(views.length);
+        views.push({ path: stmt.path, ...this.capture(stmt.children) });
+        return;
+      }
+      if (stmt.type === 'Router') {
+        const { mode, base } = stmt.config;
+        if (mode?.type === 'StringLiteral') router.mode = mode.value === 'history' ? 'history' : 'hash';
+        if (base?.type === 'StringLiteral') router.base = String(base.value).replace(/\/+$/, '');
+      }
+      if (fragment.html) parts.push(fragment.html);
+      const fold = firstRoute < 0 || index < firstRoute || (stmt.type === 'UIComponent' && FOLD_COMPONENTS.has(stmt.component));
+      (fold ? aboveFold : belowFold).push(...fragment.rules);
+      js += fragment.js;
+    });
+
+    // Routes leave out the rules every page inlines, but keep the ones the
+    // shell only loads later
+    const inlined = new Set<string>();
+    const critical = unseenRules(aboveFold, inlined).join('');
+    const deferred = unseenRules(belowFold, new Set(inlined)).join('');
+
+    const budget = options.criticalBytes ?? DEFAULT_CRITICAL_BYTES;
+    const routes = views.map((view): UIRouteChunk => {
+      const rules = unseenRules(view.rules, new Set(inlined));
+      let inline = critical.length;
+      let fold = 0;
+      while (fold < rules.length && inline + rules[fold].length <= budget) {
+        inline += rules[fold++].length;
+      }
+      const css = rules.join('');
+      return {
+        path: view.path,
+        id: contentId(`${view.path}\0${view.html}\0${css}\0${view.js}`),
+        html: view.html,
+        critical: rules.slice(0, fold).join(''),
+        css,
+        js: view.js,
+      };
+    });
+
+    const html = parts
+      .map((part) => {
+        if (typeof part === 'string') return part;
+        const route = routes[part];
+        return routeSection(route.path, '', { hidden: true, chunk: route.id, css: route.css !== '' });
+      })
+      .join('\n');
+    const runtime = runtimeCode(this.runtimes);
     return {
-      html: this.output,
-      css: this.styles,
-      js: this.scripts,
+      shell: { id: contentId(`${html}\0${critical}\0${deferred}\0${js}`), html, critical, css: deferred, js: runtime + js },
+      routes,
+      router,
     };
   }
 
+  // Generates statements on their own: their HTML, and the rules and JS
+  // they add, without adding them to the output being generated
+  private capture(statements: ASTNode[]): { html: string; rules: string[]; js: string } {
+    const styles = this.styles;
+    const scripts = this.scripts;
+    this.styles = [];
+    this.scripts = '';
+    try {
+      const html = this.generateChildren(statements);
+      return { html, rules: this.styles, js: this.scripts };
+    } finally {
+      this.styles = styles;
+      this.scripts = scripts;
+    }
+  }
+
   private generateStatement(node: ASTNode): string {
+    // A row template belongs to the list that renders it; its fills are
+    // collected as it renders, so it is never served from the cache
+    if (this.row) return this.traceStatement(node);
+
+    const cached = this.fragments.get(node);
+    if (this.trace) this.trace.cache.generator.total++;
+    if (cached && cached.names.every((entry) => (entry[0] === '1') === this.declared.has(entry.slice(1)))) {
+      if (this.trace) this.trace.cache.generator.reused++;
+      this.styles.push(...cached.rules);
+      this.scripts += cached.js;
+      for (const runtime of cached.runtimes) this.runtimes.add(runtime);
+      this.consulted.push(...cached.names);
+      return cached.html;
+    }
+
+    const stylesStart = this.styles.length;
+    const scriptsStart = this.scripts.length;
+    const consultedStart = this.consulted.length;
+    const outer = this.runtimes;
+    const runtimes = new Set<UIRuntime>();
+    this.runtimes = runtimes;
+    let html: string;
+    try {
+      html = this.traceStatement(node);
+    } finally {
+      for (const runtime of runtimes) outer.add(runtime);
+      this.runtimes = outer;
+    }
+    if (this.retain) {
+      this.fragments.set(node, {
+        html,
+        rules: this.styles.slice(stylesStart),
+        js: this.scripts.slice(scriptsStart),
+        runtimes: [...runtimes],
+        names: this.consulted.slice(consultedStart),
+      });
+    }
+    return html;
+  }
+
+  private traceStatement(node: ASTNode): string {
+    if (!this.trace) return this.renderStatement(node);
+    const component = node.type === 'UIComponent';
+    this.trace.begin(component ? node.component.toLowerCase() : node.type, component ? 'component' : 'statement');
+    try {
+      return this.renderStatement(node);
+    } finally {
+      this.trace.end();
+    }
+  }
+
+  // Whether `name` refers to something in the program rather than spelling a
+  // word; recorded so cached output is redone when the answer changes
+  private isDeclared(name: string): boolean {
+    if (this.row?.locals.has(name)) return true;
+    const declared = this.declared.has(name);
+    this.consulted.push(`${declared ? '1' : '0'}${name}`);
+    return declared;
+  }
+
+  // Frames of the top-level `keyframe` declaration called `name`, recorded
+  // like isDeclared() so cached output is redone when they change
+  private namedFrames(name: string): KeyframeStep[] | null {
+    const entry = this.keyframes.get(name);
+    this.consulted.push(entry ? `1${entry.key}` : `0@keyframes ${name}`);
+    return entry ? entry.frames : null;
+  }
+
+  // Adds the @keyframes rule for `frames` and returns its name. The name is
+  // derived from the frames, so every element running the same animation
+  // shares one rule.
+  private keyframesRule(frames: KeyframeStep[], layers: Set<string>): string {
+    let body = '';
+    for (const frame of frames) {
+      const declarations = frameDeclarations(frame.style);
+      for (const declaration of declarations) {
+        const property = declaration.slice(0, declaration.indexOf(':'));
+        if (COMPOSITOR_PROPERTIES.has(property)) layers.add(property);
+      }
+      body += `\n  ${frame.at} { ${declarations.join(' ')} }`;
+    }
+    const name = `droy-kf-${contentId(body)}`;
+    this.styles.push(`@keyframes ${name} {${body}\n}\n`);
+    return name;
+  }
+
+  // Lowers a component's `animate` and `transition` children (and a
+  // `transition:` prop) to its declarations. The compositor properties they
+  // animate get `will-change` only while an animation or transition runs,
+  // so idle elements don't each hold a layer.
+  private lowerMotion(children: ASTNode[], props: Record<string, any>): { declarations: string; attributes: string } {
+    const animations: string[] = [];
+    const transitions: string[] = [];
+    const animated = new Set<string>();
+    const transitioned = new Set<string>();
+    let motions = children;
+    if (props.transition) {
+      const value = { type: 'StringLiteral', value: String(props.transition) };
+      motions = [...children, { type: 'Transition', property: null, value, props: {} }];
+    }
+    for (const child of motions) {
+      if (child.type === 'Animation') {
+        const frames = child.frames.length > 0 ? child.frames : child.name ? this.namedFrames(child.name) : null;
+        if (frames) animations.push(animationValue(this.keyframesRule(frames, animated), child.props));
+      } else if (child.type === 'Transition') {
+        const transition = transitionValue(child);
+        if (!transition) continue;
+        let value = transition.value;
+        for (const property of transition.properties) {
+          if (COMPOSITOR_PROPERTIES.has(property)) transitioned.add(property);
+          if (LAYOUT_CSS_PROPERTIES.has(property)) value += LAYOUT_NOTE;
+        }
+        transitions.push(value);
+      }
+    }
+
+    let declarations = '';
+    let attributes = '';
+    if (animations.length > 0) {
+      declarations += `\n  animation: ${animations.join(', ')};`;
+      attributes += layerHandlers(animated, 'animationstart', 'animationend', 'animationcancel');
+    }
+    if (transitions.length > 0) {
+      declarations += `\n  transition: ${transitions.join(', ')};`;
+      attributes += layerHandlers(transitioned, 'transitionrun', 'transitionend', 'transitioncancel');
+    }
+    return { declarations, attributes };
+  }
+
+  private useRuntime(name: UIRuntime): void {
+    this.runtimes.add(name);
+  }
+
+  // Adds a statement that calls the reactive runtime
+  private reactiveScript(code: string): void {
+    this.scripts += `${code};\n`;
+    this.useRuntime('reactive');
+  }
+
+  private renderStatement(node: ASTNode): string {
     switch (node.type) {
       case 'UIComponent':
         return this.generateUIComponent(node);
@@ -1693,6 +3029,19 @@ export class DroyUIGeneratorV3 {
         return this.generateServer(node);
       case 'ServerRequest':
         return this.generateServerRequest(node);
+      case 'Socket':
+        return this.generateSocket(node);
+      case 'Route':
+        return this.generateRoute(node);
+      case 'Router':
+        this.useRuntime('router');
+        this.scripts += `droyRouter.configure(${jsObject(node.config, NO_LOCALS)});\n`;
+        return '';
+      case 'SocketHandler':
+        if (node.handler) {
+          this.reactiveScript(`droy.onSocket(${JSON.stringify(node.event)}, ${jsHandler(node.handler)})`);
+        }
+        return '';
       case 'ColorBlend':
         return this.generateColorBlend(node);
       case 'MathOperation':
@@ -1702,22 +3051,68 @@ export class DroyUIGeneratorV3 {
         return `<!-- ${node.name} = ${JSON.stringify(node.value)} -->`;
       case 'PrintStatement':
         return `<script>console.log(${this.generateExpression(node.value)})</script>`;
+      // `state`/`bind` with a literal sets the initial value; any other
+      // expression keeps the name in sync with it
+      case 'Binding':
+        if (node.target) {
+          const name = JSON.stringify(node.target);
+          this.reactiveScript(
+            node.source && !LITERAL_NODES.has(node.source.type)
+              ? `droy.derive(${name}, () => ${jsExpression(node.source, NO_LOCALS)})`
+              : `droy.write(${name}, ${jsExpression(node.source, NO_LOCALS)})`,
+          );
+        }
+        return '';
+      case 'Watch':
+        if (node.handler) {
+          this.reactiveScript(`droy.watch(() => ${jsExpression(node.target, NO_LOCALS)}, ${jsHandler(node.handler)})`);
+        }
+        return '';
+      case 'Emit':
+        this.reactiveScript(
+          `droy.mount(() => droy.emit(${jsExpression(node.event, NO_LOCALS)}, ${jsExpression(node.data, NO_LOCALS)}))`,
+        );
+        return '';
+      // Outside a component, a handler listens on the whole document
+      case 'EventHandler':
+        if (node.handler) {
+          this.reactiveScript(`droy.listen(${JSON.stringify(domEvent(node.event))}, ${jsHandler(node.handler)})`);
+        }
+        return '';
       default:
         return '';
     }
   }
 
   private generateUIComponent(node: ASTNode): string {
-    const className = this.generateClassName();
     const component = node.component.toLowerCase();
-    const props = node.props || {};
-    const children = node.children || [];
+    const children: ASTNode[] = node.children || [];
+
+    // Literal props, and bare words that name nothing in the program, are used
+    // as they are; the rest are bound at run time
+    const props: Record<string, any> = {};
+    const bound: Array<[string, ASTNode]> = [];
+    for (const [key, value] of Object.entries<any>(node.props || {})) {
+      const words = value && typeof value === 'object' ? bareWords(value) : null;
+      if (value === null || typeof value !== 'object') {
+        props[key] = value;
+      } else if (LITERAL_NODES.has(value.type)) {
+        if (value.value !== null) props[key] = value.value;
+      } else if (words && !words.some((word) => this.isDeclared(word))) {
+        props[key] = words.join('-');
+      } else {
+        bound.push([key, value]);
+      }
+    }
 
     let tag = 'div';
-    let attributes = `class="${className}"`;
+    // Extra attributes after the class; the class is named once the rule is known
+    let attributes = '';
     let content = '';
+    // <source> elements of an image served as a <picture>
+    let sources = '';
 
-    let cssRules = `.${className} {`;
+    let cssRules = '';
 
     // Layout components
     switch (component) {
@@ -1792,33 +3187,66 @@ export class DroyUIGeneratorV3 {
         break;
 
       case 'img':
-      case 'image':
+      case 'image': {
         tag = 'img';
-        const src = props.src || props.value || '';
-        attributes += ` src="${src}" alt="${props.alt || ''}"`;
+        const src = String(props.src || props.value || '');
+        const width = pixels(props.width);
+        const height = pixels(props.height);
+        // Images load as they near the viewport unless marked as the page's
+        // main image
+        const eager = props.priority === true || props.loading === 'eager';
+        const responsive =
+          props.cdn === false ? null : responsiveImage(this.media, src, width, props.sizes ? String(props.sizes) : null);
+        attributes += ` src="${attributeValue(src)}"${responsive?.attributes ?? ''} alt="${attributeValue(String(props.alt || ''))}"`;
+        // Sizes in pixels are also attributes, so the box is reserved before
+        // the stylesheet or the image has loaded
+        attributes += sizeAttributes(width, height);
+        attributes += eager
+          ? ` loading="eager"${props.priority === true ? ' fetchpriority="high"' : ''}`
+          : ' loading="lazy" decoding="async"';
+        sources = responsive?.sources ?? '';
         cssRules += `
   max-width: 100%;
   height: auto;
   border-radius: ${props.radius || '8px'};`;
+        if (props.ratio) cssRules += `
+  aspect-ratio: ${props.ratio};`;
         break;
+      }
 
-      case 'video':
+      case 'video': {
         tag = 'video';
-        const videoSrc = props.src || props.value || '';
-        attributes += ` src="${videoSrc}" controls`;
-        if (props.autoplay) attributes += ' autoplay';
+        const src = String(props.src || props.value || '');
+        const width = pixels(props.width);
+        const height = pixels(props.height);
+        attributes += ` src="${attributeValue(src)}" controls`;
+        attributes += sizeAttributes(width, height);
+        if (props.poster) attributes += ` poster="${attributeValue(String(props.poster))}"`;
+        // Nothing is fetched until the video plays; an `autoplay` video
+        // plays, muted, once it is in view
+        attributes += ` preload="${attributeValue(String(props.preload || 'none'))}"`;
+        if (props.autoplay) {
+          attributes += ' data-droy-autoplay muted playsinline';
+          this.useRuntime('media');
+        } else if (props.muted) {
+          attributes += ' muted';
+        }
         if (props.loop) attributes += ' loop';
-        if (props.muted) attributes += ' muted';
         cssRules += `
   max-width: 100%;
+  height: auto;
   border-radius: ${props.radius || '8px'};`;
+        if (props.ratio) cssRules += `
+  aspect-ratio: ${props.ratio};`;
         break;
+      }
 
-      case 'audio':
+      case 'audio': {
         tag = 'audio';
-        const audioSrc = props.src || props.value || '';
-        attributes += ` src="${audioSrc}" controls`;
+        const src = String(props.src || props.value || '');
+        attributes += ` src="${attributeValue(src)}" controls preload="${attributeValue(String(props.preload || 'none'))}"`;
         break;
+      }
 
       case 'icon':
         tag = 'span';
@@ -1964,65 +3392,193 @@ export class DroyUIGeneratorV3 {
     if (props.z_index) cssRules += `
   z-index: ${props.z_index};`;
 
-    cssRules += '\n}';
-    this.styles += cssRules + '\n';
+    // A `virtual` (or `windowed`) component scrolls its `for` rows and only
+    // keeps the ones in view
+    const windowed = Boolean(props.virtual || props.windowed) && !this.row;
+    if (windowed) {
+      cssRules += `
+  position: relative;
+  overflow-y: auto;`;
+      if (!props.height) cssRules += `
+  height: ${DEFAULT_VIRTUAL_HEIGHT};`;
+    }
+
+    // `route: "/about"` links to a route
+    if (typeof props.route === 'string') {
+      attributes += ` data-droy-link="${attributeValue(props.route)}"`;
+      this.useRuntime('router');
+    }
+
+    const motion = this.lowerMotion(children, props);
+    cssRules += motion.declarations;
+    attributes += motion.attributes;
+
+    // Bindings, handlers and refs find the element by an id derived from the
+    // node; inside a list row, bound props are filled per item instead
+    const id = contentId(JSON.stringify(node));
+    let bindsElement = false;
+    for (const [key, value] of bound) {
+      const target = propTarget(component, key);
+      if (target.kind === 'text') content = '';
+      if (this.row) {
+        this.row.fills.push(
+          `droy.patch(cell, "${id}", "${target.kind}", ${JSON.stringify(target.name)}, ${jsExpression(value, this.row.locals)});`,
+        );
+        attributes += ` data-droy-slot="${id}"`;
+        continue;
+      }
+      const expression = jsExpression(value, NO_LOCALS);
+      this.reactiveScript(
+        target.kind === 'text'
+          ? `droy.text("${id}", () => ${expression})`
+          : `droy.${target.kind}("${id}", ${JSON.stringify(target.name)}, () => ${expression})`,
+      );
+      bindsElement = true;
+    }
+    children.forEach((child, index) => {
+      // Rows are recycled, so nothing stays attached to their elements
+      if (this.row) return;
+      if (child.type === 'EventHandler' && child.handler) {
+        this.reactiveScript(`droy.on("${id}", ${JSON.stringify(domEvent(child.event))}, ${jsHandler(child.handler)}, ${index})`);
+        bindsElement = true;
+      } else if (child.type === 'Ref' && child.name) {
+        this.reactiveScript(`droy.ref("${id}", ${JSON.stringify(child.name)})`);
+        bindsElement = true;
+      }
+    });
+    if (bindsElement) {
+      attributes += ` data-droy="${id}"`;
+    }
+
+    const className = this.styleClasses(cssRules, tag);
+    attributes = className ? `class="${className}"${attributes}` : attributes.trimStart();
+    const opening = attributes ? `${tag} ${attributes}` : tag;
+
+    const list = {
+      windowed,
+      rowHeight: parseFloat(props.row_height ?? props.rowheight) || 0,
+      columns: component === 'grid' ? Number(props.cols || 3) : 1,
+      gap: String(props.gap || '16px'),
+    };
+    const childrenHtml = children
+      .filter((child) => !ATTACHED_NODES.has(child.type))
+      .map((child) => (this.isList(child) ? this.generateList(child, list) : this.generateStatement(child)))
+      .join('\n');
+
+    if (tag === 'img') {
+      return sources ? `<picture>${sources}<${opening} /></picture>` : `<${opening} />`;
+    }
+    if (tag === 'input') {
+      return `<${opening} />`;
+    }
+
+    return `<${opening}>${content}${childrenHtml}</${tag}>`;
+  }
+
+  // Only "/" shows before the router has started
+  private generateRoute(node: ASTNode): string {
+    this.useRuntime('router');
+    return routeSection(node.path, this.generateChildren(node.children), { hidden: node.path !== '/' });
+  }
+
+  private generateChildren(children: ASTNode[]): string {
+    return children.map((child) => this.generateStatement(child)).filter((html) => html).join('\n');
+  }
 
-    const childrenHtml = children.map((child: ASTNode) => this.generateStatement(child)).join('\n');
+  // A `for` in a component that renders components, outside any other row
+  private isList(node: ASTNode): boolean {
+    return node.type === 'ForLoop' && !this.row && node.body.some((stmt: ASTNode) => stmt.type === 'UIComponent');
+  }
 
-    if (tag === 'img' || tag === 'video' || tag === 'audio' || tag === 'input') {
-      return `<${tag} ${attributes} />`;
+  // The loop body becomes a row template that the runtime clones and fills
+  // for each item, so the page holds one template however long the data is
+  private generateList(
+    loop: ASTNode,
+    options: { windowed: boolean; rowHeight: number; columns: number; gap: string },
+  ): string {
+    const id = contentId(JSON.stringify(loop));
+    this.row = { locals: new Set([loop.iterator]), fills: [] };
+    let template: string;
+    let fills: string[];
+    try {
+      template = loop.body
+        .filter((stmt: ASTNode) => stmt.type === 'UIComponent')
+        .map((stmt: ASTNode) => this.generateStatement(stmt))
+        .join('\n');
+      fills = this.row.fills;
+    } finally {
+      this.row = null;
     }
 
-    return `<${tag} ${attributes}>${content}${childrenHtml}</${tag}>`;
+    this.reactiveScript(
+      `droy.list("${id}", ${JSON.stringify(template)}, () => ${jsExpression(loop.iterable, NO_LOCALS)}, ` +
+      `(cell, ${jsName(loop.iterator)}) => { ${fills.join(' ')} }, ${JSON.stringify(options)})`,
+    );
+    return options.columns > 1
+      ? `<div data-droy="${id}" style="grid-column: 1 / -1"></div>`
+      : `<div data-droy="${id}"></div>`;
   }
 
   private generateData(node: ASTNode): string {
-    const dataId = `data-${Math.random().toString(36).substr(2, 9)}`;
+    // Derived from the node rather than random, so cached output is reproducible
+    const dataId = `data-${contentId(JSON.stringify(node))}`;
+    if (node.url) {
+      this.reactiveScript(
+        `droy.load(${JSON.stringify(node.name)}, ${jsExpression(node.url, NO_LOCALS)}, ${JSON.stringify(node.format)})`,
+      );
+      return `<script>/* Data: ${node.name} (${node.format}, loaded) */</script>`;
+    }
+    const source = node.source ? jsExpression(node.source, NO_LOCALS) : '{}';
+    if (node.source && !literalTree(node.source)) this.useRuntime('reactive');
     this.scripts += `
 // Data: ${node.name}
-const ${node.name || dataId} = ${JSON.stringify(node.source || {})};
+const ${node.name ? jsName(node.name) : dataId} = ${source};
 `;
+    // Pages with the reactive runtime also read data through its store
+    if (node.name) {
+      this.scripts += `if (typeof droy !== 'undefined') droy.write(${JSON.stringify(node.name)}, ${jsName(node.name)});\n`;
+    }
     return `<script>/* Data: ${node.name} */</script>`;
   }
 
+  // Settings merge into the runtime's serverConfig, which every request uses
   private generateServer(node: ASTNode): string {
-    this.scripts += `
-// Server config
-const serverConfig = ${JSON.stringify(node.config || {})};
-`;
+    this.reactiveScript(`droy.server(${jsObject(node.config || {}, NO_LOCALS)})`);
     return `<!-- Server configured -->`;
   }
 
   private generateServerRequest(node: ASTNode): string {
-    this.scripts += `
-// ${node.method.toUpperCase()} request
-fetch('${node.url}', {
-  method: '${node.method.toUpperCase()}',
-  ...${JSON.stringify(node.options || {})}
-});
-`;
-    return `<!-- ${node.method.toUpperCase()} ${node.url} -->`;
+    this.reactiveScript(jsRequest(node, NO_LOCALS));
+    const url = node.url?.type === 'StringLiteral' ? ` ${node.url.value}` : '';
+    return `<!-- ${node.method === 'fetch' ? 'GET' : node.method.toUpperCase()}${url} -->`;
+  }
+
+  private generateSocket(node: ASTNode): string {
+    this.reactiveScript(`droy.socket(${jsExpression(node.url, NO_LOCALS)})`);
+    return '';
   }
 
   private generateColorBlend(node: ASTNode): string {
-    const className = this.generateClassName();
     const colors = node.colors || [];
     
-    let gradient = '';
+    let background = '';
     if (node.blendType === 'gradient') {
-      gradient = `linear-gradient(135deg, ${colors.join(', ')})`;
+      background = `
+  background: linear-gradient(135deg, ${colors.join(', ')});`;
     } else if (node.blendType === 'blend') {
-      gradient = `mix-blend-mode: ${node.mode}; background: ${colors[0] || '#000'}`;
+      // 'normal' is the initial mix-blend-mode; DroyOptimizer folds literal
+      // blends down to one color in that mode
+      background = `${node.mode === 'normal' ? '' : `
+  mix-blend-mode: ${node.mode};`}
+  background: ${colors[0] || '#000'};`;
     }
 
-    this.styles += `.${className} {
-  background: ${gradient};
+    const declarations = `${background}
   width: 200px;
   height: 200px;
-  border-radius: 12px;
-}\n`;
-
-    return `<div class="${className}"></div>`;
+  border-radius: 12px;`;
+    const className = this.styleClasses(declarations, 'div');
+    return className ? `<div class="${className}"></div>` : '<div></div>';
   }
 
   private generateExpression(node: ASTNode): string {
@@ -2045,43 +3601,203 @@ fetch('${node.url}', {
   }
 }
 
+// Applies a UIPatch to the fragments received so far and returns the full
+// output, identical to what generate() returned for the same AST, along with
+// the fragments in document order and the rules `css` joins.
+export function applyUIPatch(
+  fragments: Map<string, UIFragment>,
+  patch: UIPatch,
+): { html: string; css: string; js: string; fragments: UIFragment[]; rules: string[] } {
+  for (const id of patch.removed) {
+    fragments.delete(id);
+  }
+  for (const fragment of patch.added) {
+    fragments.set(fragment.id, fragment);
+  }
+
+  const ordered: UIFragment[] = [];
+  const htmlParts: string[] = [];
+  const rules: string[] = [];
+  let js = '';
+  const runtimes = new Set<UIRuntime>();
+  for (const id of patch.order) {
+    const fragment = fragments.get(id)!;
+    ordered.push(fragment);
+    if (fragment.html) {
+      htmlParts.push(fragment.html);
+    }
+    rules.push(...fragment.rules);
+    js += fragment.js;
+    for (const runtime of fragment.runtimes) runtimes.add(runtime);
+  }
+  const seen = new Set<string>();
+  const joined = rules.filter((rule) => {
+    if (!patch.uniqueRules && !isSharedRule(rule)) return true;
+    if (seen.has(rule)) return false;
+    seen.add(rule);
+    return true;
+  });
+  return {
+    html: htmlParts.join('\n'),
+    css: joined.join(''),
+    js: runtimeCode(runtimes) + js,
+    fragments: ordered,
+    rules: joined,
+  };
+}
+
 // Main Compiler class
+// A compiler instance remembers the last source it tokenized, parsed and
+// generated, so repeated calls with an edited source only redo the lines and
+// statements that changed.
+export interface DroyCompilerV3Options {
+  // Lex into a TokenBuffer instead of Token objects. Uses far less memory on
+  // large sources, but every compile re-lexes the whole source.
+  compactTokens?: boolean;
+  // How component CSS is written; see CssMode
+  css?: CssMode;
+  // Image CDN and srcset widths for img components
+  media?: DroyMediaOptions;
+  // AST passes run before generating or running; false skips them
+  optimize?: DroyOptimizerOptions | false;
+  // Where `import`ed files are read from; the compiled source is the file
+  // `path` (default main.droy). Without it imports are ignored.
+  modules?: DroyModuleHost;
+  path?: string;
+  // compile() also returns per-phase timings, sizes and cache reuse
+  stats?: boolean;
+}
+
+export interface DroyCompileResult {
+  tokens: Token[] | TokenBuffer<TokenType>;
+  ast: ASTNode;
+  html: string;
+  css: string;
+  js: string;
+  // Only with the `stats` option
+  stats?: CompileStats;
+}
+
 export class DroyCompilerV3 {
-  public compile(source: string): { 
-    tokens: Token[]; 
-    ast: ASTNode; 
-    html: string;
-    css: string;
-    js: string;
-  } {
-    const lexer = new DroyLexerV3(source);
-    const tokens = lexer.tokenize();
-
-    const parser = new DroyParserV3(tokens);
-    const ast = parser.parse();
-
-    const uiGenerator = new DroyUIGeneratorV3();
-    const { html, css, js } = uiGenerator.generate(ast);
+  private lexer: DroyLexerV3 | null = null;
+  private tokens: Token[] = [];
+  private parser: DroyParserV3 | null = null;
+  private generator: DroyUIGeneratorV3;
+  private compactTokens: boolean;
+  private optimizer: DroyOptimizer | null;
+  private modules: DroyModuleGraph | null;
+  private path: string;
+  private stats: boolean;
+  // Tokens the last tokenize() call had to scan
+  private scanned: number = 0;
+  // What that call kept of the tokens before it, for the parser
+  private lexEdit: { previous: Token[]; window: LexWindow } | null = null;
+
+  constructor(options: DroyCompilerV3Options = {}) {
+    this.compactTokens = options.compactTokens ?? false;
+    this.generator = new DroyUIGeneratorV3({ css: options.css, media: options.media });
+    this.optimizer = options.optimize === false ? null : new DroyOptimizer(options.optimize);
+    this.modules = options.modules
+      ? new DroyModuleGraph(options.modules, (source) => new DroyParserV3(new DroyLexerV3(source).tokenizeCompact()).parse())
+      : null;
+    this.path = options.path ?? 'main.droy';
+    this.stats = options.stats ?? false;
+  }
+
+  public compile(source: string): DroyCompileResult {
+    if (this.stats) return this.compileTraced(source);
+
+    const tokens = this.compactTokens ? this.tokenizeCompact(source) : this.tokenize(source);
+    const ast = this.parseTokens(tokens);
+    const { html, css, js } = this.generator.generate(this.optimize(ast));
 
     return { tokens, ast, html, css, js };
   }
 
+  private compileTraced(source: string): DroyCompileResult {
+    const trace = new CompileTrace();
+    const tokens = trace.time('lex', 'phase', () => this.compactTokens ? this.tokenizeCompact(source) : this.tokenize(source));
+    trace.cache.lexer.total = tokens.length;
+    trace.cache.lexer.reused = this.compactTokens ? 0 : tokens.length - this.scanned;
+
+    const ast = trace.time('parse', 'phase', () => this.parseTokens(tokens));
+    trace.cache.parser.total = ast.body.length;
+    trace.cache.parser.reused = this.parser!.getReusedStatementCount();
+
+    const linked = this.modules ? trace.time('link', 'phase', () => this.modules!.link(this.path, ast)) : ast;
+    const optimized = this.optimizer ? trace.time('optimize', 'phase', () => this.optimizer!.optimize(linked)) : linked;
+
+    this.generator.setTrace(trace);
+    let output: { html: string; css: string; js: string };
+    try {
+      output = trace.time('generate', 'phase', () => this.generator.generate(optimized));
+    } finally {
+      this.generator.setTrace(null);
+    }
+
+    const stats = compileStats(trace, { tokens: tokens.length, ast, ...output });
+    return { tokens, ast, ...output, stats };
+  }
+
+  // Compiles the program to bytecode and runs it
+  public run(source: string, options?: DroyVMOptions): DroyRunResult {
+    const tokens = this.compactTokens ? this.tokenizeCompact(source) : this.tokenize(source);
+    return runDroy(this.optimize(this.parseTokens(tokens)), options);
+  }
+
   public tokenize(source: string): Token[] {
-    const lexer = new DroyLexerV3(source);
-    return lexer.tokenize();
+    if (!this.lexer) {
+      this.lexer = new DroyLexerV3(source);
+      this.tokens = this.lexer.tokenize();
+      this.scanned = this.tokens.length;
+      return this.tokens;
+    }
+
+    const edit = computeEdit(this.lexer.getSource(), source);
+    const previous = this.tokens;
+    this.scanned = 0;
+    this.lexEdit = { previous, window: { prefix: previous.length, suffix: 0 } };
+    if (edit) {
+      this.tokens = this.lexer.retokenize(previous, edit);
+      this.scanned = this.lexer.getScannedTokenCount();
+      this.lexEdit = { previous, window: this.lexer.getReusedWindow() };
+    }
+    return this.tokens;
+  }
+
+  public tokenizeCompact(source: string): TokenBuffer<TokenType> {
+    return new DroyLexerV3(source).tokenizeCompact();
   }
 
   public parse(source: string): ASTNode {
-    const lexer = new DroyLexerV3(source);
-    const tokens = lexer.tokenize();
-    const parser = new DroyParserV3(tokens);
-    return parser.parse();
+    const tokens = this.compactTokens ? this.tokenizeCompact(source) : this.tokenize(source);
+    return this.parseTokens(tokens);
+  }
+
+  // The parser is kept too, so unchanged top-level statements keep their
+  // node identity from one compile to the next.
+  private parseTokens(tokens: Token[] | TokenBuffer<TokenType>): ASTNode {
+    if (!this.parser) {
+      this.parser = new DroyParserV3(tokens);
+      return this.parser.parse();
+    }
+    return this.parser.reparse(tokens, Array.isArray(tokens) ? (this.lexEdit ?? undefined) : undefined);
+  }
+
+  // Links in what the program imports, then runs the AST passes
+  private optimize(ast: ASTNode): ASTNode {
+    const linked = this.modules ? this.modules.link(this.path, ast) : ast;
+    return this.optimizer ? this.optimizer.optimize(linked) : linked;
   }
 
   public generateUI(source: string): { html: string; css: string; js: string } {
-    const ast = this.parse(source);
-    const generator = new DroyUIGeneratorV3();
-    return generator.generate(ast);
+    return this.generator.generate(this.optimize(this.parse(source)));
+  }
+
+  // Like generateUI(), but returns only the fragments that changed since the
+  // previous generatePatch() call on this compiler.
+  public generatePatch(source: string): UIPatch {
+    return this.generator.generatePatch(this.optimize(this.parse(source)));
   }
 }
 
@@ -3,6 +3,29 @@
 // ~s=p*hello  (pointer-style strings)
 // ~s=txt="hi" (variable-style strings)
 
+import { CharCode, DroyScanner, KeywordTable, isDigit, isIdentStart, isWhitespace } from './scanner';
+import { tokenSet, type ASTNode, type TokenSet, type Token as SharedToken } from './ast';
+import { DroyParserCore } from './parser';
+import { C_RUNTIME, DOUBLE_FORMAT, SECTION_DEPENDENCIES, SECTION_INCLUDES, SECTION_ORDER, type CRuntimeSection } from './c-runtime';
+import { DroyOptimizer, type DroyOptimizerOptions } from './optimizer';
+import { DroyModuleGraph, type DroyModuleHost } from './modules';
+import {
+  BOOL,
+  DOUBLE,
+  DroyTypeInference,
+  INT,
+  STRING,
+  VALUE,
+  VOID,
+  isNumeric,
+  isPrimitive,
+  typeKey,
+  type DroyFunction,
+  type DroyMathCall,
+  type DroyType,
+  type DroyVariable,
+} from './type-inference';
+
 export type TokenType = 
   | 'SET' | 'GET' | 'VAR' | 'FUNC' | 'RETURN' | 'IF' | 'ELSE' | 'FOR' | 'WHILE'
   | 'PRINT' | 'INPUT' | 'LINK' | 'ARRAY' | 'CLASS' | 'IMPORT' | 'EXPORT'
@@ -14,28 +37,14 @@ export type TokenType =
   | 'COMMA' | 'COLON' | 'SEMICOLON' | 'DOT' | 'ARROW'
   | 'COMMENT' | 'NEWLINE' | 'EOF' | 'POINTER' | 'TILDE';
 
-export interface Token {
-  type: TokenType;
-  value: string;
-  line: number;
-  column: number;
-}
+export type Token = SharedToken<TokenType>;
 
-export interface ASTNode {
-  type: string;
-  [key: string]: any;
-}
+export type { ASTNode };
 
 // Lexer: Converts source code into tokens
-export class DroyLexer {
-  private source: string;
-  private position: number = 0;
-  private line: number = 1;
-  private column: number = 1;
-  private tokens: Token[] = [];
-
+export class DroyLexer extends DroyScanner<TokenType> {
   // Keywords mapping
-  private keywords: Map<string, TokenType> = new Map([
+  private keywords = new KeywordTable<TokenType>([
     ['set', 'SET'],
     ['get', 'GET'],
     ['var', 'VAR'],
@@ -57,344 +66,217 @@ export class DroyLexer {
     ['null', 'NULL'],
   ]);
 
-  constructor(source: string) {
-    this.source = source;
-  }
-
-  private peek(offset: number = 0): string {
-    const pos = this.position + offset;
-    return pos < this.source.length ? this.source[pos] : '\0';
-  }
-
-  private advance(): string {
-    const char = this.peek();
-    this.position++;
-    if (char === '\n') {
-      this.line++;
-      this.column = 1;
-    } else {
-      this.column++;
-    }
-    return char;
-  }
-
-  private skipWhitespace(): void {
-    while (/\s/.test(this.peek()) && this.peek() !== '\n') {
-      this.advance();
-    }
-  }
-
-  private readString(quote: string): string {
-    let value = '';
-    this.advance(); // skip opening quote
-    while (this.peek() !== quote && this.peek() !== '\0') {
-      if (this.peek() === '\\') {
-        this.advance();
-        const escaped = this.advance();
-        switch (escaped) {
-          case 'n': value += '\n'; break;
-          case 't': value += '\t'; break;
-          case 'r': value += '\r'; break;
-          case '\\': value += '\\'; break;
-          case '"': value += '"'; break;
-          case "'": value += "'"; break;
-          default: value += escaped;
-        }
-      } else {
-        value += this.advance();
-      }
-    }
-    this.advance(); // skip closing quote
-    return value;
-  }
-
-  private readNumber(): string {
-    let value = '';
-    while (/[0-9.]/.test(this.peek())) {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private readIdentifier(): string {
-    let value = '';
-    while (/[a-zA-Z0-9_]/.test(this.peek())) {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private readComment(): string {
-    let value = '';
-    while (this.peek() !== '\n' && this.peek() !== '\0') {
-      value += this.advance();
-    }
-    return value;
-  }
-
-  private addToken(type: TokenType, value: string): void {
-    this.tokens.push({
-      type,
-      value,
-      line: this.line,
-      column: this.column - value.length,
-    });
-  }
-
   public tokenize(): Token[] {
     while (this.position < this.source.length) {
-      const char = this.peek();
-
-      // New syntax: ~s=p*hello (pointer-style string)
-      if (char === '~') {
-        this.advance();
-        const next = this.peek();
-        if (next === 's') {
-          this.advance();
-          this.addToken('SET', '~s');
-          continue;
-        } else if (next === 'g') {
-          this.advance();
-          this.addToken('GET', '~g');
-          continue;
-        }
-        this.addToken('TILDE', '~');
-        continue;
-      }
-
-      // Pointer-style string: p*hello
-      if (char === 'p' && this.peek(1) === '*') {
-        this.advance(); // p
-        this.advance(); // *
-        let value = '';
-        while (this.peek() !== '\n' && this.peek() !== '\0' && this.peek() !== ' ') {
-          value += this.advance();
+      const code = this.peekCode();
+
+      // Words, blanks and numbers make up most of a source
+      if (isIdentStart(code)) {
+        // Pointer-style string: p*hello
+        if (code === CharCode.LowerP && this.peekCode(1) === CharCode.Asterisk) {
+          this.readPointer();
+        } else {
+          this.readWord(this.keywords, 'IDENTIFIER');
         }
-        this.addToken('POINTER', value);
         continue;
       }
 
-      // Skip whitespace
-      if (/\s/.test(char) && char !== '\n') {
+      if (isWhitespace(code)) {
         this.skipWhitespace();
         continue;
       }
 
-      // Newlines
-      if (char === '\n') {
-        this.addToken('NEWLINE', '\n');
-        this.advance();
+      if (isDigit(code)) {
+        const value = this.readNumber(false);
+        this.addToken('NUMBER', value);
         continue;
       }
 
-      // Comments
-      if (char === '#') {
-        this.readComment();
-        continue;
-      }
+      // Prefixes, comments and strings are decided by the first char
+      switch (code) {
+        // New syntax: ~s=p*hello (pointer-style string)
+        case CharCode.Tilde: {
+          this.advance();
+          const next = this.peekCode();
+          if (next === CharCode.LowerS) {
+            this.advance();
+            this.addToken('SET', '~s');
+          } else if (next === CharCode.LowerG) {
+            this.advance();
+            this.addToken('GET', '~g');
+          } else {
+            this.addToken('TILDE', '~');
+          }
+          continue;
+        }
 
-      // Strings
-      if (char === '"' || char === "'") {
-        const value = this.readString(char);
-        this.addToken('STRING', value);
-        continue;
-      }
+        case CharCode.Newline:
+          this.addToken('NEWLINE', '\n');
+          this.advance();
+          continue;
 
-      // Numbers
-      if (/[0-9]/.test(char)) {
-        const value = this.readNumber();
-        this.addToken('NUMBER', value);
-        continue;
-      }
+        case CharCode.Hash:
+          this.skipComment();
+          continue;
 
-      // Identifiers and keywords
-      if (/[a-zA-Z_]/.test(char)) {
-        const value = this.readIdentifier();
-        const type = this.keywords.get(value) || 'IDENTIFIER';
-        this.addToken(type, value);
-        continue;
+        case CharCode.DoubleQuote:
+        case CharCode.SingleQuote: {
+          const value = this.readString(code);
+          this.addToken('STRING', value);
+          continue;
+        }
       }
 
-      // Operators and punctuation
-      switch (char) {
-        case '+':
-          this.advance();
-          if (this.peek() === '=') {
+      // Operators and punctuation (unknown characters are skipped)
+      this.advance();
+      const next = this.peekCode();
+      switch (code) {
+        case CharCode.Plus:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '+=');
           } else {
             this.addToken('PLUS', '+');
           }
           break;
-        case '-':
-          this.advance();
-          if (this.peek() === '>') {
+        case CharCode.Minus:
+          if (next === CharCode.GreaterThan) {
             this.advance();
             this.addToken('ARROW', '->');
-          } else if (this.peek() === '=') {
+          } else if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '-=');
           } else {
             this.addToken('MINUS', '-');
           }
           break;
-        case '*':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Asterisk:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '*=');
           } else {
             this.addToken('MULTIPLY', '*');
           }
           break;
-        case '/':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Slash:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('ASSIGN', '/=');
           } else {
             this.addToken('DIVIDE', '/');
           }
           break;
-        case '%':
-          this.advance();
+        case CharCode.Percent:
           this.addToken('MODULO', '%');
           break;
-        case '=':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Equals:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('EQ', '==');
           } else {
             this.addToken('ASSIGN', '=');
           }
           break;
-        case '!':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.Exclamation:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('NEQ', '!=');
           } else {
             this.addToken('NOT', '!');
           }
           break;
-        case '<':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.LessThan:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('LTE', '<=');
           } else {
             this.addToken('LT', '<');
           }
           break;
-        case '>':
-          this.advance();
-          if (this.peek() === '=') {
+        case CharCode.GreaterThan:
+          if (next === CharCode.Equals) {
             this.advance();
             this.addToken('GTE', '>=');
           } else {
             this.addToken('GT', '>');
           }
           break;
-        case '&':
-          this.advance();
-          if (this.peek() === '&') {
+        case CharCode.Ampersand:
+          if (next === CharCode.Ampersand) {
             this.advance();
             this.addToken('AND', '&&');
           }
           break;
-        case '|':
-          this.advance();
-          if (this.peek() === '|') {
+        case CharCode.Pipe:
+          if (next === CharCode.Pipe) {
             this.advance();
             this.addToken('OR', '||');
           }
           break;
-        case '(':
-          this.advance();
+        case CharCode.OpenParen:
           this.addToken('LPAREN', '(');
           break;
-        case ')':
-          this.advance();
+        case CharCode.CloseParen:
           this.addToken('RPAREN', ')');
           break;
-        case '{':
-          this.advance();
+        case CharCode.OpenBrace:
           this.addToken('LBRACE', '{');
           break;
-        case '}':
-          this.advance();
+        case CharCode.CloseBrace:
           this.addToken('RBRACE', '}');
           break;
-        case '[':
-          this.advance();
+        case CharCode.OpenBracket:
           this.addToken('LBRACKET', '[');
           break;
-        case ']':
-          this.advance();
+        case CharCode.CloseBracket:
           this.addToken('RBRACKET', ']');
           break;
-        case ',':
-          this.advance();
+        case CharCode.Comma:
           this.addToken('COMMA', ',');
           break;
-        case ':':
-          this.advance();
+        case CharCode.Colon:
           this.addToken('COLON', ':');
           break;
-        case ';':
-          this.advance();
+        case CharCode.Semicolon:
           this.addToken('SEMICOLON', ';');
           break;
-        case '.':
-          this.advance();
+        case CharCode.Dot:
           this.addToken('DOT', '.');
           break;
-        default:
-          // Unknown character, skip it
-          this.advance();
       }
     }
 
     this.addToken('EOF', '');
     return this.tokens;
   }
-}
-
-// Parser: Converts tokens into AST
-export class DroyParser {
-  private tokens: Token[];
-  private position: number = 0;
-
-  constructor(tokens: Token[]) {
-    this.tokens = tokens;
-  }
-
-  private peek(offset: number = 0): Token {
-    const pos = this.position + offset;
-    return pos < this.tokens.length ? this.tokens[pos] : this.tokens[this.tokens.length - 1];
-  }
 
-  private advance(): Token {
-    return this.tokens[this.position++];
-  }
-
-  private expect(type: TokenType): Token {
-    const token = this.advance();
-    if (token.type !== type) {
-      throw new Error(`Expected ${type} but got ${token.type} at line ${token.line}`);
+  // Reads `p*` and the text up to the next space or newline
+  private readPointer(): void {
+    this.advance(); // p
+    this.advance(); // *
+    const start = this.position;
+    let end = start;
+    while (end < this.source.length) {
+      const c = this.source.charCodeAt(end);
+      if (c === CharCode.Newline || c === CharCode.Null || c === CharCode.Space) break;
+      end++;
     }
-    return token;
+    this.addToken('POINTER', this.consume(start, end));
   }
+}
 
-  private match(...types: TokenType[]): boolean {
-    return types.includes(this.peek().type);
-  }
+const EQUALITY_OPERATORS = tokenSet<TokenType>('EQ', 'NEQ');
+const COMPARISON_OPERATORS = tokenSet<TokenType>('LT', 'GT', 'LTE', 'GTE');
+const ADDITIVE_OPERATORS = tokenSet<TokenType>('PLUS', 'MINUS');
+const MULTIPLICATIVE_OPERATORS = tokenSet<TokenType>('MULTIPLY', 'DIVIDE', 'MODULO');
+const UNARY_OPERATORS = tokenSet<TokenType>('NOT', 'MINUS');
+// Words read as a variable in expressions
+const IDENTIFIER_TOKENS = tokenSet<TokenType>('GET', 'IDENTIFIER');
 
-  private skipNewlines(): void {
-    while (this.match('NEWLINE')) {
-      this.advance();
-    }
+// Parser: Converts tokens into AST
+export class DroyParser extends DroyParserCore<TokenType> {
+  constructor(tokens: Token[]) {
+    super(tokens);
   }
 
   public parse(): ASTNode {
@@ -671,11 +553,13 @@ export class DroyParser {
     let left = this.parseOr();
     
     if (this.match('ASSIGN')) {
+      // `n += 1` is read as `n = n + 1`, so `/=` divides as `/` does
       const op = this.advance().value;
-      const right = this.parseExpression();
+      const value = this.parseExpression();
+      const right = op === '=' ? value : { type: 'BinaryExpression', operator: op[0], left, right: value };
       return {
         type: 'AssignmentExpression',
-        operator: op,
+        operator: '=',
         left,
         right,
       };
@@ -721,7 +605,7 @@ export class DroyParser {
   private parseEquality(): ASTNode {
     let left = this.parseComparison();
     
-    while (this.match('EQ', 'NEQ')) {
+    while (this.matchAny(EQUALITY_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseComparison();
       left = {
@@ -738,7 +622,7 @@ export class DroyParser {
   private parseComparison(): ASTNode {
     let left = this.parseAdditive();
     
-    while (this.match('LT', 'GT', 'LTE', 'GTE')) {
+    while (this.matchAny(COMPARISON_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseAdditive();
       left = {
@@ -755,7 +639,7 @@ export class DroyParser {
   private parseAdditive(): ASTNode {
     let left = this.parseMultiplicative();
     
-    while (this.match('PLUS', 'MINUS')) {
+    while (this.matchAny(ADDITIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseMultiplicative();
       left = {
@@ -772,7 +656,7 @@ export class DroyParser {
   private parseMultiplicative(): ASTNode {
     let left = this.parseUnary();
     
-    while (this.match('MULTIPLY', 'DIVIDE', 'MODULO')) {
+    while (this.matchAny(MULTIPLICATIVE_OPERATORS)) {
       const op = this.advance().value;
       const right = this.parseUnary();
       left = {
@@ -787,7 +671,7 @@ export class DroyParser {
   }
 
   private parseUnary(): ASTNode {
-    if (this.match('NOT', 'MINUS')) {
+    if (this.matchAny(UNARY_OPERATORS)) {
       const op = this.advance().value;
       const operand = this.parseUnary();
       return {
@@ -857,7 +741,7 @@ export class DroyParser {
       };
     }
     
-    if (this.match('GET', 'IDENTIFIER')) {
+    if (this.matchAny(IDENTIFIER_TOKENS)) {
       const name = this.advance().value;
       return {
         type: 'Identifier',
@@ -926,11 +810,121 @@ export class DroyParser {
   }
 }
 
-// Code Generator: Converts AST to C code
+// Code Generator: Converts AST to C code. Static types come from
+// DroyTypeInference; where none could be inferred the generated code falls
+// back to the tagged DroyValue runtime. Strings, arrays and boxed values come
+// from the runtime's arena, in regions released once nothing can reach them.
+export interface DroyCodeGeneratorOptions {
+  // Infer static types (the default). When false every variable,
+  // parameter and result is a DroyValue.
+  inferTypes?: boolean;
+}
+
+// C keywords and library names a Droy identifier must not shadow
+const C_RESERVED = new Set([
+  'auto', 'bool', 'break', 'case', 'char', 'const', 'continue', 'default', 'do', 'double',
+  'else', 'enum', 'extern', 'false', 'float', 'for', 'goto', 'if', 'inline', 'int', 'long',
+  'register', 'restrict', 'return', 'short', 'signed', 'sizeof', 'static', 'struct', 'switch',
+  'true', 'typedef', 'union', 'unsigned', 'void', 'volatile', 'while', 'main', 'printf',
+  'malloc', 'free', 'memcpy', 'strcmp', 'strtod', 'fmod', 'NULL',
+]);
+
+function cIdentifier(name: string): string {
+  return C_RESERVED.has(name) || /^(droy_|Droy|DROY_)/.test(name) ? `${name}_` : name;
+}
+
+function cString(text: string): string {
+  const escaped = text.replace(/[\\"\x00-\x1f]/g, (char) => {
+    switch (char) {
+      case '\\': return '\\\\';
+      case '"': return '\\"';
+      case '\n': return '\\n';
+      case '\r': return '\\r';
+      case '\t': return '\\t';
+      default: return `\\${char.charCodeAt(0).toString(8).padStart(3, '0')}`;
+    }
+  });
+  return `"${escaped}"`;
+}
+
+// Wraps C code in parentheses unless it already is one operand
+function parenthesize(code: string): string {
+  if (/^[\w.]+$/.test(code)) return code;
+  if (code.startsWith('(') && code.endsWith(')')) {
+    let depth = 0;
+    for (let i = 0; i < code.length; i++) {
+      if (code[i] === '(') depth++;
+      else if (code[i] === ')' && --depth === 0) return i === code.length - 1 ? code : `(${code})`;
+    }
+  }
+  return `(${code})`;
+}
+
+const VALUE_OPERATIONS: Record<string, string> = {
+  '+': 'droy_add',
+  '-': 'droy_sub',
+  '*': 'droy_mul',
+  '/': 'droy_div',
+  '%': 'droy_mod',
+};
+
+// One piece of a string concatenation: literal text, or a printf
+// conversion and its argument
+type FormatPart = { text: string } | { conversion: string; argument: string };
+
+// Types whose C values point into the arena
+function holdsMemory(type: DroyType): boolean {
+  return !isPrimitive(type) || type.kind === 'string';
+}
+
+// The nodes directly below `node`
+function childNodes(node: ASTNode): ASTNode[] {
+  const children: ASTNode[] = [];
+  const collect = (value: unknown): void => {
+    if (Array.isArray(value)) {
+      for (const item of value) collect(item);
+    } else if (value && typeof value === 'object') {
+      if (typeof (value as ASTNode).type === 'string') {
+        children.push(value as ASTNode);
+      } else {
+        for (const key in value) collect((value as Record<string, unknown>)[key]);
+      }
+    }
+  };
+  for (const key in node) {
+    if (key !== 'type') collect(node[key]);
+  }
+  return children;
+}
+
 export class DroyCodeGenerator {
   private indentLevel: number = 0;
   private output: string = '';
   private includes: Set<string> = new Set();
+  private inferTypes: boolean;
+  private types = new DroyTypeInference();
+  private owner: ASTNode = { type: 'Program', body: [] };
+  private runtime = new Set<CRuntimeSection>();
+  private typeNames = new Map<string, string>();
+  private typeDefinitions: string[] = [];
+  private tempCounter: number = 0;
+  // String constants by their text, to the DROY_STATIC_STRING holding it
+  private literals = new Map<string, string>();
+  // Functions that write allocated values where their caller can see them
+  private escaping = new Set<DroyFunction>();
+  // Functions whose allocations may outlive the call
+  private leaking = new Set<DroyFunction>();
+  // Functions that release their allocations when they return
+  private regions = new Set<DroyFunction>();
+  // The mark of the function being generated, if it has a region
+  private region: string | null = null;
+  // Whether the statements being generated may run many times without a
+  // region around them, so each one that allocates gets its own
+  private repeated: boolean = false;
+
+  constructor(options: DroyCodeGeneratorOptions = {}) {
+    this.inferTypes = options.inferTypes ?? true;
+  }
 
   private indent(): string {
     return '  '.repeat(this.indentLevel);
@@ -940,60 +934,140 @@ export class DroyCodeGenerator {
     this.output += this.indent() + line + '\n';
   }
 
+  // Runs `generate` against an empty output and returns what it emitted
+  private capture(generate: () => void): string {
+    const saved = this.output;
+    this.output = '';
+    generate();
+    const captured = this.output;
+    this.output = saved;
+    return captured;
+  }
+
   public generate(ast: ASTNode): string {
-    this.includes.add('#include <stdio.h>');
-    this.includes.add('#include <stdlib.h>');
-    this.includes.add('#include <string.h>');
-    this.includes.add('#include <stdbool.h>');
+    this.output = '';
+    this.includes = new Set([
+      '#include <stdio.h>',
+      '#include <stdlib.h>',
+      '#include <string.h>',
+      '#include <stdbool.h>',
+    ]);
+    this.runtime.clear();
+    this.typeNames.clear();
+    this.typeDefinitions = [];
+    this.tempCounter = 0;
+    this.literals.clear();
+    this.types = new DroyTypeInference({ dynamic: !this.inferTypes }).infer(ast);
+    this.analyzeRegions();
+
+    // Functions are hoisted to file scope; main() runs the other statements
+    const functions = this.capture(() => {
+      for (const fn of this.types.getFunctions()) {
+        this.generateFunctionDeclaration(fn);
+      }
+    });
 
-    this.emit('/* Generated by Droy Compiler */');
-    this.emit();
+    const main = this.capture(() => {
+      this.owner = ast;
+      this.region = null;
+      this.repeated = false;
+      this.emit('int main() {');
+      this.indentLevel++;
+      this.generateHoistedDeclarations(ast);
 
-    // Generate forward declarations
-    this.generateForwardDeclarations(ast);
-    
-    // Generate main function
-    this.emit('int main() {');
-    this.indentLevel++;
-    
-    if (ast.type === 'Program') {
-      for (const stmt of ast.body) {
-        this.generateStatement(stmt);
+      if (ast.type === 'Program') {
+        for (const stmt of ast.body) {
+          this.generateStatement(stmt);
+        }
+      }
+
+      this.emit('return 0;');
+      this.indentLevel--;
+      this.emit('}');
+    });
+
+    const globals = this.capture(() => this.generateGlobals(ast));
+    const declarations = this.capture(() => this.generateForwardDeclarations());
+
+    const runtime = SECTION_ORDER.filter((section) => this.runtime.has(section));
+    for (const section of runtime) {
+      for (const include of SECTION_INCLUDES[section]) {
+        this.includes.add(include);
       }
     }
-    
-    this.emit('return 0;');
-    this.indentLevel--;
-    this.emit('}');
 
-    // Prepend includes
+    const literals = [...this.literals].map(([text, name]) => `DROY_STATIC_STRING(${name}, ${cString(text)});`);
+    const prelude = [
+      ...runtime.map((section) => C_RUNTIME[section]),
+      ...(literals.length ? [literals.join('\n') + '\n'] : []),
+      ...(this.typeDefinitions.length ? [this.typeDefinitions.join('\n') + '\n'] : []),
+      ...(globals ? [globals] : []),
+    ];
+
     const includesStr = Array.from(this.includes).join('\n') + '\n\n';
-    return includesStr + this.output;
+    return (
+      includesStr +
+      '/* Generated by Droy Compiler */\n\n' +
+      prelude.map((part) => part + '\n').join('') +
+      declarations +
+      functions +
+      main
+    );
   }
 
-  private generateForwardDeclarations(ast: ASTNode): void {
-    // Collect all function declarations for forward declaration
-    if (ast.type === 'Program') {
-      for (const stmt of ast.body) {
-        if (stmt.type === 'FunctionDeclaration') {
-          const params = stmt.params.map(() => 'void*').join(', ');
-          this.emit(`void* ${stmt.name}(${params});`);
-        }
-      }
+  private generateForwardDeclarations(): void {
+    for (const fn of this.types.getFunctions()) {
+      const params = fn.params.map((param) => this.cType(param.type)).join(', ');
+      this.emit(`${this.cType(this.types.resultType(fn))} ${cIdentifier(fn.name)}(${params || 'void'});`);
     }
     this.emit();
   }
 
+  // Top-level variables that functions use live at file scope
+  private generateGlobals(ast: ASTNode): void {
+    for (const variable of this.types.variablesOf(ast)) {
+      if (variable.placement === 'global') {
+        // A string starts out empty rather than NULL; it has a length
+        const value = variable.type.kind === 'string' ? ` = ${this.zeroValue(variable.type)}` : '';
+        this.emit(`${this.cType(variable.type)} ${cIdentifier(variable.name)}${value};`);
+      }
+    }
+  }
+
+  // Variables first declared inside a nested block are declared up front,
+  // since Droy variables are visible in the whole function
+  private generateHoistedDeclarations(owner: ASTNode): void {
+    for (const variable of this.types.variablesOf(owner)) {
+      if (variable.placement === 'hoisted') {
+        this.emit(`${this.cType(variable.type)} ${cIdentifier(variable.name)} = ${this.zeroValue(variable.type)};`);
+      }
+    }
+  }
+
   private generateStatement(node: ASTNode): void {
+    // What a statement run over and over allocates is released right after it
+    if (
+      this.repeated &&
+      (node.type === 'PrintStatement' || node.type === 'ExpressionStatement') &&
+      this.allocates(node) &&
+      !this.stores(node, () => false)
+    ) {
+      const mark = `droy_region${this.tempCounter++}`;
+      this.emit(`char* ${mark} = droy_arena_mark();`);
+      this.repeated = false;
+      this.generateStatement(node);
+      this.repeated = true;
+      this.emit(`droy_arena_release(${mark});`);
+      return;
+    }
+
     switch (node.type) {
       case 'VariableDeclaration':
-        this.generateVariableDeclaration(node);
-        break;
       case 'SetDeclaration':
-        this.generateSetDeclaration(node);
+        this.generateVariableDeclaration(node);
         break;
       case 'FunctionDeclaration':
-        this.generateFunctionDeclaration(node);
+        // Emitted at file scope by generate()
         break;
       case 'IfStatement':
         this.generateIfStatement(node);
@@ -1011,8 +1085,7 @@ export class DroyCodeGenerator {
         this.generatePrintStatement(node);
         break;
       case 'ExpressionStatement':
-        this.generateExpression(node.expression);
-        this.emit(';');
+        this.emit(`${this.generateExpression(node.expression)};`);
         break;
       case 'ClassDeclaration':
         this.generateClassDeclaration(node);
@@ -1026,30 +1099,42 @@ export class DroyCodeGenerator {
     }
   }
 
+  // Covers both `var` and `set`, including the pointer form `~s=p*hello`
   private generateVariableDeclaration(node: ASTNode): void {
-    const value = this.generateExpression(node.value);
-    const type = this.inferType(node.value);
-    this.emit(`${type} ${node.name} = ${value};`);
-  }
-
-  private generateSetDeclaration(node: ASTNode): void {
-    const value = this.generateExpression(node.value);
-    if (node.pointer) {
-      this.emit(`const char* ${node.name} = "${value}";`);
+    const variable = this.types.variableOf(node)!;
+    const name = cIdentifier(variable.name);
+    const value = this.generateTypedExpression(node.value, variable.type);
+    if (variable.placement === 'inline' && variable.firstDeclaration === node) {
+      this.emit(`${this.cType(variable.type)} ${name} = ${value};`);
     } else {
-      const type = this.inferType(node.value);
-      this.emit(`${type} ${node.name} = ${value};`);
+      this.emit(`${name} = ${value};`);
     }
   }
 
-  private generateFunctionDeclaration(node: ASTNode): void {
-    const params = node.params.map((p: string) => `void* ${p}`).join(', ');
-    this.emit(`void* ${node.name}(${params}) {`);
+  private generateFunctionDeclaration(fn: DroyFunction): void {
+    const result = this.types.resultType(fn);
+    const params = fn.params.map((param) => `${this.cType(param.type)} ${cIdentifier(param.name)}`).join(', ');
+    this.owner = fn.node;
+    this.region = this.regions.has(fn) ? 'droy_region' : null;
+    this.repeated = !this.region;
+    this.emit(`${this.cType(result)} ${cIdentifier(fn.name)}(${params || 'void'}) {`);
     this.indentLevel++;
+    this.generateHoistedDeclarations(fn.node);
+    if (this.region) {
+      this.useRuntime('arena');
+      this.emit(`char* ${this.region} = droy_arena_mark();`);
+    }
     
-    for (const stmt of node.body) {
+    for (const stmt of fn.node.body) {
       this.generateStatement(stmt);
     }
+
+    // Falling off the end of a function returns undefined in Droy
+    const last = fn.node.body[fn.node.body.length - 1];
+    if (last?.type !== 'ReturnStatement') {
+      if (this.region) this.emit(`droy_arena_release(${this.region});`);
+      if (result.kind !== 'void') this.emit(`return ${this.zeroValue(result)};`);
+    }
     
     this.indentLevel--;
     this.emit('}');
@@ -1057,7 +1142,7 @@ export class DroyCodeGenerator {
   }
 
   private generateIfStatement(node: ASTNode): void {
-    const condition = this.generateExpression(node.condition);
+    const condition = this.generateCondition(node.condition);
     this.emit(`if (${condition}) {`);
     this.indentLevel++;
     
@@ -1082,52 +1167,122 @@ export class DroyCodeGenerator {
   }
 
   private generateForLoop(node: ASTNode): void {
-    const iterable = this.generateExpression(node.iterable);
-    this.emit(`// For loop: ${node.iterator} in ${iterable}`);
-    this.emit(`for (int _i = 0; _i < array_length(${iterable}); _i++) {`);
+    const variable = this.types.variableOf(node)!;
+    const iterableType = this.types.typeOf(node.iterable);
+    const id = this.tempCounter++;
+    const items = `droy_items${id}`;
+    const index = `droy_i${id}`;
+
+    let length: string;
+    let item: string;
+    let itemType: DroyType;
+    if (iterableType.kind === 'array') {
+      this.emit(`${this.cType(iterableType)} ${items} = ${this.generateExpression(node.iterable)};`);
+      length = `${items}.length`;
+      item = `${items}.items[${index}]`;
+      itemType = iterableType.element;
+    } else {
+      this.emit(`DroyValue ${items} = ${this.generateTypedExpression(node.iterable, VALUE)};`);
+      length = `droy_length(${items})`;
+      item = `droy_at(${items}, ${index})`;
+      itemType = VALUE;
+    }
+
+    this.emit(`// For loop: ${node.iterator}`);
+    this.emit(`for (int ${index} = 0; ${index} < ${length}; ${index}++) {`);
     this.indentLevel++;
-    this.emit(`void* ${node.iterator} = ${iterable}[_i];`);
-    
-    for (const stmt of node.body) {
-      this.generateStatement(stmt);
+    const value = this.convert(item, itemType, variable.type);
+    if (variable.placement === 'loop') {
+      this.emit(`${this.cType(variable.type)} ${cIdentifier(variable.name)} = ${value};`);
+    } else {
+      this.emit(`${cIdentifier(variable.name)} = ${value};`);
     }
-    
+    this.generateLoopBody(node.body);
     this.indentLevel--;
     this.emit('}');
   }
 
   private generateWhileLoop(node: ASTNode): void {
-    const condition = this.generateExpression(node.condition);
+    const condition = this.generateCondition(node.condition);
     this.emit(`while (${condition}) {`);
     this.indentLevel++;
-    
-    for (const stmt of node.body) {
-      this.generateStatement(stmt);
-    }
-    
+    this.generateLoopBody(node.body);
     this.indentLevel--;
     this.emit('}');
   }
 
+  // An iteration whose allocations nothing keeps runs in a region of its own
+  private generateLoopBody(body: ASTNode[]): void {
+    const region =
+      this.allocates(...body) && !this.stores(body, (variable) => this.iterationLocal(variable, body))
+        ? `droy_region${this.tempCounter++}`
+        : null;
+    const repeated = this.repeated;
+    this.repeated = !region;
+    if (region) {
+      this.useRuntime('arena');
+      this.emit(`char* ${region} = droy_arena_mark();`);
+    }
+    for (const stmt of body) {
+      this.generateStatement(stmt);
+    }
+    if (region) this.emit(`droy_arena_release(${region});`);
+    this.repeated = repeated;
+  }
+
   private generateReturnStatement(node: ASTNode): void {
-    const value = this.generateExpression(node.value);
-    this.emit(`return ${value};`);
+    const fn = this.owner.type === 'FunctionDeclaration' ? this.types.getFunction(this.owner.name) : undefined;
+    if (fn && fn.node === this.owner) {
+      const result = this.types.resultType(fn);
+      const value = this.generateTypedExpression(node.value, result);
+      if (!this.region) {
+        this.emit(`return ${value};`);
+      } else if (result.kind === 'string') {
+        // The string moves down to where the region started
+        this.emit(`return droy_arena_keep(${this.region}, ${value});`);
+      } else {
+        const temp = `droy_result${this.tempCounter++}`;
+        this.emit(`${this.cType(result)} ${temp} = ${value};`);
+        this.emit(`droy_arena_release(${this.region});`);
+        this.emit(`return ${temp};`);
+      }
+    } else {
+      // A top-level return ends the program
+      this.emit('return 0;');
+    }
   }
 
   private generatePrintStatement(node: ASTNode): void {
+    const type = this.types.typeOf(node.value);
+
+    // A printed concatenation becomes a single printf, without building the string
+    if (this.isConcatenation(node.value) || node.value.type === 'StringLiteral') {
+      const { format, args } = this.formatConcatenation(node.value);
+      this.emit(`printf(${[cString(format + '\n'), ...args].join(', ')});`);
+      return;
+    }
+
     const value = this.generateExpression(node.value);
-    const type = this.inferType(node.value);
-    
-    if (type === 'char*' || type === 'const char*') {
-      this.emit(`printf("%s\\n", ${value});`);
-    } else if (type === 'int') {
-      this.emit(`printf("%d\\n", ${value});`);
-    } else if (type === 'double') {
-      this.emit(`printf("%f\\n", ${value});`);
-    } else if (type === 'bool') {
-      this.emit(`printf("%s\\n", ${value} ? "true" : "false");`);
-    } else {
-      this.emit(`printf("%p\\n", ${value});`);
+    switch (type.kind) {
+      case 'string':
+        this.emit(`printf("%s\\n", ${value});`);
+        break;
+      case 'int':
+        this.emit(`printf("%d\\n", ${value});`);
+        break;
+      case 'double':
+        this.emit(`printf("${DOUBLE_FORMAT}\\n", ${value});`);
+        break;
+      case 'bool':
+        this.emit(`printf("%s\\n", ${value} ? "true" : "false");`);
+        break;
+      case 'void':
+        this.emit(`${value};`);
+        this.emit('printf("undefined\\n");');
+        break;
+      default:
+        this.emit(`droy_print(${this.box(value, type)});`);
+        break;
     }
   }
 
@@ -1145,141 +1300,1306 @@ export class DroyCodeGenerator {
     }
   }
 
-  private generateExpression(node: ASTNode): string {
-    switch (node.type) {
-      case 'NumberLiteral':
-        return String(node.value);
-      case 'StringLiteral':
-        return `"${node.value}"`;
-      case 'BooleanLiteral':
-        return node.value ? 'true' : 'false';
-      case 'NullLiteral':
-        return 'NULL';
-      case 'Identifier':
-        return node.name;
-      case 'BinaryExpression':
-        return this.generateBinaryExpression(node);
-      case 'LogicalExpression':
-        return this.generateLogicalExpression(node);
-      case 'UnaryExpression':
-        return this.generateUnaryExpression(node);
-      case 'AssignmentExpression':
-        return this.generateAssignmentExpression(node);
-      case 'CallExpression':
-        return this.generateCallExpression(node);
-      case 'ArrayLiteral':
-        return this.generateArrayLiteral(node);
-      case 'ObjectLiteral':
-        return this.generateObjectLiteral(node);
-      default:
-        return 'NULL';
+  // --- regions --------------------------------------------------------------
+
+  // Decides which functions release what they allocate when they return.
+  // One that stores an allocated value outside itself (in a global, or
+  // through a function that does) cannot; nor can one returning an array or
+  // object, which would have to be copied out. A returned string is kept.
+  private analyzeRegions(): void {
+    const functions = this.types.getFunctions();
+    this.escaping.clear();
+    this.leaking.clear();
+    this.regions.clear();
+    for (let changed = true; changed; ) {
+      changed = false;
+      for (const fn of functions) {
+        if (!this.escaping.has(fn) && this.stores(fn.node.body, (variable) => variable.owner === fn.node)) {
+          this.escaping.add(fn);
+          changed = true;
+        }
+      }
     }
-  }
-
-  private generateBinaryExpression(node: ASTNode): string {
-    const left = this.generateExpression(node.left);
-    const right = this.generateExpression(node.right);
-    return `(${left} ${node.operator} ${right})`;
-  }
 
-  private generateLogicalExpression(node: ASTNode): string {
-    const left = this.generateExpression(node.left);
-    const right = this.generateExpression(node.right);
-    return `(${left} ${node.operator} ${right})`;
+    const releases = (fn: DroyFunction): boolean => {
+      const result = this.types.resultType(fn);
+      return !this.escaping.has(fn) && (isPrimitive(result) || result.kind === 'void');
+    };
+    for (let changed = true; changed; ) {
+      changed = false;
+      for (const fn of functions) {
+        if (this.leaking.has(fn) || !this.allocates(...fn.node.body)) continue;
+        if (!releases(fn) || this.types.resultType(fn).kind === 'string') {
+          this.leaking.add(fn);
+          changed = true;
+        }
+      }
+    }
+    for (const fn of functions) {
+      if (releases(fn) && this.allocates(...fn.node.body)) this.regions.add(fn);
+    }
+  }
+
+  // Whether running the nodes may allocate from the arena and leave it
+  // allocated; what a function with a region frees does not count
+  private allocates(...nodes: ASTNode[]): boolean {
+    return nodes.some((node) => {
+      switch (node.type) {
+        case 'FunctionDeclaration':
+        case 'ClassDeclaration':
+          return false;
+        case 'ArrayLiteral':
+          return true;
+        case 'ObjectLiteral':
+          if (this.types.typeOf(node).kind !== 'struct') return true;
+          break;
+        case 'PrintStatement': {
+          const type = this.types.typeOf(node.value);
+          if (this.isConcatenation(node.value)) {
+            // Printed piece by piece
+            return this.concatenationOperands(node.value).some(
+              (part) => !isPrimitive(this.types.typeOf(part)) || this.allocates(part),
+            );
+          }
+          if (!isPrimitive(type) && type.kind !== 'void') return true;
+          break;
+        }
+        case 'VariableDeclaration':
+        case 'SetDeclaration':
+          if (this.convertAllocates(node.value, this.types.variableOf(node)!.type)) return true;
+          break;
+        case 'AssignmentExpression': {
+          const target = node.left.type === 'Identifier' ? this.types.variableOf(node.left) : undefined;
+          if (this.convertAllocates(node.right, target?.type ?? VALUE)) return true;
+          break;
+        }
+        case 'ReturnStatement':
+          // An array or object converted to the result type is boxed
+          if (node.value && !isPrimitive(this.types.typeOf(node.value))) return true;
+          break;
+        case 'ForLoop': {
+          const iterable = this.types.typeOf(node.iterable);
+          const item = iterable.kind === 'array' ? iterable.element : VALUE;
+          if (this.conversionAllocates(item, this.types.variableOf(node)!.type)) return true;
+          break;
+        }
+        case 'BinaryExpression': {
+          const left = this.types.typeOf(node.left);
+          const right = this.types.typeOf(node.right);
+          if (['<', '>', '<=', '>=', '==', '!='].includes(node.operator)) {
+            // Operands of different types are compared as DroyValues
+            const typed = (isNumeric(left) && isNumeric(right)) || left.kind === right.kind;
+            if (!typed && (this.convertAllocates(node.left, VALUE) || this.convertAllocates(node.right, VALUE))) {
+              return true;
+            }
+          } else if (this.types.typeOf(node).kind === 'string') {
+            return true;
+          } else if (this.types.typeOf(node).kind === 'value' && node.operator === '+') {
+            // droy_add concatenates when either side is a string
+            return true;
+          }
+          break;
+        }
+        case 'UnaryExpression':
+          if (this.convertAllocates(node.operand, VALUE)) return true;
+          break;
+        case 'CallExpression':
+        case 'MathOperation': {
+          if (this.types.mathCall(node)) {
+            if (!isNumeric(this.types.typeOf(node))) return true;
+            break;
+          }
+          const fn = node.type === 'CallExpression' && node.callee.type === 'Identifier'
+            ? this.types.getFunction(node.callee.name)
+            : undefined;
+          if (!fn) return node.type === 'CallExpression';
+          if (this.leaking.has(fn)) return true;
+          const args: ASTNode[] = node.arguments;
+          if (fn.params.some((param, index) => index < args.length && this.convertAllocates(args[index], param.type))) {
+            return true;
+          }
+          break;
+        }
+      }
+      return this.allocates(...childNodes(node));
+    });
+  }
+
+  // Whether generating `node` as a `to` allocates for the conversion
+  private convertAllocates(node: ASTNode | undefined, to: DroyType): boolean {
+    if (!node) return false;
+    if ((node.type === 'ArrayLiteral' && to.kind === 'array') || (node.type === 'ObjectLiteral' && to.kind === 'struct')) {
+      return false;
+    }
+    return this.conversionAllocates(this.types.typeOf(node), to);
+  }
+
+  private conversionAllocates(from: DroyType, to: DroyType): boolean {
+    if (typeKey(from) === typeKey(to)) return false;
+    switch (to.kind) {
+      case 'value':
+        return from.kind === 'array' || from.kind === 'struct';
+      case 'string':
+      case 'array':
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Whether the nodes store a value allocated in the region, or read from
+  // a variable `local` accepts, anywhere but such a variable
+  private stores(nodes: ASTNode | ASTNode[], local: (variable: DroyVariable) => boolean): boolean {
+    const fresh = (value: ASTNode | undefined): boolean => {
+      const mentionsLocal = (node: ASTNode): boolean => {
+        const variable = node.type === 'Identifier' ? this.types.variableOf(node) : undefined;
+        return (variable !== undefined && holdsMemory(variable.type) && local(variable)) || childNodes(node).some(mentionsLocal);
+      };
+      return value !== undefined && (this.allocates(value) || mentionsLocal(value));
+    };
+    return (Array.isArray(nodes) ? nodes : [nodes]).some((node) => {
+      switch (node.type) {
+        case 'FunctionDeclaration':
+        case 'ClassDeclaration':
+          return false;
+        case 'VariableDeclaration':
+        case 'SetDeclaration':
+        case 'ForLoop': {
+          const variable = this.types.variableOf(node)!;
+          const value = node.type === 'ForLoop' ? node.iterable : node.value;
+          if (holdsMemory(variable.type) && !local(variable) && fresh(value)) return true;
+          break;
+        }
+        case 'AssignmentExpression': {
+          const target = node.left.type === 'Identifier' ? this.types.variableOf(node.left) : undefined;
+          if (!target || (holdsMemory(target.type) && !local(target) && fresh(node.right))) return true;
+          break;
+        }
+        case 'CallExpression': {
+          const fn = node.callee.type === 'Identifier' ? this.types.getFunction(node.callee.name) : undefined;
+          if (fn && this.escaping.has(fn)) return true;
+          break;
+        }
+      }
+      return this.stores(childNodes(node), local);
+    });
+  }
+
+  // Whether every iteration of `body` sets the variable before reading it,
+  // and nothing outside the loop reads it
+  private iterationLocal(variable: DroyVariable, body: ASTNode[]): boolean {
+    if (variable.placement === 'global' || variable.placement === 'param') return false;
+    const mentions = (node: ASTNode): boolean =>
+      this.types.variableOf(node) === variable || childNodes(node).some(mentions);
+    const first = body.find(mentions);
+    if (
+      !first ||
+      (first.type !== 'VariableDeclaration' && first.type !== 'SetDeclaration') ||
+      this.types.variableOf(first) !== variable ||
+      mentions(first.value)
+    ) {
+      return false;
+    }
+    const inBody = new Set(body);
+    const outside = (node: ASTNode): boolean =>
+      !inBody.has(node) && (this.types.variableOf(node) === variable || childNodes(node).some(outside));
+    return !(variable.owner.body as ASTNode[]).some(outside);
+  }
+
+  // --- types ----------------------------------------------------------------
+
+  private useRuntime(section: CRuntimeSection): void {
+    if (this.runtime.has(section)) return;
+    this.runtime.add(section);
+    for (const dependency of SECTION_DEPENDENCIES[section]) {
+      this.useRuntime(dependency);
+    }
+  }
+
+  // C spelling of a type; arrays and structs get a typedef the first time
+  private cType(type: DroyType): string {
+    switch (type.kind) {
+      case 'int':
+      case 'double':
+      case 'bool':
+      case 'void':
+        return type.kind;
+      case 'string':
+        return 'const char*';
+      case 'array':
+      case 'struct':
+        return this.namedType(type);
+      default:
+        this.useRuntime('value');
+        return 'DroyValue';
+    }
+  }
+
+  private namedType(type: DroyType): string {
+    const key = typeKey(type);
+    const existing = this.typeNames.get(key);
+    if (existing) return existing;
+
+    let name: string;
+    if (type.kind === 'array') {
+      if (type.element.kind === 'value' || type.element.kind === 'unknown') {
+        this.useRuntime('value');
+        name = 'DroyArray_value';
+      } else {
+        const element = this.cType(type.element);
+        name = `DroyArray_${element.startsWith('Droy') ? element : type.element.kind}`;
+        this.useRuntime('array');
+        this.typeDefinitions.push(`DROY_ARRAY_TYPE(${element}, ${name})`);
+      }
+    } else if (type.kind === 'struct') {
+      const fields = type.fields.map((field) => `  ${this.cType(field.type)} ${cIdentifier(field.name)};`);
+      name = `DroyStruct${this.typeNames.size}`;
+      this.typeDefinitions.push(`typedef struct {\n${fields.length ? fields.join('\n') : '  char empty;'}\n} ${name};`);
+    } else {
+      return this.cType(type);
+    }
+
+    this.typeNames.set(key, name);
+    return name;
+  }
+
+  private zeroValue(type: DroyType): string {
+    switch (type.kind) {
+      case 'int':
+        return '0';
+      case 'double':
+        return '0.0';
+      case 'bool':
+        return 'false';
+      case 'string':
+        return this.literal('');
+      case 'array':
+      case 'struct':
+        return `(${this.cType(type)}){0}`;
+      default:
+        this.useRuntime('value');
+        return 'droy_null()';
+    }
+  }
+
+  // Wraps a statically typed C value in a DroyValue
+  private box(code: string, type: DroyType): string {
+    this.useRuntime('value');
+    switch (type.kind) {
+      case 'int':
+        return `droy_int(${code})`;
+      case 'double':
+        return `droy_double(${code})`;
+      case 'bool':
+        return `droy_bool(${code})`;
+      case 'string':
+        return `droy_string(${code})`;
+      case 'void':
+        return `(${code}, droy_null())`;
+      case 'array':
+        return type.element.kind === 'value' ? `droy_array(${code})` : `${this.boxFunction(type)}(${code})`;
+      case 'struct': {
+        const name = this.cType(type);
+        return `droy_object((${name}[]){ ${code} }, sizeof(${name}))`;
+      }
+      default:
+        return code;
+    }
+  }
+
+  // Boxing a typed array boxes every element into a new DroyArray_value
+  private boxFunction(type: DroyType & { kind: 'array' }): string {
+    const arrayType = this.cType(type);
+    const name = `${arrayType}_box`;
+    const key = `box:${typeKey(type)}`;
+    if (!this.typeNames.has(key)) {
+      const element = this.box('array.items[i]', type.element);
+      this.typeNames.set(key, name);
+      this.typeDefinitions.push(
+        `static inline DroyValue ${name}(${arrayType} array) {\n` +
+        `  DroyValue* items = droy_alloc(sizeof(DroyValue) * (array.length > 0 ? array.length : 1));\n` +
+        `  for (int i = 0; i < array.length; i++) items[i] = ${element};\n` +
+        `  return droy_array((DroyArray_value){ array.length, items });\n` +
+        `}`,
+      );
+    }
+    return name;
+  }
+
+  // Converts C code of type `from` to type `to`
+  private convert(code: string, from: DroyType, to: DroyType): string {
+    if (typeKey(from) === typeKey(to)) return code;
+
+    switch (to.kind) {
+      case 'value':
+        return this.box(code, from);
+      case 'int':
+        if (from.kind === 'value') return `(int)droy_number(${code})`;
+        if (isPrimitive(from) && from.kind !== 'string') return `(int)${parenthesize(code)}`;
+        break;
+      case 'double':
+        if (from.kind === 'value') return `droy_number(${code})`;
+        if (isPrimitive(from) && from.kind !== 'string') return `(double)${parenthesize(code)}`;
+        break;
+      case 'bool':
+        return this.truthy(code, from);
+      case 'array':
+        if (from.kind === 'array' && to.element.kind === 'value') {
+          return `(*${this.box(code, from)}.as.a)`;
+        }
+        break;
+      case 'string':
+        if (from.kind === 'value') return `droy_to_string(${code})`;
+        if (isPrimitive(from)) return this.concatenate([{ code, type: from }]);
+        break;
+    }
+    throw new Error(`Cannot convert ${typeKey(from)} to ${typeKey(to)} in C output`);
+  }
+
+  private truthy(code: string, type: DroyType): string {
+    switch (type.kind) {
+      case 'bool':
+      case 'int':
+      case 'double':
+        return code;
+      case 'string':
+        return `((${code})[0] != '\\0')`;
+      case 'value':
+        return `droy_truthy(${code})`;
+      case 'void':
+        return `(${code}, false)`;
+      default:
+        // Arrays and objects are always truthy
+        return `((void)(${code}), true)`;
+    }
+  }
+
+  // --- expressions ----------------------------------------------------------
+
+  private generateCondition(node: ASTNode): string {
+    return this.truthy(this.generateExpression(node), this.types.typeOf(node));
+  }
+
+  // Generates `node` as a value of type `want`. Literals are built directly
+  // in that type; anything else is converted after the fact.
+  private generateTypedExpression(node: ASTNode, want: DroyType): string {
+    const type = this.types.typeOf(node);
+    if (node.type === 'ArrayLiteral' && want.kind === 'array') {
+      return this.generateArrayLiteral(node, want);
+    }
+    if (node.type === 'ObjectLiteral' && want.kind === 'struct') {
+      return this.generateObjectLiteral(node, want);
+    }
+    if (node.type === 'NumberLiteral' && (want.kind === 'int' || want.kind === 'double')) {
+      return this.generateNumber(node.value, want);
+    }
+    return this.convert(this.generateExpression(node), type, want);
+  }
+
+  private generateExpression(node: ASTNode): string {
+    switch (node.type) {
+      case 'NumberLiteral':
+        return this.generateNumber(node.value, this.types.typeOf(node));
+      case 'StringLiteral':
+        return this.literal(node.value);
+      case 'BooleanLiteral':
+        return node.value ? 'true' : 'false';
+      case 'Identifier':
+        return cIdentifier(node.name);
+      case 'BinaryExpression':
+        return this.generateBinaryExpression(node);
+      case 'LogicalExpression':
+        return this.generateLogicalExpression(node);
+      case 'UnaryExpression':
+        return this.generateUnaryExpression(node);
+      case 'AssignmentExpression':
+        return this.generateAssignmentExpression(node);
+      case 'CallExpression':
+      case 'MathOperation':
+        return this.generateCallExpression(node);
+      case 'ArrayLiteral':
+        return this.generateArrayLiteral(node, this.types.typeOf(node));
+      case 'ObjectLiteral':
+        return this.generateObjectLiteral(node, this.types.typeOf(node));
+      default:
+        this.useRuntime('value');
+        return 'droy_null()';
+    }
+  }
+
+  private generateNumber(value: number, type: DroyType): string {
+    const text = String(value);
+    return type.kind === 'double' && /^-?\d+$/.test(text) ? `${text}.0` : text;
+  }
+
+  private generateBinaryExpression(node: ASTNode): string {
+    const operator: string = node.operator;
+    const leftType = this.types.typeOf(node.left);
+    const rightType = this.types.typeOf(node.right);
+    const type = this.types.typeOf(node);
+    const numeric = isNumeric(leftType) && isNumeric(rightType);
+    const strings = leftType.kind === 'string' && rightType.kind === 'string';
+
+    switch (operator) {
+      case '<':
+      case '>':
+      case '<=':
+      case '>=':
+      case '==':
+      case '!=': {
+        const equality = operator === '==' || operator === '!=';
+        if (numeric || (equality && leftType.kind === 'bool' && rightType.kind === 'bool')) {
+          return `(${this.generateExpression(node.left)} ${operator} ${this.generateExpression(node.right)})`;
+        }
+        if (strings && equality) {
+          this.useRuntime('arena');
+          const test = `droy_string_equals(${this.generateExpression(node.left)}, ${this.generateExpression(node.right)})`;
+          return operator === '!=' ? `(!${test})` : test;
+        }
+        if (strings) {
+          return `(strcmp(${this.generateExpression(node.left)}, ${this.generateExpression(node.right)}) ${operator} 0)`;
+        }
+        const left = this.generateTypedExpression(node.left, VALUE);
+        const right = this.generateTypedExpression(node.right, VALUE);
+        if (equality) {
+          return `${operator === '!=' ? '!' : ''}droy_equals(${left}, ${right})`;
+        }
+        return `(droy_compare(${left}, ${right}) ${operator} 0)`;
+      }
+    }
+
+    if (type.kind === 'string') {
+      return this.concatenate(
+        this.concatenationOperands(node).map((part) =>
+          part.type === 'StringLiteral'
+            ? { text: part.value }
+            : { code: this.generateExpression(part), type: this.types.typeOf(part) },
+        ),
+      );
+    }
+
+    if (type.kind === 'int' || type.kind === 'double') {
+      const left = this.generateTypedExpression(node.left, type);
+      const right = this.generateTypedExpression(node.right, type);
+      if (operator === '%' && type.kind === 'double') {
+        this.includes.add('#include <math.h>');
+        return `fmod(${left}, ${right})`;
+      }
+      return `(${left} ${operator} ${right})`;
+    }
+
+    const operation = VALUE_OPERATIONS[operator];
+    const left = this.generateTypedExpression(node.left, VALUE);
+    const right = this.generateTypedExpression(node.right, VALUE);
+    return operation ? `${operation}(${left}, ${right})` : `(${left}, ${right}, droy_null())`;
+  }
+
+  private isConcatenation(node: ASTNode): boolean {
+    return node.type === 'BinaryExpression' && node.operator === '+' && this.types.typeOf(node).kind === 'string';
+  }
+
+  // The operands of a chain of concatenations, left to right
+  private concatenationOperands(node: ASTNode): ASTNode[] {
+    return this.isConcatenation(node)
+      ? [...this.concatenationOperands(node.left), ...this.concatenationOperands(node.right)]
+      : [node];
+  }
+
+  private formatConcatenation(node: ASTNode): { format: string; args: string[] } {
+    return this.formatParts(
+      this.concatenationOperands(node).map((part) =>
+        part.type === 'StringLiteral'
+          ? { text: part.value }
+          : this.formatPart(this.generateExpression(part), this.types.typeOf(part)),
+      ),
+    );
+  }
+
+  // A string constant, with the same length header as built strings
+  private literal(text: string): string {
+    let name = this.literals.get(text);
+    if (!name) {
+      this.useRuntime('arena');
+      name = `droy_s${this.literals.size}`;
+      this.literals.set(text, name);
+    }
+    return `${name}.chars`;
+  }
+
+  // Builds a string from its pieces in one droy_concat call; adjacent text
+  // is folded into one constant
+  private concatenate(parts: Array<{ text: string } | { code: string; type: DroyType }>): string {
+    let kinds = '';
+    const args: string[] = [];
+    let text = '';
+    const flush = (): void => {
+      if (text) {
+        kinds += 's';
+        args.push(this.literal(text));
+        text = '';
+      }
+    };
+    for (const part of parts) {
+      if ('text' in part) {
+        text += part.text;
+        continue;
+      }
+      flush();
+      switch (part.type.kind) {
+        case 'int':
+          kinds += 'd';
+          args.push(part.code);
+          break;
+        case 'double':
+          kinds += 'g';
+          args.push(part.code);
+          break;
+        case 'bool':
+          kinds += 'b';
+          args.push(part.code);
+          break;
+        case 'string':
+          kinds += 's';
+          args.push(part.code);
+          break;
+        default:
+          kinds += 's';
+          args.push(`droy_to_string(${this.box(part.code, part.type)})`);
+          break;
+      }
+    }
+    if (!kinds) return this.literal(text);
+    flush();
+    this.useRuntime('format');
+    return `droy_concat(${[cString(kinds), ...args].join(', ')})`;
+  }
+
+  private formatPart(code: string, type: DroyType): FormatPart {
+    switch (type.kind) {
+      case 'int':
+        return { conversion: '%d', argument: code };
+      case 'double':
+        return { conversion: DOUBLE_FORMAT, argument: code };
+      case 'bool':
+        return { conversion: '%s', argument: `(${code}) ? "true" : "false"` };
+      case 'string':
+        return { conversion: '%s', argument: code };
+      default:
+        return { conversion: '%s', argument: `droy_to_string(${this.box(code, type)})` };
+    }
+  }
+
+  private formatParts(parts: FormatPart[]): { format: string; args: string[] } {
+    let format = '';
+    const args: string[] = [];
+    for (const part of parts) {
+      if ('text' in part) {
+        format += part.text.replace(/%/g, '%%');
+      } else {
+        format += part.conversion;
+        args.push(part.argument);
+      }
+    }
+    return { format, args };
+  }
+
+  private generateLogicalExpression(node: ASTNode): string {
+    const left = this.generateCondition(node.left);
+    const right = this.generateCondition(node.right);
+    return `(${left} ${node.operator} ${right})`;
   }
 
   private generateUnaryExpression(node: ASTNode): string {
-    const operand = this.generateExpression(node.operand);
-    return `(${node.operator}${operand})`;
+    if (node.operator === '!') {
+      return `(!${this.generateCondition(node.operand)})`;
+    }
+    const type = this.types.typeOf(node);
+    if (isNumeric(type)) {
+      return `(${node.operator}${this.generateExpression(node.operand)})`;
+    }
+    return `droy_neg(${this.generateTypedExpression(node.operand, VALUE)})`;
   }
 
   private generateAssignmentExpression(node: ASTNode): string {
+    const target = node.left.type === 'Identifier' ? this.types.variableOf(node.left) : undefined;
     const left = this.generateExpression(node.left);
-    const right = this.generateExpression(node.right);
+    const right = target
+      ? this.generateTypedExpression(node.right, target.type)
+      : this.generateTypedExpression(node.right, VALUE);
     return `${left} ${node.operator} ${right}`;
   }
 
   private generateCallExpression(node: ASTNode): string {
+    const math = this.types.mathCall(node);
+    if (math) {
+      return this.generateMathCall(node, math);
+    }
+    if (node.type !== 'CallExpression') {
+      this.useRuntime('value');
+      return 'droy_null()';
+    }
+    const fn = node.callee.type === 'Identifier' ? this.types.getFunction(node.callee.name) : undefined;
+    if (fn) {
+      // Missing arguments are undefined; extra ones are dropped
+      const args = fn.params.map((param, index) =>
+        index < node.arguments.length
+          ? this.generateTypedExpression(node.arguments[index], param.type)
+          : this.zeroValue(param.type),
+      );
+      return `${cIdentifier(fn.name)}(${args.join(', ')})`;
+    }
+
     const callee = this.generateExpression(node.callee);
-    const args = node.arguments.map((arg: ASTNode) => this.generateExpression(arg)).join(', ');
+    const args = node.arguments.map((arg: ASTNode) => this.generateTypedExpression(arg, VALUE)).join(', ');
     return `${callee}(${args})`;
   }
 
-  private generateArrayLiteral(node: ASTNode): string {
-    const elements = node.elements.map((el: ASTNode) => this.generateExpression(el)).join(', ');
-    return `(void*[]){${elements}}`;
+  // Math builtins with a numeric result are computed in their own type: a
+  // typed array goes through the math runtime's SIMD kernels, separate
+  // numbers are combined in place. Anything else takes the tagged runtime.
+  private generateMathCall(node: ASTNode, { name, args }: DroyMathCall): string {
+    const type = this.types.typeOf(node);
+    if (!isNumeric(type)) {
+      return this.generateValueMath(name, args);
+    }
+    const first = args.length > 0 ? this.types.typeOf(args[0]) : VALUE;
+
+    switch (name) {
+      case 'count': {
+        if (args.length === 1 && first.kind === 'array') {
+          return `${parenthesize(this.generateExpression(args[0]))}.length`;
+        }
+        if (args.length === 1 && first.kind === 'value') {
+          return `${this.generateValueMath(name, args)}.as.i`;
+        }
+        // Every operand still runs for its side effects
+        const effects = args
+          .filter((arg) => !/^(Identifier|NumberLiteral|StringLiteral|BooleanLiteral)$/.test(arg.type))
+          .map((arg) => `(void)(${this.generateExpression(arg)}), `);
+        return effects.length ? `(${effects.join('')}${args.length})` : String(args.length);
+      }
+      case 'round':
+      case 'floor':
+      case 'ceil':
+      case 'abs': {
+        if (args.length === 0) return '0';
+        const value = this.generateExpression(args[0]);
+        if (type.kind === 'int') return name === 'abs' ? `abs(${value})` : value;
+        this.includes.add('#include <math.h>');
+        if (name === 'round') this.useRuntime('math');
+        return `${name === 'round' ? 'droy_round' : name === 'abs' ? 'fabs' : name}(${value})`;
+      }
+    }
+
+    if (args.length === 1 && first.kind === 'array') {
+      return `${this.mathFunction(first, name)}(${this.generateExpression(args[0])})`;
+    }
+    if (args.length === 0) {
+      if (name === 'min' || name === 'max') throw new Error(`${name} needs at least one value`);
+      return this.zeroValue(type);
+    }
+    const values = args.map((arg) => this.generateTypedExpression(arg, name === 'avg' ? DOUBLE : type));
+    switch (name) {
+      case 'sum':
+        return `(${values.join(' + ')})`;
+      case 'avg':
+        return `((${values.join(' + ')}) / ${values.length}.0)`;
+      default: {
+        this.useRuntime('math');
+        const pick = `droy_${name}2_${type.kind === 'int' ? 'i32' : 'f64'}`;
+        return values.reduce((result, value) => `${pick}(${result}, ${value})`);
+      }
+    }
   }
 
-  private generateObjectLiteral(_node: ASTNode): string {
-    // Simplified object representation
-    return 'NULL /* Object literal */';
+  // sum/avg/min/max of a typed array, as an inline function of the array
+  private mathFunction(type: DroyType & { kind: 'array' }, name: string): string {
+    const arrayType = this.cType(type);
+    const fn = `${arrayType}_${name}`;
+    const key = `${name}:${typeKey(type)}`;
+    if (!this.typeNames.has(key)) {
+      this.useRuntime('math');
+      const kernel = type.element.kind === 'int' ? 'i32' : 'f64';
+      const args = 'array.items, array.length';
+      let body: string;
+      if (name === 'avg') {
+        body = `array.length > 0 ? (double)droy_sum_${kernel}(${args}) / array.length : 0.0`;
+      } else {
+        body = `${name === 'sum' && kernel === 'i32' ? '(int)' : ''}droy_${name}_${kernel}(${args})`;
+      }
+      const result = name === 'avg' ? 'double' : this.cType(type.element);
+      this.typeNames.set(key, fn);
+      this.typeDefinitions.push(`static inline ${result} ${fn}(${arrayType} array) {\n  return ${body};\n}`);
+    }
+    return fn;
+  }
+
+  // The VM's semantics over tagged values
+  private generateValueMath(name: string, args: ASTNode[]): string {
+    this.useRuntime('value');
+    const values = args.map((arg: ASTNode) => this.generateTypedExpression(arg, VALUE));
+    const list = `${values.length}, ${values.length ? `(DroyValue[]){ ${values.join(', ')} }` : 'NULL'}`;
+    switch (name) {
+      case 'sum':
+      case 'avg':
+      case 'count':
+        return `droy_${name}_values(${list})`;
+      case 'min':
+      case 'max':
+        return `droy_extreme_values(${list}, ${name === 'min' ? 1 : -1})`;
+      default: {
+        const value = values.length ? `droy_number(${values[0]})` : '0';
+        if (name === 'round') this.useRuntime('math');
+        return `droy_double(${name === 'round' ? 'droy_round' : name === 'abs' ? 'fabs' : name}(${value}))`;
+      }
+    }
   }
 
-  private inferType(node: ASTNode): string {
-    switch (node.type) {
-      case 'NumberLiteral':
-        return Number.isInteger(node.value) ? 'int' : 'double';
-      case 'StringLiteral':
-        return 'char*';
-      case 'BooleanLiteral':
-        return 'bool';
-      case 'NullLiteral':
-        return 'void*';
-      case 'ArrayLiteral':
-        return 'void**';
-      default:
-        return 'void*';
+  private generateArrayLiteral(node: ASTNode, type: DroyType): string {
+    if (type.kind !== 'array') {
+      return this.convert(this.generateArrayLiteral(node, this.types.typeOf(node)), this.types.typeOf(node), type);
+    }
+    const arrayType = this.cType(type);
+    if (node.elements.length === 0) {
+      return `${arrayType}_of(0, NULL)`;
     }
+    const elements = node.elements.map((el: ASTNode) => this.generateTypedExpression(el, type.element)).join(', ');
+    return `${arrayType}_of(${node.elements.length}, (${this.cType(type.element)}[]){${elements}})`;
+  }
+
+  private generateObjectLiteral(node: ASTNode, type: DroyType): string {
+    if (type.kind !== 'struct') {
+      return this.convert(this.generateObjectLiteral(node, this.types.typeOf(node)), this.types.typeOf(node), type);
+    }
+    const values = new Map<string, ASTNode>();
+    for (const property of node.properties) {
+      values.set(property.key, property.value);
+    }
+    const fields = type.fields.map((field) => {
+      const value = values.get(field.name);
+      const code = value ? this.generateTypedExpression(value, field.type) : this.zeroValue(field.type);
+      return `.${cIdentifier(field.name)} = ${code}`;
+    });
+    return `(${this.cType(type)}){ ${fields.join(', ')} }`;
   }
 }
 
-// LLVM IR Generator
-export class DroyLLVMGenerator {
-  private output: string = '';
-  private tempCounter: number = 0;
-  private globalStrings: Map<string, string> = new Map();
+// LLVM IR Generator. Types come from DroyTypeInference, so a program can
+// only be lowered when every value has a static type; anything that would
+// need the tagged runtime is rejected. Each variable lives in an alloca in
+// the entry block, which mem2reg and SROA turn into SSA registers.
+export interface DroyLLVMGeneratorOptions {
+  // Adds nounwind and readnone/readonly/noalias wherever the emitted code
+  // shows they hold. Droy ints wrap in i32 as in the C backend, so program
+  // arithmetic never gets nsw; only loop counters bounded by an array length
+  // do. Meant for modules that go through `opt -O2` or higher.
+  optimize?: boolean;
+  // Written as the module's target triple. Without one, opt does not know
+  // the vector width and leaves loops scalar, so pass the host's (e.g.
+  // "x86_64-pc-linux-gnu") for `opt -O3` to vectorize them.
+  triple?: string;
+  // Runs over the finished module, e.g. to pipe it through `opt`
+  pipeline?: (module: string) => string;
+}
+
+// An SSA value or constant: `ref` is what follows the type in an operand
+interface LLVMValue {
+  type: DroyType;
+  ref: string;
+  // Points to memory allocated for this value alone
+  fresh?: boolean;
+}
+
+// How much memory a function touches, from the instructions it contains
+type MemoryEffect = 0 | 1 | 2;
+const READS_NONE: MemoryEffect = 0;
+const READS: MemoryEffect = 1;
+const WRITES: MemoryEffect = 2;
+
+interface LLVMFunctionState {
+  name: string;
+  owner: ASTNode;
+  result: DroyType;
+  body: string[];
+  allocas: string[];
+  block: string;
+  terminated: boolean;
+  temps: number;
+  labels: number;
+  effect: MemoryEffect;
+  callees: Set<string>;
+  // Whether every `ret` returns a fresh allocation
+  freshResult: boolean;
+}
+
+const LLVM_COMPARISONS: Record<string, [string, string]> = {
+  '<': ['slt', 'olt'],
+  '>': ['sgt', 'ogt'],
+  '<=': ['sle', 'ole'],
+  '>=': ['sge', 'oge'],
+  '==': ['eq', 'oeq'],
+  '!=': ['ne', 'une'],
+};
+
+const LLVM_INT_OPERATIONS: Record<string, string> = { '+': 'add', '-': 'sub', '*': 'mul', '%': 'srem' };
+const LLVM_DOUBLE_OPERATIONS: Record<string, string> = { '+': 'fadd', '-': 'fsub', '*': 'fmul', '/': 'fdiv', '%': 'frem' };
+
+// Library functions the module may call
+const LLVM_DECLARATIONS: Record<string, string> = {
+  printf: 'declare i32 @printf(i8*, ...)',
+  snprintf: 'declare i32 @snprintf(i8*, i64, i8*, ...)',
+  malloc: 'declare noalias i8* @malloc(i64)',
+  strcmp: 'declare i32 @strcmp(i8*, i8*)',
+  dprintf: 'declare i32 @dprintf(i32, i8*, ...)',
+  exit: 'declare void @exit(i32) noreturn',
+  'llvm.floor.f64': 'declare double @llvm.floor.f64(double)',
+  'llvm.ceil.f64': 'declare double @llvm.ceil.f64(double)',
+  'llvm.fabs.f64': 'declare double @llvm.fabs.f64(double)',
+};
+
+// The min or max of an empty array ends the program, as it fails in the VM
+const LLVM_EMPTY_EXTREME = `define internal void @droy.empty(i8* %message) noreturn nounwind {
+entry:
+  %written = call i32 (i32, i8*, ...) @dprintf(i32 2, i8* %message)
+  call void @exit(i32 1)
+  unreachable
+}`;
+
+// Math.round: halves round up
+const LLVM_ROUND = `define internal double @droy.round(double %x) nounwind readnone {
+entry:
+  %floor = call double @llvm.floor.f64(double %x)
+  %fraction = fsub double %x, %floor
+  %up = fcmp oge double %fraction, 0.5
+  %next = fadd double %floor, 1.0
+  %result = select i1 %up, double %next, double %floor
+  ret double %result
+}`;
+
+// sum/min/max over an array's items, as plain loops that `opt` vectorizes
+// for the module's target: the int sum widens to i64 and the double sum may
+// be reassociated, as the C runtime's SIMD kernels do. NaN wins in min/max.
+// Empty arrays give 0; callers check for them before a min or max.
+function llvmReduction(name: 'sum' | 'min' | 'max', element: 'i32' | 'double'): string {
+  const result = name === 'sum' && element === 'i32' ? 'i64' : element;
+  let start: string;
+  let combine: string[];
+  if (name === 'sum') {
+    start = element === 'i32' ? '0' : '0.0';
+    combine = element === 'i32'
+      ? ['%wide = sext i32 %x to i64', '%result = add nsw i64 %total, %wide']
+      : ['%result = fadd reassoc double %total, %x'];
+  } else if (element === 'i32') {
+    start = name === 'min' ? '2147483647' : '-2147483648';
+    combine = [`%take = icmp ${name === 'min' ? 'slt' : 'sgt'} i32 %x, %total`, '%result = select i1 %take, i32 %x, i32 %total'];
+  } else {
+    start = llvmDouble(name === 'min' ? Infinity : -Infinity);
+    combine = [
+      `%better = fcmp ${name === 'min' ? 'olt' : 'ogt'} double %x, %total`,
+      '%nan = fcmp uno double %x, 0.0',
+      '%take = or i1 %better, %nan',
+      '%result = select i1 %take, double %x, double %total',
+    ];
+  }
+  const zero = element === 'double' ? '0.0' : '0';
+  return [
+    `define internal ${result} @droy.${name}.${element === 'i32' ? 'i32' : 'f64'}(${element}* %items, i32 %length) nounwind readonly {`,
+    'entry:',
+    '  %count = zext i32 %length to i64',
+    '  %empty = icmp slt i32 %length, 1',
+    '  br i1 %empty, label %done, label %loop',
+    '',
+    'loop:',
+    '  %i = phi i64 [ 0, %entry ], [ %next, %loop ]',
+    `  %total = phi ${result} [ ${start}, %entry ], [ %result, %loop ]`,
+    `  %address = getelementptr inbounds ${element}, ${element}* %items, i64 %i`,
+    `  %x = load ${element}, ${element}* %address`,
+    ...combine.map((line) => `  ${line}`),
+    '  %next = add nuw nsw i64 %i, 1',
+    '  %more = icmp ult i64 %next, %count',
+    '  br i1 %more, label %loop, label %done',
+    '',
+    'done:',
+    `  %value = phi ${result} [ ${zero}, %entry ], [ %result, %loop ]`,
+    `  ret ${result} %value`,
+    '}',
+  ].join('\n');
+}
 
-  private getTemp(): string {
-    return `%tmp${this.tempCounter++}`;
+function llvmDouble(value: number): string {
+  const view = new DataView(new ArrayBuffer(8));
+  view.setFloat64(0, value);
+  return `0x${view.getBigUint64(0).toString(16).toUpperCase().padStart(16, '0')}`;
+}
+
+function llvmName(name: string): string {
+  return /^[-a-zA-Z$._][-a-zA-Z$._0-9]*$/.test(name) ? name : `"${name}"`;
+}
+
+// Program functions get their own namespace, clear of main and libc
+function functionSymbol(name: string): string {
+  return `@${llvmName(`droy.${name}`)}`;
+}
+
+export class DroyLLVMGenerator {
+  private optimize: boolean;
+  private triple: string | undefined;
+  private pipeline: ((module: string) => string) | undefined;
+  private types = new DroyTypeInference();
+  private fn: LLVMFunctionState = this.createFunction('main', { type: 'Program', body: [] }, INT);
+  private functionStates: LLVMFunctionState[] = [];
+  private strings = new Map<string, { name: string; length: number }>();
+  private globals: string[] = [];
+  private arrayTypes = new Map<string, string>();
+  private declarations = new Set<string>();
+  // Definitions of the math builtins the module uses, by symbol
+  private mathFunctions = new Map<string, string>();
+  private constants: number = 0;
+
+  constructor(options: DroyLLVMGeneratorOptions = {}) {
+    this.optimize = options.optimize ?? false;
+    this.triple = options.triple;
+    this.pipeline = options.pipeline;
   }
 
   public generate(ast: ASTNode): string {
-    this.emit('; ModuleID = "droy"');
-    this.emit('source_filename = "droy"');
-    this.emit();
-    this.emit('declare i32 @printf(i8*, ...)');
-    this.emit('declare i8* @malloc(i64)');
-    this.emit('declare void @free(i8*)');
-    this.emit('declare i8* @strcpy(i8*, i8*)');
-    this.emit('declare i64 @strlen(i8*)');
-    this.emit();
+    this.types = new DroyTypeInference().infer(ast);
+    this.functionStates = [];
+    this.strings.clear();
+    this.globals = [];
+    this.arrayTypes.clear();
+    this.declarations.clear();
+    this.mathFunctions.clear();
+    this.constants = 0;
+
+    for (const variable of this.types.variablesOf(ast)) {
+      if (variable.placement === 'global') {
+        this.globals.push(`@${llvmName(`g.${variable.name}`)} = internal global ${this.llvmType(variable.type)} ${this.zeroConstant(variable.type)}`);
+      }
+    }
 
-    // Generate global strings
-    this.emit('@.str.format.int = private constant [4 x i8] c"%d\\0A\\00"');
-    this.emit('@.str.format.float = private constant [4 x i8] c"%f\\0A\\00"');
-    this.emit('@.str.format.str = private constant [4 x i8] c"%s\\0A\\00"');
-    this.emit();
+    for (const fn of this.types.getFunctions()) {
+      this.generateFunction(fn);
+    }
 
-    // Generate main function
-    this.emit('define i32 @main() {');
-    this.emit('entry:');
-    
+    this.fn = this.createFunction('main', ast, INT);
+    this.functionStates.push(this.fn);
+    this.declareLocals(ast);
     if (ast.type === 'Program') {
       for (const stmt of ast.body) {
         this.generateStatement(stmt);
       }
     }
-    
-    this.emit('  ret i32 0');
-    this.emit('}');
+    this.finishFunction();
 
-    return this.output;
+    const module = this.assemble();
+    return this.pipeline ? this.pipeline(module) : module;
   }
 
-  private emit(line: string = ''): void {
-    this.output += line + '\n';
+  private assemble(): string {
+    const effects = this.memoryEffects();
+    const lines: string[] = ['; ModuleID = "droy"', 'source_filename = "droy"'];
+    if (this.triple) {
+      lines.push(`target triple = "${this.triple}"`);
+    }
+    lines.push('');
+
+    if (this.arrayTypes.size) {
+      for (const [name, element] of this.arrayTypes) {
+        lines.push(`${name} = type { i32, ${element}* }`);
+      }
+      lines.push('');
+    }
+
+    const constants = [...this.strings].map(
+      ([text, { name, length }]) => `${name} = private unnamed_addr constant [${length} x i8] c"${llvmBytes(text)}\\00"`,
+    );
+    if (constants.length || this.globals.length) {
+      lines.push(...constants, ...this.globals, '');
+    }
+
+    if (this.declarations.size) {
+      lines.push(...[...this.declarations].map((name) => LLVM_DECLARATIONS[name]), '');
+    }
+
+    for (const definition of this.mathFunctions.values()) {
+      lines.push(definition, '');
+    }
+
+    for (const state of this.functionStates) {
+      lines.push(this.defineLine(state, effects.get(state.name)!));
+      lines.push('entry:');
+      lines.push(...state.allocas.map((line) => `  ${line}`));
+      lines.push(...state.body);
+      lines.push('}', '');
+    }
+
+    return lines.join('\n');
+  }
+
+  // A function's effect is the strongest of its own and its callees'
+  private memoryEffects(): Map<string, MemoryEffect> {
+    const effects = new Map(this.functionStates.map((state) => [state.name, state.effect]));
+    let changed = true;
+    while (changed) {
+      changed = false;
+      for (const state of this.functionStates) {
+        let effect = effects.get(state.name)!;
+        for (const callee of state.callees) {
+          effect = Math.max(effect, effects.get(callee) ?? WRITES) as MemoryEffect;
+        }
+        if (effect !== effects.get(state.name)) {
+          effects.set(state.name, effect);
+          changed = true;
+        }
+      }
+    }
+    return effects;
   }
 
+  private defineLine(state: LLVMFunctionState, effect: MemoryEffect): string {
+    if (state.owner.type === 'Program') {
+      return 'define i32 @main() {';
+    }
+
+    const fn = this.types.getFunction(state.name)!;
+    const params = fn.params.map((param) => {
+      const type = this.llvmType(param.type);
+      // Droy strings are immutable, so nothing is ever stored through one
+      const attributes = this.optimize && param.type.kind === 'string' ? ' readonly' : '';
+      return `${type}${attributes} %${llvmName(`p.${param.name}`)}`;
+    });
+
+    let result = this.llvmType(state.result);
+    let attributes = '';
+    if (this.optimize) {
+      if (state.result.kind === 'string' && state.freshResult) {
+        result = `noalias ${result}`;
+      }
+      attributes = effect === READS_NONE ? ' nounwind readnone' : effect === READS ? ' nounwind readonly' : ' nounwind';
+    }
+    return `define internal ${result} ${functionSymbol(state.name)}(${params.join(', ')})${attributes} {`;
+  }
+
+  // --- functions and blocks -------------------------------------------------
+
+  private createFunction(name: string, owner: ASTNode, result: DroyType): LLVMFunctionState {
+    return {
+      name,
+      owner,
+      result,
+      body: [],
+      allocas: [],
+      block: 'entry',
+      terminated: false,
+      temps: 0,
+      labels: 0,
+      effect: READS_NONE,
+      callees: new Set(),
+      freshResult: true,
+    };
+  }
+
+  private generateFunction(fn: DroyFunction): void {
+    const result = this.types.resultType(fn);
+    this.fn = this.createFunction(fn.name, fn.node, result);
+    this.functionStates.push(this.fn);
+
+    for (const param of fn.params) {
+      const type = this.llvmType(param.type);
+      this.fn.allocas.push(`${this.variablePointer(param)} = alloca ${type}`);
+      this.fn.allocas.push(`store ${type} %${llvmName(`p.${param.name}`)}, ${type}* ${this.variablePointer(param)}`);
+    }
+    this.declareLocals(fn.node);
+
+    for (const stmt of fn.node.body) {
+      this.generateStatement(stmt);
+    }
+    this.finishFunction();
+  }
+
+  // Every local gets its alloca in the entry block; ones first declared in
+  // a nested block also start at zero, as in the C backend
+  private declareLocals(owner: ASTNode): void {
+    for (const variable of this.types.variablesOf(owner)) {
+      if (variable.placement === 'param' || variable.placement === 'global') continue;
+      const type = this.llvmType(variable.type);
+      this.fn.allocas.push(`${this.variablePointer(variable)} = alloca ${type}`);
+      if (variable.placement === 'hoisted') {
+        this.fn.allocas.push(`store ${type} ${this.zeroConstant(variable.type)}, ${type}* ${this.variablePointer(variable)}`);
+      }
+    }
+  }
+
+  private finishFunction(): void {
+    if (this.fn.terminated) return;
+    if (this.fn.owner.type === 'Program') {
+      this.terminate('ret i32 0');
+    } else if (this.fn.result.kind === 'void') {
+      this.terminate('ret void');
+    } else {
+      // Falling off the end of a function returns undefined in Droy
+      this.fn.freshResult = false;
+      this.terminate(`ret ${this.llvmType(this.fn.result)} ${this.zeroConstant(this.fn.result)}`);
+    }
+  }
+
+  private variablePointer(variable: DroyVariable): string {
+    return variable.placement === 'global'
+      ? `@${llvmName(`g.${variable.name}`)}`
+      : `%${llvmName(`v.${variable.name}`)}`;
+  }
+
+  private temp(): string {
+    return `%t${this.fn.temps++}`;
+  }
+
+  private newLabel(prefix: string): string {
+    return `${prefix}${this.fn.labels++}`;
+  }
+
+  private emit(instruction: string): void {
+    if (this.fn.terminated) {
+      // Code after a return lands in a block nothing branches to
+      this.label(this.newLabel('dead'));
+    }
+    this.fn.body.push(`  ${instruction}`);
+  }
+
+  private terminate(instruction: string): void {
+    this.emit(instruction);
+    this.fn.terminated = true;
+  }
+
+  private label(name: string): void {
+    this.fn.body.push('', `${name}:`);
+    this.fn.block = name;
+    this.fn.terminated = false;
+  }
+
+  private branch(target: string): void {
+    if (!this.fn.terminated) {
+      this.terminate(`br label %${target}`);
+    }
+  }
+
+  private touch(effect: MemoryEffect): void {
+    this.fn.effect = Math.max(this.fn.effect, effect) as MemoryEffect;
+  }
+
+  private call(name: string): void {
+    this.declarations.add(name);
+    this.touch(name === 'strcmp' ? READS : WRITES);
+  }
+
+  // --- types and constants ----------------------------------------------------
+
+  private llvmType(type: DroyType): string {
+    switch (type.kind) {
+      case 'int':
+        return 'i32';
+      case 'double':
+        return 'double';
+      case 'bool':
+        return 'i1';
+      case 'string':
+        return 'i8*';
+      case 'void':
+        return 'void';
+      case 'array': {
+        if (!isPrimitive(type.element)) break;
+        const element = this.llvmType(type.element);
+        const name = `%DroyArray.${type.element.kind}`;
+        this.arrayTypes.set(name, element);
+        return name;
+      }
+    }
+    throw new Error(`The LLVM backend needs a static type, but a value of type ${typeKey(type)} is used`);
+  }
+
+  private zeroConstant(type: DroyType): string {
+    switch (type.kind) {
+      case 'int':
+        return '0';
+      case 'double':
+        return '0.0';
+      case 'bool':
+        return 'false';
+      case 'string':
+        return this.stringConstant('');
+      default:
+        return 'zeroinitializer';
+    }
+  }
+
+  private stringConstant(text: string): string {
+    let entry = this.strings.get(text);
+    if (!entry) {
+      entry = { name: `@.str.${this.strings.size}`, length: new TextEncoder().encode(text).length + 1 };
+      this.strings.set(text, entry);
+    }
+    return `getelementptr inbounds ([${entry.length} x i8], [${entry.length} x i8]* ${entry.name}, i64 0, i64 0)`;
+  }
+
+  private operand(value: LLVMValue): string {
+    return `${this.llvmType(value.type)} ${value.ref}`;
+  }
+
+  private convert(value: LLVMValue, to: DroyType): LLVMValue {
+    const from = value.type;
+    if (typeKey(from) === typeKey(to)) return value;
+    if (to.kind === 'bool') {
+      return { type: BOOL, ref: this.truthy(value) };
+    }
+
+    const result = this.temp();
+    if (to.kind === 'double' && from.kind === 'int') {
+      this.emit(`${result} = sitofp i32 ${value.ref} to double`);
+      return { type: DOUBLE, ref: result };
+    }
+    if (to.kind === 'double' && from.kind === 'bool') {
+      this.emit(`${result} = uitofp i1 ${value.ref} to double`);
+      return { type: DOUBLE, ref: result };
+    }
+    if (to.kind === 'int' && from.kind === 'double') {
+      this.emit(`${result} = fptosi double ${value.ref} to i32`);
+      return { type: INT, ref: result };
+    }
+    if (to.kind === 'int' && from.kind === 'bool') {
+      this.emit(`${result} = zext i1 ${value.ref} to i32`);
+      return { type: INT, ref: result };
+    }
+    if (to.kind === 'string' && isPrimitive(from)) {
+      return this.format([this.formatPart(value)]);
+    }
+    throw new Error(`The LLVM backend cannot convert ${typeKey(from)} to ${typeKey(to)}`);
+  }
+
+  private truthy(value: LLVMValue): string {
+    if (value.type.kind === 'bool') return value.ref;
+    const result = this.temp();
+    switch (value.type.kind) {
+      case 'int':
+        this.emit(`${result} = icmp ne i32 ${value.ref}, 0`);
+        return result;
+      case 'double':
+        this.emit(`${result} = fcmp une double ${value.ref}, 0.0`);
+        return result;
+      case 'string': {
+        const first = this.temp();
+        this.touch(READS);
+        this.emit(`${first} = load i8, i8* ${value.ref}`);
+        this.emit(`${result} = icmp ne i8 ${first}, 0`);
+        return result;
+      }
+      default:
+        // Arrays are objects, and objects are always truthy
+        return 'true';
+    }
+  }
+
+  // --- statements -------------------------------------------------------------
+
   private generateStatement(node: ASTNode): void {
     switch (node.type) {
       case 'VariableDeclaration':
@@ -1295,150 +2615,672 @@ export class DroyLLVMGenerator {
       case 'WhileLoop':
         this.generateWhile(node);
         break;
-      case 'FunctionDeclaration':
-        this.generateFunction(node);
+      case 'ForLoop':
+        this.generateFor(node);
+        break;
+      case 'ReturnStatement':
+        this.generateReturn(node);
+        break;
+      case 'ExpressionStatement':
+        this.generateExpression(node.expression);
+        break;
+      case 'ExportStatement':
+        this.generateStatement(node.declaration);
+        break;
+      case 'ClassDeclaration':
+        for (const method of node.methods) {
+          this.generateStatement(method);
+        }
         break;
     }
   }
 
   private generateDeclaration(node: ASTNode): void {
-    const value = this.generateExpression(node.value);
-    const type = this.inferLLVMType(node.value);
-    this.emit(`  %${node.name} = alloca ${type}`);
-    this.emit(`  store ${type} ${value}, ${type}* %${node.name}`);
+    const variable = this.types.variableOf(node)!;
+    this.store(variable, this.generateTyped(node.value, variable.type));
+  }
+
+  private store(variable: DroyVariable, value: LLVMValue): void {
+    const type = this.llvmType(variable.type);
+    if (variable.placement === 'global') this.touch(WRITES);
+    this.emit(`store ${type} ${value.ref}, ${type}* ${this.variablePointer(variable)}`);
   }
 
   private generatePrint(node: ASTNode): void {
-    const value = this.generateExpression(node.value);
-    const type = this.inferLLVMType(node.value);
-    
-    if (type === 'i8*') {
-      this.emit(`  call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.str.format.str, i64 0, i64 0), i8* ${value})`);
-    } else if (type === 'i32') {
-      this.emit(`  call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.str.format.int, i64 0, i64 0), i32 ${value})`);
-    } else if (type === 'double') {
-      this.emit(`  call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.str.format.float, i64 0, i64 0), double ${value})`);
-    }
+    const parts = this.isConcatenation(node.value)
+      ? this.concatenationParts(node.value)
+      : [this.formatPart(this.generateExpression(node.value))];
+    parts.push({ text: '\n' });
+    const { format, args } = this.formatParts(parts);
+    this.call('printf');
+    this.emit(`call i32 (i8*, ...) @printf(${[`i8* ${this.stringConstant(format)}`, ...args].join(', ')})`);
   }
 
   private generateIf(node: ASTNode): void {
-    const cond = this.generateExpression(node.condition);
-    const thenLabel = `then${this.tempCounter}`;
-    const elseLabel = `else${this.tempCounter}`;
-    const endLabel = `endif${this.tempCounter}`;
-    this.tempCounter++;
+    const condition = this.generateCondition(node.condition);
+    const thenLabel = this.newLabel('if.then');
+    const elseLabel = node.alternate ? this.newLabel('if.else') : null;
+    const endLabel = this.newLabel('if.end');
 
-    this.emit(`  br i1 ${cond}, label %${thenLabel}, label %${elseLabel}`);
-    this.emit();
-    this.emit(`${thenLabel}:`);
-    
+    this.terminate(`br i1 ${condition}, label %${thenLabel}, label %${elseLabel ?? endLabel}`);
+    this.label(thenLabel);
     for (const stmt of node.consequent) {
       this.generateStatement(stmt);
     }
-    this.emit(`  br label %${endLabel}`);
-    this.emit();
-    
-    this.emit(`${elseLabel}:`);
-    if (node.alternate) {
+    this.branch(endLabel);
+
+    if (elseLabel) {
+      this.label(elseLabel);
       for (const stmt of node.alternate) {
         this.generateStatement(stmt);
       }
+      this.branch(endLabel);
     }
-    this.emit(`  br label %${endLabel}`);
-    this.emit();
-    
-    this.emit(`${endLabel}:`);
+
+    this.label(endLabel);
   }
 
   private generateWhile(node: ASTNode): void {
-    const condLabel = `while.cond${this.tempCounter}`;
-    const bodyLabel = `while.body${this.tempCounter}`;
-    const endLabel = `while.end${this.tempCounter}`;
-    this.tempCounter++;
+    const condLabel = this.newLabel('while.cond');
+    const bodyLabel = this.newLabel('while.body');
+    const endLabel = this.newLabel('while.end');
 
-    this.emit(`  br label %${condLabel}`);
-    this.emit();
-    this.emit(`${condLabel}:`);
-    const cond = this.generateExpression(node.condition);
-    this.emit(`  br i1 ${cond}, label %${bodyLabel}, label %${endLabel}`);
-    this.emit();
-    
-    this.emit(`${bodyLabel}:`);
+    this.branch(condLabel);
+    this.label(condLabel);
+    const condition = this.generateCondition(node.condition);
+    this.terminate(`br i1 ${condition}, label %${bodyLabel}, label %${endLabel}`);
+
+    this.label(bodyLabel);
     for (const stmt of node.body) {
       this.generateStatement(stmt);
     }
-    this.emit(`  br label %${condLabel}`);
-    this.emit();
-    
-    this.emit(`${endLabel}:`);
+    this.branch(condLabel);
+
+    this.label(endLabel);
   }
 
-  private generateFunction(_node: ASTNode): void {
-    // Function generation would go here
+  private generateFor(node: ASTNode): void {
+    const variable = this.types.variableOf(node)!;
+    const iterable = this.generateExpression(node.iterable);
+    if (iterable.type.kind !== 'array') {
+      throw new Error(`The LLVM backend can only loop over arrays, not ${typeKey(iterable.type)}`);
+    }
+    const arrayType = this.llvmType(iterable.type);
+    const element = this.llvmType(iterable.type.element);
+    const elementType = iterable.type.element;
+
+    const length = this.temp();
+    const items = this.temp();
+    this.emit(`${length} = extractvalue ${arrayType} ${iterable.ref}, 0`);
+    this.emit(`${items} = extractvalue ${arrayType} ${iterable.ref}, 1`);
+
+    const id = this.fn.labels;
+    const index = `%for.i${id}`;
+    this.fn.allocas.push(`${index} = alloca i32`);
+    const condLabel = this.newLabel('for.cond');
+    const bodyLabel = this.newLabel('for.body');
+    const nextLabel = this.newLabel('for.next');
+    const endLabel = this.newLabel('for.end');
+
+    this.emit(`store i32 0, i32* ${index}`);
+    this.branch(condLabel);
+
+    this.label(condLabel);
+    const current = this.temp();
+    const more = this.temp();
+    this.emit(`${current} = load i32, i32* ${index}`);
+    this.emit(`${more} = icmp slt i32 ${current}, ${length}`);
+    this.terminate(`br i1 ${more}, label %${bodyLabel}, label %${endLabel}`);
+
+    this.label(bodyLabel);
+    const wide = this.temp();
+    const address = this.temp();
+    const item = this.temp();
+    this.touch(READS);
+    this.emit(`${wide} = sext i32 ${current} to i64`);
+    this.emit(`${address} = getelementptr inbounds ${element}, ${element}* ${items}, i64 ${wide}`);
+    this.emit(`${item} = load ${element}, ${element}* ${address}`);
+    this.store(variable, this.convert({ type: elementType, ref: item }, variable.type));
+    for (const stmt of node.body) {
+      this.generateStatement(stmt);
+    }
+    this.branch(nextLabel);
+
+    // The index stays below the array length, so it cannot overflow
+    this.label(nextLabel);
+    const reload = this.temp();
+    const next = this.temp();
+    this.emit(`${reload} = load i32, i32* ${index}`);
+    this.emit(`${next} = add nsw i32 ${reload}, 1`);
+    this.emit(`store i32 ${next}, i32* ${index}`);
+    this.branch(condLabel);
+
+    this.label(endLabel);
   }
 
-  private generateExpression(node: ASTNode): string {
+  private generateReturn(node: ASTNode): void {
+    if (this.fn.owner.type === 'Program') {
+      // A top-level return ends the program
+      this.generateExpression(node.value);
+      this.terminate('ret i32 0');
+      return;
+    }
+    const value = this.generateTyped(node.value, this.fn.result);
+    if (!value.fresh) {
+      this.fn.freshResult = false;
+    }
+    this.terminate(`ret ${this.operand(value)}`);
+  }
+
+  // --- expressions ------------------------------------------------------------
+
+  private generateCondition(node: ASTNode): string {
+    return this.truthy(this.generateExpression(node));
+  }
+
+  // Builds `node` as a value of type `want`; numeric literals and arrays are
+  // built in that type directly
+  private generateTyped(node: ASTNode, want: DroyType): LLVMValue {
+    if (node.type === 'NumberLiteral' && (want.kind === 'int' || want.kind === 'double')) {
+      return this.generateNumber(node.value, want);
+    }
+    if (node.type === 'ArrayLiteral' && want.kind === 'array') {
+      return this.generateArray(node, want);
+    }
+    return this.convert(this.generateExpression(node), want);
+  }
+
+  private generateExpression(node: ASTNode): LLVMValue {
     switch (node.type) {
       case 'NumberLiteral':
-        return Number.isInteger(node.value) ? `i32 ${node.value}` : `double ${node.value}`;
+        return this.generateNumber(node.value, this.types.typeOf(node));
       case 'StringLiteral':
-        const strName = `@.str.${this.tempCounter++}`;
-        const len = node.value.length + 1;
-        this.globalStrings.set(strName, node.value);
-        this.emit(`${strName} = private constant [${len} x i8] c"${node.value}\\00"`);
-        return `i8* getelementptr inbounds ([${len} x i8], [${len} x i8]* ${strName}, i64 0, i64 0)`;
+        return { type: STRING, ref: this.stringConstant(node.value) };
       case 'BooleanLiteral':
-        return `i1 ${node.value ? 1 : 0}`;
+        return { type: BOOL, ref: node.value ? 'true' : 'false' };
       case 'Identifier':
-        const temp = this.getTemp();
-        this.emit(`  ${temp} = load i32, i32* %${node.name}`);
-        return temp;
+        return this.generateLoad(node);
       case 'BinaryExpression':
         return this.generateBinary(node);
+      case 'LogicalExpression':
+        return this.generateLogical(node);
+      case 'UnaryExpression':
+        return this.generateUnary(node);
+      case 'AssignmentExpression':
+        return this.generateAssignment(node);
+      case 'CallExpression':
+      case 'MathOperation':
+        return this.generateCall(node);
+      case 'ArrayLiteral':
+        return this.generateArray(node, this.types.typeOf(node));
       default:
-        return 'i32 0';
+        throw new Error(`The LLVM backend does not support ${node.type}`);
     }
   }
 
-  private generateBinary(node: ASTNode): string {
-    const left = this.generateExpression(node.left);
-    const right = this.generateExpression(node.right);
-    const temp = this.getTemp();
-    
-    switch (node.operator) {
-      case '+':
-        this.emit(`  ${temp} = add i32 ${left.split(' ')[1]}, ${right.split(' ')[1]}`);
-        break;
-      case '-':
-        this.emit(`  ${temp} = sub i32 ${left.split(' ')[1]}, ${right.split(' ')[1]}`);
-        break;
-      case '*':
-        this.emit(`  ${temp} = mul i32 ${left.split(' ')[1]}, ${right.split(' ')[1]}`);
-        break;
-      case '/':
-        this.emit(`  ${temp} = sdiv i32 ${left.split(' ')[1]}, ${right.split(' ')[1]}`);
-        break;
+  private generateNumber(value: number, type: DroyType): LLVMValue {
+    return type.kind === 'double' ? { type: DOUBLE, ref: llvmDouble(value) } : { type: INT, ref: String(value) };
+  }
+
+  private generateLoad(node: ASTNode): LLVMValue {
+    const variable = this.types.variableOf(node);
+    if (!variable) {
+      throw new Error(`The LLVM backend cannot resolve ${node.name}`);
     }
-    
-    return temp;
+    const type = this.llvmType(variable.type);
+    const result = this.temp();
+    if (variable.placement === 'global') this.touch(READS);
+    this.emit(`${result} = load ${type}, ${type}* ${this.variablePointer(variable)}`);
+    return { type: variable.type, ref: result };
   }
 
-  private inferLLVMType(node: ASTNode): string {
-    switch (node.type) {
-      case 'NumberLiteral':
-        return Number.isInteger(node.value) ? 'i32' : 'double';
-      case 'StringLiteral':
-        return 'i8*';
-      case 'BooleanLiteral':
-        return 'i1';
+  private generateBinary(node: ASTNode): LLVMValue {
+    const operator: string = node.operator;
+    const type = this.types.typeOf(node);
+
+    const comparison = LLVM_COMPARISONS[operator];
+    if (comparison) {
+      return this.generateComparison(node, comparison);
+    }
+
+    if (type.kind === 'string') {
+      return this.format(this.concatenationParts(node));
+    }
+
+    const left = this.generateTyped(node.left, type);
+    const right = this.generateTyped(node.right, type);
+    const result = this.temp();
+    if (type.kind === 'int' && LLVM_INT_OPERATIONS[operator]) {
+      const instruction = LLVM_INT_OPERATIONS[operator];
+      this.emit(`${result} = ${instruction} i32 ${left.ref}, ${right.ref}`);
+      return { type: INT, ref: result };
+    }
+    if (type.kind === 'double' && LLVM_DOUBLE_OPERATIONS[operator]) {
+      this.emit(`${result} = ${LLVM_DOUBLE_OPERATIONS[operator]} double ${left.ref}, ${right.ref}`);
+      return { type: DOUBLE, ref: result };
+    }
+    throw new Error(`The LLVM backend cannot apply ${operator} to ${typeKey(type)}`);
+  }
+
+  private generateComparison(node: ASTNode, [signed, ordered]: [string, string]): LLVMValue {
+    const leftType = this.types.typeOf(node.left);
+    const rightType = this.types.typeOf(node.right);
+    let instruction: string;
+
+    if (leftType.kind === 'int' && rightType.kind === 'int') {
+      const left = this.generateExpression(node.left);
+      const right = this.generateExpression(node.right);
+      instruction = `icmp ${signed} i32 ${left.ref}, ${right.ref}`;
+    } else if (isNumeric(leftType) && isNumeric(rightType)) {
+      const left = this.generateTyped(node.left, DOUBLE);
+      const right = this.generateTyped(node.right, DOUBLE);
+      instruction = `fcmp ${ordered} double ${left.ref}, ${right.ref}`;
+    } else if (leftType.kind === 'bool' && rightType.kind === 'bool' && (signed === 'eq' || signed === 'ne')) {
+      const left = this.generateExpression(node.left);
+      const right = this.generateExpression(node.right);
+      instruction = `icmp ${signed} i1 ${left.ref}, ${right.ref}`;
+    } else if (leftType.kind === 'string' && rightType.kind === 'string') {
+      const left = this.generateExpression(node.left);
+      const right = this.generateExpression(node.right);
+      const order = this.temp();
+      this.call('strcmp');
+      this.emit(`${order} = call i32 @strcmp(i8* ${left.ref}, i8* ${right.ref})`);
+      instruction = `icmp ${signed} i32 ${order}, 0`;
+    } else {
+      throw new Error(`The LLVM backend cannot compare ${typeKey(leftType)} with ${typeKey(rightType)}`);
+    }
+
+    const result = this.temp();
+    this.emit(`${result} = ${instruction}`);
+    return { type: BOOL, ref: result };
+  }
+
+  // && and || only evaluate their right side when it decides the result
+  private generateLogical(node: ASTNode): LLVMValue {
+    const isAnd = node.operator === '&&';
+    const left = this.generateCondition(node.left);
+    const leftBlock = this.fn.block;
+    const rightLabel = this.newLabel(isAnd ? 'and.rhs' : 'or.rhs');
+    const endLabel = this.newLabel(isAnd ? 'and.end' : 'or.end');
+
+    this.terminate(isAnd
+      ? `br i1 ${left}, label %${rightLabel}, label %${endLabel}`
+      : `br i1 ${left}, label %${endLabel}, label %${rightLabel}`);
+
+    this.label(rightLabel);
+    const right = this.generateCondition(node.right);
+    const rightBlock = this.fn.block;
+    this.branch(endLabel);
+
+    this.label(endLabel);
+    const result = this.temp();
+    this.emit(`${result} = phi i1 [ ${isAnd ? 'false' : 'true'}, %${leftBlock} ], [ ${right}, %${rightBlock} ]`);
+    return { type: BOOL, ref: result };
+  }
+
+  private generateUnary(node: ASTNode): LLVMValue {
+    if (node.operator === '!') {
+      const operand = this.generateCondition(node.operand);
+      const result = this.temp();
+      this.emit(`${result} = xor i1 ${operand}, true`);
+      return { type: BOOL, ref: result };
+    }
+
+    const operand = this.generateExpression(node.operand);
+    const result = this.temp();
+    if (operand.type.kind === 'int') {
+      this.emit(`${result} = sub i32 0, ${operand.ref}`);
+    } else if (operand.type.kind === 'double') {
+      this.emit(`${result} = fneg double ${operand.ref}`);
+    } else {
+      throw new Error(`The LLVM backend cannot negate ${typeKey(operand.type)}`);
+    }
+    return { type: operand.type, ref: result };
+  }
+
+  private generateAssignment(node: ASTNode): LLVMValue {
+    const target = node.left.type === 'Identifier' ? this.types.variableOf(node.left) : undefined;
+    if (!target) {
+      throw new Error('The LLVM backend can only assign to variables');
+    }
+    const value = this.generateTyped(node.right, target.type);
+    this.store(target, value);
+    return value;
+  }
+
+  private generateCall(node: ASTNode): LLVMValue {
+    const math = this.types.mathCall(node);
+    if (math) {
+      return this.generateMath(node, math);
+    }
+    const fn = node.type === 'CallExpression' && node.callee.type === 'Identifier'
+      ? this.types.getFunction(node.callee.name)
+      : undefined;
+    if (!fn) {
+      throw new Error('The LLVM backend can only call functions declared in the program');
+    }
+
+    // Missing arguments are undefined; extra ones are dropped
+    const args = fn.params.map((param, index) =>
+      index < node.arguments.length
+        ? this.operand(this.generateTyped(node.arguments[index], param.type))
+        : `${this.llvmType(param.type)} ${this.zeroConstant(param.type)}`,
+    );
+    const result = this.types.resultType(fn);
+    this.fn.callees.add(fn.name);
+
+    const call = `call ${this.llvmType(result)} ${functionSymbol(fn.name)}(${args.join(', ')})`;
+    if (result.kind === 'void') {
+      this.emit(call);
+      return { type: VOID, ref: '' };
+    }
+    const temp = this.temp();
+    this.emit(`${temp} = ${call}`);
+    return { type: result, ref: temp };
+  }
+
+  // Math builtins, on the same terms as in the C backend: typed arrays are
+  // reduced by the loops of llvmReduction, separate numbers in place
+  private generateMath(node: ASTNode, { name, args }: DroyMathCall): LLVMValue {
+    const type = this.types.typeOf(node);
+    if (!isNumeric(type)) {
+      throw new Error(`The LLVM backend needs numbers or an array of numbers for ${name}`);
+    }
+    const result = this.temp();
+
+    if (name === 'count') {
+      const values = args.map((arg) => this.generateExpression(arg));
+      if (values.length === 1 && values[0].type.kind === 'array') {
+        this.emit(`${result} = extractvalue ${this.operand(values[0])}, 0`);
+        return { type: INT, ref: result };
+      }
+      return { type: INT, ref: String(values.length) };
+    }
+
+    if (name === 'round' || name === 'floor' || name === 'ceil' || name === 'abs') {
+      if (args.length === 0) return { type: INT, ref: '0' };
+      const value = this.generateExpression(args[0]);
+      if (type.kind === 'int') {
+        if (name !== 'abs') return value;
+        const negative = this.temp();
+        const negated = this.temp();
+        this.emit(`${negative} = icmp slt i32 ${value.ref}, 0`);
+        this.emit(`${negated} = sub i32 0, ${value.ref}`);
+        this.emit(`${result} = select i1 ${negative}, i32 ${negated}, i32 ${value.ref}`);
+        return { type: INT, ref: result };
+      }
+      let callee: string;
+      if (name === 'round') {
+        this.declarations.add('llvm.floor.f64');
+        this.mathFunctions.set('droy.round', LLVM_ROUND);
+        callee = '@droy.round';
+      } else {
+        const intrinsic = `llvm.${name === 'abs' ? 'fabs' : name}.f64`;
+        this.declarations.add(intrinsic);
+        callee = `@${intrinsic}`;
+      }
+      this.emit(`${result} = call double ${callee}(double ${value.ref})`);
+      return { type: DOUBLE, ref: result };
+    }
+
+    if (args.length === 1 && this.types.typeOf(args[0]).kind === 'array') {
+      return this.generateReduction(name, this.generateExpression(args[0]), type);
+    }
+    if (args.length === 0) {
+      if (name === 'min' || name === 'max') throw new Error(`${name} needs at least one value`);
+      return { type, ref: this.zeroConstant(type) };
+    }
+
+    const operands = name === 'avg' ? DOUBLE : type;
+    const values = args.map((arg) => this.generateTyped(arg, operands));
+    let total = values[0].ref;
+    for (const value of values.slice(1)) {
+      const next = this.temp();
+      if (name === 'sum' || name === 'avg') {
+        const operation = operands.kind === 'int' ? 'add' : 'fadd';
+        this.emit(`${next} = ${operation} ${this.llvmType(operands)} ${total}, ${value.ref}`);
+      } else if (operands.kind === 'int') {
+        const take = this.temp();
+        this.emit(`${take} = icmp ${name === 'min' ? 'slt' : 'sgt'} i32 ${value.ref}, ${total}`);
+        this.emit(`${next} = select i1 ${take}, i32 ${value.ref}, i32 ${total}`);
+      } else {
+        // NaN wins, as in Math.min
+        const better = this.temp();
+        const nan = this.temp();
+        const take = this.temp();
+        this.emit(`${better} = fcmp ${name === 'min' ? 'olt' : 'ogt'} double ${value.ref}, ${total}`);
+        this.emit(`${nan} = fcmp uno double ${value.ref}, ${total}`);
+        this.emit(`${take} = or i1 ${better}, ${nan}`);
+        this.emit(`${next} = select i1 ${take}, double ${value.ref}, double ${total}`);
+      }
+      total = next;
+    }
+    if (name !== 'avg') return { type, ref: total };
+    this.emit(`${result} = fdiv double ${total}, ${llvmDouble(values.length)}`);
+    return { type: DOUBLE, ref: result };
+  }
+
+  private generateReduction(name: string, array: LLVMValue, type: DroyType): LLVMValue {
+    if (array.type.kind !== 'array') {
+      throw new Error(`The LLVM backend cannot reduce ${typeKey(array.type)}`);
+    }
+    const element = this.llvmType(array.type.element);
+    const suffix = array.type.element.kind === 'int' ? 'i32' : 'f64';
+    const kernel = name === 'avg' ? 'sum' : (name as 'sum' | 'min' | 'max');
+    const symbol = `droy.${kernel}.${suffix}`;
+    if (!this.mathFunctions.has(symbol)) {
+      this.mathFunctions.set(symbol, llvmReduction(kernel, element as 'i32' | 'double'));
+    }
+    this.touch(READS);
+
+    const length = this.temp();
+    const items = this.temp();
+    const reduced = this.temp();
+    const sum = kernel === 'sum' && suffix === 'i32' ? 'i64' : element;
+    this.emit(`${length} = extractvalue ${this.operand(array)}, 0`);
+    this.emit(`${items} = extractvalue ${this.operand(array)}, 1`);
+    if (kernel !== 'sum') {
+      const empty = this.temp();
+      const emptyLabel = this.newLabel(`${name}.empty`);
+      const doneLabel = this.newLabel(`${name}.ok`);
+      this.call('dprintf');
+      this.call('exit');
+      this.mathFunctions.set('droy.empty', LLVM_EMPTY_EXTREME);
+      this.emit(`${empty} = icmp slt i32 ${length}, 1`);
+      this.terminate(`br i1 ${empty}, label %${emptyLabel}, label %${doneLabel}`);
+      this.label(emptyLabel);
+      this.emit(`call void @droy.empty(i8* ${this.stringConstant(`droy: ${name} of an empty array\n`)})`);
+      this.terminate('unreachable');
+      this.label(doneLabel);
+    }
+    this.emit(`${reduced} = call ${sum} @${symbol}(${element}* ${items}, i32 ${length})`);
+
+    const result = this.temp();
+    if (name === 'sum' && suffix === 'i32') {
+      this.emit(`${result} = trunc i64 ${reduced} to i32`);
+      return { type: INT, ref: result };
+    }
+    if (name !== 'avg') return { type, ref: reduced };
+
+    // The average of no numbers is 0
+    const total = suffix === 'i32' ? this.temp() : reduced;
+    const count = this.temp();
+    const quotient = this.temp();
+    const empty = this.temp();
+    if (suffix === 'i32') this.emit(`${total} = sitofp i64 ${reduced} to double`);
+    this.emit(`${count} = sitofp i32 ${length} to double`);
+    this.emit(`${quotient} = fdiv double ${total}, ${count}`);
+    this.emit(`${empty} = icmp eq i32 ${length}, 0`);
+    this.emit(`${result} = select i1 ${empty}, double 0.0, double ${quotient}`);
+    return { type: DOUBLE, ref: result };
+  }
+
+  // Arrays of constants become private globals; others are built on the heap
+  private generateArray(node: ASTNode, type: DroyType): LLVMValue {
+    if (type.kind !== 'array') {
+      throw new Error(`The LLVM backend cannot build an array as ${typeKey(type)}`);
+    }
+    const arrayType = this.llvmType(type);
+    const element = this.llvmType(type.element);
+    const count = node.elements.length;
+    if (count === 0) {
+      return { type, ref: `{ i32 0, ${element}* null }` };
+    }
+
+    const elements = node.elements.map((item: ASTNode) => this.constantElement(item, type.element));
+    let items: string;
+    if (elements.every((item: string | null) => item !== null)) {
+      const name = `@.arr.${this.constants++}`;
+      this.globals.push(`${name} = private unnamed_addr constant [${count} x ${element}] [${elements.join(', ')}]`);
+      items = `getelementptr inbounds ([${count} x ${element}], [${count} x ${element}]* ${name}, i64 0, i64 0)`;
+    } else {
+      const bytes = this.temp();
+      const memory = this.temp();
+      items = this.temp();
+      this.call('malloc');
+      this.emit(`${bytes} = mul i64 ${count}, ptrtoint (${element}* getelementptr (${element}, ${element}* null, i32 1) to i64)`);
+      this.emit(`${memory} = call i8* @malloc(i64 ${bytes})`);
+      this.emit(`${items} = bitcast i8* ${memory} to ${element}*`);
+      node.elements.forEach((item: ASTNode, index: number) => {
+        const value = this.generateTyped(item, type.element);
+        const address = this.temp();
+        this.emit(`${address} = getelementptr inbounds ${element}, ${element}* ${items}, i64 ${index}`);
+        this.emit(`store ${element} ${value.ref}, ${element}* ${address}`);
+      });
+    }
+
+    const partial = this.temp();
+    const result = this.temp();
+    this.emit(`${partial} = insertvalue ${arrayType} undef, i32 ${count}, 0`);
+    this.emit(`${result} = insertvalue ${arrayType} ${partial}, ${element}* ${items}, 1`);
+    return { type, ref: result };
+  }
+
+  private constantElement(node: ASTNode, type: DroyType): string | null {
+    const element = this.llvmType(type);
+    if (node.type === 'NumberLiteral' && isNumeric(type)) {
+      if (type.kind === 'int' && !Number.isInteger(node.value)) return null;
+      return `${element} ${this.generateNumber(node.value, type).ref}`;
+    }
+    if (node.type === 'StringLiteral' && type.kind === 'string') {
+      return `${element} ${this.stringConstant(node.value)}`;
+    }
+    if (node.type === 'BooleanLiteral' && type.kind === 'bool') {
+      return `${element} ${node.value ? 'true' : 'false'}`;
+    }
+    return null;
+  }
+
+  // --- string building --------------------------------------------------------
+
+  private isConcatenation(node: ASTNode): boolean {
+    return node.type === 'BinaryExpression' && node.operator === '+' && this.types.typeOf(node).kind === 'string';
+  }
+
+  private concatenationParts(node: ASTNode): FormatPart[] {
+    const parts: FormatPart[] = [];
+    const collect = (part: ASTNode): void => {
+      if (this.isConcatenation(part)) {
+        collect(part.left);
+        collect(part.right);
+      } else if (part.type === 'StringLiteral') {
+        parts.push({ text: part.value });
+      } else {
+        parts.push(this.formatPart(this.generateExpression(part)));
+      }
+    };
+    collect(node);
+    return parts;
+  }
+
+  private formatPart(value: LLVMValue): FormatPart {
+    switch (value.type.kind) {
+      case 'int':
+        return { conversion: '%d', argument: `i32 ${value.ref}` };
+      case 'double':
+        return { conversion: DOUBLE_FORMAT, argument: `double ${value.ref}` };
+      case 'string':
+        return { conversion: '%s', argument: `i8* ${value.ref}` };
+      case 'bool': {
+        const text = this.temp();
+        this.emit(`${text} = select i1 ${value.ref}, i8* ${this.stringConstant('true')}, i8* ${this.stringConstant('false')}`);
+        return { conversion: '%s', argument: `i8* ${text}` };
+      }
       default:
-        return 'i32';
+        throw new Error(`The LLVM backend cannot print ${typeKey(value.type)}`);
+    }
+  }
+
+  private formatParts(parts: FormatPart[]): { format: string; args: string[] } {
+    let format = '';
+    const args: string[] = [];
+    for (const part of parts) {
+      if ('text' in part) {
+        format += part.text.replace(/%/g, '%%');
+      } else {
+        format += part.conversion;
+        args.push(part.argument);
+      }
+    }
+    return { format, args };
+  }
+
+  // Formats into a new heap string: snprintf once to size it, then again
+  private format(parts: FormatPart[]): LLVMValue {
+    const { format, args } = this.formatParts(parts);
+    if (args.length === 0) {
+      return { type: STRING, ref: this.stringConstant(format.replace(/%%/g, '%')) };
     }
+
+    const formatRef = `i8* ${this.stringConstant(format)}`;
+    const length = this.temp();
+    const size = this.temp();
+    const wide = this.temp();
+    const buffer = this.temp();
+    this.call('snprintf');
+    this.call('malloc');
+    this.emit(`${length} = call i32 (i8*, i64, i8*, ...) @snprintf(${['i8* null', 'i64 0', formatRef, ...args].join(', ')})`);
+    this.emit(`${size} = add i32 ${length}, 1`);
+    this.emit(`${wide} = sext i32 ${size} to i64`);
+    this.emit(`${buffer} = call i8* @malloc(i64 ${wide})`);
+    this.emit(`call i32 (i8*, i64, i8*, ...) @snprintf(${[`i8* ${buffer}`, `i64 ${wide}`, formatRef, ...args].join(', ')})`);
+    return { type: STRING, ref: buffer, fresh: true };
   }
 }
 
+function llvmBytes(text: string): string {
+  let out = '';
+  for (const byte of new TextEncoder().encode(text)) {
+    out += byte >= 0x20 && byte < 0x7f && byte !== 0x22 && byte !== 0x5c
+      ? String.fromCharCode(byte)
+      : `\\${byte.toString(16).toUpperCase().padStart(2, '0')}`;
+  }
+  return out;
+}
+
 // Main Compiler class
+export interface DroyCompilerOptions {
+  // AST passes run before either backend; false skips them
+  optimize?: DroyOptimizerOptions | false;
+  // Where `import`ed files are read from; the compiled source is the file
+  // `path` (default main.droy). Without it imports are ignored.
+  modules?: DroyModuleHost;
+  path?: string;
+}
+
 export class DroyCompiler {
+  private optimizer: DroyOptimizer | null;
+  private modules: DroyModuleGraph | null;
+  private path: string;
+
+  constructor(options: DroyCompilerOptions = {}) {
+    this.optimizer = options.optimize === false ? null : new DroyOptimizer(options.optimize);
+    this.modules = options.modules
+      ? new DroyModuleGraph(options.modules, (source) => new DroyParser(new DroyLexer(source).tokenize()).parse())
+      : null;
+    this.path = options.path ?? 'main.droy';
+  }
+
   public compile(source: string): { tokens: Token[]; ast: ASTNode; cCode: string; llvmIR: string } {
     // Tokenize
     const lexer = new DroyLexer(source);
@@ -1447,14 +3289,19 @@ export class DroyCompiler {
     // Parse
     const parser = new DroyParser(tokens);
     const ast = parser.parse();
+    const optimized = this.optimize(ast);
 
     // Generate C code
     const cGenerator = new DroyCodeGenerator();
-    const cCode = cGenerator.generate(ast);
+    const cCode = cGenerator.generate(optimized);
 
-    // Generate LLVM IR
-    const llvmGenerator = new DroyLLVMGenerator();
-    const llvmIR = llvmGenerator.generate(ast);
+    // Generate LLVM IR; programs that need dynamic values have none
+    let llvmIR: string;
+    try {
+      llvmIR = new DroyLLVMGenerator().generate(optimized);
+    } catch (error) {
+      llvmIR = `; ${error instanceof Error ? error.message : String(error)}\n`;
+    }
 
     return { tokens, ast, cCode, llvmIR };
   }
@@ -1471,15 +3318,21 @@ export class DroyCompiler {
     return parser.parse();
   }
 
+  // Links in what the program imports, then runs the AST passes
+  private optimize(ast: ASTNode): ASTNode {
+    const linked = this.modules ? this.modules.link(this.path, ast) : ast;
+    return this.optimizer ? this.optimizer.optimize(linked) : linked;
+  }
+
   public generateC(source: string): string {
-    const ast = this.parse(source);
+    const ast = this.optimize(this.parse(source));
     const generator = new DroyCodeGenerator();
     return generator.generate(ast);
   }
 
-  public generateLLVM(source: string): string {
-    const ast = this.parse(source);
-    const generator = new DroyLLVMGenerator();
+  public generateLLVM(source: string, options: DroyLLVMGeneratorOptions = {}): string {
+    const ast = this.optimize(this.parse(source));
+    const generator = new DroyLLVMGenerator(options);
     return generator.generate(ast);
   }
 }
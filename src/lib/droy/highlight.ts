@@ -0,0 +1,282 @@
+// Droy Language - syntax highlighting
+// Turns source into HTML, one string per line, in a single pass. Droy is
+// colored from the lexer's token stream: the highlighter walks the source
+// alongside the tokens, so whitespace, comments and characters the lexer
+// skips come out as they are written. C and LLVM output go through a small
+// grammar of sticky regexes instead. No span crosses a line, so a view can
+// render any window of the lines on its own.
+
+import { DroyLexerV3, type TokenType } from './compiler-v3';
+import { CharCode, isHexDigit, isWhitespace } from './scanner';
+import type { TokenStream } from './token-buffer';
+
+export type HighlightLanguage = 'droy' | 'c' | 'llvm';
+
+const KEYWORD = 'text-pink-400';
+const DECLARATION = 'text-purple-400';
+const COMPONENT = 'text-cyan-400';
+const PROPERTY = 'text-yellow-400';
+const LITERAL = 'text-green-400';
+const NUMBER = 'text-orange-400';
+const OPERATOR = 'text-slate-300';
+const COMMENT = 'text-slate-500';
+
+function classes(names: readonly TokenType[], className: string): Array<[TokenType, string]> {
+  return names.map((name) => [name, className]);
+}
+
+// Tokens without a class are plain
+const DROY_CLASSES = new Map<TokenType, string>([
+  ...classes([
+    'SET', 'GET', 'VAR', 'FUNC', 'RETURN', 'IF', 'ELSE', 'FOR', 'WHILE', 'PRINT', 'INPUT', 'LINK',
+    'ARRAY', 'CLASS', 'IMPORT', 'EXPORT', 'BIND', 'REF', 'WATCH', 'EMIT', 'FETCH', 'POST', 'PUT',
+    'DELETE', 'PATCH', 'WS', 'BLEND', 'GRADIENT', 'THEME', 'MODE', 'MATH', 'CALC', 'RANDOM', 'ROUND',
+    'FLOOR', 'CEIL', 'ABS', 'MIN', 'MAX', 'SUM', 'AVG', 'COUNT', 'BOOLEAN', 'NULL', 'UNDEFINED',
+    'IN', 'OF', 'IS', 'AS',
+  ], KEYWORD),
+  ...classes([
+    'SETUP', 'GET_SET', 'VALUE_SET', 'TOOL_SET', 'TOOL', 'TOOLS', 'UTIL', 'UTILS', 'HELPER', 'PLUGIN', 'EXT',
+  ], DECLARATION),
+  ...classes([
+    'UI', 'BTN', 'TOPBAR', 'SIDEBAR', 'FOOTER', 'HEADER', 'NAV', 'MENU', 'COLOR', 'BG', 'BACKGROUND',
+    'ICON', 'IMG', 'IMAGE', 'VIDEO', 'AUDIO', 'TEXT', 'TITLE', 'SUBTITLE', 'CONTAINER', 'GRID', 'FLEX',
+    'ROW', 'COL', 'COLUMN', 'CARD', 'MODAL', 'TOAST', 'TOOLTIP', 'GROUP', 'ID', 'NAME',
+  ], COMPONENT),
+  ...classes([
+    'WIDTH', 'HEIGHT', 'PADDING', 'MARGIN', 'BORDER', 'RADIUS', 'SHADOW', 'OPACITY', 'SIZE', 'POSITION',
+    'TOP', 'LEFT', 'RIGHT', 'BOTTOM', 'Z_INDEX', 'DISPLAY', 'VISIBLE', 'HIDDEN', 'HEX_COLOR',
+    'LPAREN', 'RPAREN',
+  ], PROPERTY),
+  ['DATA', LITERAL],
+  ['SERVER', NUMBER],
+  ...classes([
+    'PLUS', 'MINUS', 'MULTIPLY', 'DIVIDE', 'MODULO', 'POWER', 'ASSIGN', 'COLON_ASSIGN', 'ARROW_ASSIGN',
+    'EQ', 'NEQ', 'LT', 'GT', 'LTE', 'GTE', 'AND', 'OR', 'NOT', 'DOT', 'SPREAD', 'OPTIONAL', 'NULLISH',
+    'LBRACE', 'RBRACE', 'LBRACKET', 'RBRACKET', 'COLON', 'PIPE', 'ARROW', 'FAT_ARROW', 'TILDE',
+    'QUESTION', 'EXCLAMATION', 'PERCENT', 'AMPERSAND',
+  ], OPERATOR),
+]);
+
+function escapeHtml(text: string): string {
+  if (!/[&<>]/.test(text)) return text;
+  return text.replace(/[&<>]/g, (char) => (char === '&' ? '&amp;' : char === '<' ? '&lt;' : '&gt;'));
+}
+
+// Collects colored text into lines of HTML
+class HighlightLines {
+  private lines: string[] = [];
+  private line = '';
+
+  push(text: string, className: string | null): void {
+    let start = 0;
+    for (let end = text.indexOf('\n'); ; end = text.indexOf('\n', start)) {
+      const part = text.slice(start, end < 0 ? text.length : end);
+      if (part) {
+        this.line += className ? `<span class="${className}">${escapeHtml(part)}</span>` : escapeHtml(part);
+      }
+      if (end < 0) return;
+      this.lines.push(this.line);
+      this.line = '';
+      start = end + 1;
+    }
+  }
+
+  finish(): string[] {
+    this.lines.push(this.line);
+    return this.lines;
+  }
+}
+
+function isQuote(code: number): boolean {
+  return code === CharCode.DoubleQuote || code === CharCode.SingleQuote;
+}
+
+// Whether the token lexed as `type` and `value` is written at `pos`; string
+// literal values are decoded, so those are recognized by their quote
+function startsToken(source: string, pos: number, type: TokenType, value: string): boolean {
+  if (type === 'STRING' && isQuote(source.charCodeAt(pos))) return true;
+  return value !== '' && source.startsWith(value, pos);
+}
+
+// Where the quoted string opening at `start` ends, as DroyScanner reads it
+function stringEnd(source: string, start: number): number {
+  const quote = source.charCodeAt(start);
+  let pos = start + 1;
+  while (pos < source.length && source.charCodeAt(pos) !== quote) {
+    pos += source.charCodeAt(pos) === CharCode.Backslash ? 2 : 1;
+  }
+  return Math.min(pos + 1, source.length);
+}
+
+function droyClass(type: TokenType, text: string): string | null {
+  switch (text.charCodeAt(0)) {
+    case CharCode.Tilde:
+      return type === 'SET' || type === 'GET' ? KEYWORD : COMPONENT;
+    case CharCode.At:
+      return NUMBER;
+    case CharCode.DoubleQuote:
+    case CharCode.SingleQuote:
+      return LITERAL;
+  }
+  // The lexer gives the `number` keyword and numeric literals one kind
+  if (type === 'NUMBER') return /^\d/.test(text) ? NUMBER : KEYWORD;
+  return DROY_CLASSES.get(type) ?? null;
+}
+
+// Where a `#` or `//` comment starting at `pos` ends, or -1; `#` followed by
+// a hex digit starts a color
+function commentEnd(source: string, pos: number): number {
+  const code = source.charCodeAt(pos);
+  const next = source.charCodeAt(pos + 1);
+  if (code === CharCode.Hash ? isHexDigit(next) : code !== CharCode.Slash || next !== CharCode.Slash) return -1;
+  const end = source.indexOf('\n', pos);
+  return end === -1 ? source.length : end;
+}
+
+// `tokens` must come from lexing `source`; without them it is lexed here
+export function highlightDroy(source: string, tokens?: TokenStream<TokenType>): string[] {
+  const stream = tokens ?? new DroyLexerV3(source).tokenizeCompact();
+  const out = new HighlightLines();
+  let pos = 0;
+
+  for (let index = 0; index < stream.length && pos < source.length; index++) {
+    const type = stream.type(index);
+    if (type === 'EOF') break;
+    const value = stream.value(index);
+
+    // Pass over what the lexer skipped before this token: whitespace,
+    // comments and characters it ignores
+    let plain = pos;
+    for (;;) {
+      const code = source.charCodeAt(pos);
+      const comment = commentEnd(source, pos);
+      if (comment !== -1) {
+        out.push(source.slice(plain, pos), null);
+        out.push(source.slice(pos, comment), COMMENT);
+        plain = pos = comment;
+        continue;
+      }
+      if (code === CharCode.Newline ? type === 'NEWLINE' : !isWhitespace(code) && startsToken(source, pos, type, value)) break;
+      // A newline the tokens do not account for means they were lexed from
+      // another source; the rest stays plain
+      if (pos >= source.length || code === CharCode.Newline) {
+        out.push(source.slice(plain), null);
+        return out.finish();
+      }
+      pos++;
+    }
+    out.push(source.slice(plain, pos), null);
+
+    const end = type === 'STRING' && isQuote(source.charCodeAt(pos)) ? stringEnd(source, pos) : pos + Math.max(value.length, 1);
+    const text = source.slice(pos, end);
+    out.push(text, droyClass(type, text));
+    pos = end;
+  }
+
+  // After the last token there is only what the lexer skipped
+  let plain = pos;
+  for (; pos < source.length; pos++) {
+    const comment = commentEnd(source, pos);
+    if (comment !== -1) {
+      out.push(source.slice(plain, pos), null);
+      out.push(source.slice(pos, comment), COMMENT);
+      plain = pos = comment;
+    }
+  }
+  out.push(source.slice(plain), null);
+  return out.finish();
+}
+
+// A rule matches at the scan position (its regex must be sticky) and gives
+// the class of its match, or of a word by the text that follows it
+type HighlightRule = [RegExp, string | null | ((text: string, rest: string) => string | null)];
+
+export interface HighlightGrammar {
+  rules: HighlightRule[];
+}
+
+function words(list: string): Set<string> {
+  return new Set(list.split(' '));
+}
+
+const C_KEYWORDS = words(
+  'return if else for while do switch case default break continue goto struct union enum typedef ' +
+  'const static extern inline sizeof volatile register restrict NULL true false',
+);
+const C_TYPES = words('int void char float double bool long short unsigned signed size_t va_list');
+
+const LLVM_KEYWORDS = words(
+  'define declare global constant private internal external linkonce weak appending unnamed_addr ' +
+  'local_unnamed_addr target datalayout triple attributes nounwind readonly readnone noalias nsw nuw ' +
+  'to align inbounds type',
+);
+const LLVM_TYPES = words('float double void label metadata x86_fp80 ppc_fp128 ptr');
+const LLVM_INSTRUCTIONS = words(
+  'alloca load store getelementptr call ret br switch indirectbr invoke resume unreachable add sub mul ' +
+  'sdiv udiv urem srem fadd fsub fmul fdiv frem fneg shl lshr ashr and or xor icmp fcmp phi select ' +
+  'va_arg landingpad extractvalue insertvalue sext zext trunc sitofp uitofp fptosi fptoui fpext ' +
+  'fptrunc bitcast ptrtoint inttoptr',
+);
+
+export const HIGHLIGHT_GRAMMARS: Record<Exclude<HighlightLanguage, 'droy'>, HighlightGrammar> = {
+  c: {
+    rules: [
+      [/\s+/y, null],
+      [/\/\/[^\n]*|\/\*[\s\S]*?(?:\*\/|$)/y, COMMENT],
+      // A directive runs to the end of its line, continuations included
+      [/(?<=^|\n)[ \t]*#(?:[^\n\\]|\\[\s\S])*/y, 'text-cyan-400'],
+      [/"(?:[^"\\\n]|\\.)*"?|'(?:[^'\\\n]|\\.)*'?/y, LITERAL],
+      [/(?:0[xX][\da-fA-F]+|\d+\.?\d*(?:[eE][+-]?\d+)?|\.\d+)[uUlLfF]*/y, NUMBER],
+      [/[A-Za-z_]\w*/y, (word, rest) =>
+        C_KEYWORDS.has(word) ? DECLARATION
+        : C_TYPES.has(word) ? 'text-blue-400'
+        : /^\s*\(/.test(rest) ? PROPERTY
+        : null],
+      [/[^\w\s"'/#]+|./y, null],
+    ],
+  },
+  llvm: {
+    rules: [
+      [/\s+/y, null],
+      [/;[^\n]*/y, COMMENT],
+      [/c?"[^"\n]*"?/y, LITERAL],
+      [/[%@](?:[-\w.$]+|"[^"\n]*")/y, 'text-indigo-400'],
+      [/#\d+/y, 'text-cyan-400'],
+      [/(?<=^|\n)[-\w.$]+:/y, NUMBER],
+      [/[A-Za-z_][\w.]*/y, (word) =>
+        /^i\d+$/.test(word) || LLVM_TYPES.has(word) ? 'text-blue-400'
+        : LLVM_KEYWORDS.has(word) ? DECLARATION
+        : LLVM_INSTRUCTIONS.has(word) ? PROPERTY
+        : null],
+      [/[^\w\s";%@#]+|./y, null],
+    ],
+  },
+};
+
+export function highlightWith(source: string, grammar: HighlightGrammar): string[] {
+  const out = new HighlightLines();
+  let pos = 0;
+  while (pos < source.length) {
+    let matched = false;
+    for (const [pattern, rule] of grammar.rules) {
+      pattern.lastIndex = pos;
+      const match = pattern.exec(source);
+      if (!match || match[0].length === 0) continue;
+      const text = match[0];
+      const end = pos + text.length;
+      out.push(text, typeof rule === 'function' ? rule(text, source.slice(end, end + 16)) : rule);
+      pos = end;
+      matched = true;
+      break;
+    }
+    if (!matched) {
+      out.push(source[pos], null);
+      pos++;
+    }
+  }
+  return out.finish();
+}
+
+export function highlightCode(source: string, language: HighlightLanguage): string[] {
+  return language === 'droy' ? highlightDroy(source) : highlightWith(source, HIGHLIGHT_GRAMMARS[language]);
+}
@@ -0,0 +1,123 @@
+// Droy Language - media lowering for img, video and audio components
+// Images load lazily and decode off the main thread unless marked
+// `priority`, and media given a pixel width and height carry them as
+// attributes, so the page reserves their box before anything loads. With an
+// image CDN configured, images get a srcset of resized copies and, when the
+// CDN template takes a format, a <picture> offering newer formats first.
+// Video and audio load nothing until played; an `autoplay` video instead
+// starts once it scrolls into view, through a small IntersectionObserver
+// runtime, and pauses when it leaves.
+
+import { attributeValue } from './router';
+
+export interface DroyMediaOptions {
+  // URL of a resized image, with {src} (the URL as written, encoded when in
+  // the query), {width} and optionally {format}:
+  // "https://cdn.example.com/{src}?w={width}&fm={format}"
+  imageCdn?: string;
+  // Widths offered in srcset, in pixels
+  widths?: number[];
+  // Formats offered as <picture> sources, best first, when the template has
+  // {format}; the <img> keeps the format of its source
+  formats?: string[];
+}
+
+const DEFAULT_WIDTHS = [320, 640, 960, 1280, 1920];
+const DEFAULT_FORMATS = ['avif', 'webp'];
+
+export const MEDIA_RUNTIME = `(() => {
+  const selector = 'video[data-droy-autoplay]';
+  // The autoplay videos in and under an element
+  const videos = (root) =>
+    (root.matches && root.matches(selector) ? [root] : []).concat(Array.from(root.querySelectorAll(selector)));
+  const start = (video) => video.play().catch(() => {});
+  const run = (fn) =>
+    document.readyState === 'loading' ? document.addEventListener('DOMContentLoaded', fn, { once: true }) : fn();
+  if (!('IntersectionObserver' in window)) {
+    run(() => videos(document).forEach(start));
+    return;
+  }
+  // Deferred videos play while half of them is in view
+  const observer = new IntersectionObserver((entries) => {
+    for (const entry of entries) {
+      if (entry.isIntersecting) {
+        start(entry.target);
+      } else if (!entry.target.paused) {
+        entry.target.pause();
+      }
+    }
+  }, { threshold: 0.5 });
+  const observe = (root) => videos(root).forEach((video) => observer.observe(video));
+  run(() => {
+    observe(document);
+    // Views and list rows rendered later bring their own videos; only what
+    // was added is searched
+    new MutationObserver((records) => {
+      for (const record of records) {
+        for (const node of record.addedNodes) if (node.nodeType === 1) observe(node);
+      }
+    }).observe(document.body, { childList: true, subtree: true });
+  });
+})();
+`;
+
+// A size in pixels, written `640` or `"640px"`
+export function pixels(value: unknown): number | null {
+  if (typeof value === 'number') return value > 0 ? value : null;
+  const match = typeof value === 'string' ? /^(\d+(?:\.\d+)?)(?:px)?$/.exec(value.trim()) : null;
+  return match ? parseFloat(match[1]) : null;
+}
+
+// width/height attributes for the sizes given in pixels
+export function sizeAttributes(width: number | null, height: number | null): string {
+  return (width ? ` width="${width}"` : '') + (height ? ` height="${height}"` : '');
+}
+
+// In one pass, so a {width} in the image's URL stays as it is. {src} is
+// encoded as a query value after the template's `?`, and left as written in
+// its path, where path-style CDNs take the whole URL.
+function cdnUrl(template: string, src: string, width: number, format: string): string {
+  const query = template.indexOf('?');
+  return template.replace(/\{(src|width|format)\}/g, (_, name: string, offset: number) => {
+    if (name === 'width') return String(width);
+    if (name === 'format') return format;
+    return query !== -1 && offset > query ? encodeURIComponent(src) : src;
+  });
+}
+
+function mimeType(format: string): string {
+  return `image/${format === 'jpg' ? 'jpeg' : format}`;
+}
+
+// The srcset and sizes attributes of an image, and the <source> elements of
+// its <picture>; null when it is not served through the CDN
+export function responsiveImage(
+  options: DroyMediaOptions,
+  src: string,
+  width: number | null,
+  sizes: string | null,
+): { attributes: string; sources: string } | null {
+  const template = options.imageCdn;
+  // Vector and inline images are not resized
+  if (!template || !src || /^data:|\.svg(?:[?#]|$)/i.test(src)) return null;
+
+  const allWidths = options.widths ?? DEFAULT_WIDTHS;
+  // No copy wider than the image needs on a 2x screen, rounded up to the
+  // next width offered
+  const sorted = [...allWidths].sort((a, b) => a - b);
+  const largest = width ? sorted.findIndex((candidate) => candidate >= width * 2) : -1;
+  const widths = largest === -1 ? sorted : sorted.slice(0, largest + 1);
+  const sizesValue = sizes ?? (width ? `(max-width: ${width}px) 100vw, ${width}px` : '100vw');
+  const srcset = (format: string) =>
+    attributeValue(widths.map((candidate) => `${cdnUrl(template, src, candidate, format)} ${candidate}w`).join(', '));
+
+  const own = /\.(\w+)(?:[?#]|$)/.exec(src)?.[1].toLowerCase() ?? 'jpg';
+  const attributes = ` srcset="${srcset(own)}" sizes="${attributeValue(sizesValue)}"`;
+  if (!template.includes('{format}')) return { attributes, sources: '' };
+
+  const sources = (options.formats ?? DEFAULT_FORMATS)
+    .filter((format) => format !== own)
+    .map((format) => `<source type="${mimeType(format)}" srcset="${srcset(format)}" sizes="${attributeValue(sizesValue)}">`)
+    .join('');
+  return { attributes, sources };
+}
@@ -0,0 +1,274 @@
+// Droy Language - module graph
+// `import "lib/button"` brings in what another file exports, and `export`
+// marks the declarations a file offers. A DroyModuleGraph parses each file
+// once, however many programs import it, and link() turns a program and
+// everything it imports into one Program for any backend. Imported modules
+// come first, in dependency order. Of their declarations, only the ones the
+// program reaches through some chain of references are kept; statements
+// that declare nothing (prints, components) and declarations with an impure
+// initializer run as the module's side effects. Kept statements are the
+// module's own nodes, so backends that cache by node identity generate a
+// shared module only once.
+//
+// Only node shapes both parsers share are used, so the same graph links
+// for the UI/VM pipeline (compiler-v3) and the C/LLVM one (compiler).
+
+import type { ASTNode } from './ast';
+import { pureExpression } from './optimizer';
+
+export interface DroyModuleHost {
+  // Source of the file at `path` (relative to the root, `/`-separated);
+  // throws if there is none
+  read(path: string): string;
+}
+
+interface ModuleStatement {
+  node: ASTNode;
+  // Top-level names it declares; empty for a side effect
+  declares: string[];
+  exported: boolean;
+  // Every name it mentions, at any depth
+  references: Set<string>;
+}
+
+interface DroyModule {
+  path: string;
+  ast: ASTNode;
+  // Resolved paths, in source order
+  imports: string[];
+  statements: ModuleStatement[];
+  // Statement indexes of each top-level name's declarations
+  declared: Map<string, number[]>;
+  exports: Set<string>;
+}
+
+// `import "button"` in pages/home.droy is pages/button.droy; a leading `/`
+// starts from the root
+export function resolveImport(from: string, path: string): string {
+  const parts = path.startsWith('/') ? [] : from.split('/').slice(0, -1);
+  for (const part of path.split('/')) {
+    if (part === '..') {
+      parts.pop();
+    } else if (part !== '' && part !== '.') {
+      parts.push(part);
+    }
+  }
+  const resolved = parts.join('/');
+  return resolved.endsWith('.droy') ? resolved : `${resolved}.droy`;
+}
+
+function declaredBy(node: ASTNode): string[] {
+  switch (node.type) {
+    case 'ExportStatement':
+      return declaredBy(node.declaration);
+    case 'VariableDeclaration':
+    case 'SetDeclaration':
+    case 'FunctionDeclaration':
+    case 'ClassDeclaration':
+    case 'Data':
+      return node.name ? [node.name] : [];
+    case 'Binding':
+      return node.target ? [node.target] : [];
+    case 'ValueSet':
+      return node.assignments.map((assignment: { name: string }) => assignment.name);
+    default:
+      return [];
+  }
+}
+
+// The expressions evaluated when a declaration runs
+function initializers(node: ASTNode): ASTNode[] {
+  switch (node.type) {
+    case 'ExportStatement':
+      return node.declaration ? initializers(node.declaration) : [];
+    case 'VariableDeclaration':
+    case 'SetDeclaration':
+      return node.value ? [node.value] : [];
+    case 'ValueSet':
+      return node.assignments.map((assignment: { value: ASTNode }) => assignment.value);
+    default:
+      return [];
+  }
+}
+
+function collectReferences(value: unknown, names: Set<string>): Set<string> {
+  if (Array.isArray(value)) {
+    for (const item of value) collectReferences(item, names);
+  } else if (value && typeof value === 'object') {
+    const node = value as ASTNode;
+    if ((node.type === 'Identifier' || node.type === 'GetExpression') && typeof node.name === 'string') {
+      names.add(node.name);
+    }
+    for (const key in node) {
+      if (node[key] && typeof node[key] === 'object') collectReferences(node[key], names);
+    }
+  }
+  return names;
+}
+
+export class DroyModuleGraph {
+  private host: DroyModuleHost;
+  private parse: (source: string) => ASTNode;
+  private loaded = new Map<string, { source: string; module: DroyModule }>();
+  private described = new WeakMap<ASTNode, DroyModule>();
+
+  // `parse` turns a source into a Program with the parser of the backend
+  // the graph links for
+  constructor(host: DroyModuleHost, parse: (source: string) => ASTNode) {
+    this.host = host;
+    this.parse = parse;
+  }
+
+  // Paths of every module `path` imports, directly or not
+  public dependencies(path: string, ast?: ASTNode): string[] {
+    return this.order(ast ? this.describe(path, ast) : this.load(path)).map((module) => module.path);
+  }
+
+  // `ast` is the already parsed source of `path`; without it `path` is read.
+  // A program that imports nothing comes back as it is.
+  public link(path: string, ast?: ASTNode): ASTNode {
+    const entry = ast ? this.describe(path, ast) : this.load(path);
+    if (entry.imports.length === 0) return entry.ast;
+    const modules = this.order(entry);
+
+    // Everything the program does is kept, and so is every side effect of
+    // the modules it imports: statements that declare nothing, and
+    // declarations whose initializer may do more than produce a value (a
+    // call, a request). Other declarations are kept once something kept
+    // mentions them.
+    const kept = new Map<DroyModule, Set<number>>();
+    const pending: Array<[DroyModule, ModuleStatement]> = [];
+    const keep = (module: DroyModule, index: number): void => {
+      let indexes = kept.get(module);
+      if (!indexes) kept.set(module, (indexes = new Set()));
+      if (indexes.has(index)) return;
+      indexes.add(index);
+      pending.push([module, module.statements[index]]);
+    };
+    entry.statements.forEach((_, index) => keep(entry, index));
+    for (const module of modules) {
+      module.statements.forEach((statement, index) => {
+        if (statement.declares.length === 0 || this.effectful(module, statement)) keep(module, index);
+      });
+    }
+    while (pending.length > 0) {
+      const [module, statement] = pending.pop()!;
+      for (const name of statement.references) {
+        const owner = this.owner(module, name);
+        if (owner) {
+          for (const index of owner.declared.get(name)!) keep(owner, index);
+        }
+      }
+    }
+
+    // Modules share one namespace once linked
+    const declaredIn = new Map<string, DroyModule>();
+    for (const [module, indexes] of kept) {
+      for (const index of indexes) {
+        for (const name of module.statements[index].declares) {
+          const other = declaredIn.get(name);
+          if (other && other !== module) {
+            throw new Error(`"${name}" is declared in both ${other.path} and ${module.path}`);
+          }
+          declaredIn.set(name, module);
+        }
+      }
+    }
+
+    const body: ASTNode[] = [];
+    for (const module of [...modules, entry]) {
+      const indexes = kept.get(module);
+      module.statements.forEach((statement, index) => {
+        if (!indexes?.has(index) || statement.node.type === 'ImportStatement') return;
+        // Outside its module an export is just its declaration
+        body.push(module === entry || !statement.exported ? statement.node : statement.node.declaration);
+      });
+    }
+    return { type: 'Program', body };
+  }
+
+  // The same test DroyOptimizer uses to keep a declaration nothing reads
+  private effectful(module: DroyModule, statement: ModuleStatement): boolean {
+    const bound = (name: string): boolean => this.owner(module, name) !== null;
+    return initializers(statement.node).some((value) => !pureExpression(value, bound));
+  }
+
+  // The module a name used in `module` refers to: its own declaration, or
+  // the nearest module it imports (directly or not) that exports the name
+  private owner(module: DroyModule, name: string): DroyModule | null {
+    if (module.declared.has(name)) return module;
+    const seen = new Set([module.path]);
+    let layer = module.imports;
+    while (layer.length > 0) {
+      const next: string[] = [];
+      for (const path of layer) {
+        if (seen.has(path)) continue;
+        seen.add(path);
+        const imported = this.load(path);
+        if (imported.exports.has(name)) return imported;
+        next.push(...imported.imports);
+      }
+      layer = next;
+    }
+    return null;
+  }
+
+  // Imported modules, each after the ones it imports; import cycles are cut
+  // where they close
+  private order(entry: DroyModule): DroyModule[] {
+    const modules: DroyModule[] = [];
+    const seen = new Set([entry.path]);
+    const visit = (module: DroyModule): void => {
+      for (const path of module.imports) {
+        if (seen.has(path)) continue;
+        seen.add(path);
+        const imported = this.load(path, module.path);
+        visit(imported);
+        modules.push(imported);
+      }
+    };
+    visit(entry);
+    return modules;
+  }
+
+  // Parsed again only when its source changed
+  private load(path: string, importer?: string): DroyModule {
+    let source: string;
+    try {
+      source = this.host.read(path);
+    } catch (error) {
+      const reason = error instanceof Error ? error.message : String(error);
+      throw new Error(importer ? `${importer}: cannot import ${path}: ${reason}` : reason);
+    }
+    const loaded = this.loaded.get(path);
+    if (loaded && loaded.source === source) return loaded.module;
+    const module = this.describe(path, this.parse(source));
+    this.loaded.set(path, { source, module });
+    return module;
+  }
+
+  private describe(path: string, ast: ASTNode): DroyModule {
+    const known = this.described.get(ast);
+    if (known && known.path === path) return known;
+
+    const module: DroyModule = { path, ast, imports: [], statements: [], declared: new Map(), exports: new Set() };
+    for (const node of ast.body as ASTNode[]) {
+      if (node.type === 'ImportStatement') {
+        const imported = resolveImport(path, node.path);
+        if (imported !== path && !module.imports.includes(imported)) module.imports.push(imported);
+      }
+      const declares = declaredBy(node);
+      const exported = node.type === 'ExportStatement' && node.declaration != null;
+      const index = module.statements.length;
+      for (const name of declares) {
+        const indexes = module.declared.get(name);
+        if (indexes) indexes.push(index);
+        else module.declared.set(name, [index]);
+        if (exported) module.exports.add(name);
+      }
+      module.statements.push({ node, declares, exported, references: collectReferences(node, new Set()) });
+    }
+    this.described.set(ast, module);
+    return module;
+  }
+}
@@ -0,0 +1,748 @@
+// Droy Language - AST optimizer
+// Rewrites a parsed program before a backend sees it. Both front ends build
+// the same node shapes for everything handled here, so DroyParser output for
+// the C and LLVM backends and DroyParserV3 output for the UI generator and
+// the VM go through the same passes:
+//
+// - folding: operators, math operations and pipes over literals are
+//   evaluated with the VM's value semantics (which match the C runtime), and
+//   a blend of literal colors becomes the color it produces
+// - propagation: reads of a variable that is declared once, never assigned
+//   and holds a literal are replaced by the literal, where the read is known
+//   to run after the declaration
+// - elimination: declarations nothing mentions and `if`/`while` branches a
+//   literal condition rules out are dropped
+//
+// Nodes are never mutated and unchanged subtrees keep their identity. An
+// optimizer also reuses its output for a top-level statement while the
+// constants that statement reads stay the same, so DroyUIGeneratorV3's
+// per-node cache keeps working across DroyParserV3.reparse() calls.
+
+import type { ASTNode, LiteralNode } from './ast';
+import { BUILTINS, droyEquals, droyToString, droyTruthy, type DroyValue } from './vm';
+
+export interface DroyOptimizerOptions {
+  // Evaluate constant expressions, math operations, pipes and color blends
+  fold?: boolean;
+  // Substitute variables that hold a literal
+  propagate?: boolean;
+  // Drop unused declarations and statically dead branches
+  eliminate?: boolean;
+}
+
+type Constant = null | number | string | boolean;
+
+// Every mention of a name inside a subtree
+interface Usage {
+  // Identifier reads, `get`, and math keywords (which may name a func)
+  reads: Map<string, number>;
+  // var / set / value-set
+  declarations: Map<string, number>;
+  // Everything else: assignment targets, funcs, params, loop variables and
+  // names inside nodes the optimizer does not interpret
+  bindings: Map<string, number>;
+}
+
+const NAME = /^[A-Za-z_]\w*$/;
+const INT_MAX = 2147483647;
+
+const BUILTIN_CALLS = new Map(BUILTINS.map((builtin) => [builtin.name, builtin.call]));
+// Evaluated at run time on every call
+const IMPURE_BUILTINS = new Set(['random']);
+
+const usages = new WeakMap<ASTNode, Usage>();
+
+function count(counts: Map<string, number>, name: string): void {
+  counts.set(name, (counts.get(name) ?? 0) + 1);
+}
+
+function scan(node: ASTNode, usage: Usage): void {
+  switch (node.type) {
+    case 'Identifier':
+    case 'GetExpression':
+      count(usage.reads, node.name);
+      return;
+    case 'VariableDeclaration':
+    case 'SetDeclaration':
+      count(usage.declarations, node.name);
+      scanValue(node.value, usage);
+      return;
+    case 'ValueSet':
+      for (const assignment of node.assignments) {
+        count(assignment.operation ? usage.bindings : usage.declarations, assignment.name);
+        scanValue(assignment.value, usage);
+      }
+      return;
+    case 'MathOperation':
+      count(usage.reads, node.operation);
+      scanValue(node.values, usage);
+      return;
+    case 'AssignmentExpression':
+      if (node.left.type === 'Identifier') {
+        count(usage.bindings, node.left.name);
+      } else {
+        scan(node.left, usage);
+      }
+      scan(node.right, usage);
+      return;
+    case 'ObjectLiteral':
+      for (const property of node.properties) {
+        scan(property.value, usage);
+      }
+      return;
+    case 'NumberLiteral':
+    case 'StringLiteral':
+    case 'BooleanLiteral':
+    case 'NullLiteral':
+    case 'ColorLiteral':
+      return;
+  }
+  for (const key in node) {
+    if (key !== 'type' && key !== 'operator') {
+      scanValue(node[key], usage);
+    }
+  }
+}
+
+function scanValue(value: unknown, usage: Usage): void {
+  if (typeof value === 'string') {
+    if (NAME.test(value)) count(usage.bindings, value);
+  } else if (Array.isArray(value)) {
+    for (const item of value) scanValue(item, usage);
+  } else if (value && typeof value === 'object') {
+    if (typeof (value as ASTNode).type === 'string') {
+      scan(value as ASTNode, usage);
+    } else {
+      for (const item of Object.values(value)) scanValue(item, usage);
+    }
+  }
+}
+
+function usageOf(node: ASTNode): Usage {
+  let usage = usages.get(node);
+  if (!usage) {
+    usage = { reads: new Map(), declarations: new Map(), bindings: new Map() };
+    scan(node, usage);
+    usages.set(node, usage);
+  }
+  return usage;
+}
+
+function mentions(usage: Usage, name: string): number {
+  return (usage.reads.get(name) ?? 0) + (usage.declarations.get(name) ?? 0) + (usage.bindings.get(name) ?? 0);
+}
+
+function names(usage: Usage): Set<string> {
+  return new Set([...usage.reads.keys(), ...usage.declarations.keys(), ...usage.bindings.keys()]);
+}
+
+// Mentions of every name across `body`
+function totals(body: ASTNode[]): Map<string, number> {
+  const result = new Map<string, number>();
+  for (const stmt of body) {
+    const usage = usageOf(stmt);
+    for (const counts of [usage.reads, usage.declarations, usage.bindings]) {
+      for (const [name, n] of counts) {
+        result.set(name, (result.get(name) ?? 0) + n);
+      }
+    }
+  }
+  return result;
+}
+
+function literal(value: Constant): LiteralNode {
+  switch (typeof value) {
+    case 'number':
+      return { type: 'NumberLiteral', value };
+    case 'string':
+      return { type: 'StringLiteral', value };
+    case 'boolean':
+      return { type: 'BooleanLiteral', value };
+    default:
+      return { type: 'NullLiteral', value: null };
+  }
+}
+
+function constantOf(node: ASTNode | null | undefined): Constant | undefined {
+  switch (node?.type) {
+    case 'NumberLiteral':
+    case 'StringLiteral':
+    case 'BooleanLiteral':
+      return node.value;
+    case 'NullLiteral':
+      return null;
+    default:
+      return undefined;
+  }
+}
+
+// Like constantOf, but also takes arrays of literals as builtin arguments
+function valueOf(node: ASTNode): DroyValue | undefined {
+  if (node.type !== 'ArrayLiteral') return constantOf(node);
+  const items: DroyValue[] = [];
+  for (const element of node.elements) {
+    const item = valueOf(element);
+    if (item === undefined) return undefined;
+    items.push(item);
+  }
+  return items;
+}
+
+// A number the backends represent the way folding produced it: finite, and
+// not an int result that int arithmetic would have overflowed
+function representable(result: number, operands: number[]): boolean {
+  if (!Number.isFinite(result)) return false;
+  const intOperands = operands.every((operand) => Number.isInteger(operand) && Math.abs(operand) <= INT_MAX);
+  return !(intOperands && Number.isInteger(result) && Math.abs(result) > INT_MAX);
+}
+
+function foldBinary(operator: string, left: Constant, right: Constant): Constant | undefined {
+  if (operator === '+' && (typeof left === 'string' || typeof right === 'string')) {
+    return droyToString(left) + droyToString(right);
+  }
+  if (operator === '==' || operator === '!=') {
+    if (typeof left !== typeof right && left !== null && right !== null) return undefined;
+    return droyEquals(left, right) === (operator === '==');
+  }
+  if (typeof left === 'string' && typeof right === 'string' && /^[\x20-\x7e]*$/.test(left + right)) {
+    switch (operator) {
+      case '<': return left < right;
+      case '>': return left > right;
+      case '<=': return left <= right;
+      case '>=': return left >= right;
+    }
+    return undefined;
+  }
+  if (typeof left !== 'number' || typeof right !== 'number') return undefined;
+
+  let result: number;
+  switch (operator) {
+    case '+': result = left + right; break;
+    case '-': result = left - right; break;
+    case '*': result = left * right; break;
+    case '/': result = left / right; break;
+    case '%': result = left % right; break;
+    case '<': return left < right;
+    case '>': return left > right;
+    case '<=': return left <= right;
+    case '>=': return left >= right;
+    default: return undefined;
+  }
+  return representable(result, [left, right]) ? result : undefined;
+}
+
+function callBuiltin(name: string, args: DroyValue[]): Constant | undefined {
+  let result: DroyValue;
+  try {
+    result = BUILTIN_CALLS.get(name)!(args);
+  } catch {
+    // Left for the program to fail on when it runs
+    return undefined;
+  }
+  if (typeof result === 'number') return representable(result, args.filter((arg) => typeof arg === 'number')) ? result : undefined;
+  return result === null || typeof result === 'string' || typeof result === 'boolean' ? result : undefined;
+}
+
+// --- colors ------------------------------------------------------------------
+
+type RGB = [number, number, number];
+
+// Separable blend modes, per channel in [0, 1]: backdrop `b`, source `s`
+const BLEND_MODES: Record<string, (b: number, s: number) => number> = {
+  normal: (_b, s) => s,
+  multiply: (b, s) => b * s,
+  screen: (b, s) => b + s - b * s,
+  overlay: (b, s) => (b <= 0.5 ? 2 * b * s : 1 - 2 * (1 - b) * (1 - s)),
+  darken: (b, s) => Math.min(b, s),
+  lighten: (b, s) => Math.max(b, s),
+  difference: (b, s) => Math.abs(b - s),
+  exclusion: (b, s) => b + s - 2 * b * s,
+};
+
+function parseHex(color: string): RGB | null {
+  const match = /^#([0-9a-f]{3}|[0-9a-f]{6})$/i.exec(color);
+  if (!match) return null;
+  const hex = match[1].length === 3 ? match[1].replace(/./g, '$&$&') : match[1];
+  return [0, 2, 4].map((at) => parseInt(hex.slice(at, at + 2), 16) / 255) as RGB;
+}
+
+function formatHex(color: RGB): string {
+  return `#${color.map((channel) => Math.round(channel * 255).toString(16).padStart(2, '0')).join('')}`;
+}
+
+// The single color a ColorBlend node paints, when it can be known statically
+function blendColors(node: ASTNode): string | null {
+  const colors: string[] = node.colors ?? [];
+  if (node.blendType === 'gradient') {
+    return colors.length > 0 && colors.every((color) => color.toLowerCase() === colors[0].toLowerCase()) ? colors[0] : null;
+  }
+  const blend = BLEND_MODES[node.mode];
+  if (node.blendType !== 'blend' || !blend || colors.length < 2) return null;
+  const parsed = colors.map(parseHex);
+  if (parsed.some((color) => !color)) return null;
+  const result = parsed.reduce((backdrop, source) => backdrop!.map((b, i) => blend(b, source![i])) as RGB);
+  return formatHex(result!);
+}
+
+// --- optimizer ---------------------------------------------------------------
+
+// Node types an expression may contain and still be dropped unevaluated
+const PURE_EXPRESSIONS = new Set([
+  'NumberLiteral', 'StringLiteral', 'BooleanLiteral', 'NullLiteral', 'ColorLiteral', 'Identifier',
+  'GetExpression', 'BinaryExpression', 'LogicalExpression', 'UnaryExpression', 'ArrayLiteral',
+  'ObjectLiteral', 'MathOperation',
+]);
+
+// Whether evaluating `node` can have no effect besides its value. `bound`
+// tells whether a name is the program's own, so a math keyword may call a
+// func of that name.
+export function pureExpression(node: ASTNode | null | undefined, bound: (name: string) => boolean): boolean {
+  if (!node) return true;
+  if (!PURE_EXPRESSIONS.has(node.type)) return false;
+  switch (node.type) {
+    case 'BinaryExpression':
+    case 'LogicalExpression':
+      return pureExpression(node.left, bound) && pureExpression(node.right, bound);
+    case 'UnaryExpression':
+      return pureExpression(node.operand, bound);
+    case 'ArrayLiteral':
+      return node.elements.every((element: ASTNode) => pureExpression(element, bound));
+    case 'ObjectLiteral':
+      return node.properties.every((property: { value: ASTNode }) => pureExpression(property.value, bound));
+    case 'MathOperation':
+      return !bound(node.operation) && node.values.every((value: ASTNode) => pureExpression(value, bound));
+    default:
+      return true;
+  }
+}
+
+export class DroyOptimizer {
+  private fold: boolean;
+  private propagate: boolean;
+  private eliminate: boolean;
+  // Output for each top-level statement, with the constants it was built from
+  private cache = new WeakMap<ASTNode, { key: string; result: ASTNode }>();
+  // Per optimize() call: how often each name is declared or otherwise bound
+  private declarations = new Map<string, number>();
+  private bindings = new Map<string, number>();
+  // Constants declared before anything can call a func; visible in func bodies
+  private functionConstants = new Map<string, Constant>();
+
+  constructor(options: DroyOptimizerOptions = {}) {
+    this.fold = options.fold ?? true;
+    this.propagate = options.propagate ?? true;
+    this.eliminate = options.eliminate ?? true;
+  }
+
+  public optimize(program: ASTNode): ASTNode {
+    if (program.type !== 'Program') return program;
+
+    this.declarations = new Map();
+    this.bindings = new Map();
+    for (const stmt of program.body) {
+      const usage = usageOf(stmt);
+      usage.declarations.forEach((n, name) => this.declarations.set(name, (this.declarations.get(name) ?? 0) + n));
+      usage.bindings.forEach((n, name) => this.bindings.set(name, (this.bindings.get(name) ?? 0) + n));
+    }
+    this.functionConstants = this.prefixConstants(program.body);
+
+    let body = this.optimizeBody(program.body, new Map(), true, true);
+    while (this.eliminate) {
+      const next = this.eliminateBody(body, totals(body));
+      if (next === body) break;
+      body = next;
+    }
+    return body === program.body ? program : { ...program, body };
+  }
+
+  // Whether a read of `name` can be replaced once its declaration has run
+  private constantName(name: string): boolean {
+    return this.propagate && this.declarations.get(name) === 1 && !this.bindings.has(name);
+  }
+
+  // Whether the program gives `name` a meaning of its own, hiding the builtin
+  private bound(name: string): boolean {
+    return this.declarations.has(name) || this.bindings.has(name);
+  }
+
+  // Constants from the leading statements that cannot run a func: every func
+  // call happens after them, so func bodies may use them too
+  private prefixConstants(body: ASTNode[]): Map<string, Constant> {
+    const constants = new Map<string, Constant>();
+    if (!this.propagate) return constants;
+    for (const stmt of body) {
+      if (stmt.type === 'FunctionDeclaration') continue;
+      if (stmt.type === 'VariableDeclaration' || stmt.type === 'SetDeclaration') {
+        if (!this.pure(stmt.value)) break;
+        this.learn({ ...stmt, value: this.optimizeExpression(stmt.value, constants) }, constants);
+      } else if (stmt.type === 'ValueSet') {
+        if (!stmt.assignments.every((assignment: { value: ASTNode }) => this.pure(assignment.value))) break;
+        this.learn(this.optimizeStatement(stmt, constants), constants);
+      } else {
+        break;
+      }
+    }
+    return constants;
+  }
+
+  // Records the constants a statement at the top of a body declares
+  private learn(stmt: ASTNode, constants: Map<string, Constant>): void {
+    switch (stmt.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration': {
+        const value = constantOf(stmt.value);
+        if (value !== undefined && this.constantName(stmt.name)) constants.set(stmt.name, value);
+        break;
+      }
+      case 'ValueSet':
+        for (const assignment of stmt.assignments) {
+          const value = constantOf(assignment.value);
+          if (value !== undefined && !assignment.operation && this.constantName(assignment.name)) {
+            constants.set(assignment.name, value);
+          }
+        }
+        break;
+      case 'ExportStatement':
+        this.learn(stmt.declaration, constants);
+        break;
+    }
+  }
+
+  // `sequential` bodies run top to bottom exactly once per entry (a program
+  // or func body), so their declarations become constants for what follows
+  private optimizeBody(
+    body: ASTNode[],
+    constants: Map<string, Constant>,
+    sequential: boolean,
+    topLevel: boolean = false,
+  ): ASTNode[] {
+    let result: ASTNode[] | null = null;
+    for (let index = 0; index < body.length; index++) {
+      const stmt = body[index];
+      const next = topLevel ? this.optimizeTopLevel(stmt, constants) : this.optimizeStatement(stmt, constants);
+      if (sequential) this.learn(next, constants);
+      if (next !== stmt && !result) result = body.slice(0, index);
+      result?.push(next);
+    }
+    return result ?? body;
+  }
+
+  private optimizeTopLevel(stmt: ASTNode, constants: Map<string, Constant>): ASTNode {
+    // Everything the output depends on besides the statement itself
+    let key = '';
+    for (const name of names(usageOf(stmt))) {
+      key += `${name}:${JSON.stringify(constants.get(name))}:${JSON.stringify(this.functionConstants.get(name))}` +
+        `:${this.constantName(name)}:${this.bound(name)};`;
+    }
+    const cached = this.cache.get(stmt);
+    if (cached?.key === key) return cached.result;
+
+    const result = this.optimizeStatement(stmt, constants);
+    this.cache.set(stmt, { key, result });
+    return result;
+  }
+
+  private optimizeStatement(node: ASTNode, constants: Map<string, Constant>): ASTNode {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+      case 'PrintStatement':
+      case 'ReturnStatement': {
+        if (!node.value) return node;
+        const value = this.optimizeExpression(node.value, constants);
+        return value === node.value ? node : { ...node, value };
+      }
+      case 'ExpressionStatement': {
+        const expression = this.optimizeExpression(node.expression, constants);
+        return expression === node.expression ? node : { ...node, expression };
+      }
+      // A math keyword used as a statement; its value is the program result
+      case 'MathOperation': {
+        const expression = this.optimizeExpression(node, constants);
+        if (expression === node) return node;
+        return expression.type === 'MathOperation' ? expression : { type: 'ExpressionStatement', expression };
+      }
+      case 'ValueSet': {
+        // Later assignments in the set may use earlier ones
+        const scope = new Map(constants);
+        let changed = false;
+        const assignments = node.assignments.map((assignment: { name: string; value: ASTNode; operation?: string }) => {
+          const value = this.optimizeExpression(assignment.value, scope);
+          const constant = constantOf(value);
+          if (constant !== undefined && !assignment.operation && this.constantName(assignment.name)) {
+            scope.set(assignment.name, constant);
+          }
+          if (value === assignment.value) return assignment;
+          changed = true;
+          return { ...assignment, value };
+        });
+        return changed ? { ...node, assignments } : node;
+      }
+      case 'IfStatement': {
+        const condition = this.optimizeExpression(node.condition, constants);
+        const consequent = this.optimizeBody(node.consequent, new Map(constants), false);
+        const alternate = node.alternate && this.optimizeBody(node.alternate, new Map(constants), false);
+        return condition === node.condition && consequent === node.consequent && alternate === node.alternate
+          ? node
+          : { ...node, condition, consequent, alternate };
+      }
+      case 'WhileLoop': {
+        const condition = this.optimizeExpression(node.condition, constants);
+        const body = this.optimizeBody(node.body, new Map(constants), false);
+        return condition === node.condition && body === node.body ? node : { ...node, condition, body };
+      }
+      case 'ForLoop': {
+        const iterable = this.optimizeExpression(node.iterable, constants);
+        const body = this.optimizeBody(node.body, new Map(constants), false);
+        return iterable === node.iterable && body === node.body ? node : { ...node, iterable, body };
+      }
+      case 'FunctionDeclaration': {
+        const body = this.optimizeBody(node.body, new Map(this.functionConstants), true);
+        return body === node.body ? node : { ...node, body };
+      }
+      case 'ExportStatement': {
+        const declaration = this.optimizeStatement(node.declaration, constants);
+        return declaration === node.declaration ? node : { ...node, declaration };
+      }
+      case 'UIComponent': {
+        // Props that fold to a literal render statically instead of binding
+        let props = node.props;
+        for (const key in node.props) {
+          const value = node.props[key];
+          if (!value || typeof value !== 'object') continue;
+          const next = this.optimizeExpression(value, constants);
+          if (next !== value) {
+            if (props === node.props) props = { ...node.props };
+            props[key] = next;
+          }
+        }
+        const children = node.children && this.optimizeBody(node.children, new Map(constants), false);
+        return props === node.props && children === node.children ? node : { ...node, props, children };
+      }
+      case 'Route': {
+        const children = this.optimizeBody(node.children, new Map(constants), false);
+        return children === node.children ? node : { ...node, children };
+      }
+      case 'EventHandler': {
+        if (node.handler?.type !== 'BlockStatement') return node;
+        const body = this.optimizeBody(node.handler.body, new Map(constants), false);
+        return body === node.handler.body ? node : { ...node, handler: { ...node.handler, body } };
+      }
+      case 'ColorBlend': {
+        const color = this.fold ? blendColors(node) : null;
+        if (color === null || (node.blendType === 'blend' && node.mode === 'normal' && node.colors.length === 1)) {
+          return node;
+        }
+        return { ...node, blendType: 'blend', colors: [color], mode: 'normal' };
+      }
+      default:
+        return node;
+    }
+  }
+
+  private optimizeExpressions(nodes: ASTNode[], constants: Map<string, Constant>): ASTNode[] {
+    let result: ASTNode[] | null = null;
+    for (let index = 0; index < nodes.length; index++) {
+      const next = this.optimizeExpression(nodes[index], constants);
+      if (next !== nodes[index] && !result) result = nodes.slice(0, index);
+      result?.push(next);
+    }
+    return result ?? nodes;
+  }
+
+  private optimizeExpression(node: ASTNode, constants: Map<string, Constant>): ASTNode {
+    switch (node.type) {
+      case 'Identifier':
+        return constants.has(node.name) ? literal(constants.get(node.name)!) : node;
+
+      case 'BinaryExpression': {
+        const left = this.optimizeExpression(node.left, constants);
+        const right = this.optimizeExpression(node.right, constants);
+        const a = constantOf(left);
+        const b = constantOf(right);
+        if (this.fold && a !== undefined && b !== undefined) {
+          const result = foldBinary(node.operator, a, b);
+          if (result !== undefined) return literal(result);
+        }
+        return left === node.left && right === node.right ? node : { ...node, left, right };
+      }
+
+      // Both backends produce a boolean; a literal left side decides whether
+      // the right one runs at all
+      case 'LogicalExpression': {
+        const left = this.optimizeExpression(node.left, constants);
+        const right = this.optimizeExpression(node.right, constants);
+        const a = constantOf(left);
+        if (this.fold && a !== undefined) {
+          const decided = node.operator === '||' ? droyTruthy(a) : !droyTruthy(a);
+          if (decided) return literal(node.operator === '||');
+          const b = constantOf(right);
+          if (b !== undefined) return literal(droyTruthy(b));
+        }
+        return left === node.left && right === node.right ? node : { ...node, left, right };
+      }
+
+      case 'UnaryExpression': {
+        const operand = this.optimizeExpression(node.operand, constants);
+        const value = constantOf(operand);
+        if (this.fold && value !== undefined) {
+          if (node.operator === '!') return literal(!droyTruthy(value));
+          if (node.operator === '-' && typeof value === 'number') return literal(-value);
+        }
+        return operand === node.operand ? node : { ...node, operand };
+      }
+
+      case 'CallExpression': {
+        const callee = node.callee.type === 'Identifier' ? node.callee : this.optimizeExpression(node.callee, constants);
+        const args = this.optimizeExpressions(node.arguments, constants);
+        return callee === node.callee && args === node.arguments ? node : { ...node, callee, arguments: args };
+      }
+
+      // `x | f` is f(x) and `x | f(a)` is f(x, a)
+      case 'PipeExpression': {
+        const left = this.optimizeExpression(node.left, constants);
+        const right = node.right.type === 'Identifier' ? node.right : this.optimizeExpression(node.right, constants);
+        const callee = right.type === 'CallExpression' ? right.callee : right;
+        const args = right.type === 'CallExpression' ? [left, ...right.arguments] : [left];
+        const folded = this.foldCall(callee.type === 'Identifier' ? callee.name : null, args);
+        if (folded) return folded;
+        return left === node.left && right === node.right ? node : { ...node, left, right };
+      }
+
+      case 'MathOperation': {
+        const values = this.optimizeExpressions(node.values, constants);
+        const folded = this.foldCall(node.operation, values);
+        if (folded) return folded;
+        return values === node.values ? node : { ...node, values };
+      }
+
+      case 'ArrayLiteral': {
+        const elements = this.optimizeExpressions(node.elements, constants);
+        return elements === node.elements ? node : { ...node, elements };
+      }
+
+      case 'ObjectLiteral': {
+        let changed = false;
+        const properties = node.properties.map((property: { key: string; value: ASTNode }) => {
+          const value = this.optimizeExpression(property.value, constants);
+          if (value === property.value) return property;
+          changed = true;
+          return { ...property, value };
+        });
+        return changed ? { ...node, properties } : node;
+      }
+
+      case 'AssignmentExpression': {
+        const right = this.optimizeExpression(node.right, constants);
+        return right === node.right ? node : { ...node, right };
+      }
+
+      default:
+        return node;
+    }
+  }
+
+  // A builtin the program does not redefine, applied to literals
+  private foldCall(name: string | null, args: ASTNode[]): ASTNode | null {
+    if (!this.fold || !name || !BUILTIN_CALLS.has(name) || IMPURE_BUILTINS.has(name) || this.bound(name)) {
+      return null;
+    }
+    const values: DroyValue[] = [];
+    for (const arg of args) {
+      const value = valueOf(arg);
+      if (value === undefined) return null;
+      values.push(value);
+    }
+    const result = callBuiltin(name, values);
+    return result === undefined ? null : literal(result);
+  }
+
+  // Whether evaluating `node` can have no effect besides its value
+  private pure(node: ASTNode | null | undefined): boolean {
+    return pureExpression(node, (name) => this.bound(name));
+  }
+
+  // --- elimination -------------------------------------------------------------
+
+  // Whether nothing outside `node` mentions `name`
+  private unused(name: string, node: ASTNode, mentionCounts: Map<string, number>): boolean {
+    return (mentionCounts.get(name) ?? 0) === mentions(usageOf(node), name);
+  }
+
+  // Whether `body` may be dropped: nothing outside it mentions a name it binds
+  private droppable(body: ASTNode[], mentionCounts: Map<string, number>): boolean {
+    return body.every((stmt) => {
+      const usage = usageOf(stmt);
+      return [...usage.declarations.keys(), ...usage.bindings.keys()].every((name) => {
+        const inside = body.reduce((n, other) => n + mentions(usageOf(other), name), 0);
+        return (mentionCounts.get(name) ?? 0) === inside;
+      });
+    });
+  }
+
+  private eliminateBody(body: ASTNode[], mentionCounts: Map<string, number>): ASTNode[] {
+    let result: ASTNode[] | null = null;
+    for (let index = 0; index < body.length; index++) {
+      const next = this.eliminateStatement(body[index], mentionCounts);
+      if (!(next.length === 1 && next[0] === body[index]) && !result) result = body.slice(0, index);
+      result?.push(...next);
+    }
+    return result ?? body;
+  }
+
+  private eliminateStatement(node: ASTNode, mentionCounts: Map<string, number>): ASTNode[] {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+        return this.unused(node.name, node, mentionCounts) && this.pure(node.value) ? [] : [node];
+
+      case 'ValueSet': {
+        const assignments = node.assignments.filter((assignment: { name: string; value: ASTNode; operation?: string }) => {
+          const inside = 1 + mentions(usageOf(assignment.value), assignment.name);
+          return assignment.operation || (mentionCounts.get(assignment.name) ?? 0) !== inside || !this.pure(assignment.value);
+        });
+        if (assignments.length === 0) return [];
+        return [assignments.length === node.assignments.length ? node : { ...node, assignments }];
+      }
+
+      case 'FunctionDeclaration': {
+        if (this.unused(node.name, node, mentionCounts)) return [];
+        const body = this.eliminateBody(node.body, mentionCounts);
+        return [body === node.body ? node : { ...node, body }];
+      }
+
+      case 'IfStatement': {
+        const condition = constantOf(node.condition);
+        if (condition !== undefined) {
+          const live = (droyTruthy(condition) ? node.consequent : node.alternate) ?? [];
+          const dead = (droyTruthy(condition) ? node.alternate : node.consequent) ?? [];
+          if (this.droppable(dead, mentionCounts)) return this.eliminateBody(live, mentionCounts);
+        }
+        const consequent = this.eliminateBody(node.consequent, mentionCounts);
+        const alternate = node.alternate && this.eliminateBody(node.alternate, mentionCounts);
+        return [consequent === node.consequent && alternate === node.alternate ? node : { ...node, consequent, alternate }];
+      }
+
+      case 'WhileLoop': {
+        const condition = constantOf(node.condition);
+        if (condition !== undefined && !droyTruthy(condition) && this.droppable(node.body, mentionCounts)) return [];
+        const body = this.eliminateBody(node.body, mentionCounts);
+        return [body === node.body ? node : { ...node, body }];
+      }
+
+      case 'ForLoop': {
+        const body = this.eliminateBody(node.body, mentionCounts);
+        return [body === node.body ? node : { ...node, body }];
+      }
+
+      case 'UIComponent': {
+        if (!node.children) return [node];
+        const children = this.eliminateBody(node.children, mentionCounts);
+        return [children === node.children ? node : { ...node, children }];
+      }
+
+      default:
+        return [node];
+    }
+  }
+}
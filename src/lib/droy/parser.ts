@@ -0,0 +1,53 @@
+// Droy Language - Shared parsing core
+// Token access every parser version builds on: lookahead, consuming and
+// expecting tokens, over a plain token array or a compact TokenBuffer.
+
+import type { TokenSet } from './ast';
+import type { ScannedToken } from './scanner';
+import { TokenArray, type TokenStream } from './token-buffer';
+
+export class DroyParserCore<T extends string> {
+  protected tokens: TokenStream<T>;
+  protected position: number = 0;
+
+  constructor(tokens: ScannedToken<T>[] | TokenStream<T>) {
+    this.tokens = Array.isArray(tokens) ? new TokenArray(tokens) : tokens;
+  }
+
+  // Past the end, every lookahead sees the last token (EOF)
+  protected peek(offset: number = 0): ScannedToken<T> {
+    const pos = this.position + offset;
+    return this.tokens.get(pos < this.tokens.length ? pos : this.tokens.length - 1);
+  }
+
+  protected advance(): ScannedToken<T> {
+    return this.tokens.get(this.position++);
+  }
+
+  protected expect(type: T): ScannedToken<T> {
+    const token = this.advance();
+    if (token.type !== type) {
+      throw new Error(`Expected ${type} but got ${token.type} at line ${token.line}`);
+    }
+    return token;
+  }
+
+  protected match(type: T): boolean {
+    return this.currentType() === type;
+  }
+
+  protected matchAny(types: TokenSet<T>): boolean {
+    return types.has(this.currentType());
+  }
+
+  // The current token's kind, without building its value
+  protected currentType(): T {
+    return this.tokens.type(this.position < this.tokens.length ? this.position : this.tokens.length - 1);
+  }
+
+  protected skipNewlines(): void {
+    while (this.currentType() === 'NEWLINE') {
+      this.advance();
+    }
+  }
+}
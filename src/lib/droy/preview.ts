@@ -0,0 +1,213 @@
+// Droy Language - live preview host
+// The playground previews pages in a sandboxed iframe whose document stays
+// alive across compiles. PREVIEW_DOCUMENT is that document: a small bootstrap
+// that applies PreviewUpdate messages. PreviewHost runs on the page side and
+// turns each compile's output into the smallest update:
+// - fragments are keyed by their content id, so unchanged ones keep their
+//   DOM nodes and only new ones are parsed; the rest are moved or removed
+// - the stylesheet is patched through CSSOM, deleting and inserting only the
+//   rules between the unchanged ones at either end
+// - the JS bundle only runs when it changed. The previous bundle's timers,
+//   sockets and window/document listeners are torn down first, and the
+//   fragments it bound (`data-droy` elements) get fresh nodes
+// The frame has no same-origin access, so generated code can't reach the
+// playground; everything goes through postMessage.
+
+import type { UIFragment } from './compiler-v3';
+
+// What a compile produced, in document order; CompileResult is one
+export interface PreviewContent {
+  fragments: Array<Pick<UIFragment, 'id' | 'html'>>;
+  rules: string[];
+  js: string;
+}
+
+export interface PreviewUpdate {
+  type: 'droy-preview';
+  // Fragment keys in document order, with the HTML of those the frame has to
+  // (re)create and null for those it keeps
+  nodes: Array<[string, string | null]>;
+  // Replaces `remove` rules at `start` with `insert`; null when unchanged
+  rules: { start: number; remove: number; insert: string[] } | null;
+  // The bundle to run; null when unchanged
+  js: string | null;
+}
+
+// Sent by the frame whenever its content height changes
+export interface PreviewSize {
+  type: 'droy-preview-size';
+  height: number;
+}
+
+export class PreviewHost {
+  // Keys of the fragment nodes the frame has
+  private keys = new Set<string>();
+  private rules: string[] = [];
+  private js = '';
+
+  // The frame (re)loaded with an empty document; its load event fires once
+  // the bootstrap is listening
+  public reset(): void {
+    this.keys.clear();
+    this.rules = [];
+    this.js = '';
+  }
+
+  // The update that turns what the frame shows into `content`
+  public update(content: PreviewContent): PreviewUpdate {
+    const swapJs = content.js !== this.js;
+    const nodes: Array<[string, string | null]> = [];
+    const keys = new Set<string>();
+    const seen = new Map<string, number>();
+    for (const fragment of content.fragments) {
+      // Equal fragments share an id; each copy has its own node
+      const copy = seen.get(fragment.id) ?? 0;
+      seen.set(fragment.id, copy + 1);
+      const key = copy ? `${fragment.id}:${copy}` : fragment.id;
+      // A new bundle binds fresh nodes, not ones the old one set up
+      const kept = this.keys.has(key) && !(swapJs && fragment.html.includes('data-droy'));
+      nodes.push([key, kept ? null : fragment.html]);
+      keys.add(key);
+    }
+    this.keys = keys;
+
+    const rules = diffRules(this.rules, content.rules);
+    this.rules = content.rules;
+    this.js = content.js;
+    return { type: 'droy-preview', nodes, rules, js: swapJs ? content.js : null };
+  }
+}
+
+function diffRules(previous: string[], next: string[]): PreviewUpdate['rules'] {
+  let start = 0;
+  while (start < previous.length && start < next.length && previous[start] === next[start]) start++;
+  let end = 0;
+  while (
+    end < previous.length - start &&
+    end < next.length - start &&
+    previous[previous.length - 1 - end] === next[next.length - 1 - end]
+  ) {
+    end++;
+  }
+  if (start + end === previous.length && start + end === next.length) return null;
+  return { start, remove: previous.length - start - end, insert: next.slice(start, next.length - end) };
+}
+
+// The bootstrap's own listeners are added before it starts tracking, so
+// tearing a bundle down never removes them
+const PREVIEW_BOOTSTRAP = `(() => {
+  const root = document.getElementById('droy-root');
+  const sheet = document.getElementById('droy-styles').sheet;
+  const nodes = new Map();
+
+  window.addEventListener('message', (event) => {
+    if (event.source !== parent || event.data?.type !== 'droy-preview') return;
+    const update = event.data;
+    patchNodes(update.nodes);
+    if (update.rules) patchRules(update.rules);
+    if (update.js !== null) swap(update.js);
+  });
+
+  new ResizeObserver(() => {
+    parent.postMessage({ type: 'droy-preview-size', height: document.documentElement.scrollHeight }, '*');
+  }).observe(document.documentElement);
+
+  function patchNodes(list) {
+    const next = new Map();
+    let cursor = root.firstChild;
+    for (const [key, html] of list) {
+      let node = html === null ? nodes.get(key) : null;
+      if (!node) {
+        node = document.createElement('droy-fragment');
+        node.innerHTML = html ?? '';
+      }
+      next.set(key, node);
+      if (node === cursor) {
+        cursor = cursor.nextSibling;
+      } else {
+        root.insertBefore(node, cursor);
+      }
+    }
+    for (const [key, node] of nodes) {
+      if (next.get(key) !== node) node.remove();
+    }
+    nodes.clear();
+    for (const [key, node] of next) nodes.set(key, node);
+  }
+
+  function patchRules({ start, remove, insert }) {
+    for (let i = 0; i < remove; i++) sheet.deleteRule(start);
+    insert.forEach((rule, i) => {
+      try {
+        sheet.insertRule(rule, start + i);
+      } catch {
+        // Keeps rule indexes in step with the host's list
+        sheet.insertRule('droy-invalid {}', start + i);
+      }
+    });
+  }
+
+  // Teardown for what the running bundle set up outside the fragments
+  let disposers = new Set();
+
+  const addEventListener = EventTarget.prototype.addEventListener;
+  EventTarget.prototype.addEventListener = function (type, listener, options) {
+    addEventListener.call(this, type, listener, options);
+    if (!(this instanceof Element)) disposers.add(() => this.removeEventListener(type, listener, options));
+  };
+  // A one-shot timer stops being tracked once it fired
+  for (const [set, clear, once] of [
+    ['setTimeout', 'clearTimeout', true],
+    ['setInterval', 'clearInterval', false],
+    ['requestAnimationFrame', 'cancelAnimationFrame', true],
+  ]) {
+    const start = window[set].bind(window);
+    const stop = window[clear].bind(window);
+    window[set] = (callback, ...args) => {
+      const dispose = () => stop(id);
+      const fire = once && typeof callback === 'function'
+        ? (...values) => {
+            disposers.delete(dispose);
+            callback(...values);
+          }
+        : callback;
+      const id = start(fire, ...args);
+      disposers.add(dispose);
+      return id;
+    };
+  }
+  for (const name of ['WebSocket', 'EventSource']) {
+    const Native = window[name];
+    if (!Native) continue;
+    window[name] = class extends Native {
+      constructor(...args) {
+        super(...args);
+        disposers.add(() => this.close());
+      }
+    };
+  }
+
+  function swap(js) {
+    const previous = disposers;
+    disposers = new Set();
+    for (const dispose of previous) dispose();
+    try {
+      new Function(js)();
+    } catch (error) {
+      console.error(error);
+    }
+  }
+})();`;
+
+export const PREVIEW_DOCUMENT = `<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<style>droy-fragment { display: contents; } body { margin: 0; color: #fff; font-family: system-ui, sans-serif; }</style>
+<style id="droy-styles"></style>
+</head>
+<body>
+<div id="droy-root"></div>
+<script>${PREVIEW_BOOTSTRAP}</script>
+</body>
+</html>`;
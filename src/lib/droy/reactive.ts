@@ -0,0 +1,835 @@
+// Droy Language - reactive runtime for generated JS
+// DroyUIGeneratorV3 compiles `bind`/`state`, `watch`, `ref`, `emit`, event
+// handlers and component props that are not literals into calls on a small
+// runtime, prepended to the JS of any page that uses one of them.
+//
+// Every program name is a signal in one store, created on first use and null
+// until written. An effect records the signals it reads while it runs, and a
+// write schedules only the effects that read that signal; all writes in the
+// same task are flushed together in a microtask, so a batch of updates costs
+// O(dependents) rather than a re-render. DOM bindings are effects that patch
+// one text node, attribute or style property of the element they were
+// compiled for, found through its `data-droy` id. A `for` inside a component
+// renders its rows from a template, windowed when the component is `virtual`.
+// Server requests and `ws` sockets go through the same runtime, which shares,
+// caches and batches requests and keeps one socket per URL.
+
+import type { ASTNode } from './ast';
+import { BUILTINS } from './vm';
+
+export const REACTIVE_RUNTIME = `const droy = (() => {
+  // The effect whose reads are being recorded
+  let active = null;
+  const pending = new Set();
+  let scheduled = false;
+
+  class Signal {
+    constructor() {
+      this.value = null;
+      this.subscribers = new Set();
+    }
+    get() {
+      if (active) {
+        this.subscribers.add(active);
+        active.sources.add(this);
+      }
+      return this.value;
+    }
+    set(value) {
+      if (Object.is(value, this.value)) return;
+      this.value = value;
+      this.changed();
+    }
+    // Also called after the value was changed in place
+    changed() {
+      for (const effect of this.subscribers) pending.add(effect);
+      if (!scheduled && pending.size > 0) {
+        scheduled = true;
+        queueMicrotask(flush);
+      }
+    }
+  }
+
+  // Effects scheduled by other effects run in the same flush
+  function flush() {
+    scheduled = false;
+    for (let round = 0; pending.size > 0; round++) {
+      if (round === 100) {
+        pending.clear();
+        throw new Error('Droy bindings did not settle after 100 rounds');
+      }
+      const effects = [...pending];
+      pending.clear();
+      for (const effect of effects) run(effect);
+    }
+  }
+
+  // Dependencies are recorded afresh on every run, so a branch not taken
+  // stops triggering the effect
+  function run(effect) {
+    for (const source of effect.sources) source.subscribers.delete(effect);
+    effect.sources.clear();
+    const outer = active;
+    active = effect;
+    try {
+      effect.fn();
+    } finally {
+      active = outer;
+    }
+  }
+
+  function effect(fn) {
+    run({ fn, sources: new Set() });
+  }
+
+  function untracked(fn) {
+    const outer = active;
+    active = null;
+    try {
+      return fn();
+    } finally {
+      active = outer;
+    }
+  }
+
+  const signals = new Map();
+  function signal(name) {
+    let found = signals.get(name);
+    if (!found) {
+      found = new Signal();
+      signals.set(name, found);
+    }
+    return found;
+  }
+  const read = (name) => signal(name).get();
+  const write = (name, value) => {
+    signal(name).set(value);
+    return value;
+  };
+
+  // Keeps \`name\` equal to fn() until it is written directly
+  function derive(name, fn) {
+    effect(() => write(name, fn()));
+  }
+
+  function watch(fn, handler) {
+    let first = true;
+    let previous = null;
+    effect(() => {
+      const value = fn();
+      if (first) {
+        first = false;
+      } else if (!Object.is(value, previous)) {
+        const old = previous;
+        untracked(() => handler(value, old));
+      }
+      previous = value;
+    });
+  }
+
+  function mount(fn) {
+    if (document.readyState === 'loading') {
+      document.addEventListener('DOMContentLoaded', fn, { once: true });
+    } else {
+      fn();
+    }
+  }
+
+  // Calls fn(el) once per key for each element generated from the node \`id\`;
+  // equal nodes share an id, and each copy's script binds every element
+  const bound = new WeakMap();
+  function each(id, key, fn) {
+    mount(() => {
+      for (const el of document.querySelectorAll('[data-droy="' + id + '"]')) {
+        let keys = bound.get(el);
+        if (!keys) bound.set(el, (keys = new Set()));
+        if (!keys.has(key)) {
+          keys.add(key);
+          fn(el);
+        }
+      }
+    });
+  }
+
+  const format = (value) =>
+    value === null || value === undefined ? '' : Array.isArray(value) ? value.map(format).join(',') : String(value);
+
+  function text(id, fn) {
+    each(id, 'text', (el) => {
+      const node = el.insertBefore(document.createTextNode(''), el.firstChild);
+      effect(() => {
+        const value = format(fn());
+        if (node.data !== value) node.data = value;
+      });
+    });
+  }
+
+  function attr(id, name, fn) {
+    each(id, 'attr:' + name, (el) => effect(() => {
+      const value = fn();
+      if (value === null || value === false) {
+        el.removeAttribute(name);
+      } else if (el.getAttribute(name) !== format(value)) {
+        el.setAttribute(name, format(value));
+      }
+    }));
+  }
+
+  function style(id, property, fn) {
+    each(id, 'style:' + property, (el) => effect(() => el.style.setProperty(property, format(fn()))));
+  }
+
+  function on(id, event, handler, key) {
+    each(id, 'on:' + key, (el) => el.addEventListener(event, (e) => untracked(() => handler(e))));
+  }
+
+  function listen(event, handler) {
+    document.addEventListener(event, (e) => untracked(() => handler(e)));
+  }
+
+  function ref(id, name) {
+    each(id, 'ref:' + name, (el) => write(name, el));
+  }
+
+  // Sets one slot of a list row, like text/attr/style do for a whole page
+  function patch(root, slot, kind, name, value) {
+    for (const el of root.querySelectorAll('[data-droy-slot="' + slot + '"]')) {
+      const text = format(value);
+      if (kind === 'text') {
+        if (!el.droyText) el.droyText = el.insertBefore(document.createTextNode(''), el.firstChild);
+        if (el.droyText.data !== text) el.droyText.data = text;
+      } else if (kind === 'style') {
+        el.style.setProperty(name, text);
+      } else if (value === null || value === false) {
+        el.removeAttribute(name);
+      } else if (el.getAttribute(name) !== text) {
+        el.setAttribute(name, text);
+      }
+    }
+  }
+
+  // The rows of a \`for\` inside a component. Each line holds \`columns\` cells
+  // cloned from the row template and filled by fill(cell, item, index).
+  // Windowed lists keep only the lines in view, plus a few either side, and
+  // recycle lines that scroll out for the ones scrolling in. With a fixed
+  // rowHeight line offsets are computed; otherwise every line starts at an
+  // estimate and a Fenwick tree of measured heights gives offsets in O(log n).
+  function list(id, template, items, fill, options) {
+    const columns = options.columns || 1;
+    const overscan = 4;
+    each(id, 'list', (el) => {
+      const viewport = options.windowed ? el.parentElement : null;
+      const shown = new Map();
+      const pool = [];
+      let data = [];
+      let length = 0;
+      let lines = 0;
+      let heights = new Float64Array(0);
+      let tree = new Float64Array(1);
+      let estimate = options.rowHeight || 0;
+      let frame = 0;
+
+      function makeLine() {
+        const line = document.createElement('div');
+        if (columns > 1) {
+          line.style.cssText = 'display: grid; grid-template-columns: repeat(' + columns + ', 1fr); gap: ' + options.gap;
+        }
+        if (viewport) {
+          line.style.position = 'absolute';
+          line.style.left = '0';
+          line.style.right = '0';
+        }
+        for (let c = 0; c < columns; c++) {
+          const cell = document.createElement('div');
+          cell.innerHTML = template;
+          line.appendChild(cell);
+        }
+        return line;
+      }
+
+      function fillLine(line, index) {
+        for (let c = 0; c < columns; c++) {
+          const i = index * columns + c;
+          const cell = line.children[c];
+          cell.hidden = i >= data.length;
+          if (i < data.length) fill(cell, data[i], i);
+        }
+      }
+
+      function offset(line) {
+        if (options.rowHeight) return line * options.rowHeight;
+        let top = 0;
+        for (let i = line; i > 0; i -= i & -i) top += tree[i];
+        return top;
+      }
+
+      // The line that contains y
+      function lineAt(y) {
+        if (options.rowHeight) return Math.floor(y / options.rowHeight);
+        let line = 0;
+        for (let bit = 1 << Math.floor(Math.log2(lines || 1)); bit > 0; bit >>= 1) {
+          if (line + bit <= lines && tree[line + bit] <= y) {
+            line += bit;
+            y -= tree[line];
+          }
+        }
+        return line;
+      }
+
+      function resize(line, height) {
+        const delta = height - heights[line];
+        heights[line] = height;
+        for (let i = line + 1; i <= lines; i += i & -i) tree[i] += delta;
+      }
+
+      function render() {
+        const top = viewport.scrollTop - el.offsetTop;
+        const bottom = top + viewport.clientHeight;
+        const first = Math.max(0, lineAt(Math.max(0, top)) - overscan);
+        let last = first;
+        while (last < lines && offset(last) < bottom) last++;
+        last = Math.min(lines, last + overscan);
+
+        for (const [line, row] of shown) {
+          if (line < first || line >= last) {
+            shown.delete(line);
+            row.style.display = 'none';
+            pool.push(row);
+          }
+        }
+        for (let line = first; line < last; line++) {
+          if (shown.has(line)) continue;
+          const row = pool.pop() || el.appendChild(makeLine());
+          row.style.display = '';
+          shown.set(line, row);
+          fillLine(row, line);
+        }
+        if (!options.rowHeight) {
+          for (const [line, row] of shown) {
+            if (row.offsetHeight && row.offsetHeight !== heights[line]) resize(line, row.offsetHeight);
+          }
+        }
+        for (const [line, row] of shown) row.style.transform = 'translateY(' + offset(line) + 'px)';
+        el.style.height = offset(lines) + 'px';
+      }
+
+      if (viewport) {
+        el.style.position = 'relative';
+        viewport.addEventListener('scroll', () => {
+          if (!frame) frame = requestAnimationFrame(() => {
+            frame = 0;
+            render();
+          });
+        }, { passive: true });
+      }
+
+      effect(() => {
+        const next = items() || [];
+        // Data still arriving grows the same array; keep what is rendered
+        const grown = next === data && next.length >= length;
+        data = next;
+        length = data.length;
+        lines = Math.ceil(length / columns);
+        if (!viewport) {
+          if (!grown) el.textContent = '';
+          // The last line may have been partly filled
+          for (let line = grown ? Math.max(0, el.children.length - 1) : 0; line < lines; line++) {
+            fillLine(el.children[line] || el.appendChild(makeLine()), line);
+          }
+          return;
+        }
+        for (const [, row] of shown) {
+          row.style.display = 'none';
+          pool.push(row);
+        }
+        shown.clear();
+        if (!estimate && lines > 0) {
+          const probe = pool.pop() || el.appendChild(makeLine());
+          probe.style.display = '';
+          fillLine(probe, 0);
+          estimate = probe.offsetHeight || 40;
+          probe.style.display = 'none';
+          pool.push(probe);
+        }
+        const measured = heights;
+        heights = new Float64Array(lines).fill(estimate);
+        if (grown) heights.set(measured.subarray(0, Math.min(measured.length, lines)));
+        tree = new Float64Array(lines + 1);
+        for (let i = 1; i <= lines; i++) {
+          tree[i] += heights[i - 1];
+          const parent = i + (i & -i);
+          if (parent <= lines) tree[parent] += tree[i];
+        }
+        render();
+      });
+    });
+  }
+
+  // Record parsers, fed text in chunks of any size: feed(chunk, done)
+  function csvParser(onRecord) {
+    let header = null;
+    let record = [];
+    let field = '';
+    let quoted = false;
+    let afterQuote = false;
+    const value = (text) => (text.trim() !== '' && !isNaN(text) ? Number(text) : text);
+    const end = () => {
+      record.push(field);
+      field = '';
+      if (!header) {
+        header = record;
+      } else if (record.length > 1 || record[0] !== '') {
+        const row = {};
+        for (let i = 0; i < header.length; i++) row[header[i]] = value(record[i] ?? '');
+        onRecord(row);
+      }
+      record = [];
+    };
+    return (chunk, done) => {
+      for (let i = 0; i < chunk.length; i++) {
+        const ch = chunk[i];
+        if (quoted) {
+          if (ch === '"') {
+            quoted = false;
+            afterQuote = true;
+          } else {
+            field += ch;
+          }
+          continue;
+        }
+        // "" inside quotes is a literal quote, even across chunks
+        if (ch === '"') {
+          if (afterQuote) field += '"';
+          quoted = true;
+        } else if (ch === ',') {
+          record.push(field);
+          field = '';
+        } else if (ch === '\\n') {
+          end();
+        } else if (ch !== '\\r') {
+          field += ch;
+        }
+        afterQuote = false;
+      }
+      if (done && (field !== '' || record.length > 0)) end();
+    };
+  }
+
+  function lineParser(onRecord) {
+    let rest = '';
+    return (chunk, done) => {
+      const lines = (rest + chunk).split('\\n');
+      rest = done ? '' : lines.pop();
+      for (const line of lines) {
+        if (line.trim()) onRecord(JSON.parse(line));
+      }
+    };
+  }
+
+  function xmlRows(text) {
+    const root = new DOMParser().parseFromString(text, 'application/xml').documentElement;
+    return [...root.children].map((el) =>
+      el.children.length ? Object.fromEntries([...el.children].map((child) => [child.tagName, child.textContent])) : el.textContent);
+  }
+
+  // Lets the page render what has arrived before more is read
+  const nextFrame = () => new Promise((resolve) =>
+    typeof requestAnimationFrame === 'function' && !document.hidden ? requestAnimationFrame(() => resolve()) : setTimeout(resolve, 0));
+
+  // \`data name: fetch url\`: csv and ndjson are parsed as the response streams
+  // in, and the rows so far are published to \`name\` after every chunk. The
+  // next chunk is only read once the page caught up, so a slow page slows
+  // the download instead of buffering it. Other formats load whole.
+  async function load(name, url, format) {
+    const response = await fetch(url);
+    if (!response.ok) throw new Error(response.status + ' ' + response.statusText);
+    if (format !== 'csv' && format !== 'ndjson') {
+      const text = await response.text();
+      write(name, format === 'json' ? JSON.parse(text) : format === 'xml' ? xmlRows(text) : text);
+      return;
+    }
+
+    const rows = [];
+    write(name, rows);
+    const feed = (format === 'csv' ? csvParser : lineParser)((row) => rows.push(row));
+    if (!response.body) {
+      feed(await response.text(), true);
+      signal(name).changed();
+      return;
+    }
+    const reader = response.body.pipeThrough(new TextDecoderStream()).getReader();
+    for (;;) {
+      const { value, done } = await reader.read();
+      feed(value || '', done);
+      signal(name).changed();
+      if (done) return;
+      await nextFrame();
+    }
+  }
+
+  // Every \`fetch:\`/\`get:\`/\`post:\`/... statement calls request(). GETs for
+  // the same URL share one fetch while it is in flight, and the response is
+  // kept for \`ttl\` seconds, then revalidated with its ETag. Once the server
+  // config names a \`batch\` endpoint, the API requests made in one task are
+  // sent together as one POST of [{ method, url, headers, body }], which the
+  // endpoint answers with [{ status, headers, body }] in the same order.
+  const serverConfig = { api: '', endpoint: '', batch: null, ttl: 0, headers: {} };
+  const responses = new Map();
+  const inflight = new Map();
+  let batch = null;
+
+  function server(config) {
+    Object.assign(serverConfig, config);
+  }
+
+  // Relative URLs are under the configured API and endpoint
+  function resolve(url) {
+    url = format(url);
+    if (/^[a-z][a-z0-9+.-]*:/i.test(url)) return url;
+    const base = (String(serverConfig.api || '') + String(serverConfig.endpoint || '')).replace(/\\/+$/, '');
+    return base ? base + (url.startsWith('/') ? url : '/' + url) : url;
+  }
+
+  // One round trip, resolved with { status, etag, body }
+  async function send(method, url, headers, body) {
+    const response = await fetch(url, {
+      method,
+      headers: body === undefined ? headers : { 'Content-Type': 'application/json', ...headers },
+      body: body === undefined ? undefined : JSON.stringify(body),
+    });
+    const text = response.status === 304 ? '' : await response.text();
+    const json = (response.headers.get('Content-Type') || '').includes('json');
+    return { status: response.status, etag: response.headers.get('ETag'), body: json && text ? JSON.parse(text) : text };
+  }
+
+  function queued(method, url, headers, body) {
+    const api = String(serverConfig.api || '');
+    if (!serverConfig.batch || !api || !url.startsWith(api)) return send(method, url, headers, body);
+    if (!batch) {
+      batch = [];
+      queueMicrotask(flushBatch);
+    }
+    return new Promise((done, fail) => batch.push({ method, url: url.slice(api.length), headers, body, done, fail }));
+  }
+
+  async function flushBatch() {
+    const calls = batch;
+    batch = null;
+    if (calls.length === 1) {
+      const [call] = calls;
+      send(call.method, String(serverConfig.api) + call.url, call.headers, call.body).then(call.done, call.fail);
+      return;
+    }
+    try {
+      const requests = calls.map(({ method, url, headers, body }) => ({ method, url, headers, body }));
+      const reply = await send('POST', resolve(serverConfig.batch), { ...serverConfig.headers }, requests);
+      if (reply.status >= 400 || !Array.isArray(reply.body)) throw new Error('batch failed with status ' + reply.status);
+      calls.forEach((call, index) => {
+        const { status = 502, headers = {}, body = null } = reply.body[index] || {};
+        call.done({ status, etag: headers.etag ?? headers.ETag ?? null, body });
+      });
+    } catch (error) {
+      for (const call of calls) call.fail(error);
+    }
+  }
+
+  function checked(method, url, reply) {
+    if (reply.status >= 400) throw new Error(method + ' ' + url + ' failed with status ' + reply.status);
+    return reply.body;
+  }
+
+  function cachedGet(via, url, headers, ttl) {
+    const cached = responses.get(url);
+    if (cached && performance.now() < cached.expires) return Promise.resolve(cached.body);
+    let pending = inflight.get(url);
+    if (!pending) {
+      const conditional = cached?.etag ? { ...headers, 'If-None-Match': cached.etag } : headers;
+      pending = via('GET', url, conditional).then((reply) => {
+        const fresh = reply.status !== 304 || !cached;
+        const body = fresh ? checked('GET', url, reply) : cached.body;
+        const etag = fresh ? reply.etag : reply.etag || cached.etag;
+        if (etag || ttl > 0) responses.set(url, { body, etag, expires: performance.now() + ttl * 1000 });
+        return body;
+      }).finally(() => inflight.delete(url));
+      inflight.set(url, pending);
+    }
+    return pending;
+  }
+
+  // A URL and the paths under it describe the same resource
+  const related = (a, b) => a === b || b.startsWith(a + '/') || b.startsWith(a + '?');
+
+  function request(method, url, options = {}, handler = null) {
+    const target = resolve(url);
+    const headers = { ...serverConfig.headers, ...options.headers };
+    // \`batch: false\` sends a request on its own
+    const via = options.batch === false ? send : queued;
+    const reply = method === 'GET'
+      ? cachedGet(via, target, headers, Number(options.ttl ?? serverConfig.ttl) || 0)
+      : via(method, target, headers, options.data ?? options.body).then((reply) => {
+          // Writes make cached reads of what they touched stale
+          for (const key of responses.keys()) {
+            if (related(key, target) || related(target, key)) responses.delete(key);
+          }
+          return checked(method, target, reply);
+        });
+    return reply
+      .then((body) => (handler ? untracked(() => handler(body)) : body))
+      .catch((error) => console.error(error));
+  }
+
+  // \`ws: url\` opens one socket per URL, however many statements name it, and
+  // \`@ws:\` handlers receive the events of every socket. A closed socket
+  // reconnects with backoff; sends made meanwhile wait for it to reopen.
+  const sockets = new Map();
+  const socketHandlers = {};
+
+  function socket(url) {
+    url = format(url);
+    let entry = sockets.get(url);
+    if (!entry) {
+      entry = { ws: null, waiting: [], retries: 0 };
+      sockets.set(url, entry);
+      connect(url, entry);
+    }
+    return {
+      send(data) {
+        const text = typeof data === 'string' ? data : JSON.stringify(data);
+        if (entry.ws.readyState === 1) entry.ws.send(text);
+        else entry.waiting.push(text);
+      },
+    };
+  }
+
+  function connect(url, entry) {
+    const ws = (entry.ws = new WebSocket(url));
+    ws.addEventListener('open', (e) => {
+      entry.retries = 0;
+      for (const text of entry.waiting.splice(0)) ws.send(text);
+      dispatchSocket('open', e);
+    });
+    ws.addEventListener('message', (e) => {
+      let data = e.data;
+      if (typeof data === 'string') {
+        try {
+          data = JSON.parse(data);
+        } catch {
+          // plain text message
+        }
+      }
+      dispatchSocket('message', data);
+    });
+    ws.addEventListener('error', (e) => dispatchSocket('error', e));
+    ws.addEventListener('close', (e) => {
+      dispatchSocket('close', e);
+      setTimeout(() => connect(url, entry), Math.min(30000, 500 * 2 ** entry.retries++));
+    });
+  }
+
+  function onSocket(event, handler) {
+    (socketHandlers[event] ||= []).push(handler);
+  }
+
+  function dispatchSocket(event, value) {
+    for (const handler of socketHandlers[event] || []) untracked(() => handler(value));
+  }
+
+  function emit(event, detail) {
+    document.dispatchEvent(new CustomEvent(format(event), { detail }));
+  }
+
+  const items = (value) => (Array.isArray(value) ? value : []);
+
+  // Same behaviour as the VM builtins (vm.ts), down to droyNumber()
+  const toNumber = (value) => {
+    if (typeof value === 'number') return value;
+    if (typeof value === 'boolean') return value ? 1 : 0;
+    if (typeof value !== 'string') return 0;
+    const number = parseFloat(value);
+    return Number.isNaN(number) ? 0 : number;
+  };
+  const numbers = (args) => (args.length === 1 && Array.isArray(args[0]) ? args[0] : args).map(toNumber);
+  const extreme = (name, args, pick) => {
+    const values = numbers(args);
+    if (values.length === 0) {
+      throw new Error(name + (args.length === 0 ? ' needs at least one value' : ' of an empty array'));
+    }
+    return values.reduce((result, value) => pick(result, value));
+  };
+  const builtins = {
+    sum: (...args) => numbers(args).reduce((total, value) => total + value, 0),
+    avg: (...args) => {
+      const values = numbers(args);
+      return values.length ? values.reduce((total, value) => total + value, 0) / values.length : 0;
+    },
+    min: (...args) => extreme('min', args, Math.min),
+    max: (...args) => extreme('max', args, Math.max),
+    count: (...args) => (args.length === 1 && Array.isArray(args[0]) ? args[0].length : args.length),
+    round: (value) => {
+      // -0.5 to 0 round to 0, not -0, as in the VM
+      const number = toNumber(value);
+      const result = Math.round(number);
+      return result === 0 && number < 0 ? 0 : result;
+    },
+    floor: (value) => Math.floor(toNumber(value)),
+    ceil: (value) => Math.ceil(toNumber(value)),
+    abs: (value) => Math.abs(toNumber(value)),
+    random: (...args) => {
+      if (args.length === 0) return Math.random();
+      const low = args.length === 1 ? 1 : Math.ceil(toNumber(args[0]));
+      const high = Math.floor(toNumber(args[args.length === 1 ? 0 : 1]));
+      return low + Math.floor(Math.random() * (high - low + 1));
+    },
+    math: (value = null) => value,
+    calc: (value = null) => value,
+    len: (value) => (typeof value === 'string' || Array.isArray(value) ? value.length : 0),
+    upper: (value) => format(value).toUpperCase(),
+    lower: (value) => format(value).toLowerCase(),
+    trim: (value) => format(value).trim(),
+  };
+
+  return {
+    read, write, derive, watch, mount, text, attr, style, on, listen, ref, patch, list, emit, format, items, builtins,
+    server, request, socket, onSocket,
+    load: (name, url, format) => load(name, url, format).catch((error) => console.error('Loading ' + url + ' failed:', error)),
+  };
+})();
+`;
+
+const BUILTIN_NAMES = new Set(BUILTINS.map((builtin) => builtin.name));
+
+const JS_OPERATORS: Record<string, string> = { '==': '===', '!=': '!==' };
+
+// Words a Droy name may be spelled as that JS does not allow as a variable
+const JS_RESERVED = new Set([
+  'break', 'case', 'catch', 'class', 'const', 'continue', 'debugger', 'default', 'delete', 'do', 'else',
+  'enum', 'export', 'extends', 'false', 'finally', 'for', 'function', 'if', 'import', 'in', 'instanceof',
+  'let', 'new', 'null', 'return', 'super', 'switch', 'this', 'throw', 'true', 'try', 'typeof', 'var',
+  'void', 'while', 'with', 'yield', 'await', 'static', 'arguments', 'eval', 'droy',
+]);
+
+export function jsName(name: string): string {
+  return JS_RESERVED.has(name) ? `${name}_` : name;
+}
+
+// Compiles Droy expressions and statements to JS over the runtime's store.
+// Names in `locals` (handler parameters and the vars a handler declares)
+// become JS variables; every other name is a store read or write, so an
+// effect that evaluates the expression depends on exactly the names it reads.
+export function jsExpression(node: ASTNode | null | undefined, locals: ReadonlySet<string>): string {
+  if (!node) return 'null';
+  switch (node.type) {
+    case 'NumberLiteral':
+    case 'StringLiteral':
+    case 'ColorLiteral':
+    case 'BooleanLiteral':
+      return JSON.stringify(node.value);
+    case 'Identifier':
+    case 'GetExpression':
+      return locals.has(node.name) ? jsName(node.name) : `droy.read(${JSON.stringify(node.name)})`;
+    case 'AssignmentExpression':
+      return jsAssignment(node.left.name, jsExpression(node.right, locals), locals);
+    case 'BinaryExpression':
+    case 'LogicalExpression':
+      return `(${jsExpression(node.left, locals)} ${JS_OPERATORS[node.operator] ?? node.operator} ${jsExpression(node.right, locals)})`;
+    case 'UnaryExpression':
+      return `(${node.operator === '-' ? '-' : '!'}${jsExpression(node.operand, locals)})`;
+    case 'CallExpression':
+      return jsCall(node.callee, node.arguments, locals);
+    // `x | f` calls f(x); `x | f(a)` calls f(x, a)
+    case 'PipeExpression':
+      return node.right.type === 'CallExpression'
+        ? jsCall(node.right.callee, [node.left, ...node.right.arguments], locals)
+        : jsCall(node.right, [node.left], locals);
+    case 'MathOperation':
+      return jsCall({ type: 'Identifier', name: node.operation }, node.values, locals);
+    case 'ArrayLiteral':
+      return `[${node.elements.map((element: ASTNode) => jsExpression(element, locals)).join(', ')}]`;
+    case 'ObjectLiteral':
+      return `{ ${node.properties
+        .map((property: { key: string; value: ASTNode }) => `${JSON.stringify(property.key)}: ${jsExpression(property.value, locals)}`)
+        .join(', ')} }`;
+    default:
+      return 'null';
+  }
+}
+
+function jsAssignment(name: string, value: string, locals: ReadonlySet<string>): string {
+  return locals.has(name) ? `(${jsName(name)} = ${value})` : `droy.write(${JSON.stringify(name)}, ${value})`;
+}
+
+function jsCall(callee: ASTNode, args: ASTNode[], locals: ReadonlySet<string>): string {
+  const argList = args.map((arg) => jsExpression(arg, locals)).join(', ');
+  // Builtins no local shadows are called directly, as in the VM
+  if (callee.type === 'Identifier' && BUILTIN_NAMES.has(callee.name) && !locals.has(callee.name)) {
+    return `droy.builtins.${callee.name}(${argList})`;
+  }
+  return `${jsExpression(callee, locals)}(${argList})`;
+}
+
+function jsStatements(body: ASTNode[], locals: Set<string>): string {
+  return body.map((stmt) => jsStatement(stmt, locals)).filter(Boolean).join(' ');
+}
+
+function jsStatement(node: ASTNode, locals: Set<string>): string {
+  switch (node.type) {
+    case 'VariableDeclaration':
+    case 'SetDeclaration':
+      locals.add(node.name);
+      return `${jsName(node.name)} = ${jsExpression(node.value, locals)};`;
+    case 'ExpressionStatement':
+      return `${jsExpression(node.expression, locals)};`;
+    case 'MathOperation':
+      return `${jsExpression(node, locals)};`;
+    case 'PrintStatement':
+      return `console.log(droy.format(${jsExpression(node.value, locals)}));`;
+    case 'ReturnStatement':
+      return `return ${jsExpression(node.value, locals)};`;
+    case 'Emit':
+      return `droy.emit(${jsExpression(node.event, locals)}, ${jsExpression(node.data, locals)});`;
+    case 'ServerRequest':
+      return `${jsRequest(node, locals)};`;
+    case 'IfStatement': {
+      const consequent = jsStatements(node.consequent, locals);
+      return node.alternate
+        ? `if (${jsExpression(node.condition, locals)}) { ${consequent} } else { ${jsStatements(node.alternate, locals)} }`
+        : `if (${jsExpression(node.condition, locals)}) { ${consequent} }`;
+    }
+    case 'WhileLoop':
+      return `while (${jsExpression(node.condition, locals)}) { ${jsStatements(node.body, locals)} }`;
+    case 'ForLoop':
+      locals.add(node.iterator);
+      return `for (${jsName(node.iterator)} of droy.items(${jsExpression(node.iterable, locals)})) { ${jsStatements(node.body, locals)} }`;
+    default:
+      return '';
+  }
+}
+
+// Settings or options keyed by name, each value an expression
+export function jsObject(entries: Record<string, ASTNode>, locals: ReadonlySet<string>): string {
+  const fields = Object.entries(entries).map(([key, value]) => `${JSON.stringify(key)}: ${jsExpression(value, locals)}`);
+  return fields.length ? `{ ${fields.join(', ')} }` : '{}';
+}
+
+// A `fetch:`/`get:`/`post:`/... statement; `fetch` is a GET
+export function jsRequest(node: ASTNode, locals: ReadonlySet<string>): string {
+  const method = node.method === 'fetch' ? 'GET' : node.method.toUpperCase();
+  const handler = node.handler ? `, ${jsHandler(node.handler)}` : '';
+  return `droy.request(${JSON.stringify(method)}, ${jsExpression(node.url, locals)}, ${jsObject(node.options || {}, locals)}${handler})`;
+}
+
+// A handler as a JS function: a block with its parameters, or an expression
+// evaluated for its effect. Handlers run untracked, so the names they read
+// do not subscribe anything.
+export function jsHandler(handler: ASTNode): string {
+  if (handler.type !== 'BlockStatement') {
+    return `() => { ${jsExpression(handler, new Set())}; }`;
+  }
+  const params: string[] = handler.params ?? [];
+  const locals = new Set(params);
+  const body = jsStatements(handler.body, locals);
+  // Vars the body declares are hoisted to the handler, as Droy scopes them
+  const hoisted = [...locals].filter((name) => !params.includes(name)).map(jsName);
+  const declarations = hoisted.length ? `var ${hoisted.join(', ')}; ` : '';
+  return `(${params.map(jsName).join(', ')}) => { ${declarations}${body} }`;
+}
@@ -0,0 +1,228 @@
+// Droy Language - client router and route-split pages
+// A `route "/path" { ... }` renders as a <section data-droy-route> that the
+// router runtime shows while the URL is at its path, by hash (`#/about`,
+// the default) or, with `router mode: "history"`, by pathname under `base`.
+// Components with a `route:` prop link to a route.
+//
+// DroyUIGeneratorV3.split() turns a program into a shell and one chunk per
+// route. A route's page holds the shell and that route's view, inlines the
+// critical rules and loads the rest of the CSS without blocking render; the
+// other routes are empty sections that the runtime fills from their chunk
+// the first time they are shown, or as soon as a link to one is pointed at.
+
+import type { UIRouteChunk, UISplitOutput } from './compiler-v3';
+
+export const ROUTER_RUNTIME = `const droyRouter = (() => {
+  const config = { mode: 'hash', base: '', chunks: '' };
+  const loads = new Map();
+
+  // Read on every use, since the preview replaces route sections in place
+  function views() {
+    const found = new Map();
+    for (const view of document.querySelectorAll('[data-droy-route]')) found.set(view.dataset.droyRoute, view);
+    return found;
+  }
+
+  function current(found) {
+    const url = config.mode === 'history' ? location.pathname.slice(config.base.length) : location.hash.slice(1);
+    const path = url.replace(/\\/+$/, '') || '/';
+    if (found.has(path)) return path;
+    return found.has('/') ? '/' : found.keys().next().value;
+  }
+
+  function resource(tag, props) {
+    return new Promise((resolve, reject) => {
+      const el = Object.assign(document.createElement(tag), props, { onload: resolve, onerror: reject });
+      document.head.appendChild(el);
+    });
+  }
+
+  // Fetches the chunk of a route whose view is still empty, once; its rules
+  // and its script load in parallel, and the script fills the view
+  function load(path) {
+    const view = views().get(path);
+    const id = view && view.dataset.droyChunk;
+    if (!id) return Promise.resolve();
+    if (!loads.has(path)) {
+      loads.set(path, Promise.all([
+        view.dataset.droyCss === undefined
+          ? null
+          : resource('link', { rel: 'stylesheet', href: config.chunks + id + '.css' }),
+        resource('script', { src: config.chunks + id + '.js' }),
+      ]));
+    }
+    return loads.get(path);
+  }
+
+  function define(path, html, run) {
+    const view = views().get(path);
+    if (!view || !view.dataset.droyChunk) return;
+    view.innerHTML = html;
+    delete view.dataset.droyChunk;
+    run();
+  }
+
+  async function show() {
+    const path = current(views());
+    try {
+      await load(path);
+    } catch (error) {
+      loads.delete(path);
+      console.error(error);
+    }
+    const found = views();
+    if (path !== current(found)) return;
+    for (const [key, view] of found) view.hidden = key !== path;
+  }
+
+  function go(path) {
+    if (config.mode !== 'history') {
+      location.hash = path;
+      return;
+    }
+    history.pushState(null, '', config.base + path);
+    show();
+  }
+
+  function linkOf(event) {
+    return event.target instanceof Element ? event.target.closest('[data-droy-link]') : null;
+  }
+
+  function start() {
+    addEventListener(config.mode === 'history' ? 'popstate' : 'hashchange', show);
+    document.addEventListener('click', (event) => {
+      const link = linkOf(event);
+      if (!link || event.defaultPrevented || event.button !== 0 || event.metaKey || event.ctrlKey || event.shiftKey) {
+        return;
+      }
+      event.preventDefault();
+      go(link.dataset.droyLink);
+    });
+    document.addEventListener('pointerover', (event) => {
+      const link = linkOf(event);
+      if (link) load(link.dataset.droyLink).catch(() => loads.delete(link.dataset.droyLink));
+    });
+    show();
+  }
+
+  // Started once the whole bundle ran, so its configure() calls come first
+  if (document.readyState === 'loading') {
+    document.addEventListener('DOMContentLoaded', start, { once: true });
+  } else {
+    queueMicrotask(start);
+  }
+
+  return {
+    configure: (settings) => Object.assign(config, settings),
+    define,
+    go,
+    load,
+  };
+})();
+`;
+
+export function attributeValue(text: string): string {
+  return text.replace(/[&"<]/g, (ch) => `&#${ch.charCodeAt(0)};`);
+}
+
+// The section a route renders as. A chunk id marks it as still empty, to be
+// filled from that chunk; `css` says the chunk has a stylesheet.
+export function routeSection(
+  path: string,
+  html: string,
+  options: { hidden: boolean; chunk?: string; css?: boolean },
+): string {
+  let attributes = ` data-droy-route="${attributeValue(path)}"`;
+  if (options.chunk) attributes += ` data-droy-chunk="${options.chunk}"`;
+  if (options.css) attributes += ' data-droy-css';
+  if (options.hidden) attributes += ' hidden';
+  return `<section${attributes}>${html}</section>`;
+}
+
+// The page a browser gets first: the route at "/", or the first one
+export function defaultRoute(split: UISplitOutput): UIRouteChunk | undefined {
+  return split.routes.find((route) => route.path === '/') ?? split.routes[0];
+}
+
+// Where the page of a route goes under its program's directory in history
+// mode: `route "/docs/intro"` is served from docs/intro/. A "." or ".."
+// segment, or a backslash, would put it somewhere else.
+export function routeDirectory(path: string): string {
+  const segments = path.split('/').filter((segment) => segment !== '');
+  if (segments.some((segment) => segment === '.' || segment === '..' || segment.includes('\\'))) {
+    throw new Error(`route "${path}" has no page of its own: "." and ".." segments and backslashes are not allowed`);
+  }
+  return segments.join('/');
+}
+
+// Stylesheet that loads without blocking the first paint
+function deferredStylesheet(href: string): string {
+  return `<link rel="stylesheet" href="${href}" media="print" onload="this.media='all'">`;
+}
+
+// The HTML, inline CSS and JS of the page for `route`, whose chunks are
+// served from the `chunks` URL
+export function routePage(
+  split: UISplitOutput,
+  route: UIRouteChunk,
+  chunks: string,
+): { html: string; css: string; js: string } {
+  const placeholder = routeSection(route.path, '', { hidden: true, chunk: route.id, css: route.css !== '' });
+  let html = split.shell.html.replace(placeholder, () => routeSection(route.path, route.html, { hidden: false }));
+  if (split.shell.css) html += `\n${deferredStylesheet(`${chunks}${split.shell.id}.css`)}`;
+  // The route's stylesheet also holds its critical rules, for other pages
+  if (route.css.length > route.critical.length) html += `\n${deferredStylesheet(`${chunks}${route.id}.css`)}`;
+  return {
+    html,
+    css: split.shell.critical + route.critical,
+    js: `${split.shell.js}${route.js}droyRouter.configure({ chunks: ${JSON.stringify(chunks)} });\n`,
+  };
+}
+
+// The script of a route's chunk
+export function routeChunk(route: UIRouteChunk): string {
+  return `droyRouter.define(${JSON.stringify(route.path)}, ${JSON.stringify(route.html)}, () => {\n${route.js}});\n`;
+}
+
+export interface UIManifestSizes {
+  // UTF-8 bytes
+  html: number;
+  critical: number;
+  css: number;
+  js: number;
+}
+
+// What split() produced, by file name in the chunks directory
+export interface UIManifest {
+  version: 1;
+  mode: 'hash' | 'history';
+  base: string;
+  shell: { css: string | null; bytes: UIManifestSizes };
+  routes: Array<{ path: string; js: string; css: string | null; bytes: UIManifestSizes }>;
+}
+
+const encoder = new TextEncoder();
+
+function sizes(part: { html: string; critical: string; css: string; js: string }): UIManifestSizes {
+  return {
+    html: encoder.encode(part.html).length,
+    critical: encoder.encode(part.critical).length,
+    css: encoder.encode(part.css).length,
+    js: encoder.encode(part.js).length,
+  };
+}
+
+export function splitManifest(split: UISplitOutput): UIManifest {
+  return {
+    version: 1,
+    mode: split.router.mode,
+    base: split.router.base,
+    shell: { css: split.shell.css ? `${split.shell.id}.css` : null, bytes: sizes(split.shell) },
+    routes: split.routes.map((route) => ({
+      path: route.path,
+      js: `${route.id}.js`,
+      css: route.css ? `${route.id}.css` : null,
+      bytes: sizes(route),
+    })),
+  };
+}
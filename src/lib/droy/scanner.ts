@@ -0,0 +1,394 @@
+// Droy Language - Shared scanning core
+// Character classification and lexeme readers used by every lexer version.
+// Characters are classified through a lookup table indexed by charCodeAt, and
+// lexemes are sliced out of the source instead of being built char by char.
+
+import type { TokenBuffer } from './token-buffer';
+
+export interface ScannedToken<T extends string> {
+  type: T;
+  value: string;
+  line: number;
+  column: number;
+}
+
+// Character class bits
+export const CharClass = {
+  Whitespace: 1,   // matches /\s/, except '\n' which the lexers tokenize
+  Digit: 2,        // [0-9]
+  Alpha: 4,        // [a-zA-Z]
+  IdentStart: 8,   // [a-zA-Z_]
+  IdentPart: 16,   // [a-zA-Z0-9_]
+  Hex: 32,         // [0-9a-fA-F]
+  NumberPart: 64,  // [0-9.]
+} as const;
+
+// Char codes the lexers dispatch on
+export const CharCode = {
+  Null: 0,
+  Newline: 10,
+  Space: 32,
+  Exclamation: 33,     // !
+  DoubleQuote: 34,     // "
+  Hash: 35,            // #
+  Dollar: 36,          // $
+  Percent: 37,         // %
+  Ampersand: 38,       // &
+  SingleQuote: 39,     // '
+  OpenParen: 40,       // (
+  CloseParen: 41,      // )
+  Asterisk: 42,        // *
+  Plus: 43,            // +
+  Comma: 44,           // ,
+  Minus: 45,           // -
+  Dot: 46,             // .
+  Slash: 47,           // /
+  Colon: 58,           // :
+  Semicolon: 59,       // ;
+  LessThan: 60,        // <
+  Equals: 61,          // =
+  GreaterThan: 62,     // >
+  Question: 63,        // ?
+  At: 64,              // @
+  OpenBracket: 91,     // [
+  Backslash: 92,       // \
+  CloseBracket: 93,    // ]
+  LowerG: 103,         // g
+  LowerN: 110,         // n
+  LowerP: 112,         // p
+  LowerR: 114,         // r
+  LowerS: 115,         // s
+  LowerT: 116,         // t
+  OpenBrace: 123,      // {
+  Pipe: 124,           // |
+  CloseBrace: 125,     // }
+  Tilde: 126,          // ~
+} as const;
+
+// One entry per UTF-16 code unit, so classification never needs a range check
+const CHAR_CLASS = new Uint8Array(0x10000);
+
+function classify(from: number, to: number, bits: number): void {
+  for (let code = from; code <= to; code++) {
+    CHAR_CLASS[code] |= bits;
+  }
+}
+
+classify(0x30, 0x39, CharClass.Digit | CharClass.IdentPart | CharClass.Hex | CharClass.NumberPart);
+classify(0x41, 0x5a, CharClass.Alpha | CharClass.IdentStart | CharClass.IdentPart);
+classify(0x61, 0x7a, CharClass.Alpha | CharClass.IdentStart | CharClass.IdentPart);
+classify(0x41, 0x46, CharClass.Hex);
+classify(0x61, 0x66, CharClass.Hex);
+classify(0x5f, 0x5f, CharClass.IdentStart | CharClass.IdentPart);
+classify(0x2e, 0x2e, CharClass.NumberPart);
+// Same set as the /\s/ escape, minus '\n'
+for (const code of [0x09, 0x0b, 0x0c, 0x0d, 0x20, 0xa0, 0x1680, 0x2028, 0x2029, 0x202f, 0x205f, 0x3000, 0xfeff]) {
+  CHAR_CLASS[code] |= CharClass.Whitespace;
+}
+classify(0x2000, 0x200a, CharClass.Whitespace);
+
+export function isWhitespace(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.Whitespace) !== 0;
+}
+
+export function isDigit(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.Digit) !== 0;
+}
+
+export function isAlpha(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.Alpha) !== 0;
+}
+
+export function isIdentStart(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.IdentStart) !== 0;
+}
+
+export function isIdentPart(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.IdentPart) !== 0;
+}
+
+export function isHexDigit(code: number): boolean {
+  return (CHAR_CLASS[code] & CharClass.Hex) !== 0;
+}
+
+export interface KeywordEntry<T extends string> {
+  word: string;
+  type: T;
+}
+
+// Keywords in a minimal-probe perfect hash, built when the table is created
+// ("hash and displace"). A lexeme is reduced to a key packing its length and
+// its first, second, middle and last chars; the key picks a bucket, and each
+// bucket's displacement was chosen so that every keyword lands in a slot of
+// its own. A lookup is therefore two multiplies and one comparison against
+// the source in place, and a lexeme is only sliced out when it is not a
+// keyword. Keywords must differ in their key, which the constructor checks.
+export class KeywordTable<T extends string> {
+  private slots: Array<KeywordEntry<T> | undefined>;
+  private displacements: Uint32Array;
+  private slotShift: number;
+  private bucketShift: number;
+
+  constructor(entries: Iterable<readonly [string, T]>) {
+    const byKey = new Map<number, KeywordEntry<T>>();
+    for (const [word, type] of entries) {
+      const key = KeywordTable.key(word, 0, word.length);
+      const existing = byKey.get(key);
+      // The first entry for a word wins, as in a lookup over the list
+      if (existing?.word === word) continue;
+      if (existing) {
+        throw new Error(`Keywords "${existing.word}" and "${word}" share a hash key`);
+      }
+      byKey.set(key, { word, type });
+    }
+
+    // Twice as many slots as keywords, and about two keywords per bucket
+    const slotBits = Math.max(1, Math.ceil(Math.log2(byKey.size + 1)) + 1);
+    const bucketBits = Math.max(1, slotBits - 2);
+    this.slotShift = 32 - slotBits;
+    this.bucketShift = 32 - bucketBits;
+    this.slots = new Array(1 << slotBits);
+    this.displacements = new Uint32Array(1 << bucketBits);
+
+    const buckets: number[][] = Array.from({ length: 1 << bucketBits }, () => []);
+    for (const key of byKey.keys()) {
+      buckets[this.bucket(key)].push(key);
+    }
+    // Place the largest buckets first, while most slots are free
+    buckets.sort((a, b) => b.length - a.length);
+    for (const bucket of buckets) {
+      if (bucket.length === 0) break;
+      let displacement = 0;
+      let placed: number[];
+      do {
+        displacement++;
+        placed = bucket.map((key) => this.slot(key, displacement));
+      } while (placed.some((slot, index) => this.slots[slot] !== undefined || placed.indexOf(slot) !== index));
+      this.displacements[this.bucket(bucket[0])] = displacement;
+      bucket.forEach((key, index) => {
+        this.slots[placed[index]] = byKey.get(key);
+      });
+    }
+  }
+
+  // Length (mod 16) and four 7-bit chars of source[start, end)
+  private static key(source: string, start: number, end: number): number {
+    const length = end - start;
+    return (
+      (length << 28) |
+      ((source.charCodeAt(start) & 0x7f) << 21) |
+      ((source.charCodeAt(start + (length > 1 ? 1 : 0)) & 0x7f) << 14) |
+      ((source.charCodeAt(start + (length >> 1)) & 0x7f) << 7) |
+      (source.charCodeAt(end - 1) & 0x7f)
+    ) >>> 0;
+  }
+
+  private bucket(key: number): number {
+    return Math.imul(key, 0x9e3779b1) >>> this.bucketShift;
+  }
+
+  private slot(key: number, displacement: number): number {
+    return Math.imul(key ^ Math.imul(displacement, 0x27d4eb2f), 0x85ebca6b) >>> this.slotShift;
+  }
+
+  lookup(source: string, start: number, end: number): KeywordEntry<T> | undefined {
+    const length = end - start;
+    if (length === 0) return undefined;
+
+    const key = KeywordTable.key(source, start, end);
+    const entry = this.slots[this.slot(key, this.displacements[this.bucket(key)])];
+    if (entry !== undefined && entry.word.length === length && source.startsWith(entry.word, start)) {
+      return entry;
+    }
+    return undefined;
+  }
+
+  get(word: string): T | undefined {
+    return this.lookup(word, 0, word.length)?.type;
+  }
+}
+
+// Base class for the lexers: owns the cursor, the token list and the readers
+// whose behaviour is shared between language versions.
+export class DroyScanner<T extends string> {
+  protected source: string;
+  protected position: number = 0;
+  protected line: number = 1;
+  protected column: number = 1;
+  protected tokens: ScannedToken<T>[] = [];
+  // When set, tokens go to this compact buffer instead of `tokens`
+  protected buffer: TokenBuffer<T> | null = null;
+
+  constructor(source: string) {
+    this.source = source;
+  }
+
+  // Char code at the cursor, or 0 past the end of the source
+  protected peekCode(offset: number = 0): number {
+    const pos = this.position + offset;
+    return pos < this.source.length ? this.source.charCodeAt(pos) : CharCode.Null;
+  }
+
+  protected advance(): number {
+    const code = this.peekCode();
+    this.position++;
+    if (code === CharCode.Newline) {
+      this.line++;
+      this.column = 1;
+    } else {
+      this.column++;
+    }
+    return code;
+  }
+
+  protected skipWhitespace(): void {
+    const source = this.source;
+    let pos = this.position;
+    while (pos < source.length && isWhitespace(source.charCodeAt(pos))) {
+      pos++;
+    }
+    this.column += pos - this.position;
+    this.position = pos;
+  }
+
+  // Reads a quoted string starting at the opening quote; escapes are decoded
+  protected readString(quote: number): string {
+    this.advance();
+    let value = '';
+    let start = this.position;
+
+    for (let code = this.peekCode(); code !== quote && code !== CharCode.Null; code = this.peekCode()) {
+      if (code !== CharCode.Backslash) {
+        this.advance();
+        continue;
+      }
+
+      value += this.source.slice(start, this.position);
+      this.advance();
+      const escaped = this.advance();
+      switch (escaped) {
+        case CharCode.LowerN: value += '\n'; break;
+        case CharCode.LowerT: value += '\t'; break;
+        case CharCode.LowerR: value += '\r'; break;
+        default: value += String.fromCharCode(escaped);
+      }
+      start = this.position;
+    }
+
+    value += this.source.slice(start, this.position);
+    this.advance();
+    return value;
+  }
+
+  // Reads [0-9.]+; with `singleDot` the number ends at a second '.'
+  protected readNumber(singleDot: boolean = true): string {
+    const source = this.source;
+    const start = this.position;
+    let pos = start;
+    let hasDot = false;
+    while (pos < source.length) {
+      const code = source.charCodeAt(pos);
+      if ((CHAR_CLASS[code] & CharClass.NumberPart) === 0) break;
+      if (code === CharCode.Dot && singleDot) {
+        if (hasDot) break;
+        hasDot = true;
+      }
+      pos++;
+    }
+    return this.consume(start, pos);
+  }
+
+  protected readIdentifier(): string {
+    const source = this.source;
+    const start = this.position;
+    let pos = start;
+    while (pos < source.length && isIdentPart(source.charCodeAt(pos))) {
+      pos++;
+    }
+    return this.consume(start, pos);
+  }
+
+  // Reads an identifier at the cursor and adds it as a keyword token, or as
+  // `fallback` when it is not one. `start` may point at a one-char prefix
+  // (~, @) that was already consumed; it is kept in the token value.
+  protected readWord(keywords: KeywordTable<T>, fallback: T, start: number = this.position): void {
+    const source = this.source;
+    const wordStart = this.position;
+    let end = wordStart;
+    while (end < source.length && isIdentPart(source.charCodeAt(end))) {
+      end++;
+    }
+
+    const keyword = keywords.lookup(source, wordStart, end);
+    this.column += end - wordStart;
+    this.position = end;
+    if (keyword === undefined) {
+      this.emit(fallback, start, end);
+    } else if (start === wordStart && this.buffer === null) {
+      this.addToken(keyword.type, keyword.word);
+    } else {
+      this.emit(keyword.type, start, end);
+    }
+  }
+
+  // Reads '#' followed by up to six hex digits
+  protected readHexColor(): string {
+    const source = this.source;
+    const start = this.position;
+    const limit = Math.min(source.length, start + 7);
+    let pos = start + 1;
+    while (pos < limit && isHexDigit(source.charCodeAt(pos))) {
+      pos++;
+    }
+    return this.consume(start, pos);
+  }
+
+  // Skips to the end of the line (or an embedded NUL), leaving the '\n'
+  protected skipComment(): void {
+    const source = this.source;
+    let pos = this.position;
+    while (pos < source.length) {
+      const code = source.charCodeAt(pos);
+      if (code === CharCode.Newline || code === CharCode.Null) break;
+      pos++;
+    }
+    this.column += pos - this.position;
+    this.position = pos;
+  }
+
+  // Moves the cursor over a lexeme that contains no newline and returns it
+  protected consume(start: number, end: number): string {
+    this.column += end - this.position;
+    this.position = end;
+    return this.source.slice(start, end);
+  }
+
+  // Adds a token whose value is source[start, end), ending at the cursor
+  protected emit(type: T, start: number, end: number): void {
+    if (this.buffer !== null) {
+      this.buffer.push(type, start, end - start, this.line, this.column - (end - start));
+      return;
+    }
+    this.tokens.push({
+      type,
+      value: this.source.slice(start, end),
+      line: this.line,
+      column: this.column - (end - start),
+    });
+  }
+
+  // `end` is where the lexeme ends in the source; it only matters for the
+  // compact buffer, which stores values that are a verbatim slice as offsets.
+  protected addToken(type: T, value: string, end: number = this.position): void {
+    if (this.buffer !== null) {
+      this.buffer.pushValue(type, value, end, this.line, this.column - value.length);
+      return;
+    }
+    this.tokens.push({
+      type,
+      value,
+      line: this.line,
+      column: this.column - value.length,
+    });
+  }
+}
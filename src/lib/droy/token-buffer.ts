@@ -0,0 +1,260 @@
+// Droy Language - Compact token storage
+// A struct-of-arrays alternative to one object per token: kind ids, offsets,
+// lengths and positions live in typed arrays, and token values are sliced
+// from the source only when the parser asks for them.
+
+import type { ScannedToken } from './scanner';
+
+// What the parser needs from a token sequence
+export interface TokenStream<T extends string> {
+  readonly length: number;
+  type(index: number): T;
+  value(index: number): string;
+  get(index: number): ScannedToken<T>;
+}
+
+// Adapts a plain token array (the default lexer output) to TokenStream
+export class TokenArray<T extends string> implements TokenStream<T> {
+  private tokens: ScannedToken<T>[];
+
+  constructor(tokens: ScannedToken<T>[]) {
+    this.tokens = tokens;
+  }
+
+  get length(): number {
+    return this.tokens.length;
+  }
+
+  type(index: number): T {
+    return this.tokens[index].type;
+  }
+
+  value(index: number): string {
+    return this.tokens[index].value;
+  }
+
+  get(index: number): ScannedToken<T> {
+    return this.tokens[index];
+  }
+
+  line(index: number): number {
+    return this.tokens[index].line;
+  }
+}
+
+// Interns token type names as small integer ids. One registry is shared by
+// every buffer of a language version, so ids are stable between compiles.
+export class TokenKinds<T extends string> {
+  private ids = new Map<T, number>();
+  private names: T[] = [];
+
+  constructor(names: readonly T[] = []) {
+    for (const name of names) {
+      this.id(name);
+    }
+  }
+
+  id(type: T): number {
+    let id = this.ids.get(type);
+    if (id === undefined) {
+      id = this.names.length;
+      this.ids.set(type, id);
+      this.names.push(type);
+    }
+    return id;
+  }
+
+  name(id: number): T {
+    return this.names[id];
+  }
+
+  list(): readonly T[] {
+    return this.names;
+  }
+}
+
+// Structured-clone form of a TokenBuffer; the typed arrays can be transferred
+export interface TokenBufferData<T extends string> {
+  count: number;
+  kinds: T[];
+  kindIds: Uint16Array;
+  starts: Int32Array;
+  lengths: Int32Array;
+  lines: Int32Array;
+  columns: Int32Array;
+  decoded: Array<[number, string]>;
+}
+
+export class TokenBuffer<T extends string> implements TokenStream<T> {
+  private source: string;
+  private kinds: TokenKinds<T>;
+  private count: number = 0;
+  private kindIds: Uint16Array;
+  private starts: Int32Array;
+  private lengths: Int32Array;
+  private lines: Int32Array;
+  private columns: Int32Array;
+  // Values that are not a verbatim slice of the source (strings with escapes)
+  private decoded = new Map<number, string>();
+
+  constructor(source: string, kinds: TokenKinds<T>, capacity: number = 1024) {
+    this.source = source;
+    this.kinds = kinds;
+    this.kindIds = new Uint16Array(capacity);
+    this.starts = new Int32Array(capacity);
+    this.lengths = new Int32Array(capacity);
+    this.lines = new Int32Array(capacity);
+    this.columns = new Int32Array(capacity);
+  }
+
+  get length(): number {
+    return this.count;
+  }
+
+  // Adds a token whose value is source[start, start + length)
+  push(type: T, start: number, length: number, line: number, column: number): void {
+    if (this.count === this.kindIds.length) {
+      this.grow();
+    }
+    const index = this.count++;
+    this.kindIds[index] = this.kinds.id(type);
+    this.starts[index] = start;
+    this.lengths[index] = length;
+    this.lines[index] = line;
+    this.columns[index] = column;
+  }
+
+  // Adds a token with an explicit value ending at `end`; the value is only
+  // stored when it differs from the source text at that position.
+  pushValue(type: T, value: string, end: number, line: number, column: number): void {
+    const start = end - value.length;
+    if (value.length !== 0 && !this.source.startsWith(value, start)) {
+      this.decoded.set(this.count, value);
+    }
+    this.push(type, start, value.length, line, column);
+  }
+
+  type(index: number): T {
+    return this.kinds.name(this.kindIds[index]);
+  }
+
+  value(index: number): string {
+    if (this.decoded.size !== 0) {
+      const value = this.decoded.get(index);
+      if (value !== undefined) return value;
+    }
+    const start = this.starts[index];
+    return this.source.slice(start, start + this.lengths[index]);
+  }
+
+  start(index: number): number {
+    return this.starts[index];
+  }
+
+  line(index: number): number {
+    return this.lines[index];
+  }
+
+  column(index: number): number {
+    return this.columns[index];
+  }
+
+  get(index: number): ScannedToken<T> {
+    if (index < 0 || index >= this.count) {
+      throw new RangeError(`Token index ${index} out of range (${this.count} tokens)`);
+    }
+    return {
+      type: this.type(index),
+      value: this.value(index),
+      line: this.lines[index],
+      column: this.columns[index],
+    };
+  }
+
+  // Appends tokens [from, to) of `other`, a buffer over an earlier version of
+  // this buffer's source: their offsets move by `offsetDelta` and their
+  // lines by `lineDelta`. Incremental re-lexing copies the unchanged tokens
+  // around an edit this way instead of scanning them again.
+  append(other: TokenBuffer<T>, from: number, to: number, offsetDelta: number, lineDelta: number): void {
+    if (other.kinds !== this.kinds) {
+      for (let i = from; i < to; i++) {
+        this.push(other.type(i), other.starts[i] + offsetDelta, other.lengths[i], other.lines[i] + lineDelta, other.columns[i]);
+      }
+    } else {
+      while (this.kindIds.length < this.count + (to - from)) {
+        this.grow();
+      }
+      const at = this.count;
+      this.kindIds.set(other.kindIds.subarray(from, to), at);
+      this.starts.set(other.starts.subarray(from, to), at);
+      this.lengths.set(other.lengths.subarray(from, to), at);
+      this.lines.set(other.lines.subarray(from, to), at);
+      this.columns.set(other.columns.subarray(from, to), at);
+      this.count += to - from;
+      if (offsetDelta !== 0) {
+        for (let i = at; i < this.count; i++) this.starts[i] += offsetDelta;
+      }
+      if (lineDelta !== 0) {
+        for (let i = at; i < this.count; i++) this.lines[i] += lineDelta;
+      }
+    }
+    for (const [index, value] of other.decoded) {
+      if (index >= from && index < to) this.decoded.set(this.count - (to - index), value);
+    }
+  }
+
+  // Copies the arrays trimmed to `length`, so they can be transferred to
+  // another thread while this buffer stays usable.
+  toData(): TokenBufferData<T> {
+    return {
+      count: this.count,
+      kinds: [...this.kinds.list()],
+      kindIds: this.kindIds.slice(0, this.count),
+      starts: this.starts.slice(0, this.count),
+      lengths: this.lengths.slice(0, this.count),
+      lines: this.lines.slice(0, this.count),
+      columns: this.columns.slice(0, this.count),
+      decoded: [...this.decoded],
+    };
+  }
+
+  static transferList<T extends string>(data: TokenBufferData<T>): ArrayBuffer[] {
+    return [data.kindIds, data.starts, data.lengths, data.lines, data.columns].map(
+      (array) => array.buffer as ArrayBuffer,
+    );
+  }
+
+  // Rebuilds a buffer over `source`, which must be the text it was lexed from
+  static fromData<T extends string>(source: string, data: TokenBufferData<T>): TokenBuffer<T> {
+    const buffer = new TokenBuffer<T>(source, new TokenKinds(data.kinds), 0);
+    buffer.count = data.count;
+    buffer.kindIds = data.kindIds;
+    buffer.starts = data.starts;
+    buffer.lengths = data.lengths;
+    buffer.lines = data.lines;
+    buffer.columns = data.columns;
+    buffer.decoded = new Map(data.decoded);
+    return buffer;
+  }
+
+  toArray(): ScannedToken<T>[] {
+    const tokens: ScannedToken<T>[] = new Array(this.count);
+    for (let i = 0; i < this.count; i++) {
+      tokens[i] = this.get(i);
+    }
+    return tokens;
+  }
+
+  private grow(): void {
+    const capacity = Math.max(this.kindIds.length * 2, 16);
+    const grow = <A extends Uint16Array | Int32Array>(array: A, next: A): A => {
+      next.set(array);
+      return next;
+    };
+    this.kindIds = grow(this.kindIds, new Uint16Array(capacity));
+    this.starts = grow(this.starts, new Int32Array(capacity));
+    this.lengths = grow(this.lengths, new Int32Array(capacity));
+    this.lines = grow(this.lines, new Int32Array(capacity));
+    this.columns = grow(this.columns, new Int32Array(capacity));
+  }
+}
@@ -0,0 +1,182 @@
+// Droy Language - Compile instrumentation
+// A CompileTrace records nested timed spans (the compile phases, and the
+// statements and components the UI generator renders) along with cache
+// counters. compileStats() condenses it into plain data that survives
+// postMessage, and toTraceEvents() exports that in the Chrome trace-event
+// format, which chrome://tracing, Perfetto and speedscope load.
+
+export interface TraceSpan {
+  name: string;
+  // 'phase', 'statement' or 'component'
+  category: string;
+  // Milliseconds since the trace started
+  start: number;
+  duration: number;
+  // 0 for the compile phases, 1 for what runs inside them, and so on
+  depth: number;
+}
+
+// Reuse by the incremental stages; `reused` of `total` were not redone
+export interface CacheCounter {
+  reused: number;
+  total: number;
+}
+
+export interface CompileStats {
+  // Wall time in milliseconds per phase (lex, parse, link, optimize,
+  // generate) and for the whole compile
+  phases: Record<string, number>;
+  total: number;
+  tokens: number;
+  nodes: number;
+  // Generation time per component type, excluding nested components
+  components: Record<string, { count: number; ms: number }>;
+  // UTF-8 bytes of each output
+  output: { html: number; css: number; js: number };
+  cache: {
+    lexer: CacheCounter;
+    parser: CacheCounter;
+    generator: CacheCounter;
+  };
+  spans: TraceSpan[];
+}
+
+const now = (): number => performance.now();
+
+export class CompileTrace {
+  public readonly spans: TraceSpan[] = [];
+  public readonly components = new Map<string, { count: number; ms: number }>();
+  public readonly cache = {
+    lexer: { reused: 0, total: 0 },
+    parser: { reused: 0, total: 0 },
+    generator: { reused: 0, total: 0 },
+  };
+  private origin: number = now();
+  // Open spans, and for each the time its nested components took
+  private open: Array<{ span: TraceSpan; nested: number }> = [];
+
+  public begin(name: string, category: string): void {
+    const span = { name, category, start: now() - this.origin, duration: 0, depth: this.open.length };
+    this.spans.push(span);
+    this.open.push({ span, nested: 0 });
+  }
+
+  // Closes the innermost span; a component span also adds its own time,
+  // without its nested components, to the per-type totals
+  public end(): void {
+    const { span, nested } = this.open.pop()!;
+    span.duration = now() - this.origin - span.start;
+    if (span.category !== 'component') return;
+
+    const parent = this.open[this.open.length - 1];
+    if (parent) parent.nested += span.duration;
+    const entry = this.components.get(span.name) ?? { count: 0, ms: 0 };
+    entry.count++;
+    entry.ms += span.duration - nested;
+    this.components.set(span.name, entry);
+  }
+
+  public time<T>(name: string, category: string, run: () => T): T {
+    this.begin(name, category);
+    try {
+      return run();
+    } finally {
+      this.end();
+    }
+  }
+}
+
+// AST nodes are the objects of the tree with a string `type`
+export function countNodes(value: unknown): number {
+  if (Array.isArray(value)) {
+    let count = 0;
+    for (const item of value) count += countNodes(item);
+    return count;
+  }
+  if (value === null || typeof value !== 'object') return 0;
+  let count = typeof (value as { type?: unknown }).type === 'string' ? 1 : 0;
+  for (const child of Object.values(value)) count += countNodes(child);
+  return count;
+}
+
+const encoder = new TextEncoder();
+
+export function outputBytes(output: { html: string; css: string; js: string }): CompileStats['output'] {
+  return {
+    html: encoder.encode(output.html).length,
+    css: encoder.encode(output.css).length,
+    js: encoder.encode(output.js).length,
+  };
+}
+
+export function compileStats(
+  trace: CompileTrace,
+  result: { tokens: number; ast: unknown; html: string; css: string; js: string },
+): CompileStats {
+  const phases: Record<string, number> = {};
+  let total = 0;
+  for (const span of trace.spans) {
+    if (span.depth !== 0) continue;
+    phases[span.name] = (phases[span.name] ?? 0) + span.duration;
+    total += span.duration;
+  }
+  return {
+    phases,
+    total,
+    tokens: result.tokens,
+    nodes: countNodes(result.ast),
+    components: Object.fromEntries(trace.components),
+    output: outputBytes(result),
+    cache: {
+      lexer: { ...trace.cache.lexer },
+      parser: { ...trace.cache.parser },
+      generator: { ...trace.cache.generator },
+    },
+    spans: trace.spans.slice(),
+  };
+}
+
+// Fraction of the work a cache saved, or null when there was nothing to do
+export function hitRate(counter: CacheCounter): number | null {
+  return counter.total > 0 ? counter.reused / counter.total : null;
+}
+
+export interface TraceEvent {
+  name: string;
+  cat: string;
+  ph: 'X' | 'C' | 'M';
+  // Microseconds
+  ts: number;
+  dur?: number;
+  pid: number;
+  tid: number;
+  args?: Record<string, unknown>;
+}
+
+// Complete events for every span, counter events for the sizes, and the
+// remaining stats as trace metadata
+export function toTraceEvents(stats: CompileStats): { traceEvents: TraceEvent[]; metadata: Record<string, unknown> } {
+  const events: TraceEvent[] = [
+    { name: 'thread_name', cat: '__metadata', ph: 'M', ts: 0, pid: 1, tid: 1, args: { name: 'droy compile' } },
+  ];
+  for (const span of stats.spans) {
+    events.push({
+      name: span.name,
+      cat: span.category,
+      ph: 'X',
+      ts: span.start * 1000,
+      dur: span.duration * 1000,
+      pid: 1,
+      tid: 1,
+    });
+  }
+  const end = stats.spans.reduce((last, span) => Math.max(last, span.start + span.duration), 0) * 1000;
+  events.push(
+    { name: 'front end', cat: 'size', ph: 'C', ts: end, pid: 1, tid: 1, args: { tokens: stats.tokens, nodes: stats.nodes } },
+    { name: 'output bytes', cat: 'size', ph: 'C', ts: end, pid: 1, tid: 1, args: { ...stats.output } },
+  );
+  return {
+    traceEvents: events,
+    metadata: { phases: stats.phases, components: stats.components, cache: stats.cache },
+  };
+}
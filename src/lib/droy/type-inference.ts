@@ -0,0 +1,671 @@
+// Droy Language - Static types for the native backends
+// Every variable, parameter and function result gets a slot. Slots that
+// flow into each other (one variable assigned to another, arguments to
+// parameters, results to the variables that receive them) are unified, and
+// other values widen the slot they are stored in. Types only ever grow along
+// a small lattice, so repeating the pass until nothing changes terminates:
+//
+//   unknown < int < double;  bool;  string;  array<T>;  struct { ... }
+//
+// and anything else that meets becomes `value`, a runtime-tagged DroyValue.
+
+import type { ASTNode } from './ast';
+
+export type DroyType =
+  | { kind: 'unknown' }
+  | { kind: 'int' }
+  | { kind: 'double' }
+  | { kind: 'bool' }
+  | { kind: 'string' }
+  | { kind: 'value' }
+  | { kind: 'void' }
+  | { kind: 'array'; element: DroyType }
+  | { kind: 'struct'; fields: ReadonlyArray<{ name: string; type: DroyType }> };
+
+export const UNKNOWN: DroyType = { kind: 'unknown' };
+export const INT: DroyType = { kind: 'int' };
+export const DOUBLE: DroyType = { kind: 'double' };
+export const BOOL: DroyType = { kind: 'bool' };
+export const STRING: DroyType = { kind: 'string' };
+export const VALUE: DroyType = { kind: 'value' };
+export const VOID: DroyType = { kind: 'void' };
+
+const INT_MAX = 2147483647;
+
+export function isNumeric(type: DroyType): boolean {
+  return type.kind === 'int' || type.kind === 'double';
+}
+
+export function isPrimitive(type: DroyType): boolean {
+  return isNumeric(type) || type.kind === 'bool' || type.kind === 'string';
+}
+
+// Canonical spelling of a type; equal keys mean equal types
+export function typeKey(type: DroyType): string {
+  switch (type.kind) {
+    case 'array':
+      return `array<${typeKey(type.element)}>`;
+    case 'struct':
+      return `{${type.fields.map((field) => `${field.name}:${typeKey(field.type)}`).join(',')}}`;
+    default:
+      return type.kind;
+  }
+}
+
+export function joinTypes(a: DroyType, b: DroyType): DroyType {
+  if (a.kind === 'unknown') return b;
+  if (b.kind === 'unknown') return a;
+  if (a.kind === 'value' || b.kind === 'value') return VALUE;
+  if (isNumeric(a) && isNumeric(b)) {
+    return a.kind === 'int' && b.kind === 'int' ? INT : DOUBLE;
+  }
+  if (a.kind === 'array' && b.kind === 'array') {
+    return { kind: 'array', element: joinTypes(a.element, b.element) };
+  }
+  if (a.kind === 'struct' && b.kind === 'struct') {
+    if (a.fields.length !== b.fields.length) return VALUE;
+    const fields = [];
+    for (const field of a.fields) {
+      const other = b.fields.find((candidate) => candidate.name === field.name);
+      if (!other) return VALUE;
+      fields.push({ name: field.name, type: joinTypes(field.type, other.type) });
+    }
+    return { kind: 'struct', fields };
+  }
+  return a.kind === b.kind ? a : VALUE;
+}
+
+// Replaces whatever is still unknown after inference with `value`
+export function concreteType(type: DroyType): DroyType {
+  switch (type.kind) {
+    case 'unknown':
+      return VALUE;
+    case 'array':
+      return { kind: 'array', element: concreteType(type.element) };
+    case 'struct':
+      return {
+        kind: 'struct',
+        fields: type.fields.map((field) => ({ name: field.name, type: concreteType(field.type) })),
+      };
+    default:
+      return type;
+  }
+}
+
+class TypeSlot {
+  parent: TypeSlot = this;
+  type: DroyType = UNKNOWN;
+
+  find(): TypeSlot {
+    let root: TypeSlot = this;
+    while (root.parent !== root) {
+      root.parent = root.parent.parent;
+      root = root.parent;
+    }
+    return root;
+  }
+}
+
+// Where the C backend declares a variable:
+// - 'param': in the function signature
+// - 'global': at file scope, because a function reads or writes it
+// - 'inline': at its first declaration, which is in the function's own body
+// - 'hoisted': at the top of the function (first declared in a nested block)
+// - 'loop': inside each `for` that binds it (it is only ever a loop variable)
+export type Placement = 'param' | 'global' | 'inline' | 'hoisted' | 'loop';
+
+export class DroyVariable {
+  readonly name: string;
+  readonly owner: ASTNode;
+  readonly slot = new TypeSlot();
+  // The first VariableDeclaration / SetDeclaration / ForLoop that binds it
+  firstDeclaration: ASTNode | null = null;
+  private param: boolean = false;
+  private onlyLoops: boolean = true;
+  private nested: boolean = false;
+  private usedEarly: boolean = false;
+  private captured: boolean = false;
+  seen: boolean = false;
+
+  constructor(name: string, owner: ASTNode) {
+    this.name = name;
+    this.owner = owner;
+  }
+
+  get type(): DroyType {
+    return concreteType(this.slot.find().type);
+  }
+
+  get placement(): Placement {
+    if (this.param) return 'param';
+    if (this.captured) return 'global';
+    if (this.onlyLoops && !this.usedEarly) return 'loop';
+    return this.nested || this.usedEarly ? 'hoisted' : 'inline';
+  }
+
+  markParam(): void {
+    this.param = true;
+  }
+
+  markDeclared(node: ASTNode, kind: 'var' | 'loop', topLevel: boolean): void {
+    if (kind === 'var') {
+      this.onlyLoops = false;
+    }
+    if (!this.firstDeclaration) {
+      this.firstDeclaration = node;
+      this.nested = kind === 'loop' || !topLevel;
+    }
+  }
+
+  markUsed(fromOwner: ASTNode): void {
+    if (fromOwner !== this.owner) {
+      this.captured = true;
+    } else if (!this.seen) {
+      this.usedEarly = true;
+    }
+  }
+}
+
+export interface DroyFunction {
+  name: string;
+  node: ASTNode;
+  params: DroyVariable[];
+  // Null for functions without a `return`; they return void
+  result: TypeSlot | null;
+}
+
+// Builtins the native backends lower themselves
+export const MATH_BUILTINS: ReadonlySet<string> = new Set([
+  'sum', 'avg', 'min', 'max', 'count', 'round', 'floor', 'ceil', 'abs',
+]);
+
+// A math builtin applied to its operands, from `sum(values)` or a
+// MathOperation node
+export interface DroyMathCall {
+  name: string;
+  args: ASTNode[];
+}
+
+export interface DroyTypeInferenceOptions {
+  // Give every variable, parameter and result the tagged `value` type, as
+  // if nothing could be inferred. Used to measure what inference buys.
+  dynamic?: boolean;
+}
+
+const MAX_PASSES = 64;
+
+export class DroyTypeInference {
+  private dynamic: boolean;
+  private program: ASTNode = { type: 'Program', body: [] };
+  private scopes = new Map<ASTNode, Map<string, DroyVariable>>();
+  private functions = new Map<string, DroyFunction>();
+  private resolved = new Map<ASTNode, DroyVariable>();
+  private types = new Map<ASTNode, DroyType>();
+  private changed: boolean = false;
+  private done: boolean = false;
+
+  constructor(options: DroyTypeInferenceOptions = {}) {
+    this.dynamic = options.dynamic ?? false;
+  }
+
+  public infer(program: ASTNode): this {
+    this.program = program;
+    this.scopes.set(program, new Map());
+    this.declareAll(program, program.type === 'Program' ? program.body : [], true);
+
+    if (this.dynamic) {
+      for (const scope of this.scopes.values()) {
+        for (const variable of scope.values()) {
+          variable.slot.type = VALUE;
+        }
+      }
+    }
+
+    for (let pass = 0; pass < MAX_PASSES; pass++) {
+      this.changed = false;
+      for (const scope of this.scopes.values()) {
+        for (const variable of scope.values()) {
+          variable.seen = false;
+        }
+      }
+      this.visitBlock(program, program.type === 'Program' ? program.body : []);
+      if (!this.changed) break;
+    }
+
+    this.done = true;
+    this.types.clear();
+    return this;
+  }
+
+  // Functions in declaration order, including class methods
+  public getFunctions(): DroyFunction[] {
+    return [...this.functions.values()];
+  }
+
+  public getFunction(name: string): DroyFunction | undefined {
+    return this.functions.get(name);
+  }
+
+  public resultType(fn: DroyFunction): DroyType {
+    return fn.result ? concreteType(fn.result.find().type) : VOID;
+  }
+
+  // Variables owned by a FunctionDeclaration or by the Program
+  public variablesOf(owner: ASTNode): DroyVariable[] {
+    return [...(this.scopes.get(owner)?.values() ?? [])];
+  }
+
+  // The variable an Identifier, declaration or ForLoop refers to
+  public variableOf(node: ASTNode): DroyVariable | undefined {
+    return this.resolved.get(node);
+  }
+
+  public typeOf(node: ASTNode): DroyType {
+    let type = this.types.get(node);
+    if (type === undefined) {
+      type = concreteType(this.expressionType(node));
+      this.types.set(node, type);
+    }
+    return type;
+  }
+
+  // The math builtin `node` applies, if any. A function or variable the
+  // program declares under the same name hides the builtin.
+  public mathCall(node: ASTNode): DroyMathCall | null {
+    if (node.type === 'MathOperation') {
+      return MATH_BUILTINS.has(node.operation) ? { name: node.operation, args: node.values } : null;
+    }
+    if (
+      node.type === 'CallExpression' &&
+      node.callee.type === 'Identifier' &&
+      MATH_BUILTINS.has(node.callee.name) &&
+      !this.functions.has(node.callee.name) &&
+      !this.resolved.has(node.callee)
+    ) {
+      return { name: node.callee.name, args: node.arguments };
+    }
+    return null;
+  }
+
+  // --- declarations ---------------------------------------------------------
+
+  private declareAll(owner: ASTNode, body: ASTNode[], topLevel: boolean): void {
+    for (const stmt of body) {
+      this.declareStatement(owner, stmt, topLevel);
+    }
+  }
+
+  private declareStatement(owner: ASTNode, node: ASTNode, topLevel: boolean): void {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+        this.variable(owner, node.name).markDeclared(node, 'var', topLevel);
+        this.resolved.set(node, this.variable(owner, node.name));
+        break;
+      case 'FunctionDeclaration': {
+        const scope = new Map<string, DroyVariable>();
+        this.scopes.set(node, scope);
+        const params = node.params.map((name: string) => {
+          const param = this.variable(node, name);
+          param.markParam();
+          return param;
+        });
+        if (!this.functions.has(node.name)) {
+          const result = containsReturn(node.body) ? new TypeSlot() : null;
+          if (result && this.dynamic) result.type = VALUE;
+          this.functions.set(node.name, { name: node.name, node, params, result });
+        }
+        this.declareAll(node, node.body, true);
+        break;
+      }
+      case 'IfStatement':
+        this.declareAll(owner, node.consequent, false);
+        this.declareAll(owner, node.alternate ?? [], false);
+        break;
+      case 'ForLoop':
+        this.variable(owner, node.iterator).markDeclared(node, 'loop', topLevel);
+        this.resolved.set(node, this.variable(owner, node.iterator));
+        this.declareAll(owner, node.body, false);
+        break;
+      case 'WhileLoop':
+        this.declareAll(owner, node.body, false);
+        break;
+      case 'ClassDeclaration':
+        this.declareAll(owner, node.methods, false);
+        break;
+      case 'ExportStatement':
+        this.declareStatement(owner, node.declaration, topLevel);
+        break;
+    }
+  }
+
+  private variable(owner: ASTNode, name: string): DroyVariable {
+    const scope = this.scopes.get(owner)!;
+    let variable = scope.get(name);
+    if (!variable) {
+      variable = new DroyVariable(name, owner);
+      scope.set(name, variable);
+    }
+    return variable;
+  }
+
+  private lookup(owner: ASTNode, name: string): DroyVariable | undefined {
+    return this.scopes.get(owner)?.get(name) ?? this.scopes.get(this.program)!.get(name);
+  }
+
+  // --- slots ----------------------------------------------------------------
+
+  private widen(slot: TypeSlot, type: DroyType): void {
+    const root = slot.find();
+    const joined = joinTypes(root.type, type);
+    if (typeKey(joined) !== typeKey(root.type)) {
+      root.type = joined;
+      this.changed = true;
+    }
+  }
+
+  private unify(a: TypeSlot, b: TypeSlot): void {
+    const rootA = a.find();
+    const rootB = b.find();
+    if (rootA === rootB) return;
+    rootB.parent = rootA;
+    this.changed = true;
+    this.widen(rootA, rootB.type);
+  }
+
+  // Stores `value` into `slot`, unifying when the value is itself a slot
+  private flow(owner: ASTNode, slot: TypeSlot, value: ASTNode): void {
+    const type = this.visitExpression(owner, value);
+    const source = this.slotOf(value);
+    if (source && !this.dynamic) {
+      this.unify(slot, source);
+    } else {
+      // A call to a function without `return` stores undefined
+      this.widen(slot, type.kind === 'void' ? VALUE : type);
+    }
+  }
+
+  private slotOf(node: ASTNode): TypeSlot | null {
+    if (node.type === 'Identifier') {
+      return this.resolved.get(node)?.slot ?? null;
+    }
+    if (node.type === 'CallExpression' && node.callee.type === 'Identifier') {
+      return this.functions.get(node.callee.name)?.result ?? null;
+    }
+    return null;
+  }
+
+  // --- statements -----------------------------------------------------------
+
+  private visitBlock(owner: ASTNode, body: ASTNode[]): void {
+    for (const stmt of body) {
+      this.visitStatement(owner, stmt);
+    }
+  }
+
+  private visitStatement(owner: ASTNode, node: ASTNode): void {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration': {
+        const variable = this.resolved.get(node)!;
+        this.flow(owner, variable.slot, node.value);
+        variable.seen = true;
+        break;
+      }
+      case 'FunctionDeclaration':
+        this.visitBlock(node, node.body);
+        break;
+      case 'IfStatement':
+        this.visitExpression(owner, node.condition);
+        this.visitBlock(owner, node.consequent);
+        this.visitBlock(owner, node.alternate ?? []);
+        break;
+      case 'ForLoop': {
+        const iterable = this.visitExpression(owner, node.iterable);
+        const variable = this.resolved.get(node)!;
+        if (iterable.kind === 'array') {
+          this.widen(variable.slot, iterable.element);
+        } else if (iterable.kind !== 'unknown') {
+          this.widen(variable.slot, VALUE);
+        }
+        variable.seen = true;
+        this.visitBlock(owner, node.body);
+        break;
+      }
+      case 'WhileLoop':
+        this.visitExpression(owner, node.condition);
+        this.visitBlock(owner, node.body);
+        break;
+      case 'ReturnStatement': {
+        const fn = owner.type === 'FunctionDeclaration' ? this.functions.get(owner.name) : undefined;
+        if (fn && fn.node === owner && fn.result) {
+          this.flow(owner, fn.result, node.value);
+        } else {
+          this.visitExpression(owner, node.value);
+        }
+        break;
+      }
+      case 'PrintStatement':
+        this.visitExpression(owner, node.value);
+        break;
+      case 'ExpressionStatement':
+        this.visitExpression(owner, node.expression);
+        break;
+      case 'ClassDeclaration':
+        this.visitBlock(owner, node.methods);
+        break;
+      case 'ExportStatement':
+        this.visitStatement(owner, node.declaration);
+        break;
+    }
+  }
+
+  // --- expressions ----------------------------------------------------------
+
+  // Records what the expression reads and writes, then returns its type
+  private visitExpression(owner: ASTNode, node: ASTNode): DroyType {
+    switch (node.type) {
+      case 'Identifier': {
+        const variable = this.lookup(owner, node.name);
+        if (variable) {
+          this.resolved.set(node, variable);
+          variable.markUsed(owner);
+        }
+        break;
+      }
+      case 'BinaryExpression':
+      case 'LogicalExpression':
+        this.visitExpression(owner, node.left);
+        this.visitExpression(owner, node.right);
+        break;
+      case 'UnaryExpression':
+        this.visitExpression(owner, node.operand);
+        break;
+      case 'AssignmentExpression': {
+        this.visitExpression(owner, node.left);
+        const target = node.left.type === 'Identifier' ? this.resolved.get(node.left) : undefined;
+        if (target) {
+          this.flow(owner, target.slot, node.right);
+        } else {
+          this.visitExpression(owner, node.right);
+        }
+        break;
+      }
+      case 'CallExpression': {
+        const fn = node.callee.type === 'Identifier' ? this.functions.get(node.callee.name) : undefined;
+        if (!fn) {
+          this.visitExpression(owner, node.callee);
+        }
+        node.arguments.forEach((arg: ASTNode, index: number) => {
+          if (fn && index < fn.params.length) {
+            this.flow(owner, fn.params[index].slot, arg);
+          } else {
+            this.visitExpression(owner, arg);
+          }
+        });
+        break;
+      }
+      case 'MathOperation':
+        for (const value of node.values) {
+          this.visitExpression(owner, value);
+        }
+        break;
+      case 'ArrayLiteral':
+        for (const element of node.elements) {
+          this.visitExpression(owner, element);
+        }
+        break;
+      case 'ObjectLiteral':
+        for (const property of node.properties) {
+          this.visitExpression(owner, property.value);
+        }
+        break;
+    }
+    return this.expressionType(node);
+  }
+
+  // Type of an expression from the current slot types (no side effects)
+  private expressionType(node: ASTNode): DroyType {
+    if (this.done && this.types.has(node)) {
+      return this.types.get(node)!;
+    }
+
+    switch (node.type) {
+      case 'NumberLiteral':
+        return Number.isInteger(node.value) && Math.abs(node.value) <= INT_MAX ? INT : DOUBLE;
+      case 'StringLiteral':
+        return STRING;
+      case 'BooleanLiteral':
+        return BOOL;
+      case 'Identifier': {
+        const variable = this.resolved.get(node);
+        return variable ? variable.slot.find().type : VALUE;
+      }
+      case 'BinaryExpression':
+        return binaryType(node.operator, this.expressionType(node.left), this.expressionType(node.right));
+      case 'LogicalExpression':
+        // Conditions are tested for truthiness, so && and || yield a bool
+        return BOOL;
+      case 'UnaryExpression': {
+        if (node.operator === '!') return BOOL;
+        const operand = this.expressionType(node.operand);
+        return isNumeric(operand) || operand.kind === 'unknown' ? operand : VALUE;
+      }
+      case 'AssignmentExpression': {
+        const target = node.left.type === 'Identifier' ? this.resolved.get(node.left) : undefined;
+        return target ? target.slot.find().type : VALUE;
+      }
+      case 'CallExpression':
+      case 'MathOperation': {
+        const math = this.mathCall(node);
+        if (math) {
+          return mathType(math.name, math.args.map((arg) => this.expressionType(arg)));
+        }
+        const fn = node.type === 'CallExpression' && node.callee.type === 'Identifier'
+          ? this.functions.get(node.callee.name)
+          : undefined;
+        if (!fn) return VALUE;
+        return fn.result ? fn.result.find().type : VOID;
+      }
+      case 'ArrayLiteral': {
+        let element = UNKNOWN;
+        for (const item of node.elements) {
+          element = joinTypes(element, this.expressionType(item));
+        }
+        return { kind: 'array', element };
+      }
+      case 'ObjectLiteral': {
+        const fields: Array<{ name: string; type: DroyType }> = [];
+        for (const property of node.properties) {
+          const type = this.expressionType(property.value);
+          const existing = fields.findIndex((field) => field.name === property.key);
+          if (existing === -1) {
+            fields.push({ name: property.key, type });
+          } else {
+            fields[existing] = { name: property.key, type };
+          }
+        }
+        return { kind: 'struct', fields };
+      }
+      default:
+        return VALUE;
+    }
+  }
+}
+
+function containsReturn(body: ASTNode[]): boolean {
+  return body.some((node) => {
+    switch (node.type) {
+      case 'ReturnStatement':
+        return true;
+      case 'IfStatement':
+        return containsReturn(node.consequent) || containsReturn(node.alternate ?? []);
+      case 'ForLoop':
+      case 'WhileLoop':
+        return containsReturn(node.body);
+      default:
+        return false;
+    }
+  });
+}
+
+// sum/avg/min/max take one array or several numbers; over numbers they stay
+// in the numbers' type (avg is always a double). The native backends give an
+// empty min/max 0 where the VM gives null; min/max with no operands at all
+// are null everywhere.
+function mathType(name: string, args: DroyType[]): DroyType {
+  if (name === 'count') return INT;
+  const pending = args.some((arg) => arg.kind === 'unknown' || (arg.kind === 'array' && arg.element.kind === 'unknown'));
+
+  if (name === 'round' || name === 'floor' || name === 'ceil' || name === 'abs') {
+    if (args.length === 0) return INT;
+    if (args[0].kind === 'unknown') return UNKNOWN;
+    return isNumeric(args[0]) ? args[0] : VALUE;
+  }
+
+  if (args.length === 0) return name === 'sum' ? INT : name === 'avg' ? DOUBLE : VALUE;
+  if (pending) return UNKNOWN;
+  let element: DroyType = UNKNOWN;
+  if (args.length === 1 && args[0].kind === 'array') {
+    element = args[0].element;
+  } else {
+    for (const arg of args) {
+      element = joinTypes(element, arg);
+    }
+  }
+  if (!isNumeric(element)) return VALUE;
+  return name === 'avg' ? DOUBLE : element;
+}
+
+function binaryType(operator: string, left: DroyType, right: DroyType): DroyType {
+  switch (operator) {
+    case '<':
+    case '>':
+    case '<=':
+    case '>=':
+    case '==':
+    case '!=':
+      return BOOL;
+  }
+
+  if (left.kind === 'unknown' || right.kind === 'unknown') return UNKNOWN;
+  const numeric = isNumeric(left) && isNumeric(right);
+  const ints = left.kind === 'int' && right.kind === 'int';
+
+  switch (operator) {
+    case '+':
+      if (left.kind === 'string' || right.kind === 'string') {
+        return isPrimitive(left) && isPrimitive(right) ? STRING : VALUE;
+      }
+      return numeric ? (ints ? INT : DOUBLE) : VALUE;
+    case '-':
+    case '*':
+      return numeric ? (ints ? INT : DOUBLE) : VALUE;
+    case '/':
+      return numeric ? DOUBLE : VALUE;
+    case '%':
+      return numeric ? (ints ? INT : DOUBLE) : VALUE;
+    default:
+      return VALUE;
+  }
+}
@@ -0,0 +1,60 @@
+// Droy Language - Streaming UI output
+// Writes generated chunks (all HTML, then CSS, then JS) to a callback, a
+// WHATWG WritableStream or a Node.js writable, waiting for the sink to drain
+// before producing more. Nothing here depends on the DOM or on Node.
+
+export type UIPart = 'html' | 'css' | 'js';
+
+export interface UIChunk {
+  part: UIPart;
+  text: string;
+}
+
+// Receives every chunk in order; a returned promise is awaited before the next
+export type UIChunkCallback = (text: string, part: UIPart) => void | Promise<unknown>;
+
+// The subset of a Node.js stream.Writable used here
+export interface NodeWritableLike {
+  write(chunk: string): boolean;
+  once(event: 'drain', listener: () => void): unknown;
+}
+
+export type UISink = UIChunkCallback | WritableStream<string> | NodeWritableLike;
+
+function isWritableStream(sink: UISink): sink is WritableStream<string> {
+  return typeof (sink as WritableStream<string>).getWriter === 'function';
+}
+
+// Drains `chunks` into `sink`. The sink is left open, so the caller decides
+// whether to end it or write more; a WritableStream's lock is released.
+export async function writeUIChunks(chunks: Iterable<UIChunk>, sink: UISink): Promise<void> {
+  if (typeof sink === 'function') {
+    for (const chunk of chunks) {
+      await sink(chunk.text, chunk.part);
+    }
+    return;
+  }
+
+  if (isWritableStream(sink)) {
+    const writer = sink.getWriter();
+    try {
+      let written: Promise<void> = Promise.resolve();
+      for (const chunk of chunks) {
+        await writer.ready;
+        // A failed write also rejects `ready`, which surfaces the error
+        written = writer.write(chunk.text);
+        written.catch(() => {});
+      }
+      await written;
+    } finally {
+      writer.releaseLock();
+    }
+    return;
+  }
+
+  for (const chunk of chunks) {
+    if (!sink.write(chunk.text)) {
+      await new Promise<void>((resolve) => sink.once('drain', resolve));
+    }
+  }
+}
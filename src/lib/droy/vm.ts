@@ -0,0 +1,1306 @@
+// Droy Language - Bytecode VM
+// Compiles a DroyParserV3 AST into stack-machine bytecode and runs it. Each
+// `func` (and the program itself) becomes a DroyFunctionProto with its own
+// code array and constant pool. Names resolve to frame slots at compile time;
+// a variable that an inner `func` captures, or that is watched, lives in a
+// Cell shared between the frame and every closure over it.
+//
+// Values follow the C runtime's rules (c-runtime.ts): `+` concatenates when
+// either side is a string, comparisons are numeric unless both sides are
+// strings, and printed numbers use 15 significant digits.
+
+import type { ASTNode } from './ast';
+
+// One instruction is an opcode followed by its operands. The interpreter's
+// switch uses these numbers as literal case labels, so keep them dense.
+export const OP = {
+  CONST: 0, // index: push constants[index]
+  NULL: 1,
+  TRUE: 2,
+  FALSE: 3,
+  POP: 4,
+  DUP: 5,
+  GET_LOCAL: 6, // slot
+  SET_LOCAL: 7, // slot: pops
+  GET_CELL: 8, // slot: the slot holds a Cell
+  SET_CELL: 9, // slot: pops, notifies watchers
+  GET_UPVALUE: 10, // index into the closure's cells
+  SET_UPVALUE: 11, // index: pops, notifies watchers
+  NEW_CELL: 12, // slot: wraps the slot's value in a Cell
+  ADD: 13,
+  SUB: 14,
+  MUL: 15,
+  DIV: 16,
+  MOD: 17,
+  POW: 18,
+  NEG: 19,
+  NOT: 20,
+  TRUTHY: 21,
+  EQ: 22,
+  NE: 23,
+  LT: 24,
+  GT: 25,
+  LE: 26,
+  GE: 27,
+  JUMP: 28, // target
+  JUMP_IF_FALSE: 29, // target: pops the condition
+  LOOP: 30, // target: a backward jump, counted against maxSteps
+  ITERATE: 31, // slot, target: slot holds the iterable, slot + 1 the index
+  ARRAY: 32, // count
+  OBJECT: 33, // keys, count: constants[keys] is the key list
+  CLOSURE: 34, // index: constants[index] is a DroyFunctionProto
+  CALL: 35, // argc: the callee sits below its arguments
+  BUILTIN: 36, // id, argc
+  RETURN: 37,
+  PRINT: 38,
+  WATCH: 39, // upvalue, index: pops the handler
+} as const;
+
+const OP_NAMES = Object.keys(OP);
+
+export type DroyValue =
+  | null
+  | number
+  | string
+  | boolean
+  | DroyValue[]
+  | DroyObject
+  | DroyClosure
+  | DroyBuiltin;
+
+export interface DroyObject {
+  [key: string]: DroyValue;
+}
+
+type Constant = DroyValue | DroyFunctionProto | string[];
+
+export class DroyFunctionProto {
+  readonly name: string;
+  readonly arity: number;
+  // Parameters first, then locals, then loop temporaries
+  readonly slots: number;
+  readonly code: Int32Array;
+  readonly constants: Constant[];
+  // Two entries per captured cell: 1 and a slot of the creating frame, or 0
+  // and an index into the creating closure's own cells
+  readonly captures: Int32Array;
+  // Callee names by CALL position, for error messages
+  readonly callees: ReadonlyMap<number, string>;
+
+  constructor(
+    name: string,
+    arity: number,
+    slots: number,
+    code: number[],
+    constants: Constant[],
+    captures: number[],
+    callees: ReadonlyMap<number, string> = new Map(),
+  ) {
+    this.name = name;
+    this.arity = arity;
+    this.slots = slots;
+    this.code = Int32Array.from(code);
+    this.constants = constants;
+    this.captures = Int32Array.from(captures);
+    this.callees = callees;
+  }
+
+  // One instruction per line, for debugging the compiler
+  public disassemble(): string {
+    const lines: string[] = [];
+    const code = this.code;
+    for (let ip = 0; ip < code.length; ) {
+      const op = code[ip];
+      const width = OPERAND_COUNTS[op];
+      const operands = Array.from(code.subarray(ip + 1, ip + 1 + width));
+      lines.push(`${String(ip).padStart(5)}  ${[OP_NAMES[op], ...operands].join(' ')}`);
+      ip += 1 + width;
+    }
+    return lines.join('\n');
+  }
+}
+
+const OPERAND_COUNTS: number[] = OP_NAMES.map((name) => {
+  switch (name) {
+    case 'CONST': case 'GET_LOCAL': case 'SET_LOCAL': case 'GET_CELL': case 'SET_CELL':
+    case 'GET_UPVALUE': case 'SET_UPVALUE': case 'NEW_CELL': case 'JUMP': case 'JUMP_IF_FALSE':
+    case 'LOOP': case 'ARRAY': case 'CLOSURE': case 'CALL':
+      return 1;
+    case 'ITERATE': case 'OBJECT': case 'BUILTIN': case 'WATCH':
+      return 2;
+    default:
+      return 0;
+  }
+});
+
+class Cell {
+  value: DroyValue;
+  watchers: DroyValue[] | null = null;
+
+  constructor(value: DroyValue) {
+    this.value = value;
+  }
+}
+
+export class DroyClosure {
+  readonly proto: DroyFunctionProto;
+  readonly cells: Cell[];
+
+  constructor(proto: DroyFunctionProto, cells: Cell[]) {
+    this.proto = proto;
+    this.cells = cells;
+  }
+}
+
+export class DroyBuiltin {
+  readonly name: string;
+  readonly call: (args: DroyValue[]) => DroyValue;
+
+  constructor(name: string, call: (args: DroyValue[]) => DroyValue) {
+    this.name = name;
+    this.call = call;
+  }
+}
+
+// --- value semantics ---------------------------------------------------------
+
+export function droyNumber(value: DroyValue): number {
+  switch (typeof value) {
+    case 'number':
+      return value;
+    case 'boolean':
+      return value ? 1 : 0;
+    case 'string': {
+      const number = parseFloat(value);
+      return Number.isNaN(number) ? 0 : number;
+    }
+    default:
+      return 0;
+  }
+}
+
+export function droyTruthy(value: DroyValue): boolean {
+  return value !== null && value !== false && value !== 0 && value !== '' && !Number.isNaN(value);
+}
+
+// printf's %.15g, as the native backends print doubles (DOUBLE_FORMAT):
+// 15 significant digits without trailing zeros, in exponent form when the
+// exponent is below -4 or at least 15
+function formatNumber(value: number): string {
+  if (!Number.isFinite(value)) {
+    return Number.isNaN(value) ? 'nan' : value > 0 ? 'inf' : '-inf';
+  }
+  if (value === 0) return Object.is(value, -0) ? '-0' : '0';
+  const [mantissa, exponent] = value.toExponential(14).split('e');
+  const power = Number(exponent);
+  const trim = (digits: string): string => (digits.includes('.') ? digits.replace(/\.?0+$/, '') : digits);
+  if (power < -4 || power >= 15) {
+    return `${trim(mantissa)}e${power < 0 ? '-' : '+'}${String(Math.abs(power)).padStart(2, '0')}`;
+  }
+  return trim(value.toFixed(14 - power));
+}
+
+export function droyToString(value: DroyValue): string {
+  if (value === null) return 'null';
+  switch (typeof value) {
+    case 'string':
+      return value;
+    case 'number':
+      return formatNumber(value);
+    case 'boolean':
+      return value ? 'true' : 'false';
+  }
+  if (Array.isArray(value)) return value.map(droyToString).join(',');
+  if (value instanceof DroyClosure) return `[func ${value.proto.name}]`;
+  if (value instanceof DroyBuiltin) return `[builtin ${value.name}]`;
+  return '[object Object]';
+}
+
+function add(a: DroyValue, b: DroyValue): DroyValue {
+  if (typeof a === 'string' || typeof b === 'string') {
+    return droyToString(a) + droyToString(b);
+  }
+  return droyNumber(a) + droyNumber(b);
+}
+
+function compare(a: DroyValue, b: DroyValue): number {
+  if (typeof a === 'string' && typeof b === 'string') {
+    return a < b ? -1 : a > b ? 1 : 0;
+  }
+  const x = droyNumber(a);
+  const y = droyNumber(b);
+  // NaN compares false every way, as it does in C
+  return x < y ? -1 : x > y ? 1 : x === y ? 0 : NaN;
+}
+
+export function droyEquals(a: DroyValue, b: DroyValue): boolean {
+  if (typeof a === 'string' && typeof b === 'string') return a === b;
+  if (a === null || b === null) return a === b;
+  if (typeof a === 'object' || typeof b === 'object') return a === b;
+  return droyNumber(a) === droyNumber(b);
+}
+
+// --- builtins ------------------------------------------------------------------
+
+// Aggregates take one array or several values
+function numbers(args: DroyValue[]): number[] {
+  const values = args.length === 1 && Array.isArray(args[0]) ? args[0] : args;
+  return values.map(droyNumber);
+}
+
+// Nothing has no min or max, in any backend
+function extreme(name: string, args: DroyValue[], pick: (a: number, b: number) => number): DroyValue {
+  const values = numbers(args);
+  if (values.length === 0) {
+    throw new Error(args.length === 0 ? `${name} needs at least one value` : `${name} of an empty array`);
+  }
+  let result = values[0];
+  for (let i = 1; i < values.length; i++) {
+    result = pick(result, values[i]);
+  }
+  return result;
+}
+
+function stringBuiltin(name: string, apply: (text: string) => DroyValue): DroyBuiltin {
+  return new DroyBuiltin(name, (args) => apply(droyToString(args[0] ?? '')));
+}
+
+// Math.round, but -0.5 to 0 round to 0 rather than -0, as the native
+// backends' floor-based droy_round does
+function round(value: number): number {
+  const result = Math.round(value);
+  return result === 0 && value < 0 ? 0 : result;
+}
+
+export const BUILTINS: readonly DroyBuiltin[] = [
+  new DroyBuiltin('sum', (args) => numbers(args).reduce((total, value) => total + value, 0)),
+  new DroyBuiltin('avg', (args) => {
+    const values = numbers(args);
+    return values.length ? values.reduce((total, value) => total + value, 0) / values.length : 0;
+  }),
+  new DroyBuiltin('min', (args) => extreme('min', args, Math.min)),
+  new DroyBuiltin('max', (args) => extreme('max', args, Math.max)),
+  new DroyBuiltin('count', (args) => (args.length === 1 && Array.isArray(args[0]) ? args[0].length : args.length)),
+  new DroyBuiltin('round', (args) => round(droyNumber(args[0] ?? 0))),
+  new DroyBuiltin('floor', (args) => Math.floor(droyNumber(args[0] ?? 0))),
+  new DroyBuiltin('ceil', (args) => Math.ceil(droyNumber(args[0] ?? 0))),
+  new DroyBuiltin('abs', (args) => Math.abs(droyNumber(args[0] ?? 0))),
+  // random: [0, 1); random n: 1..n; random a b: a..b
+  new DroyBuiltin('random', (args) => {
+    if (args.length === 0) return Math.random();
+    const low = args.length === 1 ? 1 : Math.ceil(droyNumber(args[0]));
+    const high = Math.floor(droyNumber(args[args.length === 1 ? 0 : 1]));
+    return low + Math.floor(Math.random() * (high - low + 1));
+  }),
+  // math: and calc: evaluate their expression
+  new DroyBuiltin('math', (args) => args[0] ?? null),
+  new DroyBuiltin('calc', (args) => args[0] ?? null),
+  new DroyBuiltin('len', (args) => {
+    const value = args[0] ?? null;
+    return typeof value === 'string' || Array.isArray(value) ? value.length : 0;
+  }),
+  stringBuiltin('upper', (text) => text.toUpperCase()),
+  stringBuiltin('lower', (text) => text.toLowerCase()),
+  stringBuiltin('trim', (text) => text.trim()),
+];
+
+const BUILTIN_IDS = new Map(BUILTINS.map((builtin, id) => [builtin.name, id]));
+
+// --- compiler ------------------------------------------------------------------
+
+interface Variable {
+  slot: number;
+  // Captured by an inner func or watched, so it lives in a Cell
+  cell: boolean;
+  // Declared by a func
+  func: boolean;
+}
+
+class Scope {
+  readonly parent: Scope | null;
+  readonly variables = new Map<string, Variable>();
+  // Funcs declared in this scope, created when it is entered
+  readonly functions: ASTNode[] = [];
+  slots: number = 0;
+
+  constructor(parent: Scope | null) {
+    this.parent = parent;
+  }
+
+  public variable(name: string): Variable {
+    let variable = this.variables.get(name);
+    if (!variable) {
+      variable = { slot: this.slots++, cell: false, func: false };
+      this.variables.set(name, variable);
+    }
+    return variable;
+  }
+
+  public lookup(name: string): { scope: Scope; variable: Variable } | null {
+    for (let scope: Scope | null = this; scope; scope = scope.parent) {
+      const variable = scope.variables.get(name);
+      if (variable) return { scope, variable };
+    }
+    return null;
+  }
+}
+
+// Code for one function while it is being compiled
+interface FunctionState {
+  scope: Scope;
+  parent: FunctionState | null;
+  code: number[];
+  constants: Constant[];
+  constantIndex: Map<unknown, number>;
+  captures: number[];
+  captureIndex: Map<string, number>;
+  callees: Map<number, string>;
+}
+
+type NameVisitor = (scope: Scope, name: string, assigned: boolean) => void;
+
+export class DroyBytecodeCompiler {
+  private scopes = new Map<ASTNode, Scope>();
+  private program: Scope = new Scope(null);
+  private state!: FunctionState;
+
+  public compile(ast: ASTNode): DroyFunctionProto {
+    this.scopes.clear();
+    this.program = new Scope(null);
+    this.scopes.set(ast, this.program);
+    // Slot 0 holds the value of the last top-level expression
+    this.program.slots = 1;
+    const body: ASTNode[] = ast.body ?? [];
+
+    this.declareAll(this.program, body);
+    // Assigning a name declared nowhere declares it for the whole program
+    this.walkAll(this.program, body, (scope, name, assigned) => {
+      if (assigned && !scope.lookup(name)) this.program.variable(name);
+    });
+    this.walkAll(this.program, body, (scope, name) => {
+      const found = scope.lookup(name);
+      if (found && found.scope !== scope) found.variable.cell = true;
+    });
+
+    return this.compileFunction('main', 0, this.program, null, body);
+  }
+
+  // --- analysis ----------------------------------------------------------------
+
+  private declareAll(scope: Scope, body: ASTNode[]): void {
+    for (const stmt of body) {
+      this.declareStatement(scope, stmt);
+    }
+  }
+
+  private declareStatement(scope: Scope, node: ASTNode): void {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+        scope.variable(node.name);
+        break;
+      case 'Data':
+        if (node.name && node.source) scope.variable(node.name);
+        break;
+      case 'Binding':
+        if (node.target) scope.variable(node.target);
+        break;
+      case 'ValueSet':
+        for (const assignment of node.assignments) {
+          scope.variable(assignment.name);
+        }
+        break;
+      // A block handler is a closure over the scope it is written in
+      case 'Watch':
+        if (node.handler?.type === 'BlockStatement') {
+          const inner = new Scope(scope);
+          for (const param of node.handler.params ?? []) {
+            inner.variable(param);
+          }
+          this.scopes.set(node.handler, inner);
+          this.declareAll(inner, node.handler.body);
+        }
+        break;
+      case 'FunctionDeclaration': {
+        // The first declaration of a name wins, as in the other backends
+        if (!scope.functions.some((fn) => fn.name === node.name)) {
+          scope.functions.push(node);
+        }
+        scope.variable(node.name).func = true;
+        const inner = new Scope(scope);
+        for (const param of node.params) {
+          inner.variable(param);
+        }
+        this.scopes.set(node, inner);
+        this.declareAll(inner, node.body);
+        break;
+      }
+      case 'IfStatement':
+        this.declareAll(scope, node.consequent);
+        this.declareAll(scope, node.alternate ?? []);
+        break;
+      case 'ForLoop':
+        scope.variable(node.iterator);
+        this.declareAll(scope, node.body);
+        break;
+      case 'WhileLoop':
+        this.declareAll(scope, node.body);
+        break;
+      case 'ExportStatement':
+        this.declareStatement(scope, node.declaration);
+        break;
+    }
+  }
+
+  private walkAll(scope: Scope, body: ASTNode[], visit: NameVisitor): void {
+    for (const stmt of body) {
+      this.walk(scope, stmt, visit);
+    }
+  }
+
+  // Visits every name the executable parts of `node` read or assign
+  private walk(scope: Scope, node: ASTNode | null | undefined, visit: NameVisitor): void {
+    if (!node) return;
+    switch (node.type) {
+      case 'Identifier':
+      case 'GetExpression':
+        visit(scope, node.name, false);
+        break;
+      case 'AssignmentExpression':
+        if (node.left.type === 'Identifier') visit(scope, node.left.name, true);
+        this.walk(scope, node.right, visit);
+        break;
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+        visit(scope, node.name, true);
+        this.walk(scope, node.value, visit);
+        break;
+      case 'Data':
+        if (node.name && node.source) {
+          visit(scope, node.name, true);
+          this.walk(scope, node.source, visit);
+        }
+        break;
+      case 'Binding':
+        if (node.target) {
+          visit(scope, node.target, true);
+          this.walk(scope, node.source, visit);
+        }
+        break;
+      case 'ValueSet':
+        for (const assignment of node.assignments) {
+          visit(scope, assignment.name, true);
+          this.walk(scope, assignment.value, visit);
+        }
+        break;
+      case 'Watch':
+        // Watched variables are Cells so their stores can notify
+        if (node.target.type === 'Identifier') {
+          visit(scope, node.target.name, false);
+          const found = scope.lookup(node.target.name);
+          if (found) found.variable.cell = true;
+        }
+        this.walk(scope, node.handler, visit);
+        break;
+      case 'FunctionDeclaration':
+        this.walkAll(this.scopes.get(node)!, node.body, visit);
+        break;
+      case 'BlockStatement': {
+        const inner = this.scopes.get(node);
+        if (inner) this.walkAll(inner, node.body, visit);
+        break;
+      }
+      case 'ForLoop':
+        visit(scope, node.iterator, true);
+        this.walk(scope, node.iterable, visit);
+        this.walkAll(scope, node.body, visit);
+        break;
+      case 'IfStatement':
+        this.walk(scope, node.condition, visit);
+        this.walkAll(scope, node.consequent, visit);
+        this.walkAll(scope, node.alternate ?? [], visit);
+        break;
+      case 'WhileLoop':
+        this.walk(scope, node.condition, visit);
+        this.walkAll(scope, node.body, visit);
+        break;
+      case 'ExportStatement':
+        this.walk(scope, node.declaration, visit);
+        break;
+      case 'PrintStatement':
+      case 'ReturnStatement':
+        this.walk(scope, node.value, visit);
+        break;
+      case 'ExpressionStatement':
+        this.walk(scope, node.expression, visit);
+        break;
+      case 'BinaryExpression':
+      case 'LogicalExpression':
+      case 'PipeExpression':
+        this.walk(scope, node.left, visit);
+        this.walk(scope, node.right, visit);
+        break;
+      case 'UnaryExpression':
+        this.walk(scope, node.operand, visit);
+        break;
+      case 'CallExpression':
+        this.walk(scope, node.callee, visit);
+        this.walkAll(scope, node.arguments, visit);
+        break;
+      case 'MathOperation':
+        this.walkAll(scope, node.values, visit);
+        break;
+      case 'ArrayLiteral':
+        this.walkAll(scope, node.elements, visit);
+        break;
+      case 'ObjectLiteral':
+        for (const property of node.properties) {
+          this.walk(scope, property.value, visit);
+        }
+        break;
+    }
+  }
+
+  // --- emission ----------------------------------------------------------------
+
+  private compileFunction(
+    name: string,
+    arity: number,
+    scope: Scope,
+    parent: FunctionState | null,
+    body: ASTNode[],
+  ): DroyFunctionProto {
+    const state: FunctionState = {
+      scope,
+      parent,
+      code: [],
+      constants: [],
+      constantIndex: new Map(),
+      captures: [],
+      captureIndex: new Map(),
+      callees: new Map(),
+    };
+    const outer = this.state;
+    this.state = state;
+
+    for (const variable of scope.variables.values()) {
+      if (variable.cell) this.emit(OP.NEW_CELL, variable.slot);
+    }
+    for (const fn of scope.functions) {
+      this.emitClosure(fn);
+      this.emitStore(fn.name);
+    }
+    this.compileBlock(body);
+    if (scope === this.program) {
+      this.emit(OP.GET_LOCAL, 0);
+    } else {
+      this.emit(OP.NULL);
+    }
+    this.emit(OP.RETURN);
+
+    this.state = outer;
+    return new DroyFunctionProto(name, arity, scope.slots, state.code, state.constants, state.captures, state.callees);
+  }
+
+  private emitClosure(fn: ASTNode): void {
+    const proto = this.compileFunction(fn.name, fn.params.length, this.scopes.get(fn)!, this.state, fn.body);
+    this.emit(OP.CLOSURE, this.constant(proto));
+  }
+
+  private emit(...code: number[]): void {
+    this.state.code.push(...code);
+  }
+
+  private here(): number {
+    return this.state.code.length;
+  }
+
+  // Emits a jump with a placeholder target and returns where to patch it
+  private emitJump(op: number): number {
+    this.emit(op, -1);
+    return this.here() - 1;
+  }
+
+  private patch(at: number): void {
+    this.state.code[at] = this.here();
+  }
+
+  private constant(value: Constant): number {
+    // String(-0) is "0", but 1 / -0 is not 1 / 0
+    const key =
+      typeof value === 'object' && value !== null ? value : Object.is(value, -0) ? 'number:-0' : `${typeof value}:${String(value)}`;
+    let index = this.state.constantIndex.get(key);
+    if (index === undefined) {
+      index = this.state.constants.push(value) - 1;
+      this.state.constantIndex.set(key, index);
+    }
+    return index;
+  }
+
+  private temporary(): number {
+    return this.state.scope.slots++;
+  }
+
+  // Where `name` lives from the current function's point of view
+  private resolve(name: string, state: FunctionState = this.state): { op: 'local' | 'cell' | 'upvalue'; index: number } | null {
+    const own = state.scope.variables.get(name);
+    if (own) return { op: own.cell ? 'cell' : 'local', index: own.slot };
+    if (!state.parent) return null;
+
+    let index = state.captureIndex.get(name);
+    if (index === undefined) {
+      const outer = this.resolve(name, state.parent);
+      if (!outer) return null;
+      index = state.captures.length / 2;
+      state.captures.push(outer.op === 'upvalue' ? 0 : 1, outer.index);
+      state.captureIndex.set(name, index);
+    }
+    return { op: 'upvalue', index };
+  }
+
+  private emitLoad(name: string): void {
+    const target = this.resolve(name);
+    if (!target) {
+      const builtin = BUILTIN_IDS.get(name);
+      // A name that is never assigned reads as null
+      this.emit(...(builtin === undefined ? [OP.NULL] : [OP.CONST, this.constant(BUILTINS[builtin])]));
+      return;
+    }
+    this.emit(target.op === 'local' ? OP.GET_LOCAL : target.op === 'cell' ? OP.GET_CELL : OP.GET_UPVALUE, target.index);
+  }
+
+  private emitStore(name: string): void {
+    const target = this.resolve(name)!;
+    this.emit(target.op === 'local' ? OP.SET_LOCAL : target.op === 'cell' ? OP.SET_CELL : OP.SET_UPVALUE, target.index);
+  }
+
+  private compileBlock(body: ASTNode[]): void {
+    for (const stmt of body) {
+      this.compileStatement(stmt);
+    }
+  }
+
+  private compileStatement(node: ASTNode): void {
+    switch (node.type) {
+      case 'VariableDeclaration':
+      case 'SetDeclaration':
+        this.compileExpression(node.value);
+        this.emitStore(node.name);
+        break;
+      case 'Data':
+        if (node.name && node.source) {
+          this.compileExpression(node.source);
+          this.emitStore(node.name);
+        }
+        break;
+      // Outside a page, `bind`/`state` just declares the variable
+      case 'Binding':
+        if (node.target) {
+          this.compileExpression(node.source);
+          this.emitStore(node.target);
+        }
+        break;
+      case 'ValueSet':
+        for (const assignment of node.assignments) {
+          this.compileExpression(assignment.value);
+          this.emitStore(assignment.name);
+        }
+        break;
+      case 'PrintStatement':
+        this.compileExpression(node.value);
+        this.emit(OP.PRINT);
+        break;
+      case 'IfStatement': {
+        this.compileExpression(node.condition);
+        const otherwise = this.emitJump(OP.JUMP_IF_FALSE);
+        this.compileBlock(node.consequent);
+        if (node.alternate) {
+          const end = this.emitJump(OP.JUMP);
+          this.patch(otherwise);
+          this.compileBlock(node.alternate);
+          this.patch(end);
+        } else {
+          this.patch(otherwise);
+        }
+        break;
+      }
+      case 'WhileLoop': {
+        const start = this.here();
+        this.compileExpression(node.condition);
+        const end = this.emitJump(OP.JUMP_IF_FALSE);
+        this.compileBlock(node.body);
+        this.emit(OP.LOOP, start);
+        this.patch(end);
+        break;
+      }
+      case 'ForLoop': {
+        const slot = this.temporary();
+        this.temporary();
+        this.compileExpression(node.iterable);
+        this.emit(OP.SET_LOCAL, slot, OP.CONST, this.constant(0), OP.SET_LOCAL, slot + 1);
+        const start = this.here();
+        this.emit(OP.ITERATE, slot, -1);
+        const end = this.here() - 1;
+        this.emitStore(node.iterator);
+        this.compileBlock(node.body);
+        this.emit(OP.LOOP, start);
+        this.patch(end);
+        break;
+      }
+      case 'ReturnStatement':
+        this.compileExpression(node.value);
+        this.emit(OP.RETURN);
+        break;
+      case 'Watch': {
+        // Only variables can be watched; `watch state.user` has nothing to hook
+        const target = node.target.type === 'Identifier' ? this.resolve(node.target.name) : null;
+        if (!target || target.op === 'local' || !node.handler) break;
+        this.compileExpression(node.handler);
+        this.emit(OP.WATCH, target.op === 'upvalue' ? 1 : 0, target.index);
+        break;
+      }
+      case 'ExportStatement':
+        this.compileStatement(node.declaration);
+        break;
+      case 'ExpressionStatement':
+        if (node.expression.type === 'AssignmentExpression') {
+          this.compileExpression(node.expression.right);
+          this.emitStore(node.expression.left.name);
+        } else {
+          this.compileResult(node.expression);
+        }
+        break;
+      case 'MathOperation':
+      case 'GetExpression':
+        this.compileResult(node);
+        break;
+      // Functions were created on entry; UI, server and event statements
+      // describe the page rather than run
+    }
+  }
+
+  // A top-level expression's value becomes the program's result
+  private compileResult(node: ASTNode): void {
+    this.compileExpression(node);
+    this.emit(...(this.state.scope === this.program ? [OP.SET_LOCAL, 0] : [OP.POP]));
+  }
+
+  private compileExpression(node: ASTNode | null | undefined): void {
+    if (!node) {
+      this.emit(OP.NULL);
+      return;
+    }
+    switch (node.type) {
+      case 'NumberLiteral':
+      case 'StringLiteral':
+      case 'ColorLiteral':
+        this.emit(OP.CONST, this.constant(node.value));
+        break;
+      case 'BooleanLiteral':
+        this.emit(node.value ? OP.TRUE : OP.FALSE);
+        break;
+      case 'Identifier':
+      case 'GetExpression':
+        this.emitLoad(node.name);
+        break;
+      case 'AssignmentExpression':
+        this.compileExpression(node.right);
+        this.emit(OP.DUP);
+        this.emitStore(node.left.name);
+        break;
+      case 'BinaryExpression':
+        this.compileExpression(node.left);
+        this.compileExpression(node.right);
+        if (!(node.operator in BINARY_OPS)) {
+          throw new Error(`Unknown operator ${node.operator}`);
+        }
+        this.emit(BINARY_OPS[node.operator]);
+        break;
+      case 'LogicalExpression': {
+        // Both operators produce booleans, like the native backends
+        this.compileExpression(node.left);
+        if (node.operator === '&&') {
+          const otherwise = this.emitJump(OP.JUMP_IF_FALSE);
+          this.compileExpression(node.right);
+          this.emit(OP.TRUTHY);
+          const end = this.emitJump(OP.JUMP);
+          this.patch(otherwise);
+          this.emit(OP.FALSE);
+          this.patch(end);
+        } else {
+          const otherwise = this.emitJump(OP.JUMP_IF_FALSE);
+          this.emit(OP.TRUE);
+          const end = this.emitJump(OP.JUMP);
+          this.patch(otherwise);
+          this.compileExpression(node.right);
+          this.emit(OP.TRUTHY);
+          this.patch(end);
+        }
+        break;
+      }
+      case 'UnaryExpression':
+        this.compileExpression(node.operand);
+        this.emit(node.operator === '-' ? OP.NEG : OP.NOT);
+        break;
+      case 'CallExpression':
+        this.compileCall(node.callee, node.arguments);
+        break;
+      // `x | f` calls f(x); `x | f(a)` calls f(x, a)
+      case 'PipeExpression':
+        if (node.right.type === 'CallExpression') {
+          this.compileCall(node.right.callee, [node.left, ...node.right.arguments]);
+        } else {
+          this.compileCall(node.right, [node.left]);
+        }
+        break;
+      // The keyword forms mean the builtin unless a func of that name is in scope
+      case 'MathOperation':
+        if (this.state.scope.lookup(node.operation)?.variable.func) {
+          this.compileCall({ type: 'Identifier', name: node.operation }, node.values);
+          break;
+        }
+        for (const value of node.values) {
+          this.compileExpression(value);
+        }
+        this.emit(OP.BUILTIN, BUILTIN_IDS.get(node.operation)!, node.values.length);
+        break;
+      case 'ArrayLiteral':
+        for (const element of node.elements) {
+          this.compileExpression(element);
+        }
+        this.emit(OP.ARRAY, node.elements.length);
+        break;
+      case 'ObjectLiteral':
+        for (const property of node.properties) {
+          this.compileExpression(property.value);
+        }
+        this.emit(OP.OBJECT, this.constant(node.properties.map((property: { key: string }) => property.key)), node.properties.length);
+        break;
+      // A watch handler declared in place
+      case 'BlockStatement': {
+        const scope = this.scopes.get(node);
+        if (!scope) {
+          this.emit(OP.NULL);
+          break;
+        }
+        const proto = this.compileFunction('watch', node.params?.length ?? 0, scope, this.state, node.body);
+        this.emit(OP.CLOSURE, this.constant(proto));
+        break;
+      }
+      default:
+        this.emit(OP.NULL);
+    }
+  }
+
+  private compileCall(callee: ASTNode, args: ASTNode[]): void {
+    // Builtins that no variable shadows are called directly
+    const builtin = callee.type === 'Identifier' && !this.resolve(callee.name) ? BUILTIN_IDS.get(callee.name) : undefined;
+    if (builtin === undefined) {
+      this.compileExpression(callee);
+    }
+    for (const arg of args) {
+      this.compileExpression(arg);
+    }
+    if (builtin === undefined && callee.type === 'Identifier') {
+      this.state.callees.set(this.here(), callee.name);
+    }
+    this.emit(...(builtin === undefined ? [OP.CALL, args.length] : [OP.BUILTIN, builtin, args.length]));
+  }
+}
+
+const BINARY_OPS: Record<string, number> = {
+  '+': OP.ADD,
+  '-': OP.SUB,
+  '*': OP.MUL,
+  '/': OP.DIV,
+  '%': OP.MOD,
+  '**': OP.POW,
+  '==': OP.EQ,
+  '!=': OP.NE,
+  '<': OP.LT,
+  '>': OP.GT,
+  '<=': OP.LE,
+  '>=': OP.GE,
+};
+
+// --- interpreter ---------------------------------------------------------------
+
+export interface DroyVMOptions {
+  // Receives each printed line; without it lines are collected into `output`
+  print?: (line: string) => void;
+  // Fails a run after this many calls and loop iterations
+  maxSteps?: number;
+  // Deepest call nesting before a run fails
+  maxDepth?: number;
+}
+
+export interface DroyRunResult {
+  // Printed lines, each ending in '\n'; empty when `print` was given
+  output: string;
+  // The top-level `return` value, or else the last top-level expression's
+  value: DroyValue;
+}
+
+interface Frame {
+  closure: DroyClosure;
+  ip: number;
+  // Stack index of slot 0; the callee sits just below it
+  base: number;
+}
+
+type Slot = DroyValue | Cell;
+
+export class DroyVM {
+  private print: ((line: string) => void) | undefined;
+  private maxSteps: number;
+  private maxDepth: number;
+  private stack: Slot[] = [];
+  private sp: number = 0;
+  private frames: Frame[] = [];
+  private steps: number = 0;
+  private output: string[] = [];
+
+  constructor(options: DroyVMOptions = {}) {
+    this.print = options.print;
+    this.maxSteps = options.maxSteps ?? Infinity;
+    this.maxDepth = options.maxDepth ?? 10000;
+  }
+
+  public run(program: DroyFunctionProto): DroyRunResult {
+    this.stack = [];
+    this.sp = 0;
+    this.frames = [];
+    this.steps = this.maxSteps;
+    this.output = [];
+    const value = this.call(new DroyClosure(program, []), []);
+    return { output: this.output.join(''), value };
+  }
+
+  // Calls a Droy function from the host, e.g. one returned by a program
+  public call(fn: DroyValue, args: DroyValue[]): DroyValue {
+    if (fn instanceof DroyBuiltin) return fn.call(args);
+    if (!(fn instanceof DroyClosure)) {
+      throw new Error(`${droyToString(fn)} is not a function`);
+    }
+    const depth = this.frames.length;
+    this.stack[this.sp++] = fn;
+    for (const arg of args) {
+      this.stack[this.sp++] = arg;
+    }
+    this.enter(fn, args.length);
+    try {
+      return this.execute(depth);
+    } catch (error) {
+      this.frames.length = depth;
+      throw error;
+    }
+  }
+
+  // Pushes a frame for `closure`, whose `argc` arguments are on the stack
+  private enter(closure: DroyClosure, argc: number): Frame {
+    if (this.frames.length >= this.maxDepth) {
+      throw new Error(`Call depth exceeded ${this.maxDepth} in ${closure.proto.name}`);
+    }
+    if (--this.steps < 0) {
+      throw new Error(`Execution exceeded ${this.maxSteps} steps`);
+    }
+    const proto = closure.proto;
+    const stack = this.stack;
+    let sp = this.sp;
+    // Missing arguments are null; extra ones are dropped
+    for (let i = argc; i < proto.arity; i++) stack[sp++] = null;
+    if (argc > proto.arity) sp -= argc - proto.arity;
+    const base = sp - proto.arity;
+    for (let i = proto.arity; i < proto.slots; i++) stack[sp++] = null;
+    this.sp = sp;
+
+    const frame: Frame = { closure, ip: 0, base };
+    this.frames.push(frame);
+    return frame;
+  }
+
+  private assign(cell: Cell, value: DroyValue): void {
+    const previous = cell.value;
+    cell.value = value;
+    if (cell.watchers && previous !== value) {
+      for (const watcher of cell.watchers) {
+        this.call(watcher, [value, previous]);
+      }
+    }
+  }
+
+  // Runs until the frame at `depth` returns
+  private execute(depth: number): DroyValue {
+    const stack = this.stack;
+    let frame = this.frames[this.frames.length - 1];
+    let code = frame.closure.proto.code;
+    let constants = frame.closure.proto.constants;
+    let cells = frame.closure.cells;
+    let base = frame.base;
+    let ip = frame.ip;
+    let sp = this.sp;
+    let a: any;
+    let b: any;
+
+    for (;;) {
+      // Literal case labels keep this a jump table; see OP for the names
+      switch (code[ip++]) {
+        case 0: // CONST
+          stack[sp++] = constants[code[ip++]] as DroyValue;
+          break;
+        case 1: // NULL
+          stack[sp++] = null;
+          break;
+        case 2: // TRUE
+          stack[sp++] = true;
+          break;
+        case 3: // FALSE
+          stack[sp++] = false;
+          break;
+        case 4: // POP
+          sp--;
+          break;
+        case 5: // DUP
+          stack[sp] = stack[sp - 1];
+          sp++;
+          break;
+        case 6: // GET_LOCAL
+          stack[sp++] = stack[base + code[ip++]];
+          break;
+        case 7: // SET_LOCAL
+          stack[base + code[ip++]] = stack[--sp];
+          break;
+        case 8: // GET_CELL
+          stack[sp++] = (stack[base + code[ip++]] as Cell).value;
+          break;
+        case 9: // SET_CELL
+          a = stack[base + code[ip++]];
+          b = stack[--sp];
+          if (a.watchers) {
+            frame.ip = ip;
+            this.sp = sp;
+            this.assign(a, b);
+          } else {
+            a.value = b;
+          }
+          break;
+        case 10: // GET_UPVALUE
+          stack[sp++] = cells[code[ip++]].value;
+          break;
+        case 11: // SET_UPVALUE
+          a = cells[code[ip++]];
+          b = stack[--sp];
+          if (a.watchers) {
+            frame.ip = ip;
+            this.sp = sp;
+            this.assign(a, b);
+          } else {
+            a.value = b;
+          }
+          break;
+        case 12: // NEW_CELL
+          a = base + code[ip++];
+          stack[a] = new Cell(stack[a] as DroyValue);
+          break;
+        case 13: // ADD
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a + b : add(a, b);
+          break;
+        case 14: // SUB
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a - b : droyNumber(a) - droyNumber(b);
+          break;
+        case 15: // MUL
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a * b : droyNumber(a) * droyNumber(b);
+          break;
+        case 16: // DIV
+          b = stack[--sp];
+          stack[sp - 1] = droyNumber(stack[sp - 1] as DroyValue) / droyNumber(b);
+          break;
+        case 17: // MOD
+          b = stack[--sp];
+          stack[sp - 1] = droyNumber(stack[sp - 1] as DroyValue) % droyNumber(b);
+          break;
+        case 18: // POW
+          b = stack[--sp];
+          stack[sp - 1] = droyNumber(stack[sp - 1] as DroyValue) ** droyNumber(b);
+          break;
+        case 19: // NEG
+          stack[sp - 1] = -droyNumber(stack[sp - 1] as DroyValue);
+          break;
+        case 20: // NOT
+          stack[sp - 1] = !droyTruthy(stack[sp - 1] as DroyValue);
+          break;
+        case 21: // TRUTHY
+          stack[sp - 1] = droyTruthy(stack[sp - 1] as DroyValue);
+          break;
+        case 22: // EQ
+          b = stack[--sp];
+          stack[sp - 1] = droyEquals(stack[sp - 1] as DroyValue, b);
+          break;
+        case 23: // NE
+          b = stack[--sp];
+          stack[sp - 1] = !droyEquals(stack[sp - 1] as DroyValue, b);
+          break;
+        case 24: // LT
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a < b : compare(a, b) < 0;
+          break;
+        case 25: // GT
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a > b : compare(a, b) > 0;
+          break;
+        case 26: // LE
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a <= b : compare(a, b) <= 0;
+          break;
+        case 27: // GE
+          b = stack[--sp];
+          a = stack[sp - 1];
+          stack[sp - 1] = typeof a === 'number' && typeof b === 'number' ? a >= b : compare(a, b) >= 0;
+          break;
+        case 28: // JUMP
+          ip = code[ip];
+          break;
+        case 29: // JUMP_IF_FALSE
+          a = stack[--sp];
+          ip = a === true || (a !== false && droyTruthy(a)) ? ip + 1 : code[ip];
+          break;
+        case 30: // LOOP
+          if (--this.steps < 0) {
+            throw new Error(`Execution exceeded ${this.maxSteps} steps`);
+          }
+          ip = code[ip];
+          break;
+        case 31: { // ITERATE
+          const slot = base + code[ip++];
+          const items = stack[slot] as DroyValue;
+          const index = stack[slot + 1] as number;
+          if (typeof items !== 'string' && !Array.isArray(items)) {
+            throw new Error(`Cannot loop over ${droyToString(items)}`);
+          }
+          if (index < items.length) {
+            stack[sp++] = items[index];
+            stack[slot + 1] = index + 1;
+            ip++;
+          } else {
+            ip = code[ip];
+          }
+          break;
+        }
+        case 32: { // ARRAY
+          const count = code[ip++];
+          sp -= count;
+          stack[sp] = stack.slice(sp, sp + count) as DroyValue[];
+          sp++;
+          break;
+        }
+        case 33: { // OBJECT
+          const keys = constants[code[ip++]] as string[];
+          const count = code[ip++];
+          const object: DroyObject = {};
+          sp -= count;
+          for (let i = 0; i < count; i++) {
+            object[keys[i]] = stack[sp + i] as DroyValue;
+          }
+          stack[sp++] = object;
+          break;
+        }
+        case 34: { // CLOSURE
+          const proto = constants[code[ip++]] as DroyFunctionProto;
+          const captures = proto.captures;
+          const captured: Cell[] = new Array(captures.length / 2);
+          for (let i = 0; i < captures.length; i += 2) {
+            captured[i / 2] = captures[i] ? (stack[base + captures[i + 1]] as Cell) : cells[captures[i + 1]];
+          }
+          stack[sp++] = new DroyClosure(proto, captured);
+          break;
+        }
+        case 35: { // CALL
+          const argc = code[ip++];
+          const callee = stack[sp - argc - 1];
+          if (callee instanceof DroyClosure) {
+            frame.ip = ip;
+            this.sp = sp;
+            frame = this.enter(callee, argc);
+            code = callee.proto.code;
+            constants = callee.proto.constants;
+            cells = callee.cells;
+            base = frame.base;
+            ip = 0;
+            sp = this.sp;
+          } else if (callee instanceof DroyBuiltin) {
+            const args = stack.slice(sp - argc, sp) as DroyValue[];
+            sp -= argc + 1;
+            stack[sp++] = callee.call(args);
+          } else {
+            const name = frame.closure.proto.callees.get(ip - 2) ?? droyToString(callee as DroyValue);
+            throw new Error(`${name} is not a function`);
+          }
+          break;
+        }
+        case 36: { // BUILTIN
+          const builtin = BUILTINS[code[ip++]];
+          const argc = code[ip++];
+          const args = stack.slice(sp - argc, sp) as DroyValue[];
+          sp -= argc;
+          stack[sp++] = builtin.call(args);
+          break;
+        }
+        case 37: { // RETURN
+          const value = stack[sp - 1] as DroyValue;
+          // Drop the frame's slots and the callee below them
+          sp = base - 1;
+          this.frames.pop();
+          if (this.frames.length === depth) {
+            stack.length = sp;
+            this.sp = sp;
+            return value;
+          }
+          stack[sp++] = value;
+          frame = this.frames[this.frames.length - 1];
+          code = frame.closure.proto.code;
+          constants = frame.closure.proto.constants;
+          cells = frame.closure.cells;
+          base = frame.base;
+          ip = frame.ip;
+          break;
+        }
+        case 38: { // PRINT
+          const line = droyToString(stack[--sp] as DroyValue);
+          if (this.print) {
+            this.print(line);
+          } else {
+            this.output.push(line, '\n');
+          }
+          break;
+        }
+        case 39: { // WATCH
+          const fromClosure = code[ip++];
+          const index = code[ip++];
+          const cell = fromClosure ? cells[index] : (stack[base + index] as Cell);
+          const handler = stack[--sp] as DroyValue;
+          if (!(handler instanceof DroyClosure || handler instanceof DroyBuiltin)) {
+            throw new Error('watch needs a function to call');
+          }
+          (cell.watchers ??= []).push(handler);
+          break;
+        }
+        default:
+          throw new Error(`Invalid opcode ${code[ip - 1]} in ${frame.closure.proto.name}`);
+      }
+    }
+  }
+}
+
+// Compiles and runs a parsed program
+export function runDroy(ast: ASTNode, options: DroyVMOptions = {}): DroyRunResult {
+  return new DroyVM(options).run(new DroyBytecodeCompiler().compile(ast));
+}
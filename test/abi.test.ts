@@ -0,0 +1,29 @@
+// The byte-level compile ABI.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { DroyABICompiler, DroyABIStatus, decodeOutput, encodeOutput } from '../src/lib/droy/abi';
+
+test('output round-trips through the byte layout', () => {
+  const output = decodeOutput(encodeOutput(DroyABIStatus.OK, ['<p>é</p>', 'p{}', 'x()', '']));
+  assert.deepEqual(output, { status: DroyABIStatus.OK, html: '<p>é</p>', css: 'p{}', js: 'x()', error: '' });
+});
+
+test('a compile comes back as bytes', () => {
+  const output = decodeOutput(new DroyABICompiler().compile(new TextEncoder().encode('~text "Hi"')));
+  assert.equal(output.status, DroyABIStatus.OK);
+  assert.match(output.html, /Hi/);
+});
+
+test('truncated output is an error, not a short decode', () => {
+  const buffer = encodeOutput(DroyABIStatus.OK, ['html', 'css', 'js', '']);
+  for (const end of [14, 20, buffer.length - 1]) {
+    assert.throws(() => decodeOutput(buffer.subarray(0, end)), /truncated/);
+  }
+});
+
+test('a section length past the end is an error', () => {
+  const buffer = encodeOutput(DroyABIStatus.OK, ['', '', '', '']);
+  new DataView(buffer.buffer).setUint32(12, 0xffffffff, true);
+  assert.throws(() => decodeOutput(buffer), /truncated/);
+});
@@ -0,0 +1,89 @@
+// The `droy build` cache: which files a build compiles again.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { existsSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { afterEach, beforeEach, test } from 'node:test';
+import { build } from '../cli/build';
+
+let root: string;
+beforeEach(() => {
+  root = mkdtempSync(join(tmpdir(), 'droy-build-'));
+});
+afterEach(() => rmSync(root, { recursive: true, force: true }));
+
+function write(files: Record<string, string>): void {
+  for (const [name, source] of Object.entries(files)) writeFileSync(join(root, name), source);
+}
+
+// The files the build compiled, and the ones that failed
+async function run(): Promise<{ built: string[]; failed: string[] }> {
+  const result = await build({
+    root,
+    outDir: join(root, 'out'),
+    cacheDir: join(root, '.cache'),
+    workers: 1,
+    force: false,
+    imageCdn: null,
+  });
+  return {
+    built: result.outcomes.map((outcome) => outcome.file),
+    failed: result.outcomes.filter((outcome) => outcome.error).map((outcome) => outcome.file),
+  };
+}
+
+const LIB = '~text "Hi from lib"\nexport func greet(name) {\n  return "Hi " + name\n}\n';
+const PAGE = 'import "lib"\n~text greet("you")\n';
+
+test('files that did not change are skipped', async () => {
+  write({ 'lib.droy': LIB, 'page.droy': PAGE, 'other.droy': '~text "Other"\n' });
+  assert.deepEqual((await run()).built, ['lib.droy', 'other.droy', 'page.droy']);
+  assert.deepEqual(await run(), { built: [], failed: [] });
+});
+
+test('a changed import rebuilds the files that import it', async () => {
+  write({ 'lib.droy': LIB, 'page.droy': PAGE, 'other.droy': '~text "Other"\n' });
+  await run();
+  write({ 'lib.droy': LIB.replace('Hi', 'Hello') });
+  assert.deepEqual(await run(), { built: ['lib.droy', 'page.droy'], failed: [] });
+  assert.match(readFileSync(join(root, 'out', 'page.html'), 'utf8'), /Hello from lib/);
+});
+
+test('a deleted import fails the build of its importers', async () => {
+  write({ 'lib.droy': LIB, 'page.droy': PAGE });
+  await run();
+  rmSync(join(root, 'lib.droy'));
+  assert.deepEqual(await run(), { built: ['page.droy'], failed: ['page.droy'] });
+  // and keeps failing until it is fixed
+  assert.deepEqual((await run()).failed, ['page.droy']);
+});
+
+test('a change reaches every file of an import cycle', async () => {
+  write({
+    'a.droy': 'import "b"\nimport "c"\nexport func a() {\n  return 1\n}\n',
+    'b.droy': 'import "a"\nexport func b() {\n  return 2\n}\n',
+    'c.droy': 'export func c() {\n  return 3\n}\n',
+  });
+  await run();
+  write({ 'c.droy': 'export func c() {\n  return 4\n}\n' });
+  assert.deepEqual(await run(), { built: ['a.droy', 'b.droy', 'c.droy'], failed: [] });
+});
+
+test('a compiler change invalidates the cache', async () => {
+  write({ 'lib.droy': LIB, 'page.droy': PAGE });
+  await run();
+  // What a build with other compiler sources finds
+  const path = join(root, '.cache', 'manifest.json');
+  writeFileSync(path, JSON.stringify({ ...JSON.parse(readFileSync(path, 'utf8')), version: 'other' }));
+  assert.deepEqual((await run()).built, ['lib.droy', 'page.droy']);
+});
+
+test('a route cannot write its page outside the output directory', async () => {
+  write({
+    'app.droy': 'router mode: "history"\nroute "/" {\n  ~text "Home"\n}\nroute "/../../escape" {\n  ~text "Out"\n}\n',
+  });
+  assert.deepEqual(await run(), { built: ['app.droy'], failed: ['app.droy'] });
+  assert.equal(existsSync(join(root, 'escape')), false);
+  assert.equal(existsSync(join(root, 'out', 'app.html')), false);
+});
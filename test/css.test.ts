@@ -0,0 +1,14 @@
+// Component CSS in each CSS mode.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { DroyCompilerV3, type CssMode } from '../src/lib/droy/compiler-v3';
+
+const MODES: CssMode[] = ['rules', 'deduplicated', 'atomic'];
+
+test('declarations that override element defaults are kept', () => {
+  for (const css of MODES) {
+    const output = new DroyCompilerV3({ css }).compile('~btn "Ghost" color: transparent\n').css;
+    assert.match(output, /background: transparent;/, css);
+  }
+});
@@ -0,0 +1,160 @@
+// Differential tests: every program of the corpus prints the same, or fails
+// with the same error, on the bytecode VM, in C (with and without type
+// inference) and in LLVM IR, except where SYNTAX.md documents that native
+// code differs.
+// Run with `npm test`; the native backends are skipped without `cc` (or
+// $CC) and `lli`.
+import assert from 'node:assert/strict';
+import { execFileSync, spawnSync } from 'node:child_process';
+import { mkdtempSync, rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { after, describe, test } from 'node:test';
+import { DroyCodeGenerator, DroyLLVMGenerator, DroyLexer, DroyParser } from '../src/lib/droy/compiler';
+import { DroyCompilerV3 } from '../src/lib/droy/compiler-v3';
+
+interface Case {
+  name: string;
+  source: string;
+  // What every backend prints, or `error: <message>` for a program that fails
+  output: string;
+  // What the native backends print instead, where they differ by design
+  native?: string;
+}
+
+const corpus: Case[] = [
+  {
+    name: 'doubles print as %.15g',
+    source: `print 0.000001
+print 0.00001
+print 0.1 + 0.2
+print 1 / 3
+print 7 / 2
+print 100000000000000000000
+print -0.5 * 0
+print "x" + 0.000001`,
+    output: '1e-06\n1e-05\n0.3\n0.333333333333333\n3.5\n1e+20\n-0\nx1e-06\n',
+  },
+  {
+    name: 'literals beyond int range are doubles',
+    source: 'print 1234567890123456789',
+    output: '1.23456789012346e+18\n',
+  },
+  {
+    name: 'int overflow wraps in native code',
+    source: 'print 2147483647 + 1',
+    output: '2147483648\n',
+    native: '-2147483648\n',
+  },
+  {
+    name: 'recursive int overflow',
+    source: `func f(n) {
+  if n < 2 {
+    return 1
+  }
+  return n * f(n - 1)
+}
+print f(13)`,
+    output: '6227020800\n',
+    native: '1932053504\n',
+  },
+  {
+    name: 'min of an empty int array',
+    source: `var xs = [1]
+xs = []
+print min(xs)`,
+    output: 'error: min of an empty array',
+  },
+  {
+    name: 'max of an empty double array',
+    source: `var xs = [1.5]
+xs = []
+print max(xs)`,
+    output: 'error: max of an empty array',
+  },
+  {
+    name: 'sum and avg of an empty array',
+    source: `var xs = [1]
+xs = []
+print sum(xs)
+print avg(xs)`,
+    output: '0\n0\n',
+  },
+  {
+    name: 'round of small negatives',
+    source: `print round(-0.5)
+print round(-0.2)
+print round(-1.5)
+print round(-0.5 * 0)`,
+    output: '0\n0\n-1\n-0\n',
+  },
+  {
+    name: 'compound assignment',
+    source: `var total = 0
+for i in [1, 2, 3, 4] {
+  total += i
+}
+total -= 1
+total *= 2
+print total
+var ratio = 9
+ratio /= 2
+print ratio`,
+    output: '18\n4.5\n',
+  },
+];
+
+const CC = process.env.CC ?? 'cc';
+const hasCC = !spawnSync(CC, ['--version']).error;
+const hasLLI = !spawnSync('lli', ['--version']).error;
+const dir = mkdtempSync(join(tmpdir(), 'droy-test-'));
+after(() => rmSync(dir, { recursive: true, force: true }));
+
+function parse(source: string) {
+  return new DroyParser(new DroyLexer(source).tokenize()).parse();
+}
+
+// The output of a native program, or the error it exited with
+function execute(file: string, args: string[] = []): string {
+  const result = spawnSync(file, args, { encoding: 'utf8' });
+  return result.status === 0 ? result.stdout : `error: ${result.stderr.trim().replace(/^droy: /, '')}`;
+}
+
+function runVM(source: string): string {
+  try {
+    return new DroyCompilerV3().run(source).output;
+  } catch (err) {
+    return `error: ${err instanceof Error ? err.message : String(err)}`;
+  }
+}
+
+// Signed overflow is only defined as wrapping with -fwrapv
+function runC(name: string, source: string, inferTypes: boolean): string {
+  const file = join(dir, `${name}.c`);
+  writeFileSync(file, new DroyCodeGenerator({ inferTypes }).generate(parse(source)));
+  execFileSync(CC, ['-O2', '-std=c11', '-fwrapv', '-o', join(dir, name), file, '-lm'], { stdio: 'pipe' });
+  return execute(join(dir, name));
+}
+
+function runLLVM(name: string, source: string): string {
+  const file = join(dir, `${name}.ll`);
+  writeFileSync(file, new DroyLLVMGenerator().generate(parse(source)));
+  return execute('lli', [file]);
+}
+
+corpus.forEach(({ name, source, output, native = output }, index) => {
+  describe(name, () => {
+    test('vm', () => {
+      assert.equal(runVM(source), output);
+    });
+    test('c typed', { skip: !hasCC && `${CC} not found` }, () => {
+      assert.equal(runC(`typed${index}`, source, true), native);
+    });
+    test('c boxed', { skip: !hasCC && `${CC} not found` }, () => {
+      assert.equal(runC(`boxed${index}`, source, false), native);
+    });
+    test('llvm', { skip: !hasLLI && 'lli not found' }, () => {
+      assert.equal(runLLVM(`llvm${index}`, source), native);
+    });
+  });
+});
@@ -0,0 +1,26 @@
+// Highlighting of Droy source from the lexer's tokens.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { highlightDroy } from '../src/lib/droy/highlight';
+
+const COMMENT = 'text-slate-500';
+
+test('// and # comments are comment spans', () => {
+  const lines = highlightDroy('var x = 10 // ten\n# note\nprint x / 2 // half');
+  assert.match(lines[0], new RegExp(`<span class="${COMMENT}">// ten</span>$`));
+  assert.equal(lines[1], `<span class="${COMMENT}"># note</span>`);
+  assert.match(lines[2], /<span class="[^"]+">\/<\/span>/);
+  assert.match(lines[2], new RegExp(`<span class="${COMMENT}">// half</span>$`));
+});
+
+test('colors are not comments', () => {
+  const [line] = highlightDroy('var c = #ff0000');
+  assert.doesNotMatch(line, new RegExp(COMMENT));
+});
+
+test('a comment line keeps the following tokens in step', () => {
+  const lines = highlightDroy('// heading\nvar y = 1');
+  assert.equal(lines[0], `<span class="${COMMENT}">// heading</span>`);
+  assert.match(lines[1], /^<span class="[^"]+">var<\/span> y/);
+});
@@ -0,0 +1,127 @@
+// Incremental lexing and parsing: after random edits, retokenize() and
+// reparse() give what lexing and parsing the edited source from scratch
+// gives.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { readFileSync } from 'node:fs';
+import { test } from 'node:test';
+import { DroyLexerV3, DroyParserV3, computeEdit, type LexEdit, type Token } from '../src/lib/droy/compiler-v3';
+
+const EXAMPLES = [...readFileSync(new URL('../droy-docs/EXAMPLES.md', import.meta.url), 'utf8')
+  .matchAll(/```droy\n([\s\S]*?)```/g)].map((match) => match[1]);
+const ROUNDS = 40;
+const EDITS = 25;
+// Pieces an edit inserts; quotes, comments and newlines move token and
+// line boundaries the most
+const PIECES = ['\n', '"', '#', '//', ' ', '{', '}', '(', ')', 'x', '1', '.5', 'var a = 1\n', '~text "hi"\n', 'print 2\n', '"a\nb"'];
+
+// xorshift32, so a failure reproduces
+function random(seed: number): () => number {
+  let state = seed || 1;
+  return () => {
+    state ^= state << 13;
+    state ^= state >>> 17;
+    state ^= state << 5;
+    return (state >>> 0) / 0x100000000;
+  };
+}
+
+function randomEdit(source: string, next: () => number): LexEdit {
+  const offset = Math.floor(next() * (source.length + 1));
+  const removedLength = next() < 0.5 ? 0 : Math.floor(next() * Math.min(12, source.length - offset + 1));
+  const insertedText = next() < 0.3 ? '' : PIECES[Math.floor(next() * PIECES.length)];
+  return { offset, removedLength, insertedText };
+}
+
+function apply(source: string, edit: LexEdit): string {
+  return source.slice(0, edit.offset) + edit.insertedText + source.slice(edit.offset + edit.removedLength);
+}
+
+// What `parse` returns, or the error it throws
+function parseOrError(parse: () => unknown): unknown {
+  try {
+    return parse();
+  } catch (err) {
+    return { error: err instanceof Error ? err.message : String(err) };
+  }
+}
+
+test('computeEdit finds the edit between two sources', () => {
+  assert.equal(computeEdit('abc', 'abc'), null);
+  assert.deepEqual(computeEdit('var x = 1', 'var xy = 1'), { offset: 5, removedLength: 0, insertedText: 'y' });
+  assert.deepEqual(computeEdit('a\nb\nc', 'a\nc'), { offset: 2, removedLength: 2, insertedText: '' });
+});
+
+test('retokenize() matches a full lex after random edits', () => {
+  for (let round = 0; round < ROUNDS; round++) {
+    const next = random(round + 1);
+    let source = EXAMPLES[round % EXAMPLES.length];
+    const lexer = new DroyLexerV3(source);
+    let tokens: Token[] = lexer.tokenize();
+    for (let step = 0; step < EDITS; step++) {
+      const edit = randomEdit(source, next);
+      source = apply(source, edit);
+      tokens = lexer.retokenize(tokens, edit);
+      assert.deepEqual(tokens, new DroyLexerV3(source).tokenize(), `round ${round}, edit ${step}`);
+    }
+  }
+});
+
+test('retokenizeCompact() matches a full lex after random edits', () => {
+  for (let round = 0; round < ROUNDS; round++) {
+    const next = random(round + 1001);
+    let source = EXAMPLES[round % EXAMPLES.length];
+    const lexer = new DroyLexerV3(source);
+    let tokens = lexer.tokenizeCompact();
+    for (let step = 0; step < EDITS; step++) {
+      const edit = randomEdit(source, next);
+      source = apply(source, edit);
+      tokens = lexer.retokenizeCompact(tokens, edit);
+      const expected = new DroyLexerV3(source).tokenizeCompact();
+      assert.deepEqual(tokens.toArray(), expected.toArray(), `round ${round}, edit ${step}`);
+      for (let i = 0; i < tokens.length; i++) {
+        assert.equal(tokens.start(i), expected.start(i), `round ${round}, edit ${step}, token ${i}`);
+      }
+    }
+  }
+});
+
+test('reparse() after an incremental lex matches a full parse', () => {
+  for (let round = 0; round < ROUNDS; round++) {
+    const next = random(round + 2001);
+    let source = EXAMPLES[round % EXAMPLES.length];
+    const lexer = new DroyLexerV3(source);
+    let tokens = lexer.tokenizeCompact();
+    const parser = new DroyParserV3(tokens);
+    parseOrError(() => parser.parse());
+    for (let step = 0; step < EDITS; step++) {
+      const edit = randomEdit(source, next);
+      source = apply(source, edit);
+      const previous = tokens;
+      tokens = lexer.retokenizeCompact(previous, edit);
+      const window = lexer.getReusedWindow();
+      assert.deepEqual(
+        parseOrError(() => parser.reparse(tokens, { previous, window })),
+        parseOrError(() => new DroyParserV3(new DroyLexerV3(source).tokenize()).parse()),
+        `round ${round}, edit ${step}`,
+      );
+    }
+  }
+});
+
+test('reparse() of token arrays matches a full parse', () => {
+  for (let round = 0; round < ROUNDS; round++) {
+    const next = random(round + 3001);
+    let source = EXAMPLES[round % EXAMPLES.length];
+    const parser = new DroyParserV3(new DroyLexerV3(source).tokenize());
+    parseOrError(() => parser.parse());
+    for (let step = 0; step < EDITS; step++) {
+      source = apply(source, randomEdit(source, next));
+      assert.deepEqual(
+        parseOrError(() => parser.reparse(new DroyLexerV3(source).tokenize())),
+        parseOrError(() => new DroyParserV3(new DroyLexerV3(source).tokenize()).parse()),
+        `round ${round}, edit ${step}`,
+      );
+    }
+  }
+});
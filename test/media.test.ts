@@ -0,0 +1,27 @@
+// Images served through an image CDN.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { responsiveImage } from '../src/lib/droy/media';
+
+// The first srcset URL an image gets with `template`
+function firstUrl(template: string, src: string): string {
+  const image = responsiveImage({ imageCdn: template, widths: [320] }, src, null, null)!;
+  return /srcset="([^ ]*) /.exec(image.attributes)![1];
+}
+
+test('{src} is encoded in the query and kept as written in the path', () => {
+  const src = 'https://example.com/a b/photo.jpg?v=2&s=1';
+  assert.equal(
+    firstUrl('https://cdn.example.com/resize?url={src}&w={width}', src),
+    'https://cdn.example.com/resize?url=https%3A%2F%2Fexample.com%2Fa%20b%2Fphoto.jpg%3Fv%3D2%26s%3D1&#38;w=320',
+  );
+  assert.equal(firstUrl('https://cdn.example.com/{src}', 'img/photo.jpg'), 'https://cdn.example.com/img/photo.jpg');
+});
+
+test('placeholders in the image URL are left alone', () => {
+  assert.equal(
+    firstUrl('https://cdn.example.com/{src}?w={width}', 'img/{width}.jpg'),
+    'https://cdn.example.com/img/{width}.jpg?w=320',
+  );
+});
@@ -0,0 +1,38 @@
+// Linking imported modules: what of a module a program keeps.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { DroyCompilerV3, DroyLexerV3, DroyParserV3, type ASTNode } from '../src/lib/droy/compiler-v3';
+import { DroyModuleGraph } from '../src/lib/droy/modules';
+
+const LIB = `func boot() {
+  print "lib initialised"
+  return true
+}
+var ready = boot()
+var unused = 1 + 2
+export func double(n) {
+  return n * 2
+}
+`;
+
+const parse = (source: string) => new DroyParserV3(new DroyLexerV3(source).tokenize()).parse();
+
+function run(files: Record<string, string>, path: string, optimize = true): string {
+  const modules = { read: (file: string) => files[file] ?? assert.fail(`no ${file}`) };
+  return new DroyCompilerV3({ modules, path, optimize: optimize ? undefined : false }).run(files[path]).output;
+}
+
+test('an unused declaration with a call runs when its module is imported', () => {
+  const files = { 'lib.droy': LIB, 'page.droy': 'import "lib"\nprint double(2)\n' };
+  assert.equal(run(files, 'lib.droy'), 'lib initialised\n');
+  assert.equal(run(files, 'page.droy'), 'lib initialised\n4\n');
+  assert.equal(run(files, 'page.droy', false), 'lib initialised\n4\n');
+});
+
+test('unused pure declarations are left out', () => {
+  const files: Record<string, string> = { 'lib.droy': LIB, 'page.droy': 'import "lib"\nprint double(2)\n' };
+  const graph = new DroyModuleGraph({ read: (file) => files[file] }, parse);
+  const names = graph.link('page.droy').body.map((stmt: ASTNode) => stmt.name ?? stmt.type);
+  assert.deepEqual(names, ['boot', 'ready', 'double', 'PrintStatement']);
+});
@@ -0,0 +1,143 @@
+// The AST optimizer: programs print the same with and without it, on the VM
+// and in C, and the passes do rewrite them.
+// Run with `npm test`; the C runs are skipped without `cc` (or $CC).
+import assert from 'node:assert/strict';
+import { execFileSync, spawnSync } from 'node:child_process';
+import { mkdtempSync, rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { after, describe, test } from 'node:test';
+import { DroyCodeGenerator, DroyLexer, DroyParser } from '../src/lib/droy/compiler';
+import { DroyCompilerV3 } from '../src/lib/droy/compiler-v3';
+import { DroyOptimizer } from '../src/lib/droy/optimizer';
+
+interface Case {
+  name: string;
+  source: string;
+  // What the VM prints, optimized or not
+  output: string;
+  // What C prints instead, where it differs by design
+  native?: string;
+  // Whether the optimizer leaves the program as it is
+  unchanged?: boolean;
+}
+
+const corpus: Case[] = [
+  {
+    name: 'folding arithmetic and strings',
+    source: `print 2 + 3 * 4
+print 7 / 2
+print 10 % 3
+print "a" + 1 + 2
+print 1 + 2 + "a"
+print -(3 - 5)
+print 0.1 + 0.2
+print 1 / 0`,
+    output: '14\n3.5\n1\na12\n3a\n2\n0.3\ninf\n',
+  },
+  {
+    name: 'folding leaves int overflow to the backend',
+    source: 'print 2147483647 + 1',
+    output: '2147483648\n',
+    native: '-2147483648\n',
+    unchanged: true,
+  },
+  {
+    name: 'folding comparisons and logic',
+    source: `print 3 < 4 && "x" == "x"
+print !true || false
+print 1 == 1.0`,
+    output: 'true\nfalse\ntrue\n',
+  },
+  {
+    name: 'folding math builtins',
+    source: `print round(2.5)
+print round(-0.5)
+print max(1, 5, 3)
+print abs(-4)
+print floor(7 / 2)`,
+    output: '3\n0\n5\n4\n3\n',
+  },
+  {
+    name: 'propagating constants',
+    source: `var n = 4
+print n * n
+var s = "hi"
+print s + "!"
+var k = 1
+k = k + 1
+print k`,
+    output: '16\nhi!\n2\n',
+  },
+  {
+    name: 'eliminating unused declarations and dead branches',
+    source: `var unused = 3
+func never() {
+  print "never"
+}
+if false {
+  print "no"
+} else {
+  print "else"
+}
+while false {
+  print "loop"
+}
+print "done"`,
+    output: 'else\ndone\n',
+  },
+  {
+    name: 'keeping unused declarations with side effects',
+    source: `func f() {
+  print "side"
+  return 1
+}
+var unused = f()
+print "after"`,
+    output: 'side\nafter\n',
+    unchanged: true,
+  },
+];
+
+const CC = process.env.CC ?? 'cc';
+const hasCC = !spawnSync(CC, ['--version']).error;
+const dir = mkdtempSync(join(tmpdir(), 'droy-optimizer-'));
+after(() => rmSync(dir, { recursive: true, force: true }));
+
+function parse(source: string) {
+  return new DroyParser(new DroyLexer(source).tokenize()).parse();
+}
+
+function runVM(source: string, optimize: boolean): string {
+  try {
+    return new DroyCompilerV3({ optimize: optimize ? undefined : false }).run(source).output;
+  } catch (err) {
+    return `error: ${err instanceof Error ? err.message : String(err)}`;
+  }
+}
+
+function runC(name: string, source: string, optimize: boolean): string {
+  const ast = optimize ? new DroyOptimizer().optimize(parse(source)) : parse(source);
+  const file = join(dir, `${name}.c`);
+  writeFileSync(file, new DroyCodeGenerator({ inferTypes: true }).generate(ast));
+  execFileSync(CC, ['-O2', '-std=c11', '-fwrapv', '-o', join(dir, name), file, '-lm'], { stdio: 'pipe' });
+  const result = spawnSync(join(dir, name), { encoding: 'utf8' });
+  return result.status === 0 ? result.stdout : `error: ${result.stderr.trim().replace(/^droy: /, '')}`;
+}
+
+corpus.forEach(({ name, source, output, native = output, unchanged = false }, index) => {
+  describe(name, () => {
+    test('rewrites', () => {
+      const optimized = new DroyOptimizer().optimize(parse(source));
+      assert.equal(JSON.stringify(optimized) === JSON.stringify(parse(source)), unchanged);
+    });
+    test('vm', () => {
+      assert.equal(runVM(source, true), output);
+      assert.equal(runVM(source, false), output);
+    });
+    test('c', { skip: !hasCC && `${CC} not found` }, () => {
+      assert.equal(runC(`optimized${index}`, source, true), native);
+      assert.equal(runC(`plain${index}`, source, false), native);
+    });
+  });
+});
@@ -0,0 +1,117 @@
+// The reactive runtime that generated JS runs on (reactive.ts): its signals
+// and effects, and its builtins.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { test } from 'node:test';
+import { REACTIVE_RUNTIME } from '../src/lib/droy/reactive';
+import { BUILTINS, type DroyValue } from '../src/lib/droy/vm';
+
+// A fresh runtime; the parts tested here need no DOM
+function runtime() {
+  return new Function(`${REACTIVE_RUNTIME}\nreturn droy;`)();
+}
+
+// Writes flush in a microtask
+const settle = () => new Promise((resolve) => setImmediate(resolve));
+
+// What a builtin returns, or the error it throws
+function outcome(call: () => unknown): unknown {
+  try {
+    return call();
+  } catch (err) {
+    return { error: err instanceof Error ? err.message : String(err) };
+  }
+}
+
+test('math builtins behave as in the VM', () => {
+  const { builtins } = runtime();
+  const cases: DroyValue[][] = [
+    [], [[]], [[3, 1, 2]], [3, 1, 2], [2.5], [-2.5], [-0.5], [-0.2], ['-0'], ['7px'], [true], [null], [[1.5, '-4', 'x']],
+  ];
+  for (const name of ['sum', 'avg', 'min', 'max', 'count', 'round', 'floor', 'ceil', 'abs']) {
+    const vm = BUILTINS.find((builtin) => builtin.name === name)!;
+    for (const args of cases) {
+      assert.deepEqual(
+        outcome(() => builtins[name](...args)),
+        outcome(() => vm.call(args)),
+        `${name}(${JSON.stringify(args).slice(1, -1)})`,
+      );
+    }
+  }
+});
+
+test('random takes the same bounds as in the VM', (t) => {
+  const { builtins } = runtime();
+  const vm = BUILTINS.find((builtin) => builtin.name === 'random')!;
+  for (const roll of [0, 0.5, 0.999]) {
+    t.mock.method(Math, 'random', () => roll);
+    for (const args of [[], [6], [2, 4], [2, 4, 100]]) {
+      assert.equal(builtins.random(...args), vm.call(args), `random(${args.join(', ')}) at ${roll}`);
+    }
+    t.mock.restoreAll();
+  }
+});
+
+test('writes in one task are flushed together, after it', async () => {
+  const { read, write, watch } = runtime();
+  const calls: unknown[][] = [];
+  watch(() => `${read('first')} ${read('last')}`, (value: unknown, old: unknown) => calls.push([value, old]));
+  write('first', 'Ada');
+  write('last', 'Lovelace');
+  write('first', 'Grace');
+  assert.deepEqual(calls, []);
+  await settle();
+  assert.deepEqual(calls, [['Grace Lovelace', 'null null']]);
+  // Writing the value a signal holds schedules nothing
+  write('first', 'Grace');
+  await settle();
+  assert.equal(calls.length, 1);
+});
+
+test('effects run in the order they subscribed, derived values first', async () => {
+  const { read, write, derive, watch } = runtime();
+  const order: string[] = [];
+  derive('double', () => read('n') * 2);
+  watch(() => read('n'), () => order.push('first'));
+  watch(() => read('double'), (value: unknown) => order.push(`double ${value}`));
+  watch(() => read('n'), () => order.push('second'));
+  write('n', 3);
+  await settle();
+  assert.deepEqual(order, ['first', 'second', 'double 6']);
+});
+
+test('a diamond of derived values updates its sink once, without glitches', async () => {
+  const { read, write, derive, watch } = runtime();
+  write('a', 1);
+  derive('b', () => read('a') + 1);
+  derive('c', () => read('a') * 2);
+  let runs = 0;
+  derive('d', () => {
+    runs++;
+    return read('b') + read('c');
+  });
+  const seen: unknown[] = [];
+  watch(() => read('d'), (value: unknown) => seen.push(value));
+  assert.equal(read('d'), 4);
+  runs = 0;
+  write('a', 5);
+  await settle();
+  assert.equal(runs, 1);
+  assert.deepEqual(seen, [16]);
+});
+
+test('an effect stops depending on a branch it no longer takes', async () => {
+  const { read, write, watch } = runtime();
+  write('useNick', true);
+  write('nick', 'Ada');
+  write('name', 'Ada Lovelace');
+  const seen: unknown[] = [];
+  watch(() => (read('useNick') ? read('nick') : read('name')), (value: unknown) => seen.push(value));
+  write('useNick', false);
+  await settle();
+  write('nick', 'Countess');
+  await settle();
+  write('name', 'Augusta Ada King');
+  await settle();
+  assert.deepEqual(seen, ['Ada Lovelace', 'Augusta Ada King']);
+});
@@ -0,0 +1,161 @@
+// The bytecode VM (vm.ts): control flow, closures, builtins and run limits.
+// Run with `npm test`.
+import assert from 'node:assert/strict';
+import { describe, test } from 'node:test';
+import { DroyLexerV3, DroyParserV3 } from '../src/lib/droy/compiler-v3';
+import { runDroy, type DroyVMOptions } from '../src/lib/droy/vm';
+
+// What a program prints, or `error: <message>`
+function run(source: string, options: DroyVMOptions = {}): string {
+  try {
+    return runDroy(new DroyParserV3(new DroyLexerV3(source).tokenize()).parse(), options).output;
+  } catch (err) {
+    return `error: ${err instanceof Error ? err.message : String(err)}`;
+  }
+}
+
+describe('control flow', () => {
+  test('if / else if / else takes the first branch that holds', () => {
+    const source = (x: number) => `var x = ${x}
+if x > 10 {
+  print "big"
+} else if x > 3 {
+  print "medium"
+} else {
+  print "small"
+}`;
+    assert.equal(run(source(20)), 'big\n');
+    assert.equal(run(source(5)), 'medium\n');
+    assert.equal(run(source(1)), 'small\n');
+  });
+
+  test('for and while loops', () => {
+    assert.equal(run(`var total = 0
+for i in [1, 2, 3, 4] {
+  if i % 2 == 0 {
+    total += i
+  }
+}
+print total
+var n = 0
+while n < 3 {
+  n = n + 1
+}
+print n`), '6\n3\n');
+  });
+
+  test('&& and || short-circuit to booleans', () => {
+    assert.equal(run(`func loud() {
+  print "evaluated"
+  return true
+}
+print false && loud()
+print true || loud()
+print null || "fallback"`), 'false\ntrue\ntrue\n');
+  });
+
+  test('recursion', () => {
+    assert.equal(run(`func fib(n) {
+  if n < 2 {
+    return n
+  }
+  return fib(n - 1) + fib(n - 2)
+}
+print fib(20)`), '6765\n');
+  });
+
+  test('a top-level return ends the program with its value', () => {
+    const ast = new DroyParserV3(new DroyLexerV3('print 1\nreturn 42\nprint 2').tokenize()).parse();
+    assert.deepEqual(runDroy(ast), { output: '1\n', value: 42 });
+  });
+});
+
+describe('closures', () => {
+  test('each closure keeps its own captured variables', () => {
+    assert.equal(run(`func counter() {
+  var count = 0
+  func next() {
+    count = count + 1
+    return count
+  }
+  return next
+}
+var a = counter()
+var b = counter()
+print a()
+print a()
+print b()`), '1\n2\n1\n');
+  });
+
+  test('nested functions share the variables of an enclosing call', () => {
+    assert.equal(run(`func outer() {
+  var a = 1
+  func middle() {
+    func inner() {
+      a = a + 1
+      return a
+    }
+    return inner()
+  }
+  middle()
+  return middle()
+}
+print outer()`), '3\n');
+  });
+
+  test('parameters shadow globals, and functions assign globals', () => {
+    assert.equal(run(`var x = 1
+var total = 0
+func shadow(x) {
+  x = x + 10
+  return x
+}
+func add(n) {
+  total = total + n
+}
+print shadow(5)
+add(2)
+add(3)
+print x
+print total`), '15\n1\n5\n');
+  });
+
+  test('missing arguments are null', () => {
+    assert.equal(run('func second(a, b) {\n  return b\n}\nprint second(1)'), 'null\n');
+  });
+});
+
+describe('builtins', () => {
+  test('math over arrays and argument lists', () => {
+    assert.equal(run(`print sum([1, 2, 3])
+print avg(2, 4)
+print min([3, 1, 2])
+print max(3, 9)
+print count([1, 2])
+print len("hello")
+print ceil(1.2)
+print floor(-1.2)
+print abs(-3)
+print round(1.5)
+print round(-0.5)`), '6\n3\n1\n9\n2\n5\n2\n-2\n3\n2\n0\n');
+  });
+
+  test('min and max of an empty array fail the run', () => {
+    assert.equal(run('var xs = [1]\nxs = []\nprint min(xs)'), 'error: min of an empty array');
+  });
+
+  test('random stays within its bounds', (t) => {
+    t.mock.method(Math, 'random', () => 0.999);
+    assert.equal(run('print random(6)\nprint random(5, 5)\nprint random(2, 4)'), '6\n5\n4\n');
+  });
+});
+
+describe('limits', () => {
+  test('maxSteps stops a loop that never ends', () => {
+    assert.equal(run('while true {\n  var x = 1\n}', { maxSteps: 1000 }), 'error: Execution exceeded 1000 steps');
+  });
+
+  test('maxDepth stops unbounded recursion', () => {
+    assert.equal(run('func f() {\n  return f()\n}\nf()', { maxDepth: 50 }), 'error: Call depth exceeded 50 in f');
+  });
+});